@@ -237,9 +237,9 @@ def api_scenario_reset():
         print("NEW state - scenario_state: Waiting")
         print(f"NEW state - abort_requested: {system_status['abort_requested']}")
     
-    # Reset portal to rotating state
+    # Stop a timeline the portal may be running and reset it to rotating state
     print("Resetting portal to rotating state...")
-    portal.reset()
+    portal.abort_sequence()
 
     print("→ Restoring normal lighting...")
     ha.activate_scene("scene.halloween_pa")
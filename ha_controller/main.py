@@ -22,6 +22,8 @@ BROKER_HOSTNAME = os.getenv("BROKER_HOSTNAME")
 BROKER_PORT = int(os.getenv("BROKER_PORT", "1883"))
 PERSON_TOPIC = os.getenv("PERSON_TOPIC", "frigate/insidan/person")
 PORTAL_STATE_TOPIC = os.getenv("PORTAL_STATE_TOPIC", "portal/state")
+PORTAL_PASSAGE_TOPIC = os.getenv("PORTAL_PASSAGE_TOPIC", "portal/passage")
+EXIT_SKIP_SECONDS = int(os.getenv("EXIT_SKIP_SECONDS", "5"))
 COOLDOWN_SECONDS = int(os.getenv("COOLDOWN_SECONDS", "30"))
 WEB_PORT = int(os.getenv("WEB_PORT", "5000"))
 VISITORS_FILE = os.getenv("VISITORS_FILE", "visitors.json")
@@ -46,9 +48,11 @@ system_status = {
     "auto_trigger_enabled": True,  # Enable/disable automatic triggering from MQTT
     "total_triggers": 0,
     "last_person_count": 0,
-    "portal_state": 1,  # 1=ROTATING, 2=BLINK_RED, 3=BLINK_GREEN
+    "portal_state": 1,  # 1=ROTATING, 2=BLINK_RED, 3=BLINK_GREEN, 4=STREAMING, 5=PLAYING
     "portal_last_update": None,
     "portal_online": False,  # True if ESP32 portal is reachable
+    "last_passage_direction": None,  # "in", "out" or "unknown" (dual-sensor portal)
+    "last_passage_time": None,  # time.time() of last passage start
     "uptime_start": datetime.now().isoformat(),
     "last_mqtt_message": None,
     "ha_available": False,  # Will be updated periodically by health check
@@ -153,7 +157,8 @@ def on_connect(client, userdata, flags, rc):
         system_status["mqtt_connected"] = (rc == 0)
     client.subscribe(PERSON_TOPIC)
     client.subscribe(PORTAL_STATE_TOPIC)
-    print(f"Subscribed to topics: {PERSON_TOPIC}, {PORTAL_STATE_TOPIC}")
+    client.subscribe(PORTAL_PASSAGE_TOPIC)
+    print(f"Subscribed to topics: {PERSON_TOPIC}, {PORTAL_STATE_TOPIC}, {PORTAL_PASSAGE_TOPIC}")
     broadcast_status()
 
 def on_message(client, userdata, msg):
@@ -169,6 +174,19 @@ def on_message(client, userdata, msg):
             "timestamp": datetime.now().isoformat()
         }
     
+    # Handle passage events (published right before the resulting state)
+    if topic == PORTAL_PASSAGE_TOPIC:
+        try:
+            passage = json.loads(payload)
+            if passage.get("event") == "start":
+                with status_lock:
+                    system_status["last_passage_direction"] = passage.get("direction", "unknown")
+                    system_status["last_passage_time"] = time.time()
+            print(f"Portal passage {passage.get('event')}: direction={passage.get('direction')}")
+        except (ValueError, AttributeError) as e:
+            print(f"Error parsing passage event: {e}")
+        return
+    
     # Handle portal state updates
     if topic == PORTAL_STATE_TOPIC:
         try:
@@ -195,6 +213,17 @@ def on_message(client, userdata, msg):
                     if cooldown_remaining > 0:
                         print(f"⚠️  Cooldown active ({cooldown_remaining:.1f}s) - ignoring portal trigger")
                         return
+                    
+                    # Someone walking out doesn't get the full scenario
+                    last_passage_time = system_status["last_passage_time"]
+                    exiting = (system_status["last_passage_direction"] == "out" and
+                               last_passage_time is not None and
+                               time.time() - last_passage_time < EXIT_SKIP_SECONDS)
+                
+                if exiting:
+                    print("🚪 Portal state 2 from an exiting passage - skipping scenario")
+                    portal.reset()
+                    return
                 
                 print("🚨 Portal state 2 detected - triggering scenario!")
                 scenario.trigger_from_source("portal_red")
@@ -1,6 +1,7 @@
 """
 RGB Portal Handler
-Manages communication with the ESP32 RGB portal device over HTTP.
+Manages communication with the ESP32 RGB portal device over HTTP, or over
+the UDP control channel when PORTAL_CONTROL_KEY is set.
 """
 
 import os
@@ -8,6 +9,8 @@ import requests
 from typing import Optional, Dict, Any
 from dotenv import load_dotenv
 
+from portal_udp import PortalUdpClient, CMD_STATE, CMD_RED, CMD_GREEN, CMD_RESET, CMD_ABORT, STATUS_OK
+
 load_dotenv()
 
 
@@ -15,15 +18,23 @@ class PortalHandler:
     """
     Handler for RGB Portal communication via HTTP.
     
+    With PORTAL_CONTROL_KEY (the portal's CONTROL_KEY) commands go over the
+    UDP control channel first - a few ms instead of a TCP connect and HTTP
+    request - and fall back to HTTP if the portal doesn't answer.
+    
     Portal States:
     - 1 (ROTATING): Green rotating animation (normal/idle state)
     - 2 (BLINK_RED): Red blinking then solid red (triggered/alert state)
     - 3 (BLINK_GREEN): Green blinking (success/acknowledgment state)
+    - 4 (STREAMING): Showing frames streamed over DDP (idle state)
+    - 5 (PLAYING): Playing a pre-rendered clip from flash (idle state)
     """
     
     STATE_ROTATING = 1
     STATE_BLINK_RED = 2
     STATE_BLINK_GREEN = 3
+    STATE_STREAMING = 4
+    STATE_PLAYING = 5
     
     def __init__(self, portal_ip: Optional[str] = None, timeout: int = 5):
         """
@@ -36,6 +47,31 @@ class PortalHandler:
         self.portal_ip = portal_ip or os.getenv("PORTAL_IP", "10.1.5.32")
         self.timeout = timeout
         self.base_url = f"http://{self.portal_ip}"
+        
+        self.udp = None
+        control_key = os.getenv("PORTAL_CONTROL_KEY")
+        if control_key:
+            try:
+                self.udp = PortalUdpClient(self.portal_ip, control_key,
+                                           int(os.getenv("PORTAL_CONTROL_PORT", "4210")))
+            except ValueError as e:
+                print(f"UDP control disabled: {e}")
+    
+    def _udp_command(self, command: int) -> Optional[int]:
+        """
+        Send a command over UDP.
+        
+        Returns:
+            The state the portal reports, or None (no UDP client, no answer, or refused)
+        """
+        if not self.udp:
+            return None
+        reply = self.udp.command(command)
+        if reply is None:
+            print("Portal: no UDP answer, falling back to HTTP")
+            return None
+        status, state = reply
+        return state if status == STATUS_OK else None
     
     def check_online(self) -> bool:
         """
@@ -57,6 +93,9 @@ class PortalHandler:
         Returns:
             Dictionary with state info (e.g., {'state': 1}) or None on error
         """
+        state = self._udp_command(CMD_STATE)
+        if state is not None:
+            return {"state": state}
         try:
             response = requests.get(f"{self.base_url}/state", timeout=self.timeout)
             if response.status_code == 200:
@@ -76,6 +115,9 @@ class PortalHandler:
         Returns:
             True on success, False on failure
         """
+        if self._udp_command(CMD_RED) is not None:
+            print("Portal: Red blink triggered (UDP)")
+            return True
         try:
             response = requests.get(f"{self.base_url}/red", timeout=self.timeout)
             if response.status_code == 200:
@@ -96,6 +138,9 @@ class PortalHandler:
         Returns:
             True on success, False on failure
         """
+        if self._udp_command(CMD_GREEN) is not None:
+            print("Portal: Green blink triggered (UDP)")
+            return True
         try:
             response = requests.get(f"{self.base_url}/green", timeout=self.timeout)
             if response.status_code == 200:
@@ -116,6 +161,9 @@ class PortalHandler:
         Returns:
             True on success, False on failure
         """
+        if self._udp_command(CMD_RESET) is not None:
+            print("Portal: Reset to rotating state (UDP)")
+            return True
         try:
             response = requests.get(f"{self.base_url}/reset", timeout=self.timeout)
             if response.status_code == 200:
@@ -128,4 +176,49 @@ class PortalHandler:
             print(f"Error communicating with portal: {e}")
             return False
     
-
+    
+    def run_sequence(self, timeline: Dict[str, Any]) -> bool:
+        """
+        Send a whole scenario as one timeline; the portal runs it on its own
+        clock (see rgb_portal/src/sequencer.h for the format).
+        Progress is published on MQTT portal/sequence/event.
+        
+        Args:
+            timeline: {"id": ..., "loop": ..., "durationMs": ..., "steps": [...]}
+        
+        Returns:
+            True on success, False on failure
+        """
+        try:
+            response = requests.post(f"{self.base_url}/sequence", json=timeline, timeout=self.timeout)
+            if response.status_code == 200:
+                print(f"Portal: Timeline {timeline.get('id', '')} started")
+                return True
+            else:
+                print(f"Failed to start timeline: HTTP {response.status_code} {response.text.strip()}")
+                return False
+        except requests.exceptions.RequestException as e:
+            print(f"Error communicating with portal: {e}")
+            return False
+    
+    def abort_sequence(self) -> bool:
+        """
+        Stop the running timeline (if any) and reset portal to rotating state.
+        
+        Returns:
+            True on success, False on failure
+        """
+        if self._udp_command(CMD_ABORT) is not None:
+            print("Portal: Timeline aborted (UDP)")
+            return True
+        try:
+            response = requests.delete(f"{self.base_url}/sequence", timeout=self.timeout)
+            if response.status_code == 200:
+                print("Portal: Timeline aborted")
+                return True
+            else:
+                print(f"Failed to abort timeline: HTTP {response.status_code}")
+                return False
+        except requests.exceptions.RequestException as e:
+            print(f"Error communicating with portal: {e}")
+            return False
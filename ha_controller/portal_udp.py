@@ -0,0 +1,130 @@
+"""
+RGB Portal UDP Control Client
+Authenticated binary commands to the portal (UDP port 4210), see
+rgb_portal/src/udp_control.h for the packet format.
+"""
+
+import os
+import socket
+import struct
+import threading
+import time
+from typing import Optional, Tuple
+
+CONTROL_VERSION = 2
+CMD_STATE = 1
+CMD_RED = 2
+CMD_GREEN = 3
+CMD_RESET = 4
+CMD_TOGGLE = 5
+CMD_ABORT = 6
+
+STATUS_OK = 0
+STATUS_BUSY = 3
+STATUS_CHALLENGE = 4
+
+# Retries re-send the same sequence number, so the portal runs a command at most once
+RETRY_TIMEOUTS = (0.02, 0.04, 0.08, 0.16)
+
+REPLY_LEN = 24
+
+_MASK = 0xFFFFFFFFFFFFFFFF
+
+
+def _rotl(x: int, b: int) -> int:
+    return ((x << b) | (x >> (64 - b))) & _MASK
+
+
+def siphash24(key: bytes, data: bytes) -> int:
+    """SipHash-2-4 (64-bit tag), as computed by the portal."""
+    k0, k1 = struct.unpack("<QQ", key)
+    v = [0x736f6d6570736575 ^ k0, 0x646f72616e646f6d ^ k1, 0x6c7967656e657261 ^ k0, 0x7465646279746573 ^ k1]
+
+    def rounds(n):
+        for _ in range(n):
+            v[0] = (v[0] + v[1]) & _MASK; v[1] = _rotl(v[1], 13) ^ v[0]; v[0] = _rotl(v[0], 32)
+            v[2] = (v[2] + v[3]) & _MASK; v[3] = _rotl(v[3], 16) ^ v[2]
+            v[0] = (v[0] + v[3]) & _MASK; v[3] = _rotl(v[3], 21) ^ v[0]
+            v[2] = (v[2] + v[1]) & _MASK; v[1] = _rotl(v[1], 17) ^ v[2]; v[2] = _rotl(v[2], 32)
+
+    tail = len(data) % 8
+    for (m,) in struct.iter_unpack("<Q", data[:len(data) - tail]):
+        v[3] ^= m
+        rounds(2)
+        v[0] ^= m
+    b = (len(data) & 0xFF) << 56 | int.from_bytes(data[len(data) - tail:], "little")
+    v[3] ^= b
+    rounds(2)
+    v[0] ^= b
+    v[2] ^= 0xFF
+    rounds(4)
+    return v[0] ^ v[1] ^ v[2] ^ v[3]
+
+
+class PortalUdpClient:
+    """
+    Sends one command at a time and waits for the authenticated reply.
+    Thread-safe: MQTT callbacks and Flask handlers share one client.
+    """
+
+    def __init__(self, portal_ip: str, key_hex: str, port: int = 4210):
+        key = bytes.fromhex(key_hex)
+        if len(key) != 16:
+            raise ValueError("portal control key must be 32 hex digits")
+        self.addr = (portal_ip, port)
+        self.key = key
+        self.session = struct.unpack("<I", os.urandom(4))[0]
+        self.seq = 0
+        self.nonce = 0  # Learnt from the portal's challenge
+        self.lock = threading.Lock()
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+
+    def command(self, command: int) -> Optional[Tuple[int, int]]:
+        """
+        Send a command.
+
+        Returns:
+            (status, state) from the portal, or None if it did not answer
+        """
+        with self.lock:
+            self.seq = (self.seq + 1) & 0xFFFFFFFF
+            # The first command of a session, and the first one after the
+            # portal rebooted, is answered with a challenge: send it again
+            # with the nonce from the challenge
+            for _ in range(2):
+                reply = self._send(command)
+                if reply is None:
+                    return None
+                status, state, nonce = reply
+                if status != STATUS_CHALLENGE:
+                    return status, state
+                self.nonce = nonce
+            return None
+
+    def _send(self, command: int) -> Optional[Tuple[int, int, int]]:
+        body = struct.pack("<BBII", CONTROL_VERSION, command, self.seq, self.session)
+        packet = body + struct.pack("<Q", siphash24(self.key, body + struct.pack("<I", self.nonce)))
+        for timeout in RETRY_TIMEOUTS:
+            self.sock.sendto(packet, self.addr)
+            reply = self._receive(command, time.monotonic() + timeout)
+            if reply:
+                return reply
+        return None
+
+    def _receive(self, command: int, deadline: float) -> Optional[Tuple[int, int, int]]:
+        while True:
+            remaining = deadline - time.monotonic()
+            if remaining <= 0:
+                return None
+            self.sock.settimeout(remaining)
+            try:
+                reply = self.sock.recv(64)
+            except socket.timeout:
+                return None
+            except OSError:
+                return None  # e.g. ICMP port unreachable
+            if len(reply) != REPLY_LEN or struct.unpack("<Q", reply[16:])[0] != siphash24(self.key, reply[:16]):
+                continue
+            _, kind, seq, session, status, state, nonce = struct.unpack("<BBIIBBI", reply[:16])
+            if kind == 0x80 | command and seq == self.seq and session == self.session:
+                return status, state, nonce
@@ -0,0 +1,238 @@
+// Clip image packer and playback benchmark.
+//
+// Builds the image for the "clips" flash partition (see clip_player.h) from
+// frame sequences: PPM files with a row per frame and a column per LED (the
+// format golden --dump-dir writes), or the built-in effect sequences. Frames
+// are encoded like codec_bench does: a delta against the previous frame, a
+// keyframe every --key-interval frames or whenever it is smaller.
+//
+// The image is then played back with the firmware player, one clipPoll() per
+// frame time, and every decoded frame is compared with its source. Reports
+// the size per frame and the decode time per frame on this host; the
+// firmware reports its own in GET /clips. With --bench FILE an existing
+// image is only played back.
+//
+// Upload the image with: curl -F file=@clips.bin http://PORTAL/clips
+//
+// Usage: clip_pack [--out FILE] [--frame-ms MS] [--key-interval N] [--repeat N]
+//                  [--effects] [NAME=FILE.ppm ...]
+//        clip_pack --bench FILE [--repeat N]
+
+#include "effect_sequences.h"
+#include "clip_player.h"
+#include "frame_codec.h"
+
+#include <chrono>
+
+namespace {
+
+const size_t PARTITION_SIZE = 0x160000;  // clips in partitions.csv
+
+struct Source {
+  std::string name;
+  int leds;
+  std::vector<std::vector<CRGB>> frames;
+};
+
+struct PackedClip {
+  std::vector<uint8_t> data;  // Frame records
+  size_t keyframes = 0;
+};
+
+bool readPpm(const std::string& path, Source& src) {
+  FILE* f = fopen(path.c_str(), "rb");
+  if (!f) return false;
+  int width = 0, height = 0, maxval = 0;
+  bool ok = fscanf(f, "P6 %d %d %d", &width, &height, &maxval) == 3 && maxval == 255 &&
+            width > 0 && height > 0 && height <= 0xFFFF;
+  fgetc(f);
+  src.leds = width;
+  for (int y = 0; ok && y < height; y++) {
+    std::vector<CRGB> frame(width);
+    ok = fread(frame.data(), 3, width, f) == (size_t)width;
+    src.frames.push_back(frame);
+  }
+  fclose(f);
+  return ok;
+}
+
+PackedClip packClip(const Source& src, int keyInterval) {
+  PackedClip clip;
+  std::vector<uint8_t> key(FRAME_MAX_ENCODED(src.leds));
+  std::vector<uint8_t> delta(FRAME_MAX_ENCODED(src.leds));
+  for (size_t i = 0; i < src.frames.size(); i++) {
+    size_t keySize = frameEncode(src.frames[i].data(), nullptr, src.leds, key.data(), key.size());
+    size_t deltaSize = 0;
+    if (i % keyInterval != 0) {
+      deltaSize = frameEncode(src.frames[i].data(), src.frames[i - 1].data(), src.leds, delta.data(), delta.size());
+    }
+    const uint8_t* frame = delta.data();
+    uint16_t len = (uint16_t)deltaSize;
+    if (deltaSize == 0 || keySize <= deltaSize) {
+      frame = key.data();
+      len = (uint16_t)keySize;
+      clip.keyframes++;
+    }
+    clip.data.push_back(len & 0xFF);
+    clip.data.push_back(len >> 8);
+    clip.data.insert(clip.data.end(), frame, frame + len);
+  }
+  return clip;
+}
+
+std::vector<uint8_t> buildImage(const std::vector<Source>& sources, const std::vector<PackedClip>& packed,
+                                int frameMs) {
+  std::vector<uint8_t> image(sizeof(ClipImageHeader) + sources.size() * sizeof(ClipEntry));
+  std::vector<ClipEntry> entries(sources.size());
+  for (size_t i = 0; i < sources.size(); i++) {
+    ClipEntry& e = entries[i];
+    memset(&e, 0, sizeof(e));
+    strncpy(e.name, sources[i].name.c_str(), CLIP_NAME_LEN - 1);
+    e.offset = (uint32_t)image.size();
+    e.size = (uint32_t)packed[i].data.size();
+    e.frames = (uint16_t)sources[i].frames.size();
+    e.frameMs = (uint16_t)frameMs;
+    e.leds = (uint16_t)sources[i].leds;
+    image.insert(image.end(), packed[i].data.begin(), packed[i].data.end());
+  }
+  ClipImageHeader h = {CLIP_MAGIC, CLIP_VERSION, (uint16_t)sources.size(), (uint32_t)image.size()};
+  memcpy(image.data(), &h, sizeof(h));
+  memcpy(image.data() + sizeof(h), entries.data(), entries.size() * sizeof(ClipEntry));
+  return image;
+}
+
+// Play every clip of `image` `repeat` times, one poll per frame time.
+// Returns false if a clip fails or (with `sources`) differs from its source.
+bool benchImage(const std::vector<uint8_t>& image, const std::vector<Source>* sources,
+                const std::vector<PackedClip>* packed, int repeat) {
+  ClipPlayer player = ClipPlayer();
+  if (!clipsOpen(player, image.data(), image.size())) {
+    fprintf(stderr, "Invalid clip image\n");
+    return false;
+  }
+  printf("%-15s %7s %5s %6s %9s %9s %7s %10s %10s\n",
+         "clip", "frames", "keys", "leds", "bytes/fr", "bytes", "ratio", "dec us/fr", "max us");
+
+  bool ok = true;
+  for (int c = 0; c < player.header->count; c++) {
+    const ClipEntry& e = player.entries[c];
+    std::vector<CRGB> leds(e.leds);
+    double totalUs = 0, maxUs = 0;
+    unsigned long nowUs = 0;
+    if (!clipStart(player, c, (uint16_t)repeat, e.leds, nowUs)) {
+      fprintf(stderr, "%s: cannot start\n", e.name);
+      return false;
+    }
+    for (int frame = 0;; frame++) {
+      auto start = std::chrono::steady_clock::now();
+      ClipResult r = clipPoll(player, leds.data(), e.leds, nowUs);
+      double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+      nowUs += e.frameMs * 1000UL;
+      if (r == CLIP_DONE) break;
+      if (r != CLIP_FRAME) {
+        fprintf(stderr, "%s: playback failed at frame %d\n", e.name, frame % e.frames);
+        ok = false;
+        break;
+      }
+      totalUs += us;
+      maxUs = std::max(maxUs, us);
+      if (sources && memcmp(leds.data(), (*sources)[c].frames[frame % e.frames].data(), e.leds * 3) != 0) {
+        fprintf(stderr, "%s: frame %d differs from its source\n", e.name, frame % e.frames);
+        ok = false;
+        break;
+      }
+    }
+    double played = (double)e.frames * repeat;
+    std::string keys = packed ? std::to_string((*packed)[c].keyframes) : "-";
+    printf("%-15s %7u %5s %6u %9.1f %9u %6.1f%% %10.3f %10.3f\n", e.name, e.frames, keys.c_str(), e.leds,
+           (double)(e.size - 2 * e.frames) / e.frames, e.size,
+           100.0 * (e.size - 2 * e.frames) / ((double)e.frames * e.leds * 3), totalUs / played, maxUs);
+  }
+  printf("image %u bytes, %.1f%% of the %zu byte partition\n", player.header->size,
+         100.0 * player.header->size / PARTITION_SIZE, PARTITION_SIZE);
+  return ok;
+}
+
+int usage() {
+  fprintf(stderr,
+          "Usage: clip_pack [--out FILE] [--frame-ms MS] [--key-interval N] [--repeat N]\n"
+          "                 [--effects] [NAME=FILE.ppm ...]\n"
+          "       clip_pack --bench FILE [--repeat N]\n");
+  return 2;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::string outFile, benchFile;
+  int frameMs = 25;      // 40 fps
+  int keyInterval = 40;  // One keyframe per second at 40 fps
+  int repeat = 20;
+  bool effects = false;
+  std::vector<Source> sources;
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    auto next = [&]() { return i + 1 < argc ? argv[++i] : ""; };
+    if (a == "--out") outFile = next();
+    else if (a == "--bench") benchFile = next();
+    else if (a == "--frame-ms") frameMs = std::max(1, std::min(60000, atoi(next())));
+    else if (a == "--key-interval") keyInterval = std::max(1, atoi(next()));
+    else if (a == "--repeat") repeat = std::max(1, std::min(1000, atoi(next())));
+    else if (a == "--effects") effects = true;
+    else if (a.find('=') != std::string::npos && a[0] != '-') {
+      Source src;
+      src.name = a.substr(0, a.find('='));
+      if (src.name.size() >= CLIP_NAME_LEN || !readPpm(a.substr(a.find('=') + 1), src)) {
+        fprintf(stderr, "Cannot read %s (name up to %d characters, PPM of up to 65535 rows)\n",
+                a.c_str(), CLIP_NAME_LEN - 1);
+        return 1;
+      }
+      sources.push_back(src);
+    } else {
+      return usage();
+    }
+  }
+
+  if (!benchFile.empty()) {
+    FILE* f = fopen(benchFile.c_str(), "rb");
+    if (!f) {
+      fprintf(stderr, "Cannot read %s\n", benchFile.c_str());
+      return 1;
+    }
+    std::vector<uint8_t> image;
+    int c;
+    while ((c = fgetc(f)) != EOF) image.push_back((uint8_t)c);
+    fclose(f);
+    return benchImage(image, nullptr, nullptr, repeat) ? 0 : 1;
+  }
+
+  if (effects) {
+    for (const Sequence& seq : renderEffectSequences()) {
+      sources.push_back({seq.name.substr(0, CLIP_NAME_LEN - 1), SEQUENCE_NUM_LEDS, seq.frames});
+    }
+  }
+  if (sources.empty() || sources.size() > CLIP_MAX) {
+    fprintf(stderr, "1 to %d clips needed\n", CLIP_MAX);
+    return usage();
+  }
+
+  std::vector<PackedClip> packed;
+  for (const Source& src : sources) packed.push_back(packClip(src, keyInterval));
+  std::vector<uint8_t> image = buildImage(sources, packed, frameMs);
+  if (image.size() > PARTITION_SIZE) {
+    fprintf(stderr, "Image of %zu bytes does not fit the clips partition\n", image.size());
+    return 1;
+  }
+  bool ok = benchImage(image, &sources, &packed, repeat);
+
+  if (!outFile.empty()) {
+    FILE* f = fopen(outFile.c_str(), "wb");
+    if (!f || fwrite(image.data(), 1, image.size(), f) != image.size()) {
+      fprintf(stderr, "Cannot write %s\n", outFile.c_str());
+      return 1;
+    }
+    fclose(f);
+    printf("wrote %s\n", outFile.c_str());
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,109 @@
+// Frame codec benchmark.
+//
+// Encodes the effect sequences (the golden-frame sequences) with the frame
+// codec the way a streaming host would: a delta frame against the previous
+// frame, a keyframe every --key-interval frames or whenever it is smaller.
+// Every frame is decoded back and compared with the original. Reports bytes
+// per frame against raw DDP and encode/decode time per frame on this host.
+//
+// Usage: codec_bench [--key-interval N] [--repeat N]
+
+#include "effect_sequences.h"
+#include "frame_codec.h"
+
+#include <chrono>
+
+namespace {
+
+const int NUM_LEDS = SEQUENCE_NUM_LEDS;
+const size_t RAW_BYTES = NUM_LEDS * 3;
+
+struct Encoded {
+  std::vector<std::vector<uint8_t>> frames;
+  size_t keyframes = 0;
+};
+
+Encoded encodeSequence(const Sequence& seq, int keyInterval) {
+  Encoded enc;
+  uint8_t key[FRAME_MAX_ENCODED(NUM_LEDS)];
+  uint8_t delta[FRAME_MAX_ENCODED(NUM_LEDS)];
+  for (size_t i = 0; i < seq.frames.size(); i++) {
+    size_t keySize = frameEncode(seq.frames[i].data(), nullptr, NUM_LEDS, key, sizeof(key));
+    size_t deltaSize = 0;
+    if (i % keyInterval != 0) {
+      deltaSize = frameEncode(seq.frames[i].data(), seq.frames[i - 1].data(), NUM_LEDS, delta, sizeof(delta));
+    }
+    if (deltaSize == 0 || keySize <= deltaSize) {
+      enc.frames.emplace_back(key, key + keySize);
+      enc.keyframes++;
+    } else {
+      enc.frames.emplace_back(delta, delta + deltaSize);
+    }
+  }
+  return enc;
+}
+
+// Decode the whole sequence into one buffer like the firmware does
+bool decodeSequence(const Encoded& enc, CRGB* leds, const Sequence* verify) {
+  for (size_t i = 0; i < enc.frames.size(); i++) {
+    FrameMemorySource src = {enc.frames[i].data(), enc.frames[i].size(), 0};
+    if (frameDecode(src, leds, NUM_LEDS) < 0) return false;
+    if (verify && memcmp(leds, verify->frames[i].data(), RAW_BYTES) != 0) return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int keyInterval = 40;  // One keyframe per second at 40 fps
+  int repeat = 200;
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    const char* v = i + 1 < argc ? argv[++i] : "";
+    if (a == "--key-interval") keyInterval = std::max(1, atoi(v));
+    else if (a == "--repeat") repeat = std::max(1, atoi(v));
+    else {
+      fprintf(stderr, "Usage: codec_bench [--key-interval N] [--repeat N]\n");
+      return 2;
+    }
+  }
+
+  std::vector<Sequence> sequences = renderEffectSequences();
+  printf("%-14s %7s %6s %9s %9s %7s %10s %10s\n",
+         "sequence", "frames", "keys", "bytes/fr", "max", "ratio", "enc us/fr", "dec us/fr");
+
+  size_t totalFrames = 0, totalBytes = 0;
+  bool ok = true;
+  for (const Sequence& seq : sequences) {
+    auto encStart = std::chrono::steady_clock::now();
+    Encoded enc;
+    for (int r = 0; r < repeat; r++) enc = encodeSequence(seq, keyInterval);
+    double encUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - encStart).count();
+
+    CRGB leds[NUM_LEDS] = {};
+    if (!decodeSequence(enc, leds, &seq)) {
+      printf("%-14s round trip FAILED\n", seq.name.c_str());
+      ok = false;
+      continue;
+    }
+    auto decStart = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeat; r++) decodeSequence(enc, leds, nullptr);
+    double decUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - decStart).count();
+
+    size_t bytes = 0, maxBytes = 0;
+    for (const auto& f : enc.frames) {
+      bytes += f.size();
+      maxBytes = std::max(maxBytes, f.size());
+    }
+    size_t n = seq.frames.size();
+    printf("%-14s %7zu %6zu %9.1f %9zu %6.1fx %10.3f %10.3f\n", seq.name.c_str(), n, enc.keyframes,
+           (double)bytes / n, maxBytes, (double)RAW_BYTES * n / bytes, encUs / repeat / n, decUs / repeat / n);
+    totalFrames += n;
+    totalBytes += bytes;
+  }
+
+  printf("\nAll sequences: %.1f bytes/frame vs %zu raw (%.1fx), keyframe interval %d\n",
+         (double)totalBytes / totalFrames, RAW_BYTES, (double)RAW_BYTES * totalFrames / totalBytes, keyInterval);
+  return ok ? 0 : 1;
+}
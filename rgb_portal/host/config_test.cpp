@@ -0,0 +1,157 @@
+// Runtime config test.
+//
+// Feeds configApplyJson the requests HTTP and MQTT pass on: valid fields
+// and the dirty bits they return, unchanged values, unknown fields, values
+// out of range, blinks without a blink time and malformed JSON, which must
+// leave the request rejected as a whole. Then round-trips the config through configToJson and NVS (the
+// Preferences stub), including a stored config of another CONFIG_VERSION.
+//
+// Usage: config_test
+
+#include "portal_config.h"
+#include "unit_test.h"
+
+#include <Preferences.h>
+
+namespace {
+
+const PortalConfig DEFAULTS = {
+  50, 2.2f, CRGB(255, 255, 255), 75, 0.025f,
+  CRGB(0, 0, 255), CRGB(128, 0, 255), CRGB(255, 0, 128),
+  56, 1500, 1000, 24,
+  {CRGB::Red, 5, 200, true},
+  {CRGB::Green, 0, 0, true},
+  250, false,
+};
+
+bool sameConfig(const PortalConfig& a, const PortalConfig& b) {
+  String ja, jb;
+  configToJson(a, ja);
+  configToJson(b, jb);
+  return ja == jb;
+}
+
+// Apply `json` to the defaults, returning the result and the config
+int apply(const char* json, PortalConfig& c, String& error) {
+  c = DEFAULTS;
+  error = "";
+  return configApplyJson(c, json, error);
+}
+
+struct Case {
+  const char* json;
+  int result;          // CONFIG_DIRTY_* bits, -1 = rejected
+};
+
+const Case CASES[] = {
+  {"{}", 0},
+  {" \r\n{ \t}\n", 0},
+  {"{\"brightness\":80}", CONFIG_DIRTY_BRIGHTNESS},
+  {"{\"brightness\":50}", 0},                                    // Unchanged
+  {"{\"brightness\":\"80\"}", CONFIG_DIRTY_BRIGHTNESS},          // Quoted number
+  {"{ \"brightness\" : 80 , \"gamma\" : 1.8 }", CONFIG_DIRTY_BRIGHTNESS | CONFIG_DIRTY_OUTPUT},
+  {"{\"red.color\":\"00ff00\",\"green.blinks\":3,\"green.blinkMs\":100}", CONFIG_DIRTY_RED | CONFIG_DIRTY_GREEN},
+  {"{\"colorPink\":\"#FF00FF\"}", CONFIG_DIRTY_ANIMATION},
+  {"{\"detectionRange\":80,\"fadeBlinks\":true}", CONFIG_DIRTY_DETECTION | CONFIG_DIRTY_ANIMATION},
+  {"{\"red.solid\":0}", CONFIG_DIRTY_RED},
+  {"{\"green.solid\":true}", 0},
+  // Unknown field, bad values
+  {"{\"brightnes\":80}", -1},
+  {"{\"brightness\":256}", -1},
+  {"{\"brightness\":-1}", -1},
+  {"{\"brightness\":8x}", -1},
+  {"{\"gamma\":0.5}", -1},
+  {"{\"animationSpeed\":5}", -1},
+  {"{\"fadeBlinks\":yes}", -1},
+  {"{\"colorBlue\":\"0000f\"}", -1},
+  {"{\"colorBlue\":\"0000ff0\"}", -1},
+  {"{\"colorBlue\":\"0000fg\"}", -1},
+  {"{\"brightness\":80,\"sparks\":100000}", -1},                 // One bad field rejects all
+  {"{\"red.blinkMs\":0}", -1},                                   // Blinks without a length
+  {"{\"green.blinks\":2}", -1},
+  {"{\"red.blinks\":0,\"red.blinkMs\":0}", CONFIG_DIRTY_RED},
+  {"{\"green.blinks\":2,\"green.blinkMs\":100}", CONFIG_DIRTY_GREEN},
+  // Malformed
+  {"", -1},
+  {"[]", -1},
+  {"{\"brightness\":80", -1},
+  {"{\"brightness\" 80}", -1},
+  {"{\"brightness\":}", -1},
+  {"{\"brightness\":80,}", -1},
+  {"{\"brightness\":80;\"gamma\":2}", -1},
+  {"{brightness:80}", -1},
+  {"{\"brightness:80}", -1},
+  {"{\"brightnessbrightnessbrightnessbrightness\":80}", -1},     // Name too long
+  {"{\"colorBlue\":\"0000ff0000ff0000ff0000ff0000ff0000ff\"}", -1}, // Value too long
+};
+
+}  // namespace
+
+int main() {
+  PortalConfig c;
+  String error;
+  for (const Case& t : CASES) {
+    int result = apply(t.json, c, error);
+    CHECK_MSG(result == t.result, "%s: %d, expected %d", t.json, result, t.result);
+    CHECK_MSG((result < 0) == (error.length() > 0), "%s: error \"%s\"", t.json, error.c_str());
+  }
+
+  // Values land in their fields
+  CHECK(apply("{\"brightness\":80,\"gamma\":1.8,\"red.color\":\"#102030\",\"red.solid\":false,"
+              "\"fadeMs\":0}", c, error) > 0);
+  CHECK(c.brightness == 80 && c.gamma == 1.8f && c.red.color == CRGB(0x10, 0x20, 0x30));
+  CHECK(!c.red.solidAfterBlink && c.fadeMs == 0 && c.green.color == DEFAULTS.green.color);
+  CHECK(apply("{\"fadeBlinks\":nope}", c, error) < 0 && error == "bad value for fadeBlinks");
+  CHECK(apply("{\"sparkz\":1}", c, error) < 0 && error == "unknown field sparkz");
+  CHECK(apply("{\"red.blinkMs\":0}", c, error) < 0 && error == "red.blinkMs must be above 0 with red.blinks");
+
+  // configToJson gives back what configApplyJson reads
+  PortalConfig changed = DEFAULTS;
+  CHECK(configApplyJson(changed, "{\"brightness\":1,\"gamma\":3,\"whiteBalance\":\"ffc080\","
+                        "\"colorSpeed\":0.5,\"passageCooldown\":0,\"green.blinkMs\":10000}", error) > 0);
+  String json;
+  configToJson(changed, json);
+  PortalConfig copy = DEFAULTS;
+  CHECK(configApplyJson(copy, json.c_str(), error) > 0 && sameConfig(copy, changed));
+  CHECK(configApplyJson(copy, json.c_str(), error) == 0);
+
+  // NVS: nothing stored, a saved config, then one of another version
+  PortalConfig loaded = DEFAULTS;
+  CHECK(!configLoad(loaded) && sameConfig(loaded, DEFAULTS));
+  CHECK(configSave(changed));
+  CHECK(configLoad(loaded) && sameConfig(loaded, changed));
+
+  Preferences prefs;
+  prefs.begin(CONFIG_NVS_NAMESPACE, false);
+  CHECK(prefs.getUChar("version", 0) == CONFIG_VERSION);
+  prefs.putUChar("version", CONFIG_VERSION + 1);
+  prefs.end();
+  loaded = DEFAULTS;
+  CHECK(!configLoad(loaded) && sameConfig(loaded, DEFAULTS));
+
+  // Stored before the version key: version 1
+  prefs.begin(CONFIG_NVS_NAMESPACE, false);
+  prefs.remove("version");
+  prefs.end();
+  CHECK(configLoad(loaded) == (CONFIG_VERSION == 1));
+
+  // A stored config skips fields it doesn't know or can't use
+  prefs.begin(CONFIG_NVS_NAMESPACE, false);
+  const char* stored = "{\"brightness\":90,\"oldField\":3,\"gamma\":9}";
+  prefs.putBytes("config", stored, strlen(stored));
+  prefs.putUChar("version", CONFIG_VERSION);
+  prefs.end();
+  loaded = DEFAULTS;
+  CHECK(configLoad(loaded) && loaded.brightness == 90 && loaded.gamma == DEFAULTS.gamma);
+
+  // A stored blink without a length keeps the blink config it had
+  prefs.begin(CONFIG_NVS_NAMESPACE, false);
+  stored = "{\"red.blinks\":4,\"red.blinkMs\":0,\"green.color\":\"00ff80\"}";
+  prefs.putBytes("config", stored, strlen(stored));
+  prefs.end();
+  loaded = DEFAULTS;
+  CHECK(configLoad(loaded) && loaded.red.numBlinks == 5 && loaded.red.blinkDuration == 200);
+  CHECK(loaded.green.color == CRGB(0, 255, 128));
+
+  return unitTestResult("config_test");
+}
@@ -0,0 +1,132 @@
+#include "effect_sequences.h"
+#include "effects.h"
+#include "portal_fsm.h"
+#include "particles.h"
+#include "portal_geometry.h"
+
+namespace {
+
+const int NUM_LEDS = SEQUENCE_NUM_LEDS;
+
+// Colors and configs as in main.cpp
+const CRGB colorBlue = CRGB(0, 0, 255);
+const CRGB colorPurple = CRGB(128, 0, 255);
+const CRGB colorPink = CRGB(255, 0, 128);
+const double COLOR_TRANSITION_SPEED = 0.025;
+const BlinkConfig redBlinkConfig = {CRGB::Red, 5, 200, true};
+const BlinkConfig greenBlinkConfig = {CRGB::Green, 0, 0, true};
+const int PORTAL_WIDTH_MM = 1000;
+const int PORTAL_LEG_MM = 1600;
+
+const PortalGeometry& portalGeometry() {
+  static PortalGeometry g;
+  static bool built = false;
+  if (!built) {
+    geometryBuildArch(g, NUM_LEDS, PORTAL_WIDTH_MM, PORTAL_LEG_MM);
+    built = true;
+  }
+  return g;
+}
+
+// Not used by main.cpp: covers the blink-then-return path of renderBlink()
+const BlinkConfig returnBlinkConfig = {CRGB::Orange, 3, 150, false};
+
+// Four full rotations and several color cycles
+Sequence rotatingSequence() {
+  Sequence seq = {"rotating", {}};
+  RotatingAnimation anim = {0, 0.0, 1.0};
+  for (int f = 0; f < 4 * NUM_LEDS; f++) {
+    Frame frame(NUM_LEDS);
+    renderRotating(frame.data(), portalGeometry(), anim.position,
+                   rotatingBaseColor(anim.colorPhase, colorBlue, colorPurple, colorPink));
+    seq.frames.push_back(frame);
+    rotatingStep(anim, NUM_LEDS, COLOR_TRANSITION_SPEED, true);
+  }
+  return seq;
+}
+
+// Blink sequence sampled every 20 ms, through the end of the sequence
+Sequence blinkSequence(const std::string& name, const BlinkConfig& config) {
+  Sequence seq = {name, {}};
+  unsigned long duration = portalBlinkDuration(config);
+  for (unsigned long elapsed = 0; elapsed <= 3000; elapsed += 20) {
+    Frame frame(NUM_LEDS);
+    renderBlink(frame.data(), NUM_LEDS, config, elapsed, elapsed > duration);
+    seq.frames.push_back(frame);
+  }
+  return seq;
+}
+
+// Passage sparks over solid green, 20 ms frames: the burst of a passage
+// start, one spark per 50 ms sensor sample for 1.5 s, then the fade out
+Sequence sparksSequence() {
+  Sequence seq = {"sparks", {}};
+  static ParticlePool pool;
+  particlesInit(pool, 1);
+  particlesBurst(pool, 0, 24, greenBlinkConfig.color, 40, 120, 900);
+  for (unsigned long elapsed = 0; elapsed <= 2500; elapsed += 20) {
+    if (elapsed > 0) {
+      particlesUpdate(pool, NUM_LEDS, 20);
+    }
+    if (elapsed % 50 == 0 && elapsed < 1500) {
+      particlesBurst(pool, 0, 1, greenBlinkConfig.color, 40, 120, 900);
+    }
+    Frame frame(NUM_LEDS);
+    renderBlink(frame.data(), NUM_LEDS, greenBlinkConfig, elapsed, true);
+    renderSparks(frame.data(), NUM_LEDS, pool, 64);
+    seq.frames.push_back(frame);
+  }
+  return seq;
+}
+
+// The state machine driving the renderers like updateLEDs() does, with a
+// scripted mix of events (one frame per 75 ms animation step)
+Sequence machineSequence() {
+  Sequence seq = {"machine", {}};
+  PortalMachine m;
+  portalInit(m, &redBlinkConfig, &greenBlinkConfig);
+  RotatingAnimation anim = {0, 0.0, 1.0};
+
+  struct Scripted { unsigned long time; PortalEventType type; uint8_t arg; };
+  const Scripted script[] = {
+    {1000, EV_SENSOR_ENTER, BLINK_GREEN}, {2600, EV_SENSOR_EXIT, 0},
+    {4000, EV_HTTP_RED, 0},               {7000, EV_HTTP_GREEN, 0},
+    {8000, EV_HTTP_RESET, 0},             {9000, EV_HTTP_TOGGLE, 0},
+    {9500, EV_MQTT_RESET, 0},             {10000, EV_SENSOR_ENTER, BLINK_RED},
+    {12000, EV_MQTT_RESET, 0},
+  };
+  size_t next = 0;
+
+  for (unsigned long now = 0; now < 14000; now += 75) {
+    while (next < sizeof(script) / sizeof(script[0]) && script[next].time <= now) {
+      portalPost(m, script[next].type, script[next].time, script[next].arg);
+      next++;
+    }
+    portalCheckBlink(m, now);
+    portalProcess(m);
+    rotatingStep(anim, NUM_LEDS, COLOR_TRANSITION_SPEED, m.state == ROTATING);
+
+    Frame frame(NUM_LEDS);
+    if (m.state == ROTATING) {
+      renderRotating(frame.data(), portalGeometry(), anim.position,
+                     rotatingBaseColor(anim.colorPhase, colorBlue, colorPurple, colorPink));
+    } else {
+      renderBlink(frame.data(), NUM_LEDS, m.activeBlinkConfig, now - m.blinkStartTime, m.blinkingDone);
+    }
+    seq.frames.push_back(frame);
+  }
+  return seq;
+}
+
+}  // namespace
+
+std::vector<Sequence> renderEffectSequences() {
+  std::vector<Sequence> all;
+  all.push_back(rotatingSequence());
+  all.push_back(blinkSequence("blink-red", redBlinkConfig));
+  all.push_back(blinkSequence("blink-green", greenBlinkConfig));
+  all.push_back(blinkSequence("blink-return", returnBlinkConfig));
+  all.push_back(machineSequence());
+  all.push_back(sparksSequence());
+  return all;
+}
@@ -0,0 +1,23 @@
+#ifndef EFFECT_SEQUENCES_H
+#define EFFECT_SEQUENCES_H
+
+// Deterministic frame sequences rendered with the firmware's effect code,
+// shared by the golden-frame suite and the codec benchmark.
+
+#include <FastLED.h>
+#include <string>
+#include <vector>
+
+#define SEQUENCE_NUM_LEDS 140  // Must match NUM_LEDS in main.cpp
+
+typedef std::vector<CRGB> Frame;
+
+struct Sequence {
+  std::string name;
+  std::vector<Frame> frames;
+};
+
+// rotating, blink-red, blink-green, blink-return, machine, sparks
+std::vector<Sequence> renderEffectSequences();
+
+#endif
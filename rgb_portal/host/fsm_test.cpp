@@ -0,0 +1,147 @@
+// Transition table test.
+//
+// Applies every event in every portal state (both guard outcomes where a
+// row has a guard) and compares the result with the behaviour written out
+// below, including the events the table rejects. A new event or state
+// fails the test until its row here is filled in.
+//
+// Usage: fsm_test
+
+#include "portal_fsm.h"
+#include "unit_test.h"
+
+namespace {
+
+const PortalState STATES[] = {ROTATING, BLINK_RED, BLINK_GREEN, STREAMING, PLAYING};
+const int NUM_STATES = sizeof(STATES) / sizeof(STATES[0]);
+
+const BlinkConfig redConfig = {CRGB::Red, 5, 200, true};
+const BlinkConfig greenConfig = {CRGB::Green, 1, 1000, false};
+
+// Resulting state per starting state (order of STATES), '-' = rejected
+// R = ROTATING, r = BLINK_RED, g = BLINK_GREEN, s = STREAMING, p = PLAYING
+struct Expected {
+  PortalEventType event;
+  uint8_t arg;
+  bool solid;          // Active blink config holds its color (BLINK_DONE guard)
+  const char* to;
+  char autoTriggered;  // After an accepted event: S = set, C = cleared, K = kept
+};
+
+const Expected EXPECTED[] = {
+  {EV_SENSOR_ENTER,   BLINK_GREEN, false, "g--gg", 'S'},
+  {EV_SENSOR_ENTER,   BLINK_RED,   false, "r--rr", 'S'},
+  {EV_SENSOR_ENTER,   ROTATING,    false, "-----", 'K'},
+  {EV_SENSOR_EXIT,    0,           false, "--R--", 'C'},
+  {EV_HTTP_TOGGLE,    0,           false, "rRRrr", 'C'},
+  {EV_HTTP_RED,       0,           false, "r--rr", 'S'},
+  {EV_HTTP_GREEN,     0,           false, "gg-gg", 'S'},
+  {EV_HTTP_RESET,     0,           false, "RRRRR", 'C'},
+  {EV_MQTT_RED,       0,           false, "r--rr", 'S'},
+  {EV_MQTT_GREEN,     0,           false, "gg-gg", 'S'},
+  {EV_MQTT_RESET,     0,           false, "RRRRR", 'C'},
+  {EV_BLINK_DONE,     0,           true,  "-rg--", 'K'},
+  {EV_BLINK_DONE,     0,           false, "-RR--", 'C'},
+  {EV_STREAM_FRAME,   0,           false, "s----", 'K'},
+  {EV_STREAM_TIMEOUT, 0,           false, "---R-", 'K'},
+  {EV_UDP_TOGGLE,     0,           false, "rRRrr", 'C'},
+  {EV_UDP_RED,        0,           false, "r--rr", 'S'},
+  {EV_UDP_GREEN,      0,           false, "gg-gg", 'S'},
+  {EV_UDP_RESET,      0,           false, "RRRRR", 'C'},
+  {EV_CLIP_START,     0,           false, "p--pp", 'K'},
+  {EV_CLIP_DONE,      0,           false, "----R", 'K'},
+  {EV_SEQ_RED,        0,           false, "rrrrr", 'C'},
+  {EV_SEQ_GREEN,      0,           false, "ggggg", 'C'},
+  {EV_SEQ_RESET,      0,           false, "RRRRR", 'C'},
+  {EV_SEQ_CLIP,       0,           false, "ppppp", 'C'},
+};
+
+PortalState stateFor(char c) {
+  switch (c) {
+    case 'r': return BLINK_RED;
+    case 'g': return BLINK_GREEN;
+    case 's': return STREAMING;
+    case 'p': return PLAYING;
+    default:  return ROTATING;
+  }
+}
+
+// One event in one state, starting with `autoTriggered`
+void checkCase(const Expected& e, int s, bool autoTriggered) {
+  PortalMachine m;
+  portalInit(m, &redConfig, &greenConfig);
+  m.state = STATES[s];
+  m.autoTriggered = autoTriggered;
+  m.activeBlinkConfig = e.solid ? redConfig : greenConfig;
+  m.blinkStartTime = 100;
+  m.blinkingDone = false;
+  PortalEvent ev = {(uint8_t)e.event, e.arg, 5000, 0};
+
+  bool accepted = portalApply(m, ev);
+  char want = e.to[s];
+  const char* from = portalStateName(STATES[s]);
+  const char* name = portalEventName(e.event);
+
+  if (want == '-') {
+    CHECK_MSG(!accepted, "%s arg %u in %s", name, e.arg, from);
+    CHECK_MSG(m.state == STATES[s], "%s arg %u in %s", name, e.arg, from);
+    CHECK_MSG(m.autoTriggered == autoTriggered && m.transitionCount == 0 && m.blinkStarts == 0 &&
+              m.blinkStartTime == 100 && !m.blinkingDone, "%s in %s", name, from);
+    return;
+  }
+
+  PortalState to = stateFor(want);
+  CHECK_MSG(accepted, "%s arg %u in %s", name, e.arg, from);
+  CHECK_MSG(m.state == to, "%s arg %u in %s: %s, expected %s", name, e.arg, from,
+            portalStateName(m.state), portalStateName(to));
+  CHECK_MSG(m.transitionCount == 1, "%s in %s", name, from);
+
+  bool wantAuto = e.autoTriggered == 'S' ? true : e.autoTriggered == 'C' ? false : autoTriggered;
+  CHECK_MSG(m.autoTriggered == wantAuto, "%s in %s: autoTriggered %d", name, from, m.autoTriggered);
+
+  // Entering a blink (re)starts it with the target's config; the end of a
+  // blink only marks it done
+  if (e.event == EV_BLINK_DONE) {
+    CHECK_MSG(m.blinkingDone && m.blinkStarts == 0 && m.blinkStartTime == 100, "%s in %s", name, from);
+  } else if (to == BLINK_RED || to == BLINK_GREEN) {
+    CHECK_MSG(m.blinkStarts == 1 && m.blinkStartTime == 5000 && !m.blinkingDone, "%s in %s", name, from);
+    const BlinkConfig& c = to == BLINK_RED ? redConfig : greenConfig;
+    CHECK_MSG(m.activeBlinkConfig.color == c.color, "%s in %s: blink config", name, from);
+  } else {
+    CHECK_MSG(m.blinkStarts == 0 && m.blinkStartTime == 100, "%s in %s", name, from);
+  }
+}
+
+}  // namespace
+
+int main() {
+  bool covered[EV_COUNT] = {};
+  for (const Expected& e : EXPECTED) {
+    covered[e.event] = true;
+    for (int s = 0; s < NUM_STATES; s++) {
+      checkCase(e, s, false);
+      checkCase(e, s, true);
+    }
+  }
+  for (int ev = 0; ev < EV_COUNT; ev++) {
+    CHECK_MSG(covered[ev], "%s has no expected row", portalEventName(ev));
+  }
+  CHECK(NUM_STATES == PLAYING + 1);
+
+  // The queue applies events in order and counts what doesn't fit
+  PortalMachine m;
+  portalInit(m, &redConfig, &greenConfig);
+  portalPost(m, EV_HTTP_RED, 10);
+  portalPost(m, EV_HTTP_GREEN, 20);
+  portalPost(m, EV_SENSOR_EXIT, 30);
+  CHECK(portalPendingState(m) == ROTATING && m.state == ROTATING);
+  PortalBatch batch = portalProcess(m);
+  CHECK(batch.processed == 3 && batch.changed && !batch.stateChanged && batch.blinkStarted);
+  CHECK(m.state == ROTATING && m.processedSeq == 3 && m.transitionCount == 3);
+  for (int i = 0; i < PORTAL_EVENT_QUEUE_SIZE; i++) portalPost(m, EV_STREAM_TIMEOUT, 40);
+  CHECK(!portalPost(m, EV_HTTP_RESET, 50) && m.droppedEvents == 1);
+  batch = portalProcess(m);
+  CHECK(batch.processed == PORTAL_EVENT_QUEUE_SIZE && !batch.changed && m.queueCount == 0);
+
+  return unitTestResult("fsm_test");
+}
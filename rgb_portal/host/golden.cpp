@@ -0,0 +1,187 @@
+// Golden-frame regression suite for the LED renderers.
+//
+// Renders a deterministic sequence of frames for every portal state with the
+// firmware's effect code and records a 64-bit FNV-1a hash per frame. A
+// changed renderer must reproduce the recorded hashes bit-exactly, or stay
+// within a declared per-channel tolerance of reference frames dumped earlier.
+//
+// Usage: golden --record FILE [--dump-dir DIR]
+//        golden --check FILE [--tolerance N --ref-dir DIR] [--dump-dir DIR]
+
+#include "effect_sequences.h"
+
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+
+namespace {
+
+const int NUM_LEDS = SEQUENCE_NUM_LEDS;
+
+uint64_t hashFrame(const Frame& frame) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for (const CRGB& c : frame) {
+    for (int k = 0; k < 3; k++) {
+      h ^= c.raw[k];
+      h *= 0x100000001b3ULL;
+    }
+  }
+  return h;
+}
+
+// One PPM per sequence: a row per frame, a column per LED
+bool writePpm(const std::string& path, const Sequence& seq) {
+  FILE* f = fopen(path.c_str(), "wb");
+  if (!f) return false;
+  fprintf(f, "P6\n%d %zu\n255\n", NUM_LEDS, seq.frames.size());
+  for (const Frame& frame : seq.frames) fwrite(frame.data(), 3, frame.size(), f);
+  fclose(f);
+  return true;
+}
+
+bool readPpm(const std::string& path, std::vector<Frame>& frames) {
+  FILE* f = fopen(path.c_str(), "rb");
+  if (!f) return false;
+  int width = 0, height = 0, maxval = 0;
+  bool ok = fscanf(f, "P6 %d %d %d", &width, &height, &maxval) == 3 && width == NUM_LEDS;
+  fgetc(f);
+  for (int y = 0; ok && y < height; y++) {
+    Frame frame(NUM_LEDS);
+    ok = fread(frame.data(), 3, NUM_LEDS, f) == (size_t)NUM_LEDS;
+    frames.push_back(frame);
+  }
+  fclose(f);
+  return ok;
+}
+
+int maxChannelDiff(const Frame& a, const Frame& b) {
+  int worst = 0;
+  for (size_t i = 0; i < a.size(); i++) {
+    for (int k = 0; k < 3; k++) {
+      worst = std::max(worst, std::abs((int)a[i].raw[k] - (int)b[i].raw[k]));
+    }
+  }
+  return worst;
+}
+
+void usage() {
+  fprintf(stderr,
+          "Usage: golden --record FILE [--dump-dir DIR]\n"
+          "       golden --check FILE [--tolerance N --ref-dir DIR] [--dump-dir DIR]\n");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::string recordFile, checkFile, dumpDir, refDir;
+  int tolerance = 0;
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    const char* v = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (!v) { usage(); return 2; }
+    if (a == "--record") recordFile = v;
+    else if (a == "--check") checkFile = v;
+    else if (a == "--dump-dir") dumpDir = v;
+    else if (a == "--ref-dir") refDir = v;
+    else if (a == "--tolerance") tolerance = atoi(v);
+    else { usage(); return 2; }
+    i++;
+  }
+  if (recordFile.empty() == checkFile.empty()) {
+    usage();
+    return 2;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<Sequence> sequences = renderEffectSequences();
+  double renderMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+  size_t totalFrames = 0;
+  for (const Sequence& seq : sequences) totalFrames += seq.frames.size();
+
+  if (!dumpDir.empty()) {
+    for (const Sequence& seq : sequences) {
+      if (!writePpm(dumpDir + "/" + seq.name + ".ppm", seq)) {
+        fprintf(stderr, "Cannot write %s/%s.ppm\n", dumpDir.c_str(), seq.name.c_str());
+        return 1;
+      }
+    }
+  }
+
+  if (!recordFile.empty()) {
+    FILE* f = fopen(recordFile.c_str(), "w");
+    if (!f) {
+      fprintf(stderr, "Cannot write %s\n", recordFile.c_str());
+      return 1;
+    }
+    fprintf(f, "# Golden frame hashes (FNV-1a 64 over %d RGB LEDs): sequence frame hash\n", NUM_LEDS);
+    for (const Sequence& seq : sequences) {
+      for (size_t i = 0; i < seq.frames.size(); i++) {
+        fprintf(f, "%s %zu %016llx\n", seq.name.c_str(), i, (unsigned long long)hashFrame(seq.frames[i]));
+      }
+    }
+    fclose(f);
+    printf("Recorded %zu frames in %zu sequences to %s (%.1f ms)\n",
+           totalFrames, sequences.size(), recordFile.c_str(), renderMs);
+    return 0;
+  }
+
+  std::ifstream in(checkFile);
+  if (!in) {
+    fprintf(stderr, "Cannot open %s\n", checkFile.c_str());
+    return 1;
+  }
+  std::map<std::string, std::vector<uint64_t>> golden;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#') continue;
+    std::istringstream ls(line);
+    std::string name, hex;
+    size_t index;
+    if (!(ls >> name >> index >> hex)) continue;
+    std::vector<uint64_t>& hashes = golden[name];
+    if (hashes.size() <= index) hashes.resize(index + 1);
+    hashes[index] = strtoull(hex.c_str(), nullptr, 16);
+  }
+
+  int failures = 0;
+  size_t exact = 0, tolerated = 0;
+  for (const Sequence& seq : sequences) {
+    auto it = golden.find(seq.name);
+    if (it == golden.end() || it->second.size() != seq.frames.size()) {
+      printf("FAIL %s: %zu frames rendered, %zu in golden file\n", seq.name.c_str(),
+             seq.frames.size(), it == golden.end() ? (size_t)0 : it->second.size());
+      failures++;
+      continue;
+    }
+
+    std::vector<Frame> refs;
+    bool haveRefs = tolerance > 0 && !refDir.empty() && readPpm(refDir + "/" + seq.name + ".ppm", refs) &&
+                    refs.size() == seq.frames.size();
+
+    for (size_t i = 0; i < seq.frames.size(); i++) {
+      if (hashFrame(seq.frames[i]) == it->second[i]) {
+        exact++;
+        continue;
+      }
+      int diff = haveRefs ? maxChannelDiff(seq.frames[i], refs[i]) : -1;
+      if (diff >= 0 && diff <= tolerance) {
+        tolerated++;
+        continue;
+      }
+      if (failures < 20) {
+        if (diff >= 0) {
+          printf("FAIL %s frame %zu: max channel difference %d > %d\n", seq.name.c_str(), i, diff, tolerance);
+        } else {
+          printf("FAIL %s frame %zu: hash mismatch\n", seq.name.c_str(), i);
+        }
+      }
+      failures++;
+    }
+  }
+
+  printf("%s: %zu frames, %zu bit-exact, %zu within tolerance %d, %d failing (%.1f ms)\n",
+         failures ? "FAILED" : "OK", totalFrames, exact, tolerated, tolerance, failures, renderMs);
+  return failures ? 1 : 0;
+}
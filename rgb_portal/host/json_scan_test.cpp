@@ -0,0 +1,51 @@
+// JSON scanner test.
+//
+// The helpers the config and timeline parsers share: tokens (strings, bare
+// tokens and where they end, buffers too short), and numbers, booleans and
+// colors that must be valid as a whole and leave the output alone if not.
+//
+// Usage: json_scan_test
+
+#include "json_scan.h"
+#include "unit_test.h"
+
+int main() {
+  char out[8];
+  const char* p;
+
+  CHECK(*jsonSkipSpace(" \t\r\n x") == 'x' && *jsonSkipSpace("") == '\0');
+
+  // Strings end at the quote, bare tokens before a delimiter or space
+  CHECK((p = jsonToken("\"a b,}\":1", out, sizeof(out))) && strcmp(out, "a b,}") == 0 && *p == ':');
+  CHECK((p = jsonToken("\"\"", out, sizeof(out))) && out[0] == '\0' && *p == '\0');
+  const char* ends[] = {"12,", "12}", "12]", "12 ", "12\n", "12"};
+  for (const char* e : ends) {
+    CHECK_MSG((p = jsonToken(e, out, sizeof(out))) && strcmp(out, "12") == 0 && p == e + 2, "%s", e);
+  }
+  CHECK(jsonToken("\"1234567\"", out, sizeof(out)) != nullptr);  // 7 characters and the terminator fit
+  CHECK(!jsonToken("\"12345678\"", out, sizeof(out)));
+  CHECK(!jsonToken("12345678", out, sizeof(out)));
+  CHECK(!jsonToken("\"open", out, sizeof(out)));
+  CHECK(!jsonToken(",", out, sizeof(out)) && !jsonToken("}", out, sizeof(out)) && !jsonToken("", out, sizeof(out)));
+
+  long l = 7;
+  CHECK(jsonParseLong("-5", -10, 10, l) && l == -5);
+  CHECK(jsonParseLong("10", -10, 10, l) && l == 10);
+  CHECK(!jsonParseLong("11", -10, 10, l) && !jsonParseLong("-11", -10, 10, l) && l == 10);
+  CHECK(!jsonParseLong("", 0, 10, l) && !jsonParseLong("3x", 0, 10, l) && !jsonParseLong("1.5", 0, 10, l) && l == 10);
+
+  bool b = false;
+  CHECK(jsonParseBool("true", b) && b && jsonParseBool("0", b) && !b && jsonParseBool("1", b) && b);
+  CHECK(jsonParseBool("false", b) && !b);
+  CHECK(!jsonParseBool("True", b) && !jsonParseBool("yes", b) && !jsonParseBool("", b) && !b);
+
+  CRGB c = CRGB(1, 2, 3);
+  CHECK(jsonParseColor("ff8000", c) && c == CRGB(255, 128, 0));
+  CHECK(jsonParseColor("#0aF0b1", c) && c == CRGB(0x0a, 0xf0, 0xb1));
+  const char* badColors[] = {"", "#", "fff", "ff800", "ff80000", "ff80g0", "##ff8000", " ff8000"};
+  for (const char* bad : badColors) {
+    CHECK_MSG(!jsonParseColor(bad, c) && c == CRGB(0x0a, 0xf0, 0xb1), "\"%s\"", bad);
+  }
+
+  return unitTestResult("json_scan_test");
+}
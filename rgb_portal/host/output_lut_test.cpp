@@ -0,0 +1,81 @@
+// Output LUT test.
+//
+// Builds the table for a few gamma and white balance settings and checks
+// it against the float formula in output_lut.h (within rounding): black
+// stays black, a lit input stays lit, the curve never goes down, and the
+// table spans the full output range (brightness is FastLED's, not the
+// table's), so the top of the curve keeps its levels.
+//
+// Usage: output_lut_test
+
+#include "output_lut.h"
+#include "unit_test.h"
+
+#include <math.h>
+
+namespace {
+
+struct Setting {
+  float gamma;
+  CRGB balance;
+};
+
+const Setting SETTINGS[] = {
+  {1.0f, CRGB(255, 255, 255)},
+  {2.2f, CRGB(255, 255, 255)},
+  {2.2f, CRGB(255, 176, 240)},  // TypicalLEDStrip
+  {3.0f, CRGB(128, 1, 0)},
+};
+
+void checkTable(const OutputLut& lut, const Setting& s) {
+  for (int c = 0; c < 3; c++) {
+    const uint8_t* t = lut.table[c];
+    int levels = 1;
+    CHECK_MSG(t[0] == 0, "gamma %.1f channel %d", s.gamma, c);
+    for (int i = 1; i < 256; i++) {
+      float want = powf(i / 255.0f, s.gamma) * s.balance[c];
+      int lit = s.balance[c] > 0 ? 1 : 0;
+      CHECK_MSG(fabsf(t[i] - fmaxf(want, lit)) <= 0.5f + 1e-3f, "gamma %.1f channel %d input %d: %u, expected %.2f",
+                s.gamma, c, i, t[i], want);
+      CHECK_MSG(t[i] >= t[i - 1], "gamma %.1f channel %d input %d", s.gamma, c, i);
+      CHECK_MSG(t[i] >= lit, "gamma %.1f channel %d input %d", s.gamma, c, i);
+      if (t[i] != t[i - 1]) levels++;
+    }
+    CHECK_MSG(t[255] == s.balance[c], "gamma %.1f channel %d: top %u", s.gamma, c, t[255]);
+    // Full range white: gamma 2.2 keeps most of the 256 levels
+    if (s.balance[c] == 255) {
+      CHECK_MSG(levels >= (s.gamma == 1.0f ? 256 : 180), "gamma %.1f channel %d: %d levels", s.gamma, c, levels);
+    }
+  }
+}
+
+}  // namespace
+
+int main() {
+  OutputLut lut;
+  for (const Setting& s : SETTINGS) {
+    outputLutBuild(lut, s.gamma, s.balance);
+    CHECK(lut.gamma == s.gamma && lut.balance == s.balance);
+    checkTable(lut, s);
+  }
+
+  // Gamma 1.0 with a white balance of ffffff passes frames through
+  outputLutBuild(lut, 1.0f, CRGB(255, 255, 255));
+  for (int i = 0; i < 256; i++) {
+    CHECK_MSG(lut.table[0][i] == i && lut.table[1][i] == i && lut.table[2][i] == i, "input %d", i);
+  }
+
+  // Apply looks up each channel in its own table, in place too
+  outputLutBuild(lut, 2.2f, CRGB(255, 176, 240));
+  CRGB in[4] = {CRGB(0, 0, 0), CRGB(255, 255, 255), CRGB(1, 128, 200), CRGB(40, 0, 255)};
+  CRGB out[4];
+  outputLutApply(lut, in, out, 4);
+  for (int i = 0; i < 4; i++) {
+    CHECK_MSG(out[i] == CRGB(lut.table[0][in[i].r], lut.table[1][in[i].g], lut.table[2][in[i].b]), "pixel %d", i);
+  }
+  CHECK(out[1] == CRGB(255, 176, 240));
+  outputLutApply(lut, in, in, 4);
+  CHECK(memcmp(in, out, sizeof(out)) == 0);
+
+  return unitTestResult("output_lut_test");
+}
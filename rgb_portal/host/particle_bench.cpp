@@ -0,0 +1,78 @@
+// Particle engine benchmark.
+//
+// Keeps 10 to 1000 particles alive on the 140-LED ring and times one
+// update and one render (the solid blink color dimmed, the particles added)
+// per frame, the way drawBlinkEffect() runs them. Built with a pool of
+// 1024 particles; the firmware uses PARTICLE_CAPACITY (64).
+//
+// Usage: particle_bench [--frames N] [--dt-ms MS]
+
+#include "effect_sequences.h"
+#include "particles.h"
+#include "portal_fsm.h"
+#include "effects.h"
+
+#include <chrono>
+
+namespace {
+
+const int NUM_LEDS = SEQUENCE_NUM_LEDS;
+const BlinkConfig greenBlinkConfig = {CRGB::Green, 0, 0, true};
+
+ParticlePool pool;  // 1024 particles, too large for the stack
+
+double nsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int frames = 20000;
+  unsigned long dtMs = 75;  // ANIMATION_SPEED
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    const char* v = i + 1 < argc ? argv[++i] : "";
+    if (a == "--frames") frames = std::max(1, atoi(v));
+    else if (a == "--dt-ms") dtMs = std::max(1, atoi(v));
+    else {
+      fprintf(stderr, "Usage: particle_bench [--frames N] [--dt-ms MS]\n");
+      return 2;
+    }
+  }
+
+  printf("pool %d particles, %zu bytes, %d LEDs, %lu ms per frame\n",
+         PARTICLE_CAPACITY, sizeof(ParticlePool), NUM_LEDS, dtMs);
+  printf("%9s %12s %12s %12s %14s\n", "particles", "update ns", "render ns", "frame ns", "ns/particle");
+
+  const int counts[] = {10, 30, 100, 300, 1000};
+  CRGB leds[NUM_LEDS];
+  uint32_t checksum = 0;
+  for (int n : counts) {
+    particlesInit(pool, 1);
+    particlesBurst(pool, 0, n, greenBlinkConfig.color, 40, 120, 60000);
+
+    double updateNs = 0, renderNs = 0;
+    for (int f = 0; f < frames; f++) {
+      auto start = std::chrono::steady_clock::now();
+      particlesUpdate(pool, NUM_LEDS, dtMs);
+      updateNs += nsSince(start);
+
+      start = std::chrono::steady_clock::now();
+      renderBlink(leds, NUM_LEDS, greenBlinkConfig, 0, true);
+      renderSparks(leds, NUM_LEDS, pool, 64);
+      renderNs += nsSince(start);
+      checksum += leds[f % NUM_LEDS].g;
+
+      if (pool.active < n) {
+        // Keep the pool at n as lives (45-75 s) run out
+        particlesBurst(pool, 0, n - pool.active, greenBlinkConfig.color, 40, 120, 60000);
+      }
+    }
+    double frameNs = (updateNs + renderNs) / frames;
+    printf("%9d %12.0f %12.0f %12.0f %14.2f\n", n, updateNs / frames, renderNs / frames,
+           frameNs, (updateNs + renderNs) / frames / n);
+  }
+  printf("(checksum %u)\n", checksum);
+  return 0;
+}
@@ -0,0 +1,165 @@
+// Timeline sequencer test.
+//
+// Parses valid and malformed timelines (every rejection with its message),
+// then runs timelines on a made-up clock: steps fire at their time and
+// report how late, tracks interpolate between keyframes, a one-shot ends
+// after durationMs, a loop starts over on the same time base, and after a
+// stall of many cycles only the current cycle's steps fire instead of a
+// replay of every missed one.
+//
+// Usage: sequencer_test
+
+#include "sequencer.h"
+#include "unit_test.h"
+
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Fired {
+  uint8_t index;
+  unsigned long lateUs;
+};
+std::vector<Fired> fired;
+
+void onStep(const SequenceStep& step, uint8_t index, unsigned long lateUs) {
+  (void)step;
+  fired.push_back({index, lateUs});
+}
+
+struct Malformed {
+  const char* json;
+  const char* error;
+};
+
+const Malformed MALFORMED[] = {
+  {"", "expected a JSON object"},
+  {"[]", "expected a JSON object"},
+  {"{\"id\":\"a\"}", "no steps"},
+  {"{\"steps\":[]}", "no steps"},
+  {"{\"steps\":{}}", "steps must be an array"},
+  {"{\"steps\":[{\"state\":\"red\"}]}", "step without \"at\""},
+  {"{\"steps\":[{\"at\":10},{\"at\":5}]}", "steps out of order"},
+  {"{\"steps\":[{\"at\":0,\"blinks\":3}]}", "blink fields need state red or green"},
+  {"{\"steps\":[{\"at\":0,\"state\":\"red\",\"blinkMs\":0}]}", "blinkMs 0 needs blinks 0"},
+  {"{\"steps\":[{\"at\":0,\"state\":\"green\",\"blinks\":2,\"blinkMs\":0}]}", "blinkMs 0 needs blinks 0"},
+  {"{\"steps\":[{\"at\":0,\"state\":\"clip\"}]}", "state clip needs a clip name (and only it)"},
+  {"{\"steps\":[{\"at\":0,\"clip\":\"fire\"}]}", "state clip needs a clip name (and only it)"},
+  {"{\"steps\":[{\"at\":0,\"color\":\"ff00\"}]}", "bad step field color"},
+  {"{\"steps\":[{\"at\":0,\"level\":256}]}", "bad step field level"},
+  {"{\"steps\":[{\"at\":0,\"state\":\"blue\"}]}", "bad step field state"},
+  {"{\"steps\":[{\"at\":0,\"ease\":\"bounce\"}]}", "bad step field ease"},
+  {"{\"steps\":[{\"at\":0,\"wat\":1}]}", "bad step field wat"},
+  {"{\"steps\":[{\"at\":-1}]}", "bad step field at"},
+  {"{\"steps\":[{\"at\":3600001}]}", "bad step field at"},
+  {"{\"steps\":[{\"at\":0}],\"loop\":maybe}", "bad field loop"},
+  {"{\"steps\":[{\"at\":0}],\"speed\":2}", "bad field speed"},
+  {"{\"steps\":[{\"at\":0}],\"id\":\"a-very-long-timeline-id\"}", "bad field id"},
+  {"{\"steps\":[{\"at\":500}],\"durationMs\":400}", "durationMs before the last step"},
+  {"{\"steps\":[{\"at\":0}],\"loop\":true}", "a looping timeline needs durationMs of at least 100"},
+  {"{\"steps\":[{\"at\":0}],\"loop\":true,\"durationMs\":1}", "a looping timeline needs durationMs of at least 100"},
+  {"{\"steps\":[{\"at\":0,}]}", "expected a step field name"},
+  {"{\"steps\":[{\"at\" 0}]}", "expected ':'"},
+  {"{\"steps\":[{\"at\":0} {\"at\":1}]}", "expected ',' or ']'"},
+  {"{\"steps\":[{\"at\":0}] \"id\":\"a\"}", "expected ',' or '}'"},
+  {"{\"steps\":[{\"at\":0}],}", "expected a field name"},
+  {"{\"steps\":[{\"at\":0}]", "expected ',' or '}'"},
+  {"{\"steps\":[{\"at\":0}", "expected ',' or ']'"},
+  {"{\"steps\":[{\"at\":0},]}", "expected a step object"},
+  {"{\"steps\":[3]}", "expected a step object"},
+};
+
+std::string manySteps(int count) {
+  std::string json = "{\"steps\":[";
+  for (int i = 0; i < count; i++) {
+    json += (i ? ",{\"at\":" : "{\"at\":") + std::to_string(i * 10) + "}";
+  }
+  return json + "]}";
+}
+
+}  // namespace
+
+int main() {
+  SequenceTimeline t;
+  String error;
+
+  // Parse
+  CHECK(sequenceParse(t, "{\"id\":\"scare\",\"loop\":false,\"durationMs\":32000,\"steps\":[\n"
+                         "  {\"at\":0,\"state\":\"red\",\"blinks\":8,\"blinkMs\":80},\n"
+                         "  {\"at\":1500,\"color\":\"ff0000\",\"level\":255},\n"
+                         "  {\"at\":6000,\"color\":\"#300000\",\"level\":60,\"ease\":\"smooth\"},\n"
+                         "  {\"at\":9000,\"state\":\"clip\",\"clip\":\"fire\",\"loops\":0},\n"
+                         "  {\"at\":30000,\"state\":\"rotating\"}]}", error) == 5);
+  CHECK(strcmp(t.id, "scare") == 0 && !t.loop && t.durationMs == 32000 && t.count == 5);
+  CHECK(t.steps[0].state == SEQ_RED && t.steps[0].blinks == 8 && t.steps[0].blinkMs == 80 && t.steps[0].solid == -1);
+  CHECK(t.steps[1].tracks == (SEQ_HAS_COLOR | SEQ_HAS_LEVEL) && t.steps[1].color == CRGB(255, 0, 0));
+  CHECK(t.steps[1].state == SEQ_KEEP && t.steps[1].ease == SEQ_EASE_LINEAR && t.steps[1].level == 255);
+  CHECK(t.steps[2].color == CRGB(0x30, 0, 0) && t.steps[2].ease == SEQ_EASE_SMOOTH);
+  CHECK(t.steps[3].state == SEQ_CLIP && strcmp(t.steps[3].clip, "fire") == 0 && t.steps[3].loops == 0);
+  CHECK(sequenceParse(t, "{\"steps\":[{\"at\":0},{\"at\":750,\"level\":9}]}", error) == 2 && t.durationMs == 750);
+  CHECK(sequenceParse(t, "{\"loop\":true,\"durationMs\":100,\"steps\":[{\"at\":0}]}", error) == 1);
+  CHECK(sequenceParse(t, "{\"steps\":[{\"at\":0,\"state\":\"green\",\"blinks\":0,\"blinkMs\":0}]}", error) == 1);
+  CHECK(sequenceParse(t, manySteps(SEQUENCE_MAX_STEPS).c_str(), error) == SEQUENCE_MAX_STEPS);
+  CHECK(sequenceParse(t, manySteps(SEQUENCE_MAX_STEPS + 1).c_str(), error) == -1 && error == "more than 32 steps");
+  for (const Malformed& m : MALFORMED) {
+    error = "";
+    int result = sequenceParse(t, m.json, error);
+    CHECK_MSG(result == -1 && error == m.error, "%s: %d \"%s\", expected \"%s\"", m.json, result, error.c_str(),
+              m.error);
+  }
+
+  // One-shot: steps when due, tracks between keyframes, done after durationMs
+  Sequencer s = Sequencer();
+  CHECK(sequencePoll(s, 0, onStep) == SEQUENCE_IDLE);
+  CHECK(sequenceParse(t, "{\"durationMs\":3000,\"steps\":[{\"at\":0,\"state\":\"green\",\"level\":0},"
+                         "{\"at\":1000,\"color\":\"000000\"},{\"at\":2000,\"color\":\"ff0000\",\"level\":200}]}",
+                         error) == 3);
+  unsigned long base = 4000000000UL;  // Across the micros() wrap
+  sequenceStart(s, t, base);
+  CHECK(sequencePoll(s, base + 300, onStep) == SEQUENCE_RUNNING);
+  CHECK(fired.size() == 1 && fired[0].index == 0 && fired[0].lateUs == 300);
+  CHECK(s.levelActive && s.level == 0 && !s.colorActive);
+  sequencePoll(s, base + 1500000, onStep);
+  CHECK(fired.size() == 2 && fired[1].index == 1 && fired[1].lateUs == 500000);
+  CHECK(s.colorActive && s.color == CRGB(127, 0, 0) && s.level == 150);
+  sequencePoll(s, base + 2000000, onStep);
+  CHECK(fired.size() == 3 && fired[2].lateUs == 0 && s.color == CRGB(255, 0, 0) && s.level == 200);
+  CHECK(sequencePoll(s, base + 2999999, onStep) == SEQUENCE_RUNNING);
+  CHECK(sequencePoll(s, base + 3000000, onStep) == SEQUENCE_DONE);
+  CHECK(!s.running && !s.colorActive && !s.levelActive && s.completed == 1 && s.maxLateUs == 500000);
+  CHECK(sequencePoll(s, base + 3100000, onStep) == SEQUENCE_IDLE && fired.size() == 3);
+
+  // Loop: every cycle on the start's time base
+  CHECK(sequenceParse(t, "{\"loop\":true,\"durationMs\":1000,\"steps\":[{\"at\":0},{\"at\":400},{\"at\":800}]}",
+                      error) == 3);
+  fired.clear();
+  sequenceStart(s, t, 0);
+  for (unsigned long us = 0; us < 5000000; us += 20000) {
+    CHECK(sequencePoll(s, us, onStep) == SEQUENCE_RUNNING);
+  }
+  CHECK(fired.size() == 15 && s.cycle == 4 && s.startUs == 4000000);
+  for (const Fired& f : fired) {
+    CHECK_MSG(f.lateUs == 0, "step %u late %lu us", f.index, f.lateUs);
+  }
+
+  // Stall of ten and a half cycles: the missed cycles are skipped, the
+  // current one's first two steps fire (late), the rest on time
+  fired.clear();
+  CHECK(sequencePoll(s, 15500000, onStep) == SEQUENCE_RUNNING);
+  CHECK(s.cycle == 15 && s.startUs == 15000000 && s.next == 2);
+  CHECK(fired.size() == 2 && fired[0].index == 0 && fired[0].lateUs == 500000 && fired[1].lateUs == 100000);
+  sequencePoll(s, 15800000, onStep);
+  CHECK(fired.size() == 3 && fired[2].index == 2 && fired[2].lateUs == 0);
+
+  // A stall ending exactly on a cycle start
+  fired.clear();
+  sequencePoll(s, 18000000, onStep);
+  CHECK(s.cycle == 18 && s.startUs == 18000000 && fired.size() == 1 && fired[0].lateUs == 0);
+
+  // Abort
+  CHECK(sequenceAbort(s) && !sequenceAbort(s) && s.aborted == 1);
+  CHECK(sequencePoll(s, 18100000, onStep) == SEQUENCE_IDLE && sequenceElapsedMs(s, 18100000) == 0);
+
+  return unitTestResult("sequencer_test");
+}
@@ -0,0 +1,76 @@
+#ifndef SIM_H
+#define SIM_H
+
+// Simulator runtime shared by the stubs and the host tools.
+
+#include <Arduino.h>
+#include <FastLED.h>
+#include <WiFiUdp.h>
+#include <functional>
+
+namespace sim {
+
+// Virtual clock in microseconds since boot
+uint64_t nowUs();
+void advanceUs(uint64_t us);
+
+// Modelled cost of driving the strip: WS281x needs 30 us per LED plus a
+// 50 us latch
+extern unsigned long showUsPerLed;
+extern unsigned long showLatchUs;
+
+// Echo pulse width in us (0 = no echo) returned by pulseIn() for a ping on
+// `trigPin`, or nullptr for "no echo ever"
+extern std::function<unsigned long(uint8_t trigPin, uint64_t nowUs)> echoModel;
+
+// Called after every FastLED.show() with the buffer the controller points at
+extern std::function<void(const CRGB* leds, int count, uint8_t brightness)> onShow;
+
+// Serial output: echoed to stdout unless muted
+extern bool serialEcho;
+
+// WiFi connect time after begin()/reconnect(): scan and association, -1 =
+// never connects. A begin() with the access point's BSSID and channel skips
+// the scan (wifiDirectConnectMs); without a configured address DHCP adds
+// wifiDhcpMs.
+extern long wifiConnectDelayMs;
+extern long wifiDirectConnectMs;
+extern long wifiDhcpMs;
+
+// Drop the link; the access point is unreachable for `downUs`
+void wifiDrop(uint64_t downUs);
+
+// NVS (Preferences) contents, carried between runs as a text file
+bool nvsLoad(const char* path);
+bool nvsSave(const char* path);
+extern unsigned long nvsWrites;
+
+// Fill the clips flash partition with an image file (host/clip_pack). False
+// if it can't be read or doesn't fit.
+bool clipsLoad(const char* path);
+
+// Cause of the last reset reported by esp_reset_reason() (esp_reset_reason_t,
+// power-on by default)
+extern int resetReason;
+
+// Whether the MQTT broker accepts connections
+extern bool mqttBrokerUp;
+
+// UDP: deliver a datagram to the firmware socket bound to `port`. Returns
+// false if no socket is bound there.
+bool udpInject(uint16_t port, const uint8_t* data, size_t len,
+               IPAddress from = IPAddress(127, 0, 0, 1), uint16_t fromPort = 40000);
+
+// Called for every datagram the firmware sends (port = destination port)
+extern std::function<void(const SimUdpDatagram& d)> onUdpSend;
+
+// Bind real sockets on 127.0.0.1 (port + udpPortOffset) instead of the
+// in-process queue, for tests against external tools
+extern bool udpRealSockets;
+extern int udpPortOffset;
+
+void seedRandom(uint32_t seed);
+
+}  // namespace sim
+
+#endif
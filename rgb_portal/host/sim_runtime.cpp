@@ -0,0 +1,640 @@
+#include "sim.h"
+
+#include <WiFi.h>
+#include <esp_timer.h>
+#include <esp_system.h>
+#include <WebServer.h>
+#include <PubSubClient.h>
+#include <ArduinoOTA.h>
+#include <Preferences.h>
+#include <esp_partition.h>
+#include <stdarg.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <map>
+
+HardwareSerial Serial;
+CFastLED FastLED;
+WiFiClass WiFi;
+ArduinoOTAClass ArduinoOTA;
+
+namespace sim {
+
+static uint64_t clockUs = 0;
+unsigned long showUsPerLed = 30;
+unsigned long showLatchUs = 50;
+std::function<unsigned long(uint8_t, uint64_t)> echoModel;
+std::function<void(const CRGB*, int, uint8_t)> onShow;
+bool serialEcho = true;
+long wifiConnectDelayMs = 1500;
+long wifiDirectConnectMs = 150;
+long wifiDhcpMs = 500;
+bool mqttBrokerUp = true;
+unsigned long nvsWrites = 0;
+int resetReason = ESP_RST_POWERON;
+std::function<void(const SimUdpDatagram&)> onUdpSend;
+bool udpRealSockets = false;
+int udpPortOffset = 0;
+
+uint64_t nowUs() { return clockUs; }
+void advanceUs(uint64_t us) { clockUs += us; }
+
+// xorshift32, deterministic across platforms
+static uint32_t rngState = 0x12345678;
+
+static uint32_t nextRandom() {
+  uint32_t x = rngState;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  rngState = x;
+  return x;
+}
+
+void seedRandom(uint32_t seed) { rngState = seed ? seed : 0x12345678; }
+
+}  // namespace sim
+
+// ---- Arduino core ----
+
+unsigned long millis() { return (unsigned long)(sim::nowUs() / 1000); }
+unsigned long micros() { return (unsigned long)sim::nowUs(); }
+void delay(unsigned long ms) { sim::advanceUs((uint64_t)ms * 1000); }
+void delayMicroseconds(unsigned int us) { sim::advanceUs(us); }
+void yield() {}
+
+static uint8_t lastTriggeredPin = 0xFF;
+
+void pinMode(uint8_t pin, uint8_t mode) { (void)pin; (void)mode; }
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+  // A HIGH->LOW trigger pulse arms the echo model for that pin
+  if (val == LOW) lastTriggeredPin = pin;
+}
+
+int digitalRead(uint8_t pin) { (void)pin; return LOW; }
+
+unsigned long pulseIn(uint8_t pin, uint8_t state, unsigned long timeout) {
+  (void)pin;
+  (void)state;
+  unsigned long width = sim::echoModel ? sim::echoModel(lastTriggeredPin, sim::nowUs()) : 0;
+  if (width == 0 || width > timeout) {
+    sim::advanceUs(timeout);
+    return 0;
+  }
+  // HC-SR04 raises echo ~450 us after the trigger, then holds it for `width`
+  sim::advanceUs(450 + width);
+  return width;
+}
+
+long random(long max) { return max <= 0 ? 0 : (long)(sim::nextRandom() % (uint32_t)max); }
+long random(long min, long max) { return max <= min ? min : min + random(max - min); }
+void randomSeed(unsigned long seed) { (void)seed; }  // Keep runs reproducible
+uint32_t esp_random() { return sim::nextRandom(); }
+int64_t esp_timer_get_time() { return (int64_t)sim::nowUs(); }
+esp_reset_reason_t esp_reset_reason() { return (esp_reset_reason_t)sim::resetReason; }
+
+EspClass ESP;
+uint64_t EspClass::getEfuseMac() { return 0x010000000002ULL; }  // 02:00:00:00:00:01 like WiFi.macAddress()
+uint32_t EspClass::getCycleCount() { return (uint32_t)(sim::nowUs() * 240); }
+
+size_t Print::printf(const char* fmt, ...) {
+  char buf[256];
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+  return write((const uint8_t*)buf, n < (int)sizeof(buf) ? n : sizeof(buf) - 1);
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  if (sim::serialEcho) fputc(c, stdout);
+  return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t* buf, size_t len) {
+  if (sim::serialEcho) fwrite(buf, 1, len, stdout);
+  return len;
+}
+
+// ---- FastLED ----
+
+void CFastLED::show(uint8_t scale) {
+  sim::advanceUs((uint64_t)controller_.size() * sim::showUsPerLed + sim::showLatchUs);
+  if (sim::onShow) sim::onShow(controller_.leds(), controller_.size(), scale);
+}
+
+// ---- WiFi ----
+
+static wl_status_t wifiStatus = WL_DISCONNECTED;
+static uint64_t wifiConnectAtUs = UINT64_MAX;
+static uint64_t wifiApDownUntilUs = 0;
+static uint8_t wifiBssid[6] = {0x02, 0x00, 0x00, 0x5e, 0x00, 0x01};
+static const int32_t wifiApChannel = 6;
+static IPAddress wifiStaticIp;
+static int32_t wifiBeginChannel = 0;
+static bool wifiBeginDirect = false;
+static uint64_t wifiDhcpDoneUs = 0;  // DHCP restarted on a connected link: no address until then
+
+// Scan and association (or association only, with the right BSSID and
+// channel), then DHCP unless an address is configured. A direct attempt at
+// the wrong access point never connects.
+static void scheduleWifiConnect() {
+  wifiStatus = WL_DISCONNECTED;
+  long ms = wifiBeginDirect ? sim::wifiDirectConnectMs : sim::wifiConnectDelayMs;
+  if (ms < 0 || (wifiBeginChannel && wifiBeginChannel != wifiApChannel)) {
+    wifiConnectAtUs = UINT64_MAX;
+    return;
+  }
+  if ((uint32_t)wifiStaticIp == 0) ms += sim::wifiDhcpMs;
+  wifiConnectAtUs = std::max(sim::nowUs(), wifiApDownUntilUs) + (uint64_t)ms * 1000;
+}
+
+void sim::wifiDrop(uint64_t downUs) {
+  wifiStatus = WL_CONNECTION_LOST;
+  wifiConnectAtUs = UINT64_MAX;
+  wifiApDownUntilUs = sim::nowUs() + downUs;
+}
+
+wl_status_t WiFiClass::begin(const char* ssid, const char* passphrase, int32_t channel,
+                             const uint8_t* bssid, bool connect) {
+  (void)ssid; (void)passphrase;
+  wifiBeginChannel = channel;
+  wifiBeginDirect = bssid && channel;
+  if (bssid && memcmp(bssid, wifiBssid, sizeof(wifiBssid)) != 0) wifiBeginChannel = -1;
+  if (connect) scheduleWifiConnect();
+  return wifiStatus;
+}
+
+bool WiFiClass::config(IPAddress localIP, IPAddress gateway, IPAddress subnet, IPAddress dns1, IPAddress dns2) {
+  (void)gateway; (void)subnet; (void)dns1; (void)dns2;
+  if (status() == WL_CONNECTED && (uint32_t)wifiStaticIp != 0 && (uint32_t)localIP == 0) {
+    wifiDhcpDoneUs = sim::nowUs() + (uint64_t)sim::wifiDhcpMs * 1000;
+  }
+  wifiStaticIp = localIP;
+  return true;
+}
+
+bool WiFiClass::reconnect() {
+  scheduleWifiConnect();
+  return true;
+}
+
+bool WiFiClass::disconnect(bool wifioff) {
+  (void)wifioff;
+  wifiStatus = WL_DISCONNECTED;
+  wifiConnectAtUs = UINT64_MAX;
+  return true;
+}
+
+wl_status_t WiFiClass::status() {
+  if (wifiStatus != WL_CONNECTED && sim::nowUs() >= wifiConnectAtUs) wifiStatus = WL_CONNECTED;
+  return wifiStatus;
+}
+
+IPAddress WiFiClass::localIP() {
+  if (status() != WL_CONNECTED || sim::nowUs() < wifiDhcpDoneUs) return IPAddress((uint32_t)0);
+  return (uint32_t)wifiStaticIp != 0 ? wifiStaticIp : IPAddress(127, 0, 0, 1);
+}
+IPAddress WiFiClass::gatewayIP() { return IPAddress(127, 0, 0, 1); }
+IPAddress WiFiClass::subnetMask() { return IPAddress(255, 0, 0, 0); }
+IPAddress WiFiClass::dnsIP(uint8_t n) { (void)n; return IPAddress(127, 0, 0, 1); }
+IPAddress WiFiClass::broadcastIP() { return IPAddress(127, 255, 255, 255); }
+uint8_t* WiFiClass::BSSID() { return wifiBssid; }
+int32_t WiFiClass::channel() { return wifiApChannel; }
+int8_t WiFiClass::RSSI() { return status() == WL_CONNECTED ? -58 : 0; }
+String WiFiClass::macAddress() { return String("02:00:00:00:00:01"); }
+
+// ---- Preferences (NVS) ----
+
+static std::map<std::string, std::vector<uint8_t>> nvsStore;  // "namespace/key"
+
+bool Preferences::begin(const char* name, bool readOnly, const char* partitionLabel) {
+  (void)partitionLabel;
+  name_ = name;
+  readOnly_ = readOnly;
+  open_ = true;
+  if (readOnly) {
+    // Like NVS: a namespace that was never written can't be opened read-only
+    std::string prefix = std::string(name) + "/";
+    auto it = nvsStore.lower_bound(prefix);
+    open_ = it != nvsStore.end() && it->first.compare(0, prefix.size(), prefix) == 0;
+  }
+  return open_;
+}
+
+void Preferences::end() { open_ = false; }
+
+bool Preferences::clear() {
+  if (!open_ || readOnly_) return false;
+  std::string prefix = std::string(name_.c_str()) + "/";
+  for (auto it = nvsStore.lower_bound(prefix); it != nvsStore.end() && it->first.compare(0, prefix.size(), prefix) == 0;) {
+    it = nvsStore.erase(it);
+  }
+  return true;
+}
+
+bool Preferences::remove(const char* key) {
+  return open_ && !readOnly_ && nvsStore.erase(std::string(name_.c_str()) + "/" + key) > 0;
+}
+
+bool Preferences::isKey(const char* key) {
+  return open_ && nvsStore.count(std::string(name_.c_str()) + "/" + key) > 0;
+}
+
+size_t Preferences::putUChar(const char* key, uint8_t value) {
+  return putBytes(key, &value, 1);
+}
+
+uint8_t Preferences::getUChar(const char* key, uint8_t defaultValue) {
+  uint8_t value;
+  return getBytesLength(key) == 1 && getBytes(key, &value, 1) == 1 ? value : defaultValue;
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t len) {
+  if (!open_ || readOnly_) return 0;
+  const uint8_t* p = (const uint8_t*)value;
+  nvsStore[std::string(name_.c_str()) + "/" + key] = std::vector<uint8_t>(p, p + len);
+  sim::nvsWrites++;
+  return len;
+}
+
+size_t Preferences::getBytes(const char* key, void* buf, size_t maxLen) {
+  if (!open_) return 0;
+  auto it = nvsStore.find(std::string(name_.c_str()) + "/" + key);
+  if (it == nvsStore.end() || it->second.size() > maxLen) return 0;
+  memcpy(buf, it->second.data(), it->second.size());
+  return it->second.size();
+}
+
+size_t Preferences::getBytesLength(const char* key) {
+  if (!open_) return 0;
+  auto it = nvsStore.find(std::string(name_.c_str()) + "/" + key);
+  return it == nvsStore.end() ? 0 : it->second.size();
+}
+
+// One entry per line: <namespace/key> <hex bytes>
+bool sim::nvsLoad(const char* path) {
+  FILE* f = fopen(path, "r");
+  if (!f) return false;
+  char key[64];
+  char hex[2048];
+  while (fscanf(f, "%63s %2047s", key, hex) == 2) {
+    std::vector<uint8_t> value;
+    for (size_t i = 0; hex[i] && hex[i + 1]; i += 2) {
+      unsigned byte;
+      if (sscanf(hex + i, "%2x", &byte) != 1) break;
+      value.push_back((uint8_t)byte);
+    }
+    nvsStore[key] = value;
+  }
+  fclose(f);
+  return true;
+}
+
+bool sim::nvsSave(const char* path) {
+  FILE* f = fopen(path, "w");
+  if (!f) return false;
+  for (const auto& entry : nvsStore) {
+    fprintf(f, "%s ", entry.first.c_str());
+    for (uint8_t b : entry.second) fprintf(f, "%02x", b);
+    fprintf(f, "\n");
+  }
+  fclose(f);
+  return true;
+}
+
+// ---- Flash partitions ----
+
+// The clips partition: 0x160000 bytes at 0x290000, like partitions.csv
+static const esp_partition_t clipsPartition = {ESP_PARTITION_TYPE_DATA, 0x40, 0x290000, 0x160000, "clips", false};
+static std::vector<uint8_t> clipsFlash(clipsPartition.size, 0xFF);
+static int flashMaps = 0;
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char* label) {
+  if (type != clipsPartition.type || subtype != clipsPartition.subtype ||
+      (label && strcmp(label, clipsPartition.label) != 0)) {
+    return nullptr;
+  }
+  return &clipsPartition;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition, size_t offset, size_t size) {
+  // Whole sectors only, like the real call
+  if (partition != &clipsPartition || offset % 4096 || size % 4096) return ESP_ERR_INVALID_ARG;
+  if (offset + size > partition->size) return ESP_ERR_INVALID_SIZE;
+  if (flashMaps > 0) {
+    fprintf(stderr, "esp_partition_erase_range: partition is still mapped\n");
+    abort();
+  }
+  std::fill(clipsFlash.begin() + offset, clipsFlash.begin() + offset + size, 0xFF);
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t* partition, size_t dstOffset, const void* src, size_t size) {
+  if (partition != &clipsPartition) return ESP_ERR_INVALID_ARG;
+  if (dstOffset + size > partition->size) return ESP_ERR_INVALID_SIZE;
+  const uint8_t* p = (const uint8_t*)src;
+  for (size_t i = 0; i < size; i++) clipsFlash[dstOffset + i] &= p[i];
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* partition, size_t srcOffset, void* dst, size_t size) {
+  if (partition != &clipsPartition) return ESP_ERR_INVALID_ARG;
+  if (srcOffset + size > partition->size) return ESP_ERR_INVALID_SIZE;
+  memcpy(dst, clipsFlash.data() + srcOffset, size);
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_mmap(const esp_partition_t* partition, size_t offset, size_t size,
+                             spi_flash_mmap_memory_t memory, const void** outPtr,
+                             spi_flash_mmap_handle_t* outHandle) {
+  (void)memory;
+  if (partition != &clipsPartition) return ESP_ERR_INVALID_ARG;
+  if (offset + size > partition->size) return ESP_ERR_INVALID_SIZE;
+  *outPtr = clipsFlash.data() + offset;
+  *outHandle = ++flashMaps;
+  return ESP_OK;
+}
+
+void spi_flash_munmap(spi_flash_mmap_handle_t handle) {
+  (void)handle;
+  if (flashMaps > 0) flashMaps--;
+}
+
+bool sim::clipsLoad(const char* path) {
+  FILE* f = fopen(path, "rb");
+  if (!f) return false;
+  std::fill(clipsFlash.begin(), clipsFlash.end(), 0xFF);
+  size_t n = fread(clipsFlash.data(), 1, clipsFlash.size(), f);
+  bool ok = n > 0 && fgetc(f) == EOF;
+  fclose(f);
+  return ok;
+}
+
+// ---- WiFiUDP ----
+
+static std::vector<WiFiUDP*> udpSockets;
+
+bool sim::udpInject(uint16_t port, const uint8_t* data, size_t len, IPAddress from, uint16_t fromPort) {
+  for (WiFiUDP* u : udpSockets) {
+    if (u->simPort() == port) {
+      u->simDeliver({port, from, fromPort, std::vector<uint8_t>(data, data + len)});
+      return true;
+    }
+  }
+  return false;
+}
+
+uint8_t WiFiUDP::begin(uint16_t port) {
+  stop();
+  port_ = port;
+  if (sim::udpRealSockets) {
+    fd_ = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((uint16_t)(port + sim::udpPortOffset));
+    if (fd_ < 0 || bind(fd_, (sockaddr*)&addr, sizeof(addr)) != 0) {
+      if (fd_ >= 0) close(fd_);
+      fd_ = -1;
+      return 0;
+    }
+    fcntl(fd_, F_SETFL, O_NONBLOCK);
+  }
+  udpSockets.push_back(this);
+  return 1;
+}
+
+void WiFiUDP::stop() {
+  udpSockets.erase(std::remove(udpSockets.begin(), udpSockets.end(), this), udpSockets.end());
+  if (fd_ >= 0) close(fd_);
+  fd_ = -1;
+  port_ = 0;
+  rx_.clear();
+  current_.clear();
+  readPos_ = 0;
+}
+
+int WiFiUDP::beginPacket(IPAddress ip, uint16_t port) {
+  tx_ = {port, ip, port_, {}};
+  txOpen_ = true;
+  return 1;
+}
+
+int WiFiUDP::beginPacket(const char* host, uint16_t port) {
+  IPAddress ip;
+  return ip.fromString(host) ? beginPacket(ip, port) : 0;
+}
+
+size_t WiFiUDP::write(uint8_t c) { return write(&c, 1); }
+
+size_t WiFiUDP::write(const uint8_t* buf, size_t len) {
+  if (!txOpen_) return 0;
+  tx_.data.insert(tx_.data.end(), buf, buf + len);
+  return len;
+}
+
+int WiFiUDP::endPacket() {
+  if (!txOpen_) return 0;
+  txOpen_ = false;
+  if (fd_ >= 0) {
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = (uint32_t)tx_.remoteIP;  // Already in network byte order
+    addr.sin_port = htons(tx_.port);
+    return sendto(fd_, tx_.data.data(), tx_.data.size(), 0, (sockaddr*)&addr, sizeof(addr)) >= 0;
+  }
+  if (sim::onUdpSend) sim::onUdpSend(tx_);
+  return 1;
+}
+
+int WiFiUDP::parsePacket() {
+  if (fd_ >= 0) {
+    uint8_t buf[1500];
+    sockaddr_in from = {};
+    socklen_t fromLen = sizeof(from);
+    ssize_t n;
+    while ((n = recvfrom(fd_, buf, sizeof(buf), 0, (sockaddr*)&from, &fromLen)) >= 0) {
+      rx_.push_back({port_, IPAddress((uint32_t)from.sin_addr.s_addr), ntohs(from.sin_port),
+                     std::vector<uint8_t>(buf, buf + n)});
+      fromLen = sizeof(from);
+    }
+  }
+  // Like the ESP32 implementation, an unread rest of the previous packet is dropped
+  current_.clear();
+  readPos_ = 0;
+  if (rx_.empty()) return 0;
+  SimUdpDatagram& d = rx_.front();
+  current_.swap(d.data);
+  remoteIP_ = d.remoteIP;
+  remotePort_ = d.remotePort;
+  rx_.pop_front();
+  return (int)current_.size();
+}
+
+int WiFiUDP::read() {
+  return available() > 0 ? current_[readPos_++] : -1;
+}
+
+int WiFiUDP::read(unsigned char* buf, size_t len) {
+  size_t n = std::min(len, current_.size() - readPos_);
+  memcpy(buf, current_.data() + readPos_, n);
+  readPos_ += n;
+  return (int)n;
+}
+
+// ---- WebServer ----
+
+void WebServer::on(const String& uri, HTTPMethod method, THandlerFunction fn, THandlerFunction ufn) {
+  routes_.push_back({uri, method, fn, ufn});
+}
+
+void WebServer::handleClient() {
+  // The real server accepts at most one client per call
+  if (!started_ || pending_.empty()) return;
+  current_ = pending_.front();
+  pending_.pop_front();
+
+  uint64_t start = sim::nowUs();
+  SimHttpResponse resp = {current_.uri, 404, "", "", 0};
+  responses_.push_back(resp);
+
+  for (Route& r : routes_) {
+    if (r.uri == current_.uri && (r.method == HTTP_ANY || r.method == current_.method)) {
+      if (r.ufn && !current_.file.empty()) {
+        // The real server calls the upload handler per received chunk, then
+        // the request handler
+        upload_.filename = current_.filename;
+        upload_.name = "file";
+        upload_.totalSize = 0;
+        upload_.currentSize = 0;
+        upload_.status = UPLOAD_FILE_START;
+        r.ufn();
+        for (size_t pos = 0; pos < current_.file.size(); pos += sizeof(upload_.buf)) {
+          upload_.currentSize = std::min(sizeof(upload_.buf), current_.file.size() - pos);
+          memcpy(upload_.buf, current_.file.data() + pos, upload_.currentSize);
+          upload_.totalSize += upload_.currentSize;
+          upload_.status = UPLOAD_FILE_WRITE;
+          r.ufn();
+        }
+        upload_.currentSize = 0;
+        upload_.status = UPLOAD_FILE_END;
+        r.ufn();
+      }
+      r.fn();
+      responses_.back().handlerUs = (unsigned long)(sim::nowUs() - start);
+      return;
+    }
+  }
+  if (notFound_) notFound_();
+  responses_.back().handlerUs = (unsigned long)(sim::nowUs() - start);
+}
+
+void WebServer::send(int code, const char* contentType, const String& content) {
+  if (responses_.empty()) return;
+  SimHttpResponse& r = responses_.back();
+  r.code = code;
+  r.contentType = contentType ? contentType : "";
+  r.body += content;
+}
+
+void WebServer::sendContent(const String& content) {
+  if (!responses_.empty()) responses_.back().body += content;
+}
+
+String WebServer::arg(const String& name) const {
+  if (name == "plain") return current_.body;
+  for (auto& a : current_.args) {
+    if (a.first == name) return a.second;
+  }
+  return String();
+}
+
+String WebServer::arg(int i) const {
+  return i < (int)current_.args.size() ? current_.args[i].second : String();
+}
+
+String WebServer::argName(int i) const {
+  return i < (int)current_.args.size() ? current_.args[i].first : String();
+}
+
+int WebServer::args() const { return (int)current_.args.size(); }
+
+bool WebServer::hasArg(const String& name) const {
+  if (name == "plain") return current_.body.length() > 0;
+  for (auto& a : current_.args) {
+    if (a.first == name) return true;
+  }
+  return false;
+}
+
+// ---- PubSubClient ----
+
+// Fixed header, topic length and topic, payload: what the library buffers
+static size_t mqttPacketSize(const std::string& topic, size_t payloadLen) {
+  return MQTT_MAX_HEADER_SIZE + 2 + topic.size() + payloadLen;
+}
+
+bool PubSubClient::setBufferSize(uint16_t size) {
+  if (size == 0) return false;
+  bufferSize_ = size;
+  return true;
+}
+
+bool PubSubClient::connect(const char* id, const char* user, const char* pass) {
+  (void)id; (void)user; (void)pass;
+  connected_ = sim::mqttBrokerUp && WiFi.status() == WL_CONNECTED;
+  return connected_;
+}
+
+bool PubSubClient::connected() {
+  if (WiFi.status() != WL_CONNECTED) connected_ = false;
+  return connected_;
+}
+
+bool PubSubClient::loop() {
+  if (!connected_) return false;
+  while (!inbox_.empty() && callback_) {
+    SimMqttMessage msg = inbox_.front();
+    inbox_.pop_front();
+    if (mqttPacketSize(msg.topic, msg.payload.size()) > bufferSize_) {
+      oversized_++;
+      continue;
+    }
+    std::string topic = msg.topic;
+    callback_(&topic[0], (uint8_t*)&msg.payload[0], (unsigned int)msg.payload.size());
+  }
+  return true;
+}
+
+bool PubSubClient::publish(const char* topic, const char* payload, bool retained) {
+  (void)retained;
+  if (!connected_) return false;
+  if (mqttPacketSize(topic, strlen(payload)) > bufferSize_) {
+    oversized_++;
+    return false;
+  }
+  published_.push_back({topic, payload, millis()});
+  publishCounts_[topic]++;
+  return true;
+}
+
+bool PubSubClient::subscribe(const char* topic) {
+  subscriptions_.push_back(topic);
+  return connected_;
+}
+
+void PubSubClient::simInject(const std::string& topic, const std::string& payload) {
+  for (auto& t : subscriptions_) {
+    if (t == topic) {
+      inbox_.push_back({topic, payload, millis()});
+      return;
+    }
+  }
+}
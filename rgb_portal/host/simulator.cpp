@@ -0,0 +1,646 @@
+// Headless whole-firmware simulator.
+//
+// Runs setup()/loop() from src/main.cpp against the host stubs on a virtual
+// clock. Visitors (random or scripted) drive the ultrasonic echo model, and
+// scripted HTTP requests and MQTT messages are injected between loop passes.
+// At the end it reports frames rendered, the loop stall distribution, state
+// transitions and publish counts.
+//
+// With --realtime the virtual clock is paced to the wall clock and UDP
+// sockets are real (127.0.0.1, port + --udp-port-offset), so external tools
+// such as tools/ddp_sender.py can stream to the simulated portal.
+//
+// Usage: simulator [--hours H] [--seed N] [--visitors-per-hour R]
+//                  [--script FILE] [--poll-ms MS] [--tick-us US]
+//                  [--spacing-cm CM] [--background-cm CM] [--scenario-s S]
+//                  [--realtime] [--udp-port-offset N] [--verbose]
+//                  [--trace FILE]   (build with make PORTAL_TRACE=1)
+//                  [--wifi-ms MS]   (WiFi connect time, -1 = AP down)
+//                  [--nvs FILE]     (NVS contents, loaded at boot, saved at the end)
+//                  [--rtc FILE]     (RTC memory: boot with a warm reset if it exists)
+//                  [--clips FILE]   (clips flash partition image, see clip_pack)
+
+#include "sim.h"
+
+#include <WebServer.h>
+#include <PubSubClient.h>
+#include "portal_fsm.h"
+#include "sensor_sampler.h"
+#include "pixel_stream.h"
+#include "udp_control.h"
+#include "passage_trace.h"
+#include "timeline.h"
+#include "async_log.h"
+#include "wifi_link.h"
+#include "rtc_snapshot.h"
+#include "clip_player.h"
+#include "sequencer.h"
+#include "transition.h"
+#include <esp_system.h>
+
+#include <vector>
+#include <string>
+#include <map>
+#include <random>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <thread>
+
+void setup();
+void loop();
+
+extern PortalMachine portal;
+extern WebServer server;
+extern PubSubClient mqttClient;
+extern PixelStream pixelStream;
+extern UdpControl control;
+extern TriggerLatency triggerLatency;
+extern PassageTracer passageTrace;
+extern BootTimes bootTimes;
+extern WifiLink wifiLink;
+extern bool warmRestart;
+extern ClipPlayer clips;
+extern Sequencer sequencer;
+extern Transition transition;
+
+namespace {
+
+struct Options {
+  double hours = 8.0;
+  uint32_t seed = 1;
+  double visitorsPerHour = 120.0;
+  std::string script;
+  unsigned long pollMs = 0;        // Dashboard polling of /state and /distance, 0 = off
+  unsigned long tickUs = 1000;     // Idle time between two loop() passes
+  double spacingCm = 30.0;         // Must match SENSOR_SPACING_CM
+  double backgroundCm = 90.0;      // What the sensor sees with nobody there, 0 = no echo
+  double scenarioSeconds = 30.0;   // Controller resets the portal this long after state 2, 0 = never
+  bool realtime = false;
+  int udpPortOffset = 0;
+  bool verbose = false;
+  std::string traceFile;           // Execution timeline (PORTAL_TRACE builds)
+  std::string nvsFile;             // NVS contents loaded at boot and saved at the end
+  std::string rtcFile;             // RTC snapshot: a warm reset into this run, saved at the end
+  std::string clipsFile;           // Clips partition contents at boot
+  double directionTolerance = -1;  // % of directions that may contradict the script, <0 = don't check
+};
+
+struct Visitor {
+  double start;       // s, first sensor reached
+  bool entering;
+  double speed;       // cm/s
+  double dwell;       // s spent in each sensor beam
+  double distance;    // cm from the sensor
+};
+
+struct ScriptEntry {
+  double time;        // s
+  std::string kind;   // http, mqtt, wifi
+  std::string a;
+  std::string b;
+};
+
+// A host streaming DDP frames to the portal. WiFi delivers them in bursts
+// of `burst` frames, each burst delayed by up to `jitter` seconds.
+struct Stream {
+  double start;       // s
+  double end;         // s
+  double fps;
+  int burst;
+  double jitter;      // s
+  uint64_t frames;    // Frames sent so far
+  double burstDelay;  // s, delay of the current burst
+  double nextDelivery;  // s, delivery time of frame `frames`, <0 = not drawn yet
+  double lastDelivery;  // s
+};
+
+Options opts;
+std::vector<Visitor> visitors;
+std::vector<ScriptEntry> script;
+std::vector<Stream> streams;
+
+// Echo width (us) for sensor `index` at time `t` seconds
+unsigned long echoFor(int index, double t) {
+  double nearest = 0;
+  for (const Visitor& v : visitors) {
+    if (v.start > t) break;  // Sorted by start
+    // Entering visitors pass the outer sensor (0) first
+    bool first = (index == 0) == v.entering;
+    double offset = first ? 0.0 : opts.spacingCm / v.speed;
+    double from = v.start + offset;
+    if (t >= from && t < from + v.dwell && (nearest == 0 || v.distance < nearest)) {
+      nearest = v.distance;
+    }
+  }
+  if (nearest == 0) nearest = opts.backgroundCm;
+  return nearest > 0 ? (unsigned long)(nearest / 0.017) : 0;
+}
+
+// The visitor who entered a beam last at or before `t` seconds
+const Visitor* visitorAt(double t) {
+  const Visitor* found = nullptr;
+  for (const Visitor& v : visitors) {
+    if (v.start > t + 0.05) break;  // Sorted by start; a sensor slot of slack
+    found = &v;
+  }
+  return found;
+}
+
+void generateVisitors(double seconds, std::mt19937& rng) {
+  std::exponential_distribution<double> arrival(opts.visitorsPerHour / 3600.0);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  std::exponential_distribution<double> linger(1.0 / 0.6);
+
+  // Trick-or-treaters come in small groups, about a second apart
+  double t = 10.0 + (opts.visitorsPerHour > 0 ? arrival(rng) : seconds);
+  while (t < seconds) {
+    int groupSize = 1 + (int)(uniform(rng) * 4);
+    bool entering = uniform(rng) < 0.6;
+    for (int i = 0; i < groupSize; i++) {
+      Visitor v;
+      v.start = t + i * (0.6 + uniform(rng) * 1.2);
+      v.entering = entering;
+      v.speed = 70.0 + uniform(rng) * 90.0;
+      v.dwell = 35.0 / v.speed + linger(rng);
+      v.distance = 20.0 + uniform(rng) * 30.0;
+      visitors.push_back(v);
+    }
+    t += arrival(rng) + groupSize * 1.5;
+  }
+}
+
+bool loadScript(const std::string& path) {
+  std::ifstream in(path);
+  if (!in) {
+    fprintf(stderr, "Cannot open script %s\n", path.c_str());
+    return false;
+  }
+  std::string line;
+  while (std::getline(in, line)) {
+    size_t hash = line.find('#');
+    if (hash != std::string::npos) line.erase(hash);
+    std::istringstream ls(line);
+    ScriptEntry e;
+    if (!(ls >> e.time >> e.kind)) continue;
+
+    if (e.kind == "stream") {
+      // <t> stream <seconds> [fps] [burst] [jitter_ms]
+      double duration = 10.0, fps = 40.0, jitterMs = 0.0;
+      int burst = 1;
+      ls >> duration >> fps >> burst >> jitterMs;
+      streams.push_back({e.time, e.time + duration, fps, std::max(burst, 1), jitterMs / 1000.0, 0, 0.0, -1.0, 0.0});
+      continue;
+    }
+    if (e.kind == "visitor") {
+      // <t> visitor in|out [speed_cm_s] [dwell_ms]
+      std::string dir;
+      double speed = 110.0, dwellMs = 900.0;
+      ls >> dir >> speed >> dwellMs;
+      visitors.push_back({e.time, dir != "out", speed, dwellMs / 1000.0, 35.0});
+      continue;
+    }
+    ls >> e.a;
+    std::getline(ls, e.b);
+    size_t first = e.b.find_first_not_of(' ');
+    e.b = first == std::string::npos ? "" : e.b.substr(first);
+    script.push_back(e);
+  }
+  return true;
+}
+
+// Send the due frames of every stream as single-packet DDP frames (a
+// scrolling gradient)
+void sendStreamFrames(double t, std::mt19937& rng) {
+  const int count = 140;
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  for (Stream& st : streams) {
+    while (true) {
+      double generated = st.start + st.frames / st.fps;
+      if (generated > st.end) break;
+      if (st.nextDelivery < 0) {
+        // Frames wait for the last frame of their burst and share its delay;
+        // delivery stays in order
+        if (st.frames % st.burst == 0) st.burstDelay = uniform(rng) * st.jitter;
+        uint64_t burstEnd = (st.frames / st.burst + 1) * st.burst - 1;
+        st.nextDelivery = std::max(st.lastDelivery, st.start + burstEnd / st.fps + st.burstDelay);
+      }
+      if (st.nextDelivery > t) break;
+
+      std::vector<uint8_t> packet(DDP_HEADER_LEN + count * 3);
+      packet[0] = DDP_FLAG_VER1 | DDP_FLAG_PUSH;
+      packet[1] = st.frames & 0x0F;
+      packet[2] = 0x0B;  // RGB, 8 bits per channel
+      packet[3] = DDP_ID_DISPLAY;
+      packet[8] = (count * 3) >> 8;
+      packet[9] = (count * 3) & 0xFF;
+      for (int i = 0; i < count; i++) {
+        uint8_t phase = (uint8_t)(i * 2 + st.frames * 3);
+        CRGB c = CRGB(phase, 255 - phase, 128);
+        memcpy(&packet[DDP_HEADER_LEN + i * 3], c.raw, 3);
+      }
+      sim::udpInject(DDP_PORT, packet.data(), packet.size());
+      st.frames++;
+      st.lastDelivery = st.nextDelivery;
+      st.nextDelivery = -1.0;
+    }
+  }
+}
+
+// `target` is a path with query arguments, optionally followed by @FILE: a
+// file upload with the contents of FILE
+SimHttpRequest parseRequest(const std::string& method, std::string target) {
+  SimHttpRequest req;
+  req.method = method == "POST" ? HTTP_POST
+             : method == "PUT"  ? HTTP_PUT
+             : method == "DELETE" ? HTTP_DELETE : HTTP_GET;
+  size_t brace = target.find(" {");
+  if (brace != std::string::npos) {
+    req.body = String(target.substr(brace + 1));
+    target = target.substr(0, brace);
+  }
+  size_t at = target.find(" @");
+  if (at != std::string::npos) {
+    req.filename = String(target.substr(at + 2));
+    std::ifstream file(target.substr(at + 2), std::ios::binary);
+    req.file.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    if (req.file.empty()) fprintf(stderr, "Cannot read %s for %s\n", req.filename.c_str(), target.c_str());
+    target = target.substr(0, at);
+  }
+  size_t q = target.find('?');
+  req.uri = String(target.substr(0, q));
+  if (q != std::string::npos) {
+    std::istringstream qs(target.substr(q + 1));
+    std::string pair;
+    while (std::getline(qs, pair, '&')) {
+      size_t eq = pair.find('=');
+      req.args.push_back({String(pair.substr(0, eq)),
+                          String(eq == std::string::npos ? "" : pair.substr(eq + 1))});
+    }
+  }
+  return req;
+}
+
+// Loop stall histogram with 100 us buckets up to 100 ms
+struct StallHistogram {
+  static const int BUCKETS = 1001;
+  std::vector<unsigned long long> counts = std::vector<unsigned long long>(BUCKETS, 0);
+  unsigned long long total = 0;
+  uint64_t maxUs = 0;
+  uint64_t sumUs = 0;
+
+  void record(uint64_t us) {
+    int b = (int)std::min<uint64_t>(us / 100, BUCKETS - 1);
+    counts[b]++;
+    total++;
+    sumUs += us;
+    if (us > maxUs) maxUs = us;
+  }
+
+  double percentileMs(double p) const {
+    unsigned long long target = (unsigned long long)(p * total);
+    unsigned long long seen = 0;
+    for (int b = 0; b < BUCKETS; b++) {
+      seen += counts[b];
+      if (seen > target) return (b + 1) * 0.1;
+    }
+    return maxUs / 1000.0;
+  }
+
+  unsigned long long countAbove(uint64_t us) const {
+    unsigned long long n = 0;
+    for (int b = (int)(us / 100); b < BUCKETS; b++) n += counts[b];
+    return n;
+  }
+};
+
+void usage() {
+  fprintf(stderr,
+          "Usage: simulator [--hours H] [--seed N] [--visitors-per-hour R] [--script FILE]\n"
+          "                 [--poll-ms MS] [--tick-us US] [--spacing-cm CM]\n"
+          "                 [--background-cm CM] [--scenario-s S] [--realtime]\n"
+          "                 [--udp-port-offset N] [--verbose] [--trace FILE]\n"
+          "                 [--wifi-ms MS] [--nvs FILE] [--rtc FILE] [--clips FILE]\n"
+          "                 [--direction-tolerance PCT]\n");
+}
+
+bool parseArgs(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    auto next = [&]() -> const char* { return i + 1 < argc ? argv[++i] : ""; };
+    if (a == "--hours") opts.hours = atof(next());
+    else if (a == "--seed") opts.seed = (uint32_t)strtoul(next(), nullptr, 10);
+    else if (a == "--visitors-per-hour") opts.visitorsPerHour = atof(next());
+    else if (a == "--script") opts.script = next();
+    else if (a == "--poll-ms") opts.pollMs = strtoul(next(), nullptr, 10);
+    else if (a == "--tick-us") opts.tickUs = strtoul(next(), nullptr, 10);
+    else if (a == "--spacing-cm") opts.spacingCm = atof(next());
+    else if (a == "--background-cm") opts.backgroundCm = atof(next());
+    else if (a == "--scenario-s") opts.scenarioSeconds = atof(next());
+    else if (a == "--realtime") opts.realtime = true;
+    else if (a == "--udp-port-offset") opts.udpPortOffset = atoi(next());
+    else if (a == "--verbose") opts.verbose = true;
+    else if (a == "--trace") opts.traceFile = next();
+    else if (a == "--wifi-ms") sim::wifiConnectDelayMs = atol(next());
+    else if (a == "--nvs") opts.nvsFile = next();
+    else if (a == "--rtc") opts.rtcFile = next();
+    else if (a == "--clips") opts.clipsFile = next();
+    else if (a == "--direction-tolerance") opts.directionTolerance = atof(next());
+    else {
+      usage();
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (!parseArgs(argc, argv)) return 2;
+
+  double seconds = opts.hours * 3600.0;
+  std::mt19937 rng(opts.seed);
+  sim::seedRandom(opts.seed);
+  sim::serialEcho = opts.verbose;
+  sim::udpRealSockets = opts.realtime;
+  sim::udpPortOffset = opts.udpPortOffset;
+
+  if (!opts.script.empty() && !loadScript(opts.script)) return 1;
+  if (!opts.nvsFile.empty()) sim::nvsLoad(opts.nvsFile.c_str());
+  if (!opts.clipsFile.empty() && !sim::clipsLoad(opts.clipsFile.c_str())) {
+    fprintf(stderr, "Cannot load clips image %s\n", opts.clipsFile.c_str());
+    return 1;
+  }
+  if (!opts.rtcFile.empty()) {
+    // RTC memory survives a software reset: the previous run "rebooted"
+    std::ifstream rtc(opts.rtcFile, std::ios::binary);
+    if (rtc.read((char*)&rtcSnapshot, sizeof(rtcSnapshot))) sim::resetReason = ESP_RST_SW;
+  }
+  generateVisitors(seconds, rng);
+  std::sort(visitors.begin(), visitors.end(),
+            [](const Visitor& x, const Visitor& y) { return x.start < y.start; });
+  std::sort(script.begin(), script.end(),
+            [](const ScriptEntry& x, const ScriptEntry& y) { return x.time < y.time; });
+
+  sim::echoModel = [](uint8_t trigPin, uint64_t nowUs) -> unsigned long {
+    for (int s = 0; s < numSensors; s++) {
+      if (sensors[s].trigPin == trigPin) return echoFor(s, nowUs / 1e6);
+    }
+    return 0;
+  };
+
+  unsigned long long frames = 0;
+  // Spacing of consecutive frames shown while streaming (frame pacing)
+  std::vector<double> streamGapsMs;
+  uint64_t lastStreamShowUs = 0;
+  sim::onShow = [&](const CRGB*, int, uint8_t) {
+    frames++;
+    if (portal.state != STREAMING) {
+      lastStreamShowUs = 0;
+      return;
+    }
+    if (lastStreamShowUs != 0) streamGapsMs.push_back((sim::nowUs() - lastStreamShowUs) / 1000.0);
+    lastStreamShowUs = sim::nowUs();
+  };
+
+  auto wallStart = std::chrono::steady_clock::now();
+  uint64_t endUs = (uint64_t)(seconds * 1e6);
+
+  setup();
+  uint64_t setupUs = sim::nowUs();
+
+  StallHistogram stalls;
+  std::map<std::string, unsigned long> transitions;
+  size_t nextScript = 0;
+  uint64_t nextPollUs = opts.pollMs ? sim::nowUs() : UINT64_MAX;
+  PortalState lastState = portal.state;
+  unsigned long long loops = 0;
+  size_t seenPublishes = 0;
+  std::vector<uint64_t> scenarioResets;  // Pending controller resets (virtual us)
+
+  while (sim::nowUs() < endUs) {
+    double t = sim::nowUs() / 1e6;
+    sendStreamFrames(t, rng);
+    while (nextScript < script.size() && script[nextScript].time <= t) {
+      const ScriptEntry& e = script[nextScript++];
+      if (e.kind == "http") {
+        server.simEnqueue(parseRequest(e.a, e.b));
+      } else if (e.kind == "mqtt") {
+        mqttClient.simInject(e.a, e.b);
+      } else if (e.kind == "wifi" && e.a == "drop") {
+        sim::wifiDrop((uint64_t)(atof(e.b.c_str()) * 1e6));
+      }
+    }
+    // Controller model: a red portal runs the scenario, then gets reset
+    auto& published = mqttClient.simPublished();
+    for (; seenPublishes < published.size(); seenPublishes++) {
+      const SimMqttMessage& m = published[seenPublishes];
+      if (opts.scenarioSeconds > 0 && m.topic == "portal/state" && m.payload == "2") {
+        scenarioResets.push_back(sim::nowUs() + (uint64_t)(opts.scenarioSeconds * 1e6));
+      }
+    }
+    for (size_t i = 0; i < scenarioResets.size();) {
+      if (scenarioResets[i] <= sim::nowUs()) {
+        server.simEnqueue(parseRequest("GET", "/reset"));
+        scenarioResets.erase(scenarioResets.begin() + i);
+      } else {
+        i++;
+      }
+    }
+    if (sim::nowUs() >= nextPollUs) {
+      server.simEnqueue(parseRequest("GET", "/state"));
+      server.simEnqueue(parseRequest("GET", "/distance"));
+      nextPollUs += (uint64_t)opts.pollMs * 1000;
+    }
+
+    uint64_t before = sim::nowUs();
+    loop();
+    logDrain();  // The firmware drains from its own task
+    stalls.record(sim::nowUs() - before);
+    loops++;
+
+    if (portal.state != lastState) {
+      transitions[std::string(portalStateName(lastState)) + " -> " + portalStateName(portal.state)]++;
+      lastState = portal.state;
+    }
+    sim::advanceUs(opts.tickUs);
+
+    if (opts.realtime) {
+      auto due = wallStart + std::chrono::microseconds(sim::nowUs());
+      if (due > std::chrono::steady_clock::now()) std::this_thread::sleep_until(due);
+    }
+  }
+
+  double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+  double simSeconds = sim::nowUs() / 1e6;
+
+  printf("=== Simulated night ===\n");
+  printf("Simulated time:     %.1f h (%.2f s wall, %.0fx real time)\n",
+         simSeconds / 3600.0, wallSeconds, simSeconds / wallSeconds);
+  printf("Seed:               %u\n", opts.seed);
+  printf("Setup:              %.1f ms\n", setupUs / 1000.0);
+  printf("Boot:               %s, first frame %lu ms, detection %lu ms, WiFi %lu ms, network %lu ms, MQTT %lu ms\n",
+         warmRestart ? "warm restart" : "cold", bootTimes.firstFrame, bootTimes.detection, bootTimes.wifi,
+         bootTimes.network, bootTimes.mqtt);
+  printf("Visitors:           %zu\n", visitors.size());
+  printf("Loop passes:        %llu\n", loops);
+  printf("Frames rendered:    %llu (%.1f fps)\n", frames, frames / simSeconds);
+
+  printf("\nLoop stall distribution:\n");
+  printf("  mean %.3f ms  p50 %.1f ms  p90 %.1f ms  p99 %.1f ms  max %.1f ms\n",
+         stalls.sumUs / 1000.0 / stalls.total, stalls.percentileMs(0.5),
+         stalls.percentileMs(0.9), stalls.percentileMs(0.99), stalls.maxUs / 1000.0);
+  const uint64_t limits[] = {1000, 5000, 10000, 20000, 30000, 50000};
+  for (uint64_t limit : limits) {
+    unsigned long long n = stalls.countAbove(limit);
+    printf("  > %2llu ms: %10llu (%.3f%%)\n", (unsigned long long)(limit / 1000), n, 100.0 * n / stalls.total);
+  }
+
+  printf("\nState transitions (%lu table matches, %lu dropped events):\n",
+         portal.transitionCount, portal.droppedEvents);
+  for (auto& kv : transitions) printf("  %-28s %lu\n", kv.first.c_str(), kv.second);
+
+  printf("\nMQTT publishes:\n");
+  for (auto& kv : mqttClient.simPublishCounts()) printf("  %-28s %lu\n", kv.first.c_str(), kv.second);
+  printf("  %-28s %lu\n", "(over the buffer size)", mqttClient.simOversized());
+
+  // Estimated direction against the way the visitor who started the passage walked
+  std::map<std::string, unsigned long> passages;
+  unsigned long directed = 0, wrongDirections = 0;
+  for (const SimMqttMessage& m : mqttClient.simPublished()) {
+    if (m.topic != "portal/passage" || m.payload.find("\"end\"") == std::string::npos) continue;
+    size_t p = m.payload.find("\"direction\":\"");
+    size_t d = m.payload.find("\"duration\":");
+    if (p == std::string::npos || d == std::string::npos) continue;
+    p += 13;
+    std::string estimated = m.payload.substr(p, m.payload.find('"', p) - p);
+    double start = (m.timeMs - strtoul(m.payload.c_str() + d + 11, nullptr, 10)) / 1000.0;
+    const Visitor* walker = visitorAt(start);
+    std::string walked = walker ? (walker->entering ? "in" : "out") : "nobody";
+    passages[estimated + " (walked " + walked + ")"]++;
+    if (estimated == "unknown") continue;
+    directed++;
+    if (estimated != walked) wrongDirections++;
+  }
+  if (!passages.empty()) {
+    printf("\nPassage directions:\n");
+    for (auto& kv : passages) printf("  %-28s %lu\n", kv.first.c_str(), kv.second);
+  }
+
+  if (pixelStream.packets + pixelStream.badPackets + pixelStream.discarded > 0) {
+    printf("\nDDP stream:         %lu frames, %lu packets, %lu bad, %lu discarded (blinks, clips)\n",
+           pixelStream.frames, pixelStream.packets, pixelStream.badPackets, pixelStream.discarded);
+    if (pixelStream.compressedFrames > 0) {
+      printf("Frame codec:        %lu frames, %.1f bytes/frame, %lu deltas skipped\n",
+             pixelStream.compressedFrames, (double)pixelStream.compressedBytes / pixelStream.compressedFrames,
+             pixelStream.deltaSkipped);
+    }
+    printf("Jitter buffer:      depth %u, %lu presented, %lu late, %lu dropped, %lu underruns, "
+           "delay %.1f ms\n", pixelStream.depth, pixelStream.presented, pixelStream.late,
+           pixelStream.dropped, pixelStream.underruns, pixelStream.bufferDelayUs / 1000.0);
+    if (streamGapsMs.size() > 1) {
+      // Gaps longer than the stream timeout are pauses between streams
+      double sum = 0, sumSq = 0, maxGap = 0;
+      size_t n = 0;
+      for (double g : streamGapsMs) {
+        if (g > 500) continue;
+        sum += g;
+        sumSq += g * g;
+        maxGap = std::max(maxGap, g);
+        n++;
+      }
+      double mean = n ? sum / n : 0;
+      printf("Frame spacing:      mean %.1f ms, stddev %.2f ms, max %.1f ms\n",
+             mean, n ? sqrt(std::max(0.0, sumSq / n - mean * mean)) : 0.0, maxGap);
+    }
+  }
+
+  if (triggerLatency.count > 0) {
+    printf("Trigger to photon:  %lu triggers, mean %.2f ms, max %.2f ms (show %.2f ms)\n", triggerLatency.count,
+           triggerLatency.totalUs / 1000.0 / triggerLatency.count, triggerLatency.maxUs / 1000.0,
+           triggerLatency.lastShowUs / 1000.0);
+  }
+  if (passageTrace.passages > 0) {
+    printf("Passage latency:    %lu passages, ms buckets", passageTrace.passages);
+    for (int i = 0; i < TRACE_HIST_BUCKETS - 1; i++) printf(" <%u", TRACE_HIST_LIMITS_MS[i]);
+    printf(" more\n");
+    const char* names[2] = {"echo to photon", "echo to MQTT"};
+    const unsigned long* hists[2] = {passageTrace.photonHist, passageTrace.mqttHist};
+    for (int h = 0; h < 2; h++) {
+      printf("  %-17s", names[h]);
+      for (int i = 0; i < TRACE_HIST_BUCKETS; i++) printf(" %lu", hists[h][i]);
+      printf("\n");
+    }
+    printf("  MQTT skipped      %lu (not connected)\n", passageTrace.mqttSkipped);
+    const PassageTrace* last = traceGet(passageTrace, 0);
+    printf("  last passage     ");
+    for (int stage = 1; stage < STAGE_COUNT; stage++) {
+      if (last->marked & (1 << stage)) {
+        printf(" %s %.2f", traceStageName(stage), (last->stageUs[stage] - last->stageUs[STAGE_ECHO]) / 1000.0);
+      }
+    }
+    printf(" ms\n");
+  }
+  if (!server.simResponses().empty()) {
+    uint64_t maxUs = 0, sumUs = 0;
+    for (const SimHttpResponse& r : server.simResponses()) {
+      sumUs += r.handlerUs;
+      if (r.handlerUs > maxUs) maxUs = r.handlerUs;
+    }
+    printf("\nHTTP requests:      %zu (handler mean %.3f ms, max %.3f ms)\n",
+           server.simResponses().size(), sumUs / 1000.0 / server.simResponses().size(), maxUs / 1000.0);
+  }
+  if (wifiLink.connects > 0) {
+    printf("WiFi:               %lu connects (%lu direct, %lu scan), %lu drops, %lu direct failures, "
+           "%lu lease renewals, mean %.0f ms, max %lu ms, %lu NVS writes\n",
+           wifiLink.connects, wifiLink.directConnects, wifiLink.scanConnects, wifiLink.drops,
+           wifiLink.directFailures, wifiLink.leaseRenewals, (double)wifiLink.totalConnectMs / wifiLink.connects,
+           wifiLink.maxConnectMs, sim::nvsWrites);
+  }
+  if (clips.framesShown + clips.errors + clips.uploads > 0) {
+    printf("Clips:              %lu frames, %lu late, %lu errors, decode mean %.3f ms, max %.3f ms, "
+           "%lu uploads\n", clips.framesShown, clips.lateFrames, clips.errors,
+           clips.framesShown ? clips.decodeUsTotal / 1000.0 / clips.framesShown : 0.0,
+           clips.decodeUsMax / 1000.0, clips.uploads);
+  }
+  if (transition.started > 0) {
+    printf("Crossfades:         %lu started, %lu blended frames\n", transition.started, transition.frames);
+  }
+  if (sequencer.started > 0) {
+    printf("Timelines:          %lu started, %lu completed, %lu aborted, %lu steps, late max %.3f ms\n",
+           sequencer.started, sequencer.completed, sequencer.aborted, sequencer.stepsFired,
+           sequencer.maxLateUs / 1000.0);
+  }
+  LogStats log = logStats();
+  printf("Log:                %lu lines, %lu dropped\n", log.written, log.dropped);
+  if (control.commands + control.challenges + control.badTags + control.badPackets > 0) {
+    printf("UDP control:        %lu commands, %lu retries, %lu stale, %lu challenges, %lu bad tags, "
+           "%lu bad packets\n", control.commands, control.retries, control.stale, control.challenges,
+           control.badTags, control.badPackets);
+  }
+  if (!opts.traceFile.empty()) {
+#if PORTAL_TRACE
+    static FILE* traceOut = fopen(opts.traceFile.c_str(), "w");
+    if (traceOut) {
+      timelineExport([](const char* data, size_t len) { fwrite(data, 1, len, traceOut); });
+      fclose(traceOut);
+      printf("Timeline:           %lu events recorded, last %d written to %s\n",
+             (unsigned long)timelineCount(), TIMELINE_EVENTS, opts.traceFile.c_str());
+    }
+#else
+    fprintf(stderr, "--trace needs a PORTAL_TRACE=1 build\n");
+#endif
+  }
+  if (!opts.nvsFile.empty()) sim::nvsSave(opts.nvsFile.c_str());
+  if (!opts.rtcFile.empty()) {
+    std::ofstream rtc(opts.rtcFile, std::ios::binary);
+    rtc.write((const char*)&rtcSnapshot, sizeof(rtcSnapshot));
+  }
+  if (opts.directionTolerance >= 0 && wrongDirections > directed * opts.directionTolerance / 100.0) {
+    fprintf(stderr, "%lu of %lu passage directions contradict the visitors (tolerance %.1f%%)\n",
+            wrongDirections, directed, opts.directionTolerance);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,193 @@
+#ifndef SIM_ARDUINO_H
+#define SIM_ARDUINO_H
+
+// Host stand-in for the Arduino core. Time is virtual: millis()/micros()
+// read the simulator clock, and blocking calls (delay, pulseIn) advance it.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+#include <string>
+#include <algorithm>
+
+using std::min;
+using std::max;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+
+#define DEC 10
+#define HEX 16
+
+#define PI 3.1415926535897932384626433832795
+#define TWO_PI 6.283185307179586476925286766559
+
+#define IRAM_ATTR
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+// Virtual clock (see sim_runtime.cpp)
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+unsigned long pulseIn(uint8_t pin, uint8_t state, unsigned long timeout = 1000000L);
+
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+uint32_t esp_random();
+
+// ESP object (chip information)
+class EspClass {
+public:
+  uint64_t getEfuseMac();  // Factory MAC, first byte in the low bits
+  uint32_t getCycleCount();  // Virtual clock at getCpuFreqMHz()
+  uint32_t getCpuFreqMHz() { return 240; }
+};
+extern EspClass ESP;
+
+template <typename T> T constrain(T x, T lo, T hi) { return x < lo ? lo : (x > hi ? hi : x); }
+inline long map(long x, long inMin, long inMax, long outMin, long outMax) {
+  return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+class String {
+public:
+  String() {}
+  String(const char* s) : s_(s ? s : "") {}
+  String(const std::string& s) : s_(s) {}
+  String(char c) : s_(1, c) {}
+  String(int v, int base = DEC) { fromLong(v, base); }
+  String(unsigned int v, int base = DEC) { fromULong(v, base); }
+  String(long v, int base = DEC) { fromLong(v, base); }
+  String(unsigned long v, int base = DEC) { fromULong(v, base); }
+  String(float v, int decimals = 2) { fromDouble(v, decimals); }
+  String(double v, int decimals = 2) { fromDouble(v, decimals); }
+
+  const char* c_str() const { return s_.c_str(); }
+  unsigned int length() const { return s_.size(); }
+  bool isEmpty() const { return s_.empty(); }
+  char operator[](unsigned int i) const { return i < s_.size() ? s_[i] : 0; }
+  char charAt(unsigned int i) const { return (*this)[i]; }
+  int indexOf(char c, unsigned int from = 0) const {
+    size_t p = s_.find(c, from);
+    return p == std::string::npos ? -1 : (int)p;
+  }
+  int indexOf(const String& str, unsigned int from = 0) const {
+    size_t p = s_.find(str.s_, from);
+    return p == std::string::npos ? -1 : (int)p;
+  }
+  String substring(unsigned int from) const { return from < s_.size() ? String(s_.substr(from)) : String(); }
+  String substring(unsigned int from, unsigned int to) const {
+    if (from >= s_.size() || to <= from) return String();
+    return String(s_.substr(from, to - from));
+  }
+  long toInt() const { return strtol(s_.c_str(), nullptr, 10); }
+  float toFloat() const { return strtof(s_.c_str(), nullptr); }
+  void trim() {
+    size_t a = s_.find_first_not_of(" \t\r\n");
+    size_t b = s_.find_last_not_of(" \t\r\n");
+    s_ = (a == std::string::npos) ? std::string() : s_.substr(a, b - a + 1);
+  }
+  bool startsWith(const String& p) const { return s_.compare(0, p.s_.size(), p.s_) == 0; }
+  bool equals(const String& o) const { return s_ == o.s_; }
+  void reserve(unsigned int n) { s_.reserve(n); }
+
+  String& operator+=(const String& o) { s_ += o.s_; return *this; }
+  String& operator+=(const char* o) { s_ += o; return *this; }
+  String& operator+=(char c) { s_ += c; return *this; }
+  String& operator+=(int v) { return *this += String(v); }
+  String& operator+=(unsigned int v) { return *this += String(v); }
+  String& operator+=(long v) { return *this += String(v); }
+  String& operator+=(unsigned long v) { return *this += String(v); }
+  String& operator+=(float v) { return *this += String(v); }
+  String& operator+=(double v) { return *this += String(v); }
+
+  friend String operator+(const String& a, const String& b) { String r(a); r += b; return r; }
+  friend String operator+(const String& a, const char* b) { String r(a); r += b; return r; }
+  friend String operator+(const char* a, const String& b) { String r(a); r += b; return r; }
+  bool operator==(const String& o) const { return s_ == o.s_; }
+  bool operator==(const char* o) const { return s_ == o; }
+  bool operator!=(const String& o) const { return s_ != o.s_; }
+  bool operator!=(const char* o) const { return s_ != o; }
+
+private:
+  void fromLong(long v, int base) {
+    if (base == DEC) { s_ = std::to_string(v); return; }
+    fromULong((unsigned long)v, base);
+  }
+  void fromULong(unsigned long v, int base) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), base == HEX ? "%lx" : "%lu", v);
+    s_ = buf;
+  }
+  void fromDouble(double v, int decimals) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.*f", decimals, v);
+    s_ = buf;
+  }
+  std::string s_;
+};
+
+class Print;
+
+class Printable {
+public:
+  virtual ~Printable() {}
+  virtual size_t printTo(Print& p) const = 0;
+};
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buf, size_t len) {
+    size_t n = 0;
+    while (len--) n += write(*buf++);
+    return n;
+  }
+  size_t print(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+  size_t print(const String& s) { return print(s.c_str()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int v, int base = DEC) { return print(String(v, base)); }
+  size_t print(unsigned int v, int base = DEC) { return print(String(v, base)); }
+  size_t print(long v, int base = DEC) { return print(String(v, base)); }
+  size_t print(unsigned long v, int base = DEC) { return print(String(v, base)); }
+  size_t print(double v, int decimals = 2) { return print(String(v, decimals)); }
+  size_t print(const Printable& x) { return x.printTo(*this); }
+  size_t println() { return print("\r\n"); }
+  template <typename T> size_t println(const T& v) { size_t n = print(v); return n + println(); }
+  template <typename T> size_t println(const T& v, int fmt) { size_t n = print(v, fmt); return n + println(); }
+  size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class HardwareSerial : public Print {
+public:
+  void begin(unsigned long baud) { (void)baud; }
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t* buf, size_t len) override;
+  int available() { return 0; }
+  int availableForWrite() { return 128; }
+  void flush() {}
+  operator bool() const { return true; }
+};
+
+extern HardwareSerial Serial;
+
+#endif
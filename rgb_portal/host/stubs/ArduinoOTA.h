@@ -0,0 +1,36 @@
+#ifndef SIM_ARDUINOOTA_H
+#define SIM_ARDUINOOTA_H
+
+#include <Arduino.h>
+#include <functional>
+
+#define U_FLASH 0
+#define U_SPIFFS 100
+
+typedef enum {
+  OTA_AUTH_ERROR,
+  OTA_BEGIN_ERROR,
+  OTA_CONNECT_ERROR,
+  OTA_RECEIVE_ERROR,
+  OTA_END_ERROR
+} ota_error_t;
+
+class ArduinoOTAClass {
+public:
+  typedef std::function<void(void)> THandlerFunction;
+  typedef std::function<void(ota_error_t)> THandlerFunction_Error;
+  typedef std::function<void(unsigned int, unsigned int)> THandlerFunction_Progress;
+
+  ArduinoOTAClass& setHostname(const char* hostname) { (void)hostname; return *this; }
+  ArduinoOTAClass& onStart(THandlerFunction fn) { (void)fn; return *this; }
+  ArduinoOTAClass& onEnd(THandlerFunction fn) { (void)fn; return *this; }
+  ArduinoOTAClass& onError(THandlerFunction_Error fn) { (void)fn; return *this; }
+  ArduinoOTAClass& onProgress(THandlerFunction_Progress fn) { (void)fn; return *this; }
+  void begin() {}
+  void handle() {}
+  int getCommand() { return U_FLASH; }
+};
+
+extern ArduinoOTAClass ArduinoOTA;
+
+#endif
@@ -0,0 +1,167 @@
+#ifndef SIM_FASTLED_H
+#define SIM_FASTLED_H
+
+// Host stand-in for the parts of FastLED the firmware uses. The color math
+// (scale8, nscale8, blend8) follows FastLED 3.6 with FASTLED_SCALE8_FIXED and
+// FASTLED_BLEND_FIXED, so frames rendered on the host are bit-exact with the
+// ESP32 build.
+
+#include <Arduino.h>
+
+typedef uint8_t fract8;
+
+inline uint8_t scale8(uint8_t i, uint8_t scale) {
+  return (uint8_t)(((uint16_t)i * (1 + (uint16_t)scale)) >> 8);
+}
+
+inline uint8_t qadd8(uint8_t i, uint8_t j) {
+  unsigned int t = i + j;
+  return t > 255 ? 255 : (uint8_t)t;
+}
+
+inline uint8_t qsub8(uint8_t i, uint8_t j) {
+  return i > j ? i - j : 0;
+}
+
+inline uint8_t blend8(uint8_t a, uint8_t b, uint8_t amountOfB) {
+  uint16_t partial = (uint16_t)((a << 8) | b);
+  partial = (uint16_t)(partial + (uint16_t)(b * amountOfB));
+  partial = (uint16_t)(partial - (uint16_t)(a * amountOfB));
+  return (uint8_t)(partial >> 8);
+}
+
+struct CRGB {
+  union {
+    struct {
+      uint8_t r;
+      uint8_t g;
+      uint8_t b;
+    };
+    uint8_t raw[3];
+  };
+
+  enum HTMLColorCode {
+    Black = 0x000000,
+    Blue = 0x0000FF,
+    Green = 0x008000,
+    Orange = 0xFFA500,
+    Purple = 0x800080,
+    Red = 0xFF0000,
+    White = 0xFFFFFF,
+    Yellow = 0xFFFF00
+  };
+
+  CRGB() : r(0), g(0), b(0) {}
+  CRGB(uint8_t ir, uint8_t ig, uint8_t ib) : r(ir), g(ig), b(ib) {}
+  CRGB(uint32_t colorcode)
+      : r((colorcode >> 16) & 0xFF), g((colorcode >> 8) & 0xFF), b(colorcode & 0xFF) {}
+  CRGB(HTMLColorCode colorcode) : CRGB((uint32_t)colorcode) {}
+
+  uint8_t& operator[](uint8_t x) { return raw[x]; }
+  const uint8_t& operator[](uint8_t x) const { return raw[x]; }
+
+  CRGB& setRGB(uint8_t nr, uint8_t ng, uint8_t nb) {
+    r = nr; g = ng; b = nb;
+    return *this;
+  }
+
+  CRGB& nscale8(uint8_t scale) {
+    r = scale8(r, scale);
+    g = scale8(g, scale);
+    b = scale8(b, scale);
+    return *this;
+  }
+
+  CRGB& fadeToBlackBy(uint8_t fadefactor) { return nscale8(255 - fadefactor); }
+
+  CRGB& operator+=(const CRGB& rhs) {
+    r = qadd8(r, rhs.r);
+    g = qadd8(g, rhs.g);
+    b = qadd8(b, rhs.b);
+    return *this;
+  }
+
+  bool operator==(const CRGB& o) const { return r == o.r && g == o.g && b == o.b; }
+  bool operator!=(const CRGB& o) const { return !(*this == o); }
+};
+
+inline CRGB& nblend(CRGB& existing, const CRGB& overlay, fract8 amountOfOverlay) {
+  if (amountOfOverlay == 0) return existing;
+  if (amountOfOverlay == 255) {
+    existing = overlay;
+    return existing;
+  }
+  existing.r = blend8(existing.r, overlay.r, amountOfOverlay);
+  existing.g = blend8(existing.g, overlay.g, amountOfOverlay);
+  existing.b = blend8(existing.b, overlay.b, amountOfOverlay);
+  return existing;
+}
+
+inline CRGB blend(const CRGB& p1, const CRGB& p2, fract8 amountOfP2) {
+  CRGB nu(p1);
+  nblend(nu, p2, amountOfP2);
+  return nu;
+}
+
+inline void nscale8(CRGB* leds, uint16_t numLeds, uint8_t scale) {
+  for (uint16_t i = 0; i < numLeds; i++) leds[i].nscale8(scale);
+}
+
+inline void fill_solid(CRGB* leds, int numToFill, const CRGB& color) {
+  for (int i = 0; i < numToFill; i++) leds[i] = color;
+}
+
+enum EOrder { RGB = 0012, RBG = 0021, GRB = 0102, GBR = 0120, BRG = 0201, BGR = 0210 };
+
+template <uint8_t DATA_PIN, EOrder RGB_ORDER> class WS2812B {};
+template <uint8_t DATA_PIN, EOrder RGB_ORDER> class WS2811 {};
+template <uint8_t DATA_PIN, EOrder RGB_ORDER> class NEOPIXEL {};
+
+#define TypicalLEDStrip 0xFFB0F0
+#define UncorrectedColor 0xFFFFFF
+
+class CLEDController {
+public:
+  CLEDController& setLeds(CRGB* data, int nLeds) {
+    leds_ = data;
+    count_ = nLeds;
+    return *this;
+  }
+  CLEDController& setCorrection(uint32_t correction) { (void)correction; return *this; }
+  CRGB* leds() { return leds_; }
+  int size() const { return count_; }
+
+private:
+  CRGB* leds_ = nullptr;
+  int count_ = 0;
+};
+
+class CFastLED {
+public:
+  template <template <uint8_t, EOrder> class CHIPSET, uint8_t DATA_PIN, EOrder RGB_ORDER>
+  CLEDController& addLeds(CRGB* data, int nLedsOrOffset, int nLedsIfOffset = 0) {
+    int n = nLedsIfOffset > 0 ? nLedsIfOffset : nLedsOrOffset;
+    controller_.setLeds(nLedsIfOffset > 0 ? data + nLedsOrOffset : data, n);
+    return controller_;
+  }
+
+  void setBrightness(uint8_t scale) { brightness_ = scale; }
+  uint8_t getBrightness() const { return brightness_; }
+  void setDither(uint8_t dither) { (void)dither; }
+  void setCorrection(uint32_t correction) { (void)correction; }
+  void show() { show(brightness_); }
+  void show(uint8_t scale);
+  void clear(bool writeData = false) {
+    fill_solid(controller_.leds(), controller_.size(), CRGB::Black);
+    if (writeData) show();
+  }
+  CLEDController& operator[](int x) { (void)x; return controller_; }
+
+private:
+  CLEDController controller_;
+  uint8_t brightness_ = 255;
+};
+
+extern CFastLED FastLED;
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef SIM_IPADDRESS_H
+#define SIM_IPADDRESS_H
+
+#include <Arduino.h>
+
+class IPAddress : public Printable {
+public:
+  IPAddress() : addr_(0) {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+      : addr_((uint32_t)a | ((uint32_t)b << 8) | ((uint32_t)c << 16) | ((uint32_t)d << 24)) {}
+  IPAddress(uint32_t addr) : addr_(addr) {}
+  operator uint32_t() const { return addr_; }
+  uint8_t operator[](int i) const { return (addr_ >> (8 * i)) & 0xFF; }
+  bool fromString(const char* s) {
+    unsigned a, b, c, d;
+    if (sscanf(s, "%u.%u.%u.%u", &a, &b, &c, &d) != 4) return false;
+    *this = IPAddress(a, b, c, d);
+    return true;
+  }
+  String toString() const {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+    return String(buf);
+  }
+  size_t printTo(Print& p) const override { return p.print(toString()); }
+
+private:
+  uint32_t addr_;
+};
+
+#endif
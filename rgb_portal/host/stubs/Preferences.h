@@ -0,0 +1,29 @@
+#ifndef SIM_PREFERENCES_H
+#define SIM_PREFERENCES_H
+
+// Host stand-in for the ESP32 Preferences (NVS) library. Entries live in
+// memory for the run; the simulator can load and save them (--nvs FILE) to
+// carry them over to the next boot.
+
+#include <Arduino.h>
+
+class Preferences {
+public:
+  bool begin(const char* name, bool readOnly = false, const char* partitionLabel = nullptr);
+  void end();
+  bool clear();
+  bool remove(const char* key);
+  bool isKey(const char* key);
+  size_t putUChar(const char* key, uint8_t value);
+  uint8_t getUChar(const char* key, uint8_t defaultValue = 0);
+  size_t putBytes(const char* key, const void* value, size_t len);
+  size_t getBytes(const char* key, void* buf, size_t maxLen);
+  size_t getBytesLength(const char* key);
+
+private:
+  String name_;
+  bool open_ = false;
+  bool readOnly_ = false;
+};
+
+#endif
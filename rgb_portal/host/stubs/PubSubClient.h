@@ -0,0 +1,63 @@
+#ifndef SIM_PUBSUBCLIENT_H
+#define SIM_PUBSUBCLIENT_H
+
+// Host stand-in for PubSubClient. Publishes are recorded by the simulator and
+// subscribed messages can be injected; they are delivered from loop(). Like
+// the library, a packet larger than the buffer (setBufferSize, default 256)
+// is not sent, or dropped on receipt without a callback.
+
+#include <Arduino.h>
+#include <functional>
+#include <vector>
+#include <deque>
+#include <map>
+
+class Client;
+
+#define MQTT_MAX_PACKET_SIZE 256
+#define MQTT_MAX_HEADER_SIZE 5
+
+#define MQTT_CALLBACK_SIGNATURE std::function<void(char*, uint8_t*, unsigned int)> callback
+
+struct SimMqttMessage {
+  std::string topic;
+  std::string payload;
+  unsigned long timeMs;
+};
+
+class PubSubClient {
+public:
+  PubSubClient() {}
+  explicit PubSubClient(Client& client) { (void)client; }
+
+  PubSubClient& setServer(const char* domain, uint16_t port) { (void)domain; (void)port; return *this; }
+  PubSubClient& setCallback(MQTT_CALLBACK_SIGNATURE) { callback_ = callback; return *this; }
+  bool setBufferSize(uint16_t size);
+  uint16_t getBufferSize() { return bufferSize_; }
+  bool connect(const char* id, const char* user = nullptr, const char* pass = nullptr);
+  void disconnect() { connected_ = false; }
+  bool connected();  // Lost with the WiFi link
+  bool loop();
+  bool publish(const char* topic, const char* payload) { return publish(topic, payload, false); }
+  bool publish(const char* topic, const char* payload, bool retained);
+  bool subscribe(const char* topic);
+  int state() { return connected_ ? 0 : -2; }
+
+  // Simulator interface
+  void simInject(const std::string& topic, const std::string& payload);
+  std::vector<SimMqttMessage>& simPublished() { return published_; }
+  std::map<std::string, unsigned long>& simPublishCounts() { return publishCounts_; }
+  unsigned long simOversized() const { return oversized_; }  // Not sent or dropped on receipt
+
+private:
+  std::function<void(char*, uint8_t*, unsigned int)> callback_;
+  bool connected_ = false;
+  uint16_t bufferSize_ = MQTT_MAX_PACKET_SIZE;
+  unsigned long oversized_ = 0;
+  std::vector<std::string> subscriptions_;
+  std::deque<SimMqttMessage> inbox_;
+  std::vector<SimMqttMessage> published_;
+  std::map<std::string, unsigned long> publishCounts_;
+};
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef SIM_WEBSERVER_H
+#define SIM_WEBSERVER_H
+
+// Host stand-in for the ESP32 synchronous WebServer. Requests are injected by
+// the simulator and dispatched to the registered handlers from handleClient(),
+// exactly like the real server does inside loop().
+
+#include <Arduino.h>
+#include <functional>
+#include <vector>
+#include <deque>
+
+typedef enum { HTTP_ANY, HTTP_GET, HTTP_HEAD, HTTP_POST, HTTP_PUT, HTTP_PATCH, HTTP_DELETE, HTTP_OPTIONS } HTTPMethod;
+
+enum HTTPUploadStatus { UPLOAD_FILE_START, UPLOAD_FILE_WRITE, UPLOAD_FILE_END, UPLOAD_FILE_ABORTED };
+
+struct HTTPUpload {
+  HTTPUploadStatus status;
+  String filename;
+  String name;
+  String type;
+  size_t totalSize;
+  size_t currentSize;
+  uint8_t buf[1436];
+};
+
+#define CONTENT_LENGTH_UNKNOWN ((size_t)-1)
+
+struct SimHttpRequest {
+  HTTPMethod method;
+  String uri;
+  std::vector<std::pair<String, String>> args;
+  String body;
+  std::vector<uint8_t> file;  // Multipart file upload, fed to the upload handler
+  String filename;
+};
+
+struct SimHttpResponse {
+  String uri;
+  int code;
+  String contentType;
+  String body;
+  unsigned long handlerUs;  // Virtual time spent inside the handler
+};
+
+class WebServer {
+public:
+  typedef std::function<void(void)> THandlerFunction;
+
+  explicit WebServer(int port = 80) : port_(port) {}
+
+  void on(const String& uri, THandlerFunction handler) { on(uri, HTTP_ANY, handler); }
+  void on(const String& uri, HTTPMethod method, THandlerFunction fn) { on(uri, method, fn, nullptr); }
+  void on(const String& uri, HTTPMethod method, THandlerFunction fn, THandlerFunction ufn);
+  void onNotFound(THandlerFunction fn) { notFound_ = fn; }
+  void begin() { started_ = true; }
+  void handleClient();
+
+  void send(int code, const char* contentType = nullptr, const String& content = String());
+  void send(int code, const String& contentType, const String& content) { send(code, contentType.c_str(), content); }
+  void sendHeader(const String& name, const String& value, bool first = false) { (void)name; (void)value; (void)first; }
+  void setContentLength(size_t len) { (void)len; }
+  void sendContent(const String& content);
+  void sendContent(const char* content, size_t len) { sendContent(String(std::string(content, len))); }
+
+  String arg(const String& name) const;
+  String arg(int i) const;
+  String argName(int i) const;
+  int args() const;
+  bool hasArg(const String& name) const;
+  HTTPMethod method() const { return current_.method; }
+  String uri() const { return current_.uri; }
+  HTTPUpload& upload() { return upload_; }
+
+  // Simulator interface
+  bool started() const { return started_; }
+  void simEnqueue(const SimHttpRequest& req) { pending_.push_back(req); }
+  std::vector<SimHttpResponse>& simResponses() { return responses_; }
+
+private:
+  struct Route {
+    String uri;
+    HTTPMethod method;
+    THandlerFunction fn;
+    THandlerFunction ufn;
+  };
+
+  int port_;
+  bool started_ = false;
+  std::vector<Route> routes_;
+  THandlerFunction notFound_;
+  std::deque<SimHttpRequest> pending_;
+  SimHttpRequest current_;
+  std::vector<SimHttpResponse> responses_;
+  HTTPUpload upload_;
+  bool streaming_ = false;
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef SIM_WIFI_H
+#define SIM_WIFI_H
+
+// Host stand-in for the ESP32 WiFi library. Association is simulated: the
+// station reports WL_CONNECTED a configurable time after begin().
+
+#include <Arduino.h>
+#include <IPAddress.h>
+#include <WiFiUdp.h>
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_CONNECTION_LOST = 5,
+  WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 } wifi_mode_t;
+
+class WiFiClass {
+public:
+  wl_status_t begin(const char* ssid, const char* passphrase = nullptr, int32_t channel = 0,
+                    const uint8_t* bssid = nullptr, bool connect = true);
+  bool config(IPAddress localIP, IPAddress gateway, IPAddress subnet,
+              IPAddress dns1 = (uint32_t)0, IPAddress dns2 = (uint32_t)0);
+  bool reconnect();
+  bool disconnect(bool wifioff = false);
+  wl_status_t status();
+  bool mode(wifi_mode_t m) { (void)m; return true; }
+  bool setAutoReconnect(bool enable) { (void)enable; return true; }
+  bool persistent(bool enable) { (void)enable; return true; }
+  bool setSleep(bool enable) { (void)enable; return true; }
+  IPAddress localIP();
+  IPAddress gatewayIP();
+  IPAddress subnetMask();
+  IPAddress dnsIP(uint8_t n = 0);
+  IPAddress broadcastIP();
+  uint8_t* BSSID();
+  int32_t channel();
+  int8_t RSSI();
+  String macAddress();
+};
+
+extern WiFiClass WiFi;
+
+class Client {
+public:
+  virtual ~Client() {}
+};
+
+class WiFiClient : public Client {};
+
+#endif
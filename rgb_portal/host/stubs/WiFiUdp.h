@@ -0,0 +1,63 @@
+#ifndef SIM_WIFIUDP_H
+#define SIM_WIFIUDP_H
+
+// Host stand-in for the ESP32 WiFiUDP class. Datagrams come from the
+// simulator (sim::udpInject) or, with sim::udpRealSockets, from a real UDP
+// socket on 127.0.0.1 so that external tools can talk to the simulator.
+
+#include <Arduino.h>
+#include <IPAddress.h>
+#include <vector>
+#include <deque>
+
+struct SimUdpDatagram {
+  uint16_t port;             // Destination port
+  IPAddress remoteIP;
+  uint16_t remotePort;
+  std::vector<uint8_t> data;
+};
+
+class WiFiUDP : public Print {
+public:
+  WiFiUDP() {}
+  ~WiFiUDP() { stop(); }
+
+  uint8_t begin(uint16_t port);
+  uint8_t begin(IPAddress ip, uint16_t port) { (void)ip; return begin(port); }
+  void stop();
+
+  int beginPacket(IPAddress ip, uint16_t port);
+  int beginPacket(const char* host, uint16_t port);
+  int endPacket();
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t* buf, size_t len) override;
+
+  int parsePacket();
+  int available() { return (int)(current_.size() - readPos_); }
+  int read();
+  int read(unsigned char* buf, size_t len);
+  int read(char* buf, size_t len) { return read((unsigned char*)buf, len); }
+  int peek() { return available() > 0 ? current_[readPos_] : -1; }
+  void flush() { readPos_ = current_.size(); }
+
+  IPAddress remoteIP() { return remoteIP_; }
+  uint16_t remotePort() { return remotePort_; }
+
+  // Simulator interface
+  uint16_t simPort() const { return port_; }
+  void simDeliver(const SimUdpDatagram& d) { rx_.push_back(d); }
+
+private:
+  uint16_t port_ = 0;
+  int fd_ = -1;
+  std::deque<SimUdpDatagram> rx_;
+  std::vector<uint8_t> current_;
+  size_t readPos_ = 0;
+  IPAddress remoteIP_;
+  uint16_t remotePort_ = 0;
+
+  SimUdpDatagram tx_;
+  bool txOpen_ = false;
+};
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef SIM_ESP_TIMER_H
+#define SIM_ESP_TIMER_H
+
+#include <Arduino.h>
+
+// 64-bit microseconds since boot (virtual clock)
+int64_t esp_timer_get_time();
+
+#endif
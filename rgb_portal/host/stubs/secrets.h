@@ -0,0 +1,15 @@
+#ifndef SECRETS_H
+#define SECRETS_H
+
+// Fixed credentials for the host simulator (never used on a real network)
+#define WIFI_SSID "sim-ssid"
+#define WIFI_PASSWORD "sim-password"
+
+#define MQTT_SERVER "127.0.0.1"
+#define MQTT_PORT 1883
+#define MQTT_USER ""
+#define MQTT_PASSWORD ""
+
+#define CONTROL_KEY "000102030405060708090a0b0c0d0e0f"
+
+#endif
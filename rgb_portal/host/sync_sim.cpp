@@ -0,0 +1,258 @@
+// Multi-portal time sync simulation.
+//
+// Runs several portals' time sync (src/time_sync.cpp, unchanged) on one
+// simulated network: every portal has its own crystal (offset, frequency
+// error, slow wander), boot time and loop period, and datagrams between
+// the WiFiUDP stubs get a WiFi-like delay (base + exponential queueing,
+// independent per direction) and random loss. Every 10 ms of true time the
+// shared clock of each locked follower is compared with the master's and
+// with the 75 ms animation step it would render.
+//
+// Usage: sync_sim [--portals N] [--minutes M] [--seed N] [--ppm P]
+//                 [--delay-ms D] [--jitter-ms J] [--loss F] [--loop-ms L]
+//                 [--warmup-s S] [--fail-master-s S]
+
+#include "sim.h"
+#include "time_sync.h"
+
+#include <vector>
+#include <string>
+#include <queue>
+#include <random>
+#include <algorithm>
+#include <memory>
+
+namespace {
+
+struct Options {
+  int portals = 4;
+  double minutes = 30.0;
+  uint32_t seed = 1;
+  double ppm = 30.0;          // Crystal error, uniform +-ppm
+  double delayMs = 1.5;       // One-way base delay
+  double jitterMs = 4.0;      // Mean of the exponential queueing delay
+  double loss = 0.02;
+  double loopMs = 5.0;        // Mean loop() period of a portal
+  double warmupSeconds = 60.0;
+  double failMasterSeconds = 0;  // Take the master offline at this time, 0 = never
+};
+
+const uint64_t TICK_US = 100;
+const uint64_t SAMPLE_US = 10000;
+const int ANIMATION_STEP_MS = 75;  // ANIMATION_SPEED in main.cpp
+const double CONVERGED_US = 5000;  // All followers this close to the master
+
+struct Portal {
+  TimeSync sync;
+  IPAddress ip;
+  double bootSeconds;
+  double ppm;           // Current frequency error
+  double localUs;       // Local clock, advanced per tick
+  double nextPollUs;    // True time of the next loop pass
+  bool online = true;
+};
+
+struct InFlight {
+  double arrivalUs;
+  int to;
+  SimUdpDatagram datagram;
+  bool operator>(const InFlight& o) const { return arrivalUs > o.arrivalUs; }
+};
+
+Options opts;
+std::vector<std::unique_ptr<Portal>> portals;
+std::priority_queue<InFlight, std::vector<InFlight>, std::greater<InFlight>> network;
+std::mt19937 rng;
+int sender = -1;       // Portal inside timeSyncPoll()
+double trueUs = 0;
+unsigned long sent = 0, dropped = 0;
+
+void route(const SimUdpDatagram& d) {
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+  std::exponential_distribution<double> queueing(1.0 / (opts.jitterMs * 1000.0));
+  for (size_t i = 0; i < portals.size(); i++) {
+    if ((int)i == sender || !portals[i]->online) continue;
+    bool broadcast = d.remoteIP == WiFi.broadcastIP();
+    if (!broadcast && d.remoteIP != portals[i]->ip) continue;
+    sent++;
+    if (unit(rng) < opts.loss) {
+      dropped++;
+      continue;
+    }
+    SimUdpDatagram arriving = {d.port, portals[sender]->ip, d.remotePort, d.data};
+    network.push({trueUs + opts.delayMs * 1000.0 + queueing(rng), (int)i, arriving});
+  }
+}
+
+int masterIndex() {
+  for (size_t i = 0; i < portals.size(); i++) {
+    if (portals[i]->online && portals[i]->sync.role == SYNC_MASTER) return (int)i;
+  }
+  return -1;
+}
+
+double percentile(std::vector<double>& v, double p) {
+  if (v.empty()) return 0;
+  size_t k = std::min(v.size() - 1, (size_t)(p * v.size()));
+  std::nth_element(v.begin(), v.begin() + k, v.end());
+  return v[k];
+}
+
+void usage() {
+  fprintf(stderr,
+          "Usage: sync_sim [--portals N] [--minutes M] [--seed N] [--ppm P]\n"
+          "                [--delay-ms D] [--jitter-ms J] [--loss F] [--loop-ms L]\n"
+          "                [--warmup-s S] [--fail-master-s S]\n");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    const char* v = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (!v) { usage(); return 2; }
+    if (a == "--portals") opts.portals = std::max(2, atoi(v));
+    else if (a == "--minutes") opts.minutes = atof(v);
+    else if (a == "--seed") opts.seed = strtoul(v, nullptr, 10);
+    else if (a == "--ppm") opts.ppm = atof(v);
+    else if (a == "--delay-ms") opts.delayMs = atof(v);
+    else if (a == "--jitter-ms") opts.jitterMs = atof(v);
+    else if (a == "--loss") opts.loss = atof(v);
+    else if (a == "--loop-ms") opts.loopMs = atof(v);
+    else if (a == "--warmup-s") opts.warmupSeconds = atof(v);
+    else if (a == "--fail-master-s") opts.failMasterSeconds = atof(v);
+    else { usage(); return 2; }
+    i++;
+  }
+
+  rng.seed(opts.seed);
+  sim::serialEcho = false;
+  sim::onUdpSend = route;
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+  std::normal_distribution<double> wander(0.0, 0.02);  // ppm per second
+
+  for (int i = 0; i < opts.portals; i++) {
+    std::unique_ptr<Portal> p(new Portal());
+    p->ip = IPAddress(10, 0, 0, 10 + i);
+    p->bootSeconds = unit(rng) * 10.0;
+    p->ppm = (unit(rng) * 2.0 - 1.0) * opts.ppm;
+    p->localUs = 0;
+    p->nextPollUs = p->bootSeconds * 1e6;
+    portals.push_back(std::move(p));
+  }
+
+  const double endUs = opts.minutes * 60e6;
+  const double warmupUs = opts.warmupSeconds * 1e6;
+  std::vector<double> errorsUs;
+  unsigned long samples = 0, stepMismatches = 0, unsynced = 0;
+  double maxErrorUs = 0, lockedAtUs = -1, failedAtUs = -1, relockedAtUs = -1;
+  double lastSampleUs = 0, lastWanderUs = 0;
+  int failedMaster = -1;
+
+  for (trueUs = 0; trueUs < endUs; trueUs += TICK_US) {
+    for (auto& p : portals) {
+      if (trueUs >= p->bootSeconds * 1e6) p->localUs += TICK_US * (1.0 + p->ppm * 1e-6);
+    }
+    if (trueUs - lastWanderUs >= 1e6) {
+      for (auto& p : portals) p->ppm += wander(rng);
+      lastWanderUs = trueUs;
+    }
+
+    if (opts.failMasterSeconds > 0 && failedMaster < 0 && trueUs >= opts.failMasterSeconds * 1e6) {
+      failedMaster = masterIndex();
+      if (failedMaster >= 0) {
+        portals[failedMaster]->online = false;
+        failedAtUs = trueUs;
+      }
+    }
+
+    while (!network.empty() && network.top().arrivalUs <= trueUs) {
+      const InFlight& f = network.top();
+      if (portals[f.to]->online) portals[f.to]->sync.udp.simDeliver(f.datagram);
+      network.pop();
+    }
+
+    for (size_t i = 0; i < portals.size(); i++) {
+      Portal& p = *portals[i];
+      if (!p.online || trueUs < p.nextPollUs) continue;
+      if (p.sync.udp.simPort() == 0) {
+        // Booting: node IDs are the low MAC bytes, effectively random
+        timeSyncBegin(p.sync, (uint32_t)rng(), TIME_SYNC_PORT, (uint64_t)p.localUs);
+      }
+      sender = (int)i;
+      timeSyncPoll(p.sync, (uint64_t)p.localUs);
+      sender = -1;
+      std::exponential_distribution<double> loopPeriod(1.0 / (opts.loopMs * 1000.0));
+      p.nextPollUs = trueUs + 1000.0 + loopPeriod(rng);
+    }
+
+    if (trueUs - lastSampleUs < SAMPLE_US) continue;
+    lastSampleUs = trueUs;
+    int m = masterIndex();
+    if (m < 0) continue;
+    int64_t masterShared = timeSyncNow(portals[m]->sync, (uint64_t)portals[m]->localUs);
+    int64_t masterStep = masterShared / 1000 / ANIMATION_STEP_MS;
+    bool allLocked = true;
+    double worst = 0;
+    for (size_t i = 0; i < portals.size(); i++) {
+      Portal& p = *portals[i];
+      if ((int)i == m || !p.online || trueUs < p.bootSeconds * 1e6) continue;
+      if (!timeSyncShared(p.sync)) {
+        allLocked = false;
+        if (trueUs >= warmupUs) unsynced++;
+        continue;
+      }
+      int64_t shared = timeSyncNow(p.sync, (uint64_t)p.localUs);
+      double error = (double)(shared - masterShared);
+      worst = std::max(worst, std::abs(error));
+      if (trueUs >= warmupUs && (failedAtUs < 0 || relockedAtUs >= 0)) {
+        errorsUs.push_back(std::abs(error));
+        maxErrorUs = std::max(maxErrorUs, std::abs(error));
+        samples++;
+        if (shared / 1000 / ANIMATION_STEP_MS != masterStep) stepMismatches++;
+      }
+    }
+    if (allLocked && worst < CONVERGED_US) {
+      if (lockedAtUs < 0) lockedAtUs = trueUs;
+      if (failedAtUs >= 0 && relockedAtUs < 0) relockedAtUs = trueUs;
+    }
+  }
+
+  printf("Portals:            %d, %.0f min, crystals +-%.0f ppm, delay %.1f ms + exp(%.1f ms), loss %.0f%%\n",
+         opts.portals, opts.minutes, opts.ppm, opts.delayMs, opts.jitterMs, opts.loss * 100);
+  for (size_t i = 0; i < portals.size(); i++) {
+    Portal& p = *portals[i];
+    printf("  %-9s %08x  %-8s crystal %+6.1f ppm, correction %+8.3f ppm, %lu exchanges, %lu steps, %lu lost\n",
+           p.ip.toString().c_str(), p.sync.nodeId, p.online ? timeSyncRoleName(p.sync.role) : "offline",
+           p.ppm, p.sync.freqPpb / 1000.0, p.sync.exchanges, p.sync.steps, p.sync.lost);
+  }
+  printf("Datagrams:          %lu sent, %lu lost\n", sent, dropped);
+  if (lockedAtUs >= 0) {
+    printf("Converged (<%.0f ms): %.1f s after start\n", CONVERGED_US / 1000, lockedAtUs / 1e6);
+  } else {
+    printf("Converged (<%.0f ms): never\n", CONVERGED_US / 1000);
+  }
+  if (failedAtUs >= 0) {
+    printf("Master failover:    %s offline at %.0f s, relocked %s\n",
+           portals[failedMaster]->ip.toString().c_str(), failedAtUs / 1e6,
+           relockedAtUs >= 0 ? (std::to_string((relockedAtUs - failedAtUs) / 1e6).substr(0, 4) + " s later").c_str()
+                             : "never");
+  }
+
+  double mean = 0;
+  for (double e : errorsUs) mean += e;
+  mean = errorsUs.empty() ? 0 : mean / errorsUs.size();
+  double p50 = percentile(errorsUs, 0.50), p99 = percentile(errorsUs, 0.99);
+  printf("Phase error:        mean %.0f us, p50 %.0f us, p99 %.0f us, max %.0f us (%lu samples after %.0f s)\n",
+         mean, p50, p99, maxErrorUs, samples, opts.warmupSeconds);
+  printf("Animation steps:    %.3f%% of samples on a different %d ms step than the master, %lu unsynced\n",
+         samples ? 100.0 * stepMismatches / samples : 0.0, ANIMATION_STEP_MS, unsynced);
+  double spread = 0;
+  for (auto& a : portals) {
+    for (auto& b : portals) spread = std::max(spread, a->ppm - b->ppm);
+  }
+  printf("Free-running:       %.0f ppm apart = %.0f ms after %.0f min (%.0f animation steps)\n",
+         spread, spread * opts.minutes * 60e-3, opts.minutes, spread * opts.minutes * 60e-3 / ANIMATION_STEP_MS);
+  return lockedAtUs >= 0 ? 0 : 1;
+}
@@ -0,0 +1,213 @@
+// Crossfade benchmark.
+//
+// For every pair of portal states, runs the frames of a fade the way the
+// firmware does (transition.h): the incoming state renders as usual, goes
+// through the output LUT and is blended with the frozen outgoing frame in
+// one pass. Times each frame against a hard cut (render + LUT) and against
+// a naive crossfade that renders both effects every frame. The extra cost
+// of a fade must stay one blend pass; the first fade frame must be the
+// frozen frame and the frame after the fade the hard cut, bit for bit.
+//
+// State sources, as in main.cpp: ROTATING and the blinks (with a spark
+// burst) are rendered, PLAYING decodes delta-coded frames like the clip
+// player, STREAMING copies received frames into leds[].
+//
+// Usage: transition_bench [--fade-ms MS] [--frame-ms MS] [--repeat N]
+
+#include "effect_sequences.h"
+#include "effects.h"
+#include "frame_codec.h"
+#include "output_lut.h"
+#include "particles.h"
+#include "portal_fsm.h"
+#include "portal_geometry.h"
+#include "transition.h"
+
+#include <chrono>
+
+namespace {
+
+const int NUM_LEDS = SEQUENCE_NUM_LEDS;
+const BlinkConfig redBlinkConfig = {CRGB::Red, 5, 200, true};
+const BlinkConfig greenBlinkConfig = {CRGB::Green, 0, 0, true};
+
+const PortalState STATES[] = {ROTATING, BLINK_RED, BLINK_GREEN, STREAMING, PLAYING};
+const int NUM_STATES = sizeof(STATES) / sizeof(STATES[0]);
+
+PortalGeometry geometry;
+Transition transition;  // Frozen frame inside, keep it off the stack
+
+// One state's frame source, advanced a frame per render()
+struct StateSource {
+  PortalState state;
+  RotatingAnimation rotating;
+  unsigned long elapsedMs;
+  size_t frame;
+  ParticlePool sparks;
+  const std::vector<Frame>* streamFrames;
+  std::vector<std::vector<uint8_t>> clipFrames;  // Keyframe, then deltas
+
+  void render(CRGB* leds, int frameMs) {
+    switch (state) {
+      case ROTATING:
+        renderRotating(leds, geometry, rotating.position, rotatingBaseColor(rotating.colorPhase,
+                       CRGB(0, 0, 255), CRGB(128, 0, 255), CRGB(255, 0, 128)));
+        rotatingStep(rotating, NUM_LEDS, 0.025, true);
+        break;
+      case BLINK_RED:
+      case BLINK_GREEN: {
+        const BlinkConfig& c = state == BLINK_RED ? redBlinkConfig : greenBlinkConfig;
+        renderBlink(leds, NUM_LEDS, c, elapsedMs, elapsedMs > portalBlinkDuration(c));
+        particlesUpdate(sparks, NUM_LEDS, frameMs);
+        renderSparks(leds, NUM_LEDS, sparks, 64);
+        break;
+      }
+      case STREAMING:
+        memcpy(leds, (*streamFrames)[frame % streamFrames->size()].data(), NUM_LEDS * sizeof(CRGB));
+        break;
+      case PLAYING: {
+        const std::vector<uint8_t>& f = clipFrames[frame % clipFrames.size()];
+        FrameMemorySource src = {f.data(), f.size(), 0};
+        frameDecode(src, leds, NUM_LEDS);
+        break;
+      }
+    }
+    elapsedMs += frameMs;
+    frame++;
+  }
+};
+
+StateSource makeSource(PortalState state, const std::vector<Sequence>& sequences) {
+  StateSource s = {state, {0, 0.0, 1.0}, 0, 0, ParticlePool(), nullptr, {}};
+  particlesInit(s.sparks, 1);
+  particlesBurst(s.sparks, 0, 24, state == BLINK_RED ? CRGB::Red : CRGB::Green, 40, 120, 900);
+  for (const Sequence& seq : sequences) {
+    if (seq.name == "sparks") s.streamFrames = &seq.frames;
+    if (seq.name != "machine") continue;
+    std::vector<uint8_t> buf(FRAME_MAX_ENCODED(NUM_LEDS));
+    for (size_t i = 0; i < seq.frames.size(); i++) {
+      size_t n = frameEncode(seq.frames[i].data(), i ? seq.frames[i - 1].data() : nullptr, NUM_LEDS,
+                             buf.data(), buf.size());
+      s.clipFrames.push_back(std::vector<uint8_t>(buf.begin(), buf.begin() + n));
+    }
+  }
+  return s;
+}
+
+double nsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int fadeMs = 250;  // FADE_MS
+  int frameMs = 20;  // FADE_FRAME_MS
+  int repeat = 2000;
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    const char* v = i + 1 < argc ? argv[++i] : "";
+    if (a == "--fade-ms") fadeMs = std::max(1, std::min(5000, atoi(v)));
+    else if (a == "--frame-ms") frameMs = std::max(1, atoi(v));
+    else if (a == "--repeat") repeat = std::max(1, atoi(v));
+    else {
+      fprintf(stderr, "Usage: transition_bench [--fade-ms MS] [--frame-ms MS] [--repeat N]\n");
+      return 2;
+    }
+  }
+
+  geometryBuildArch(geometry, NUM_LEDS, 1000, 1600);
+  OutputLut lut;
+  outputLutBuild(lut, 2.2f, CRGB(255, 255, 255));
+  std::vector<Sequence> sequences = renderEffectSequences();
+  int fadeFrames = (fadeMs + frameMs - 1) / frameMs;
+
+  printf("%d LEDs, %d ms fade, %d ms frames (%d per fade), %d fades per pair\n",
+         NUM_LEDS, fadeMs, frameMs, fadeFrames, repeat);
+  printf("%-12s %-12s %10s %10s %10s %10s %10s\n",
+         "from", "to", "cut ns", "fade ns", "extra ns", "naive ns", "naive extra");
+
+  // A leds[] per source: clip and stream frames are deltas against it
+  CRGB cutLeds[NUM_LEDS], fadeLeds[NUM_LEDS], naiveLeds[NUM_LEDS], naiveFromLeds[NUM_LEDS];
+  CRGB fromLeds[NUM_LEDS], fromOut[NUM_LEDS], out[NUM_LEDS], cut[NUM_LEDS], naiveOut[NUM_LEDS];
+  bool ok = true;
+  double maxExtra = 0, blendTotal = 0;
+  long blendCount = 0;
+  uint32_t checksum = 0;
+  for (int a = 0; a < NUM_STATES; a++) {
+    for (int b = 0; b < NUM_STATES; b++) {
+      if (a == b) continue;
+      StateSource from = makeSource(STATES[a], sequences);
+      StateSource to = makeSource(STATES[b], sequences);
+      StateSource cutTo = to;
+      StateSource naiveFrom = from;
+      StateSource naiveTo = to;
+
+      double cutNs = 0, fadeNs = 0, naiveNs = 0;
+      for (int r = 0; r < repeat; r++) {
+        // The outgoing frame on the strip when the state changes
+        from.render(fromLeds, frameMs);
+        outputLutApply(lut, fromLeds, fromOut, NUM_LEDS);
+        transitionStart(transition, fromOut, NUM_LEDS, (uint16_t)fadeMs, 0);
+
+        for (int f = 0; f <= fadeFrames; f++) {
+          unsigned long nowMs = (unsigned long)f * frameMs;
+
+          auto start = std::chrono::steady_clock::now();
+          cutTo.render(cutLeds, frameMs);
+          outputLutApply(lut, cutLeds, cut, NUM_LEDS);
+          cutNs += nsSince(start);
+
+          start = std::chrono::steady_clock::now();
+          to.render(fadeLeds, frameMs);
+          outputLutApply(lut, fadeLeds, out, NUM_LEDS);
+          transitionApply(transition, out, NUM_LEDS, nowMs);
+          fadeNs += nsSince(start);
+
+          // Both effects live, blended before the LUT
+          start = std::chrono::steady_clock::now();
+          naiveFrom.render(naiveFromLeds, frameMs);
+          naiveTo.render(naiveLeds, frameMs);
+          memcpy(naiveOut, naiveLeds, sizeof(naiveOut));
+          transitionBlend(naiveFromLeds, naiveOut, NUM_LEDS, transitionAmount(nowMs, (uint16_t)fadeMs));
+          outputLutApply(lut, naiveOut, naiveOut, NUM_LEDS);
+          naiveNs += nsSince(start);
+          checksum += naiveOut[f % NUM_LEDS].r;
+
+          bool expected = f == 0 ? memcmp(out, fromOut, sizeof(out)) == 0
+                        : f == fadeFrames ? memcmp(out, cut, sizeof(out)) == 0 : true;
+          if (!expected && ok) {
+            fprintf(stderr, "%s -> %s: frame %d of the fade is not the %s frame\n", portalStateName(STATES[a]),
+                    portalStateName(STATES[b]), f, f == 0 ? "frozen" : "incoming");
+            ok = false;
+          }
+        }
+        if (transition.active) {
+          fprintf(stderr, "%s -> %s: fade still running after %d ms\n", portalStateName(STATES[a]),
+                  portalStateName(STATES[b]), fadeFrames * frameMs);
+          ok = false;
+        }
+      }
+      // The sources render the same frames in the same order, so the
+      // difference is the fade alone
+      double frames = (double)repeat * (fadeFrames + 1);
+      double extra = (fadeNs - cutNs) / frames;
+      maxExtra = std::max(maxExtra, extra);
+      printf("%-12s %-12s %10.0f %10.0f %10.0f %10.0f %10.0f\n", portalStateName(STATES[a]),
+             portalStateName(STATES[b]), cutNs / frames, fadeNs / frames, extra, naiveNs / frames,
+             naiveNs / frames - cutNs / frames);
+    }
+  }
+
+  // One blend pass on its own, for comparison with the extra cost above
+  for (int r = 0; r < repeat * 10; r++) {
+    auto start = std::chrono::steady_clock::now();
+    transitionBlend(fromOut, out, NUM_LEDS, (uint8_t)r);
+    blendTotal += nsSince(start);
+    blendCount++;
+    checksum += out[r % NUM_LEDS].g;
+  }
+  printf("blend pass %.0f ns, largest fade extra %.0f ns per frame (checksum %u)\n",
+         blendTotal / blendCount, maxExtra, checksum);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,40 @@
+#ifndef UNIT_TEST_H
+#define UNIT_TEST_H
+
+// Minimal checks for the host unit tests (*_test.cpp): a failed CHECK
+// prints the expression and its location and the test exits non-zero
+// through unitTestResult() once all checks have run.
+
+#include <stdio.h>
+
+inline int& unitTestFailures() {
+  static int failures = 0;
+  return failures;
+}
+
+inline int& unitTestChecks() {
+  static int checks = 0;
+  return checks;
+}
+
+#define CHECK(cond) CHECK_MSG(cond, "%s", "")
+
+// Extra printf-style context for table-driven checks
+#define CHECK_MSG(cond, fmt, ...)                                               \
+  do {                                                                          \
+    unitTestChecks()++;                                                         \
+    if (!(cond)) {                                                              \
+      unitTestFailures()++;                                                     \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed ", __FILE__, __LINE__, #cond);   \
+      fprintf(stderr, fmt, __VA_ARGS__);                                        \
+      fprintf(stderr, "\n");                                                    \
+    }                                                                           \
+  } while (0)
+
+// Summary line and exit status for main()
+inline int unitTestResult(const char* name) {
+  printf("%s: %d checks, %d failed\n", name, unitTestChecks(), unitTestFailures());
+  return unitTestFailures() == 0 ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,197 @@
+#include "async_log.h"
+#include <WiFi.h>
+#include <WiFiUdp.h>
+
+#ifdef ARDUINO_ARCH_ESP32
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#endif
+
+// Bounded multi-producer ring: a slot whose seq equals the reserving
+// position is free, seq == position + 1 means it holds a committed entry
+static LogEntry ring[LOG_RING_SIZE];
+static std::atomic<uint32_t> head(0);     // Next position to reserve
+static uint32_t tail = 0;                 // Next position to drain (drain task only)
+static std::atomic<uint32_t> dropped(0);
+static uint32_t written = 0;
+static bool ringReady = false;
+
+static WiFiUDP syslogUdp;
+static const char* syslogHost = "";
+
+static void ringInit() {
+  for (uint32_t i = 0; i < LOG_RING_SIZE; i++) {
+    ring[i].seq.store(i, std::memory_order_relaxed);
+  }
+  ringReady = true;
+}
+
+LogEntry* logReserve(uint8_t level, const char* format) {
+  if (!ringReady) {
+    return nullptr;
+  }
+  uint32_t pos = head.load(std::memory_order_relaxed);
+  for (;;) {
+    LogEntry& e = ring[pos % LOG_RING_SIZE];
+    int32_t diff = (int32_t)(e.seq.load(std::memory_order_acquire) - pos);
+    if (diff == 0) {
+      if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        e.pos = pos;
+        e.format = format;
+        e.time = millis();
+        e.level = level;
+        e.argc = 0;
+        e.textUsed = 0;
+        return &e;
+      }
+    } else if (diff < 0) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    } else {
+      pos = head.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+void logCommit(LogEntry* e) {
+  e->seq.store(e->pos + 1, std::memory_order_release);
+}
+
+void logPut(LogEntry& e, const String& v) {
+  LogArg a;
+  a.u = e.textUsed;
+  size_t room = LOG_TEXT_SIZE - e.textUsed;
+  if (room == 0) {
+    a.u = LOG_TEXT_SIZE - 1;  // Points at the terminator of the last copy
+  } else {
+    size_t n = v.length() < room - 1 ? v.length() : room - 1;
+    memcpy(e.text + e.textUsed, v.c_str(), n);
+    e.text[e.textUsed + n] = '\0';
+    e.textUsed += n + 1;
+  }
+  logPut(e, LOG_ARG_TEXT, a);
+}
+
+// Format one conversion spec (without length modifiers) with the argument
+static int formatArg(char* out, size_t size, const char* spec, char conv, const LogEntry& e, int i) {
+  if (i >= e.argc) {
+    return snprintf(out, size, "?");
+  }
+  const LogArg& a = e.args[i];
+  LogArgType type = e.types[i];
+  if (conv == 's') {
+    const char* s = type == LOG_ARG_TEXT ? e.text + a.u : (type == LOG_ARG_STR && a.s ? a.s : "?");
+    return snprintf(out, size, spec, s);
+  }
+  if (conv == 'f' || conv == 'g' || conv == 'e') {
+    double v = type == LOG_ARG_FLOAT ? a.f : (type == LOG_ARG_INT ? a.i : (double)a.u);
+    return snprintf(out, size, spec, v);
+  }
+  if (conv == 'u' || conv == 'x' || conv == 'X') {
+    unsigned v = type == LOG_ARG_FLOAT ? (unsigned)a.f : a.u;
+    return snprintf(out, size, spec, v);
+  }
+  int v = type == LOG_ARG_FLOAT ? (int)a.f : a.i;
+  return snprintf(out, size, spec, v);
+}
+
+// printf-style formatting of an entry, one conversion at a time
+static size_t formatEntry(char* out, size_t size, const LogEntry& e) {
+  size_t used = 0;
+  int argIndex = 0;
+  const char* p = e.format;
+  while (*p && used + 1 < size) {
+    if (*p != '%') {
+      out[used++] = *p++;
+      continue;
+    }
+    if (p[1] == '%') {
+      out[used++] = '%';
+      p += 2;
+      continue;
+    }
+    char spec[16];
+    size_t n = 0;
+    spec[n++] = *p++;
+    while (*p && strchr("-+ #0123456789.", *p) && n < sizeof(spec) - 2) {
+      spec[n++] = *p++;
+    }
+    while (*p == 'l' || *p == 'h' || *p == 'z') {
+      p++;  // Arguments are stored as 32-bit values, formatted as int/unsigned/double
+    }
+    if (!*p) {
+      break;
+    }
+    char conv = *p++;
+    spec[n++] = conv;
+    spec[n] = '\0';
+    int w = formatArg(out + used, size - used, spec, conv, e, argIndex++);
+    if (w > 0) {
+      used += (size_t)w < size - used ? (size_t)w : size - used - 1;
+    }
+  }
+  out[used] = '\0';
+  return used;
+}
+
+static void sendSyslog(uint8_t level, const char* line) {
+  if (!syslogHost[0] || WiFi.status() != WL_CONNECTED) {
+    return;
+  }
+  // Facility local0, severity from the level (err, warning, info, debug)
+  static const uint8_t severity[] = {7, 3, 4, 6, 7};
+  char packet[200];
+  int n = snprintf(packet, sizeof(packet), "<%d>portal: %s", 16 * 8 + severity[level <= 4 ? level : 4], line);
+  if (n <= 0) {
+    return;
+  }
+  syslogUdp.beginPacket(syslogHost, LOG_SYSLOG_PORT);
+  syslogUdp.write((const uint8_t*)packet, (size_t)n < sizeof(packet) ? n : sizeof(packet) - 1);
+  syslogUdp.endPacket();
+}
+
+int logDrain() {
+  int count = 0;
+  char line[160];
+  for (;;) {
+    LogEntry& e = ring[tail % LOG_RING_SIZE];
+    if (e.seq.load(std::memory_order_acquire) != tail + 1) {
+      break;
+    }
+    formatEntry(line, sizeof(line), e);
+    uint8_t level = e.level;
+    e.seq.store(tail + LOG_RING_SIZE, std::memory_order_release);
+    tail++;
+
+    Serial.println(line);
+    sendSyslog(level, line);
+    written++;
+    count++;
+  }
+  return count;
+}
+
+LogStats logStats() {
+  LogStats stats = {written, dropped.load(std::memory_order_relaxed)};
+  return stats;
+}
+
+#ifdef ARDUINO_ARCH_ESP32
+static void logTask(void* arg) {
+  for (;;) {
+    if (logDrain() == 0) {
+      vTaskDelay(pdMS_TO_TICKS(10));
+    }
+  }
+}
+#endif
+
+void logBegin(const char* host) {
+  ringInit();
+  syslogHost = host ? host : "";
+#ifdef ARDUINO_ARCH_ESP32
+  // Core 0 next to the WiFi stack, below its priority: formatting and UART
+  // output never take time from loop() on core 1
+  xTaskCreatePinnedToCore(logTask, "log", 3072, nullptr, 1, nullptr, 0);
+#endif
+}
@@ -0,0 +1,135 @@
+#ifndef ASYNC_LOG_H
+#define ASYNC_LOG_H
+
+#include <Arduino.h>
+#include <atomic>
+
+// Deferred logging for the loop.
+//
+// LOG_INFO("PASSAGE ENDED after %lu ms", duration) doesn't format anything:
+// it stores the format string pointer and up to LOG_MAX_ARGS binary
+// arguments in a slot of a lock-free ring and returns. A low-priority task
+// on the other core formats the entries and writes them to Serial (and to a
+// syslog server over UDP if one is configured), so the UART never blocks
+// the loop. A full ring drops the entry and counts it.
+//
+// Format strings must be literals. A `const char*` argument is stored as a
+// pointer and must stay valid (literals, constant names); a String argument
+// is copied into the slot (LOG_TEXT_SIZE bytes shared by all copied strings,
+// longer text is cut).
+//
+// Levels below LOG_LEVEL compile to nothing.
+
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_RING_SIZE 48     // Entries, about 150 bytes each
+#define LOG_MAX_ARGS 4
+#define LOG_TEXT_SIZE 96     // Room for an MQTT passage payload
+#define LOG_SYSLOG_PORT 514
+
+enum LogArgType : uint8_t {
+  LOG_ARG_INT,
+  LOG_ARG_UINT,
+  LOG_ARG_FLOAT,
+  LOG_ARG_STR,     // Pointer to a string that outlives the entry
+  LOG_ARG_TEXT     // Offset of a copy in LogEntry::text
+};
+
+union LogArg {
+  int32_t i;
+  uint32_t u;
+  float f;
+  const char* s;
+};
+
+struct LogEntry {
+  std::atomic<uint32_t> seq;  // Ring position the slot is free or ready for
+  uint32_t pos;
+  const char* format;
+  unsigned long time;         // millis()
+  uint8_t level;
+  uint8_t argc;
+  uint8_t textUsed;
+  LogArgType types[LOG_MAX_ARGS];
+  LogArg args[LOG_MAX_ARGS];
+  char text[LOG_TEXT_SIZE];
+};
+
+struct LogStats {
+  unsigned long written;
+  unsigned long dropped;      // Ring full
+};
+
+// Start the drain task. `syslogHost` (IP or name, empty = off) also gets
+// every line as a syslog datagram once WiFi is up.
+void logBegin(const char* syslogHost);
+
+// Format and output pending entries; returns the number written. The task
+// calls this; builds without FreeRTOS (host) call it from their loop.
+int logDrain();
+
+LogStats logStats();
+
+// Reserve a slot, nullptr if the ring is full
+LogEntry* logReserve(uint8_t level, const char* format);
+void logCommit(LogEntry* e);
+
+inline void logPut(LogEntry& e, LogArgType type, LogArg arg) {
+  if (e.argc < LOG_MAX_ARGS) {
+    e.types[e.argc] = type;
+    e.args[e.argc] = arg;
+    e.argc++;
+  }
+}
+
+inline void logPut(LogEntry& e, int v) { LogArg a; a.i = v; logPut(e, LOG_ARG_INT, a); }
+inline void logPut(LogEntry& e, long v) { LogArg a; a.i = (int32_t)v; logPut(e, LOG_ARG_INT, a); }
+inline void logPut(LogEntry& e, long long v) { LogArg a; a.i = (int32_t)v; logPut(e, LOG_ARG_INT, a); }
+inline void logPut(LogEntry& e, unsigned int v) { LogArg a; a.u = v; logPut(e, LOG_ARG_UINT, a); }
+inline void logPut(LogEntry& e, unsigned long v) { LogArg a; a.u = (uint32_t)v; logPut(e, LOG_ARG_UINT, a); }
+inline void logPut(LogEntry& e, unsigned long long v) { LogArg a; a.u = (uint32_t)v; logPut(e, LOG_ARG_UINT, a); }
+inline void logPut(LogEntry& e, double v) { LogArg a; a.f = (float)v; logPut(e, LOG_ARG_FLOAT, a); }
+inline void logPut(LogEntry& e, const char* v) { LogArg a; a.s = v; logPut(e, LOG_ARG_STR, a); }
+void logPut(LogEntry& e, const String& v);
+
+template <typename... Args>
+void logWrite(uint8_t level, const char* format, const Args&... args) {
+  LogEntry* e = logReserve(level, format);
+  if (!e) {
+    return;
+  }
+  int expand[] = {0, (logPut(*e, args), 0)...};
+  (void)expand;
+  logCommit(e);
+}
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) logWrite(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) do {} while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...) logWrite(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) do {} while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) logWrite(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) do {} while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) logWrite(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do {} while (0)
+#endif
+
+#endif
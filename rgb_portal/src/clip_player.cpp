@@ -0,0 +1,200 @@
+#include "clip_player.h"
+#include "frame_codec.h"
+
+static void clipsReset(ClipPlayer& p) {
+  p.header = nullptr;
+  p.entries = nullptr;
+  p.playing = -1;
+}
+
+static bool clipsMap(ClipPlayer& p) {
+  const void* ptr = nullptr;
+  if (esp_partition_mmap(p.partition, 0, p.partition->size, SPI_FLASH_MMAP_DATA, &ptr, &p.mapHandle) != ESP_OK) {
+    p.image = nullptr;
+    return false;
+  }
+  return clipsOpen(p, (const uint8_t*)ptr, p.partition->size);
+}
+
+bool clipsBegin(ClipPlayer& p) {
+  p.image = nullptr;
+  p.capacity = 0;
+  clipsReset(p);
+  p.uploading = false;
+  p.partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, CLIP_PARTITION_SUBTYPE, CLIP_PARTITION_LABEL);
+  if (!p.partition) {
+    return false;
+  }
+  clipsMap(p);
+  return true;
+}
+
+bool clipsOpen(ClipPlayer& p, const uint8_t* image, size_t capacity) {
+  p.image = image;
+  p.capacity = capacity;
+  clipsReset(p);
+  if (!image || capacity < sizeof(ClipImageHeader)) {
+    return false;
+  }
+
+  const ClipImageHeader* h = (const ClipImageHeader*)image;
+  if (h->magic != CLIP_MAGIC || h->version != CLIP_VERSION || h->count > CLIP_MAX ||
+      h->size > capacity || sizeof(ClipImageHeader) + h->count * sizeof(ClipEntry) > h->size) {
+    return false;
+  }
+  const ClipEntry* entries = (const ClipEntry*)(image + sizeof(ClipImageHeader));
+  for (int i = 0; i < h->count; i++) {
+    const ClipEntry& e = entries[i];
+    if (e.offset > h->size || e.size > h->size - e.offset || e.frames == 0 || e.frameMs == 0 ||
+        memchr(e.name, 0, CLIP_NAME_LEN) == nullptr) {
+      return false;
+    }
+  }
+  p.header = h;
+  p.entries = entries;
+  return true;
+}
+
+int clipFind(const ClipPlayer& p, const char* name) {
+  if (!p.header) {
+    return -1;
+  }
+  for (int i = 0; i < p.header->count; i++) {
+    if (strcmp(p.entries[i].name, name) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+bool clipStart(ClipPlayer& p, int index, uint16_t loops, int count, unsigned long nowUs) {
+  if (!p.header || index < 0 || index >= p.header->count || p.entries[index].leds != count) {
+    return false;
+  }
+  p.playing = index;
+  p.pos = p.entries[index].offset;
+  p.frame = 0;
+  p.loopsLeft = loops == 0 ? 0xFFFF : loops - 1;
+  p.nextFrameUs = nowUs;
+  return true;
+}
+
+void clipStop(ClipPlayer& p) {
+  p.playing = -1;
+}
+
+ClipResult clipPoll(ClipPlayer& p, CRGB* leds, int count, unsigned long nowUs) {
+  if (p.playing < 0) {
+    return CLIP_IDLE;
+  }
+  if ((long)(nowUs - p.nextFrameUs) < 0) {
+    return CLIP_WAIT;
+  }
+
+  const ClipEntry& e = p.entries[p.playing];
+  if (p.frame >= e.frames) {
+    // The last frame has had its time
+    if (p.loopsLeft == 0) {
+      p.playing = -1;
+      return CLIP_DONE;
+    }
+    if (p.loopsLeft != 0xFFFF) {
+      p.loopsLeft--;
+    }
+    p.pos = e.offset;
+    p.frame = 0;
+  }
+
+  unsigned long frameUs = e.frameMs * 1000UL;
+  if (nowUs - p.nextFrameUs > frameUs) {
+    // A whole frame late (a long show or a blocking handler): play on from
+    // now instead of rushing through the backlog
+    p.lateFrames++;
+    p.nextFrameUs = nowUs + frameUs;
+  } else {
+    p.nextFrameUs += frameUs;
+  }
+
+  // Every frame record is checked against the clip bounds, so a corrupt
+  // image can't make the decoder read past the partition
+  uint32_t end = e.offset + e.size;
+  uint16_t len = 0;
+  if (p.pos + 2 <= end) {
+    memcpy(&len, p.image + p.pos, 2);
+  }
+  if (len == 0 || p.pos + 2 + len > end || (p.frame == 0 && p.image[p.pos + 2] != FRAME_KEY)) {
+    p.errors++;
+    p.playing = -1;
+    return CLIP_ERROR;
+  }
+
+  unsigned long start = micros();
+  FrameMemorySource src = {p.image + p.pos + 2, len, 0};
+  int type = frameDecode(src, leds, count);
+  unsigned long took = micros() - start;
+  if (type < 0 || src.pos != len) {
+    p.errors++;
+    p.playing = -1;
+    return CLIP_ERROR;
+  }
+  p.decodeUsTotal += took;
+  if (took > p.decodeUsMax) {
+    p.decodeUsMax = took;
+  }
+  p.framesShown++;
+  p.pos += 2 + len;
+  p.frame++;
+  return CLIP_FRAME;
+}
+
+bool clipUploadBegin(ClipPlayer& p) {
+  if (!p.partition) {
+    return false;
+  }
+  if (p.image) {
+    spi_flash_munmap(p.mapHandle);
+  }
+  p.image = nullptr;
+  clipsReset(p);
+  p.uploading = true;
+  p.uploadPos = 0;
+  return true;
+}
+
+bool clipUploadWrite(ClipPlayer& p, const uint8_t* data, size_t len) {
+  if (!p.uploading || len > p.partition->size - p.uploadPos) {
+    return false;
+  }
+  // Erase the sectors this chunk reaches into that are not erased yet
+  uint32_t erased = (p.uploadPos + CLIP_SECTOR_SIZE - 1) / CLIP_SECTOR_SIZE * CLIP_SECTOR_SIZE;
+  uint32_t end = p.uploadPos + len;
+  if (end > erased) {
+    uint32_t eraseEnd = (end + CLIP_SECTOR_SIZE - 1) / CLIP_SECTOR_SIZE * CLIP_SECTOR_SIZE;
+    if (esp_partition_erase_range(p.partition, erased, eraseEnd - erased) != ESP_OK) {
+      return false;
+    }
+  }
+  if (esp_partition_write(p.partition, p.uploadPos, data, len) != ESP_OK) {
+    return false;
+  }
+  p.uploadPos = end;
+  return true;
+}
+
+bool clipUploadEnd(ClipPlayer& p) {
+  if (!p.uploading) {
+    return false;
+  }
+  p.uploading = false;
+  p.uploads++;
+  if (clipsMap(p) && p.header->size <= p.uploadPos) {
+    return true;
+  }
+  // Truncated or invalid: erase the header so it isn't read at the next boot
+  if (p.image) {
+    spi_flash_munmap(p.mapHandle);
+  }
+  esp_partition_erase_range(p.partition, 0, CLIP_SECTOR_SIZE);
+  clipsMap(p);
+  return false;
+}
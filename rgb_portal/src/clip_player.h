@@ -0,0 +1,108 @@
+#ifndef CLIP_PLAYER_H
+#define CLIP_PLAYER_H
+
+#include <FastLED.h>
+#include <esp_partition.h>
+
+// Pre-rendered animations played from flash.
+//
+// Effects too expensive to compute live (fire, ghosts, lightning) are
+// rendered offline, compressed with the frame codec (frame_codec.h) and
+// stored in the "clips" data partition. The partition is memory-mapped, so
+// playback decodes every frame straight from flash into leds[]: no read
+// into a buffer first. A new image is uploaded over HTTP and written
+// sector by sector as it arrives. host/clip_pack builds images from PPM
+// frame sequences (row = frame, column = LED).
+//
+// Image layout, little-endian, from the start of the partition:
+//   ClipImageHeader
+//   ClipEntry[count]
+//   clip data: per frame a 16-bit length, then the encoded frame. The first
+//   frame of a clip is a keyframe, the others keyframes or deltas.
+
+#define CLIP_MAGIC 0x50434C50  // "PLCP" in the image
+#define CLIP_VERSION 1
+#define CLIP_MAX 32
+#define CLIP_NAME_LEN 16
+#define CLIP_PARTITION_LABEL "clips"
+#define CLIP_PARTITION_SUBTYPE 0x40
+#define CLIP_SECTOR_SIZE 4096
+
+struct ClipImageHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t count;
+  uint32_t size;              // Whole image, header included
+};
+
+struct ClipEntry {
+  char name[CLIP_NAME_LEN];   // Zero-terminated
+  uint32_t offset;            // Of the first frame record, from the image start
+  uint32_t size;              // Bytes of frame records
+  uint16_t frames;
+  uint16_t frameMs;           // Frame time (25 = 40 fps)
+  uint16_t leds;              // Must match the strip
+  uint16_t reserved;
+};
+
+enum ClipResult {
+  CLIP_IDLE,     // Nothing playing
+  CLIP_WAIT,     // Next frame not due yet
+  CLIP_FRAME,    // A frame was decoded into leds[], show it
+  CLIP_DONE,     // Played to the end
+  CLIP_ERROR     // Corrupt frame, playback stopped
+};
+
+struct ClipPlayer {
+  const uint8_t* image;       // Mapped partition, nullptr if there is none
+  size_t capacity;            // Partition size
+  const ClipImageHeader* header;  // nullptr without a valid image
+  const ClipEntry* entries;
+  const esp_partition_t* partition;
+  spi_flash_mmap_handle_t mapHandle;
+
+  int playing;                // Clip index, -1 = none
+  uint32_t pos;               // Next frame record, offset in the image
+  uint16_t frame;             // Next frame number
+  uint16_t loopsLeft;         // Plays after the current one (0xFFFF = forever)
+  unsigned long nextFrameUs;
+
+  unsigned long framesShown;
+  unsigned long lateFrames;   // Decoded more than a frame time late
+  unsigned long errors;
+  uint64_t decodeUsTotal;
+  unsigned long decodeUsMax;
+
+  bool uploading;
+  uint32_t uploadPos;
+  unsigned long uploads;
+};
+
+// Find and map the clips partition and read the image in it. Returns false
+// if there is no partition; an empty or invalid one maps but has no clips.
+bool clipsBegin(ClipPlayer& p);
+
+// Use an image in memory (host tools). Returns false if it is invalid.
+bool clipsOpen(ClipPlayer& p, const uint8_t* image, size_t capacity);
+
+// Clip index by name, -1 if there is no such clip
+int clipFind(const ClipPlayer& p, const char* name);
+
+// Start clip `index` at `nowUs` (first frame due right away), played
+// `loops` times (0 = until stopped). False if the clip doesn't exist or is
+// for another number of LEDs.
+bool clipStart(ClipPlayer& p, int index, uint16_t loops, int count, unsigned long nowUs);
+
+void clipStop(ClipPlayer& p);
+
+// Decode the next frame into `leds` if it is due
+ClipResult clipPoll(ClipPlayer& p, CRGB* leds, int count, unsigned long nowUs);
+
+// Replace the image. Playback stops and the partition is unmapped until
+// clipUploadEnd(); each sector is erased when the upload reaches it.
+bool clipUploadBegin(ClipPlayer& p);
+bool clipUploadWrite(ClipPlayer& p, const uint8_t* data, size_t len);
+// Map the partition again and read the new image. False if it is invalid.
+bool clipUploadEnd(ClipPlayer& p);
+
+#endif
@@ -0,0 +1,71 @@
+#include "direction_estimator.h"
+
+void directionReset(DirectionEstimator& est, unsigned long now) {
+  est.startTime = now;
+  for (int s = 0; s < 2; s++) {
+    est.weightSum[s] = 0.0f;
+    est.weightedTime[s] = 0.0f;
+    est.triggered[s] = false;
+  }
+  est.firstSensor = -1;
+}
+
+void directionAddSample(DirectionEstimator& est, uint8_t sensor, unsigned long t,
+                        float distance, bool valid, float range) {
+  if (sensor > SENSOR_INNER || !valid || distance >= range) {
+    return;
+  }
+
+  // Closer readings mean more of the body is in the beam
+  float weight = (range - distance) / range;
+  // Signed: the seed readings were taken before the passage started
+  float relTime = (float)(long)(t - est.startTime);
+
+  est.weightSum[sensor] += weight;
+  est.weightedTime[sensor] += relTime * weight;
+
+  if (!est.triggered[sensor]) {
+    est.triggered[sensor] = true;
+    if (est.firstSensor < 0) {
+      est.firstSensor = sensor;
+    }
+  }
+}
+
+PassageDirection directionProvisional(const DirectionEstimator& est) {
+  if (est.firstSensor == SENSOR_OUTER) return DIR_ENTERING;
+  if (est.firstSensor == SENSOR_INNER) return DIR_EXITING;
+  return DIR_UNKNOWN;
+}
+
+PassageEstimate directionEstimate(const DirectionEstimator& est, float spacingCm) {
+  PassageEstimate result = {DIR_UNKNOWN, 0.0f, 0.0f};
+
+  if (est.weightSum[SENSOR_OUTER] <= 0.0f || est.weightSum[SENSOR_INNER] <= 0.0f) {
+    return result; // Need both time series to say anything
+  }
+
+  float outerCentroid = est.weightedTime[SENSOR_OUTER] / est.weightSum[SENSOR_OUTER];
+  float innerCentroid = est.weightedTime[SENSOR_INNER] / est.weightSum[SENSOR_INNER];
+  result.lagMs = innerCentroid - outerCentroid;
+
+  if (result.lagMs >= DIRECTION_MIN_LAG_MS) {
+    result.direction = DIR_ENTERING;
+  } else if (result.lagMs <= -DIRECTION_MIN_LAG_MS) {
+    result.direction = DIR_EXITING;
+  } else {
+    return result;
+  }
+
+  float lag = result.lagMs < 0 ? -result.lagMs : result.lagMs;
+  result.velocity = spacingCm * 1000.0f / lag;
+  return result;
+}
+
+const char* directionName(PassageDirection dir) {
+  switch (dir) {
+    case DIR_ENTERING: return "in";
+    case DIR_EXITING:  return "out";
+    default:           return "unknown";
+  }
+}
@@ -0,0 +1,57 @@
+#ifndef DIRECTION_ESTIMATOR_H
+#define DIRECTION_ESTIMATOR_H
+
+#include <stdint.h>
+
+// Direction and velocity estimation from two ultrasonic sensors mounted one
+// behind the other in the walking direction. Sensor 0 faces the street side
+// (OUTER), sensor 1 the house side (INNER).
+//
+// The estimator is streaming: every sample is folded into a per-sensor
+// occupancy-weighted time centroid, so no sample history is kept. The lag
+// between the two centroids gives the direction and, with the known sensor
+// spacing, the walking speed.
+
+#define SENSOR_OUTER 0
+#define SENSOR_INNER 1
+
+enum PassageDirection {
+  DIR_UNKNOWN,   // Only one sensor saw the person, or the lag was too small
+  DIR_ENTERING,  // Outer sensor first (street -> house)
+  DIR_EXITING    // Inner sensor first (house -> street)
+};
+
+struct DirectionEstimator {
+  unsigned long startTime;   // Passage start, centroids are relative to this
+  float weightSum[2];        // Sum of occupancy weights per sensor
+  float weightedTime[2];     // Sum of (t - startTime) * weight per sensor
+  bool triggered[2];         // Sensor has seen the person at least once
+  int8_t firstSensor;        // Sensor that triggered first, -1 if none yet
+};
+
+struct PassageEstimate {
+  PassageDirection direction;
+  float lagMs;       // Inner centroid minus outer centroid (positive = entering)
+  float velocity;    // cm/s, 0 if unknown
+};
+
+// Minimum centroid lag (ms) before a direction is reported
+#define DIRECTION_MIN_LAG_MS 15.0f
+
+void directionReset(DirectionEstimator& est, unsigned long now);
+
+// Fold in one reading taken at `t`, which may be before the passage start
+// (seed readings). Readings that are invalid or outside `range` count as
+// "nobody there" and only affect the estimate through their absence.
+void directionAddSample(DirectionEstimator& est, uint8_t sensor, unsigned long t,
+                        float distance, bool valid, float range);
+
+// Direction based on which sensor triggered first (available immediately)
+PassageDirection directionProvisional(const DirectionEstimator& est);
+
+// Final estimate based on the occupancy centroids
+PassageEstimate directionEstimate(const DirectionEstimator& est, float spacingCm);
+
+const char* directionName(PassageDirection dir);
+
+#endif
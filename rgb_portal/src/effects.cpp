@@ -0,0 +1,85 @@
+#include "effects.h"
+
+void rotatingStep(RotatingAnimation& anim, int count, double colorSpeed, bool advanceColor) {
+  anim.position = (anim.position + 1) % count;
+  
+  // Update color transition (Blue -> Purple -> Pink -> Purple -> Blue)
+  if (advanceColor) {
+    anim.colorPhase += anim.colorDirection * colorSpeed;
+    
+    // Reverse direction at endpoints (0.0 = blue, 1.0 = purple, 2.0 = pink)
+    if (anim.colorPhase >= 2.0) {
+      anim.colorPhase = 2.0;
+      anim.colorDirection = -1.0;
+    } else if (anim.colorPhase <= 0.0) {
+      anim.colorPhase = 0.0;
+      anim.colorDirection = 1.0;
+    }
+  }
+}
+
+void rotatingAt(RotatingAnimation& anim, int count, double colorSpeed, uint64_t step) {
+  anim.position = step % count;
+
+  // Triangle wave: `half` steps from blue (0.0) to pink (2.0) and back
+  int half = (int)(2.0 / colorSpeed + 0.5);
+  int k = step % (2 * half);
+  anim.colorDirection = k < half ? 1.0 : -1.0;
+  anim.colorPhase = (k < half ? k : 2 * half - k) * 2.0f / half;
+}
+
+CRGB rotatingBaseColor(float colorPhase, const CRGB& from, const CRGB& mid, const CRGB& to) {
+  if (colorPhase < 1.0) {
+    // Blend from blue to purple (phase 0.0 to 1.0)
+    return blend(from, mid, (uint8_t)(colorPhase * 255));
+  }
+  // Blend from purple to pink (phase 1.0 to 2.0)
+  return blend(mid, to, (uint8_t)((colorPhase - 1.0) * 255));
+}
+
+// Brightness of a light point by distance from its center (0 = full)
+static const uint8_t spotFade[] = {0, 240, 240, 210, 210, 180, 180, 140, 140, 90, 90};
+#define SPOT_RADIUS ((int)sizeof(spotFade) - 1)
+#define NUM_SPOTS 4
+
+void renderRotating(CRGB* leds, const PortalGeometry& geometry, int position, const CRGB& baseColor) {
+  const int count = geometry.count;
+  // Base color dimmed to 20% brightness
+  CRGB dim = baseColor;
+  dim.nscale8(50);
+
+  // One LED step of a circle of `count` LEDs, in angle units; the fade
+  // table is indexed by the angular distance to the nearest point in steps
+  const uint32_t step = GEOMETRY_TURN / count;
+  const uint16_t quarter = GEOMETRY_TURN / NUM_SPOTS;
+  uint16_t first = geometry.angle[0] + (uint16_t)(position * GEOMETRY_TURN / count);
+  for (int i = 0; i < count; i++) {
+    uint16_t offset = (uint16_t)(geometry.angle[i] - first) % quarter;
+    uint32_t dist = offset < quarter / 2 ? offset : quarter - offset;
+    uint32_t index = (dist + step / 2) / step;
+    if (index > SPOT_RADIUS) {
+      leds[i] = dim;
+    } else {
+      CRGB c = baseColor;
+      if (index > 0) {
+        c.nscale8(spotFade[index]);
+      }
+      leds[i] = c;
+    }
+  }
+}
+
+void renderBlink(CRGB* leds, int count, const BlinkConfig& config, unsigned long elapsed, bool blinkingDone) {
+  CRGB color = config.color;
+  
+  if (!blinkingDone && config.numBlinks > 0 && config.blinkDuration > 0) {
+    // Blink phase: toggle between color and black (blinkDuration 0: solid)
+    int cycle = elapsed / config.blinkDuration;
+    bool shouldLight = (cycle % 2 == 0);
+    color = shouldLight ? config.color : CRGB::Black;
+  }
+  
+  for(int i = 0; i < count; i++) {
+    leds[i] = color;
+  }
+}
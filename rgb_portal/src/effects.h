@@ -0,0 +1,39 @@
+#ifndef EFFECTS_H
+#define EFFECTS_H
+
+#include <FastLED.h>
+#include "portal_fsm.h"
+#include "portal_geometry.h"
+
+// LED effects. Renderers only write the frame buffer they are given - they
+// never call FastLED.show() - so the same code runs on the ESP32 and in the
+// host golden-frame suite (host/golden.cpp).
+
+// Animation state of the ROTATING effect
+struct RotatingAnimation {
+  int position;          // LED of the first light point
+  float colorPhase;      // Current position in transition (0.0 to 2.0)
+  float colorDirection;  // 1.0 = forward, -1.0 = backward
+};
+
+// Advance one animation step: move the light points one LED and, if
+// `advanceColor`, the base color `colorSpeed` along blue -> purple -> pink
+void rotatingStep(RotatingAnimation& anim, int count, double colorSpeed, bool advanceColor);
+
+// Animation state `step` steps after the epoch of a shared clock, so that
+// portals with synchronised clocks render the same frame (see time_sync.h).
+// The color keeps moving in every state.
+void rotatingAt(RotatingAnimation& anim, int count, double colorSpeed, uint64_t step);
+
+// Base color for a phase: blend from -> mid (0.0 to 1.0), mid -> to (1.0 to 2.0)
+CRGB rotatingBaseColor(float colorPhase, const CRGB& from, const CRGB& mid, const CRGB& to);
+
+// Dim base with four light points 90 degrees apart around the center of
+// the portal, each as wide as 21 LEDs would be on a circle. `position`
+// turns them a full turn in `count` steps, starting at LED 0.
+void renderRotating(CRGB* leds, const PortalGeometry& geometry, int position, const CRGB& baseColor);
+
+// Blink sequence `elapsed` ms after it started (solid color once done)
+void renderBlink(CRGB* leds, int count, const BlinkConfig& config, unsigned long elapsed, bool blinkingDone);
+
+#endif
@@ -0,0 +1,61 @@
+#include "frame_codec.h"
+
+// Pixel `i` as sent: the color, or its XOR with the reference
+static inline CRGB codedPixel(const CRGB* frame, const CRGB* reference, int i) {
+  if (!reference) {
+    return frame[i];
+  }
+  return CRGB(frame[i].r ^ reference[i].r, frame[i].g ^ reference[i].g, frame[i].b ^ reference[i].b);
+}
+
+size_t frameEncode(const CRGB* frame, const CRGB* reference, int count, uint8_t* out, size_t outSize) {
+  size_t pos = 0;
+  if (outSize < 1) {
+    return 0;
+  }
+  out[pos++] = reference ? FRAME_DELTA : FRAME_KEY;
+
+  int i = 0;
+  while (i < count) {
+    CRGB c = codedPixel(frame, reference, i);
+
+    // Repeat run: two or more equal pixels (4 bytes instead of 6+)
+    int run = 1;
+    while (i + run < count && run < FRAME_RUN_MAX && codedPixel(frame, reference, i + run) == c) {
+      run++;
+    }
+    if (run >= 2) {
+      if (pos + 4 > outSize) {
+        return 0;
+      }
+      out[pos++] = FRAME_RUN_REPEAT | (run - 1);
+      out[pos++] = c.r;
+      out[pos++] = c.g;
+      out[pos++] = c.b;
+      i += run;
+      continue;
+    }
+
+    // Literal run up to the next pair of equal pixels
+    int literal = 1;
+    while (i + literal < count && literal < FRAME_RUN_MAX) {
+      if (i + literal + 1 < count &&
+          codedPixel(frame, reference, i + literal) == codedPixel(frame, reference, i + literal + 1)) {
+        break;
+      }
+      literal++;
+    }
+    if (pos + 1 + literal * 3 > outSize) {
+      return 0;
+    }
+    out[pos++] = literal - 1;
+    for (int k = 0; k < literal; k++) {
+      CRGB p = codedPixel(frame, reference, i + k);
+      out[pos++] = p.r;
+      out[pos++] = p.g;
+      out[pos++] = p.b;
+    }
+    i += literal;
+  }
+  return pos;
+}
@@ -0,0 +1,105 @@
+#ifndef FRAME_CODEC_H
+#define FRAME_CODEC_H
+
+#include <FastLED.h>
+
+// Compact frame format for streamed pixels.
+//
+// A frame is one type byte followed by run tokens that cover the strip:
+//   0x00-0x7F  literal run: (token + 1) pixels follow, 3 bytes each
+//   0x80-0xFF  repeat run:  one pixel follows, used for (token & 0x7F) + 1 LEDs
+// In a keyframe the pixels are colors. In a delta frame they are XORed into
+// the previous frame, so unchanged LEDs are runs of 00 00 00 and a base
+// color change over a gradient-free area is a single repeat run.
+//
+// Decoding writes straight into the frame buffer and pulls bytes from the
+// source in small chunks: no frame or packet sized buffer is needed.
+
+#define FRAME_KEY   0x01
+#define FRAME_DELTA 0x02
+
+#define FRAME_RUN_REPEAT 0x80
+#define FRAME_RUN_MAX    128
+#define FRAME_DECODE_CHUNK 16  // Pixels read per source call for delta literals
+
+// Worst case encoded size (all literals)
+#define FRAME_MAX_ENCODED(count) (1 + (count) * 3 + ((count) + FRAME_RUN_MAX - 1) / FRAME_RUN_MAX)
+
+// Encode `frame` as a keyframe (reference == nullptr) or as a delta against
+// `reference`. Returns the encoded size, or 0 if `outSize` is too small.
+size_t frameEncode(const CRGB* frame, const CRGB* reference, int count, uint8_t* out, size_t outSize);
+
+// Byte source over a memory buffer (host tools, tests)
+struct FrameMemorySource {
+  const uint8_t* data;
+  size_t size;
+  size_t pos;
+
+  int read(uint8_t* buf, size_t len) {
+    size_t n = len < size - pos ? len : size - pos;
+    memcpy(buf, data + pos, n);
+    pos += n;
+    return (int)n;
+  }
+};
+
+inline void frameXor(CRGB& pixel, const CRGB& delta) {
+  pixel.r ^= delta.r;
+  pixel.g ^= delta.g;
+  pixel.b ^= delta.b;
+}
+
+// Decode one frame from `src` (anything with read(uint8_t*, size_t), e.g.
+// WiFiUDP) into `leds`. A delta frame is applied to what `leds` holds.
+// Returns the frame type, or -1 if the data is truncated or overruns the
+// strip (`leds` is then partially updated).
+template <typename Source>
+int frameDecode(Source& src, CRGB* leds, int count) {
+  uint8_t type;
+  if (src.read(&type, 1) != 1 || (type != FRAME_KEY && type != FRAME_DELTA)) {
+    return -1;
+  }
+
+  int i = 0;
+  while (i < count) {
+    uint8_t token;
+    if (src.read(&token, 1) != 1) {
+      return -1;
+    }
+    int run = (token & 0x7F) + 1;
+    if (i + run > count) {
+      return -1;
+    }
+
+    if (token & FRAME_RUN_REPEAT) {
+      CRGB c;
+      if (src.read(c.raw, 3) != 3) {
+        return -1;
+      }
+      if (type == FRAME_KEY) {
+        for (int k = 0; k < run; k++) leds[i + k] = c;
+      } else if (c.r | c.g | c.b) {
+        for (int k = 0; k < run; k++) frameXor(leds[i + k], c);
+      }
+    } else if (type == FRAME_KEY) {
+      // Literal colors go straight into the frame buffer
+      if (src.read((uint8_t*)(leds + i), run * 3) != run * 3) {
+        return -1;
+      }
+    } else {
+      CRGB chunk[FRAME_DECODE_CHUNK];
+      for (int done = 0; done < run;) {
+        int n = run - done < FRAME_DECODE_CHUNK ? run - done : FRAME_DECODE_CHUNK;
+        if (src.read((uint8_t*)chunk, n * 3) != n * 3) {
+          return -1;
+        }
+        for (int k = 0; k < n; k++) frameXor(leds[i + done + k], chunk[k]);
+        done += n;
+      }
+    }
+    i += run;
+  }
+  return type;
+}
+
+#endif
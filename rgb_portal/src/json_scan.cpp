@@ -0,0 +1,67 @@
+#include "json_scan.h"
+
+const char* jsonSkipSpace(const char* p) {
+  while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+  return p;
+}
+
+const char* jsonToken(const char* p, char* out, size_t size) {
+  size_t n = 0;
+  if (*p == '"') {
+    p++;
+    while (*p && *p != '"') {
+      if (n + 1 >= size) return nullptr;
+      out[n++] = *p++;
+    }
+    if (*p != '"') return nullptr;
+    p++;
+  } else {
+    while (*p && *p != ',' && *p != '}' && *p != ']' && *p != ' ' && *p != '\r' && *p != '\n' && *p != '\t') {
+      if (n + 1 >= size) return nullptr;
+      out[n++] = *p++;
+    }
+    if (n == 0) return nullptr;
+  }
+  out[n] = '\0';
+  return p;
+}
+
+bool jsonParseLong(const char* value, long min, long max, long& out) {
+  char* end = nullptr;
+  long v = strtol(value, &end, 10);
+  if (end == value || *end || v < min || v > max) return false;
+  out = v;
+  return true;
+}
+
+bool jsonParseBool(const char* value, bool& out) {
+  if (strcmp(value, "true") == 0 || strcmp(value, "1") == 0) {
+    out = true;
+  } else if (strcmp(value, "false") == 0 || strcmp(value, "0") == 0) {
+    out = false;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+static int hexDigit(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+bool jsonParseColor(const char* value, CRGB& out) {
+  if (*value == '#') value++;
+  uint8_t rgb[3];
+  for (int i = 0; i < 3; i++) {
+    int hi = hexDigit(value[2 * i]);
+    int lo = hi < 0 ? -1 : hexDigit(value[2 * i + 1]);
+    if (lo < 0) return false;
+    rgb[i] = (uint8_t)(hi * 16 + lo);
+  }
+  if (value[6]) return false;
+  out = CRGB(rgb[0], rgb[1], rgb[2]);
+  return true;
+}
@@ -0,0 +1,29 @@
+#ifndef JSON_SCAN_H
+#define JSON_SCAN_H
+
+#include <Arduino.h>
+#include <FastLED.h>
+
+// Scanning helpers for the small JSON documents of the control API.
+//
+// The runtime config (portal_config.h) and timelines (sequencer.h) arrive
+// as flat JSON objects (a timeline with one array of step objects) and are
+// parsed in place without a DOM or allocations: the parsers walk the text
+// with these helpers and copy each name and value into a short buffer.
+// Strings have no escapes; a value is a string or a bare token (number,
+// true, false).
+
+// Past spaces, tabs and line breaks
+const char* jsonSkipSpace(const char* p);
+
+// Copy the string or bare token at `p` into `out` (`size` bytes with the
+// terminator). Returns the position after it, nullptr if there is none or
+// it doesn't fit.
+const char* jsonToken(const char* p, char* out, size_t size);
+
+// A whole token as a value; false (and `out` unchanged) if it isn't one
+bool jsonParseLong(const char* value, long min, long max, long& out);
+bool jsonParseBool(const char* value, bool& out);   // true, false, 1 or 0
+bool jsonParseColor(const char* value, CRGB& out);  // "rrggbb" or "#rrggbb"
+
+#endif
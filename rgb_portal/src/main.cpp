@@ -4,18 +4,68 @@
 #include <WebServer.h>
 #include <PubSubClient.h>
 #include <ArduinoOTA.h>
+#include <esp_timer.h>
 #include "secrets.h"
+#include "sensor_sampler.h"
+#include "direction_estimator.h"
+#include "portal_fsm.h"
+#include "effects.h"
+#include "pixel_stream.h"
+#include "time_sync.h"
+#include "udp_control.h"
+#include "passage_trace.h"
+#include "timeline.h"
+#include "async_log.h"
+#include "wifi_link.h"
+#include "rtc_snapshot.h"
+#include "portal_config.h"
+#include "output_lut.h"
+#include "particles.h"
+#include "portal_geometry.h"
+#include "clip_player.h"
+#include "sequencer.h"
+#include "transition.h"
 
 // WiFi configuration from secrets.h
 const char* ssid = WIFI_SSID;
 const char* password = WIFI_PASSWORD;
 
+// Optional static address from secrets.h (empty = DHCP)
+#ifndef WIFI_STATIC_IP
+#define WIFI_STATIC_IP ""
+#endif
+#ifndef WIFI_GATEWAY
+#define WIFI_GATEWAY ""
+#endif
+#ifndef WIFI_SUBNET
+#define WIFI_SUBNET ""
+#endif
+#ifndef WIFI_DNS
+#define WIFI_DNS ""
+#endif
+#define WIFI_REUSE_LEASE false // Reuse the DHCP lease stored before a reboot (needs a DHCP reservation)
+
 // MQTT configuration from secrets.h
 const char* mqtt_server = MQTT_SERVER;
 const int mqtt_port = MQTT_PORT;
 const char* mqtt_user = MQTT_USER;
 const char* mqtt_password = MQTT_PASSWORD;
 const char* mqtt_topic_state = "portal/state";  // Topic to publish state changes
+const char* mqtt_topic_passage = "portal/passage";  // Topic to publish passage events (with direction)
+const char* mqtt_topic_command = "portal/command";  // Topic to receive commands (red, green, reset)
+const char* mqtt_topic_config = "portal/config";  // Topic to receive config changes (JSON, see /config)
+const char* mqtt_topic_sequence = "portal/sequence";  // Topic to receive timelines (JSON, see /sequence)
+const char* mqtt_topic_sequence_event = "portal/sequence/event";  // Topic to publish timeline progress
+
+// UDP control channel key from secrets.h (32 hex digits, empty = channel off)
+#ifndef CONTROL_KEY
+#define CONTROL_KEY ""
+#endif
+
+// Syslog server for the log output from secrets.h (empty = Serial only)
+#ifndef LOG_SYSLOG_HOST
+#define LOG_SYSLOG_HOST ""
+#endif
 
 WiFiClient espClient;
 PubSubClient mqttClient(espClient);
@@ -26,279 +76,272 @@ PubSubClient mqttClient(espClient);
 #define LED_TYPE    WS2812B // WS2815 works with WS2812B protocol
 #define COLOR_ORDER RGB     // Color order for WS2815
 
+// Portal shape (see portal_geometry.h): the strip runs from the bottom of the
+// left leg over the arch to the bottom of the right leg
+#define PORTAL_WIDTH_MM 1000  // Opening width, the arch on top is a semicircle
+#define PORTAL_LEG_MM   1600  // Height of the straight legs
+static_assert(NUM_LEDS <= GEOMETRY_MAX_LEDS, "raise GEOMETRY_MAX_LEDS to NUM_LEDS");
+
 // HC-SR04 Ultrasonic Sensor configuration
 #define TRIG_PIN    18      // GPIO pin for trigger
 #define ECHO_PIN    19      // GPIO pin for echo
-#define DETECTION_RANGE 56  // cm - someone is in portal if distance < this
+#define TRIG2_PIN   25      // GPIO pin for trigger, second (inner) sensor
+#define ECHO2_PIN   26      // GPIO pin for echo, second (inner) sensor
+#ifndef NUM_SENSORS
+#define NUM_SENSORS 1       // 1 = single sensor, 2 = outer + inner sensor for direction detection
+#endif
+#define SENSOR_SPACING_CM 30 // cm between outer and inner sensor (walking direction)
+#define DETECTION_RANGE 56  // cm - someone is in portal if distance < this (default, see /config)
 #define MIN_DETECTION_DISTANCE 1  // cm - ignore readings closer than this (noise)
 #define MAX_DETECTION_DISTANCE 70  // cm - ignore readings farther than this (for sensor validity)
 
-CRGB leds[NUM_LEDS];
+CRGB leds[NUM_LEDS];        // Rendered frame (linear values)
+CRGB outputLeds[NUM_LEDS];  // leds[] after the output LUT, what the strip sends
+OutputLut outputLut;        // Gamma and white balance (see output_lut.h)
 WebServer server(80);
 
-// Portal states
-enum PortalState {
-  ROTATING,      // Rotating light points
-  BLINK_RED,     // Blink red, then solid red
-  BLINK_GREEN    // Blink green once, then return to ROTATING
-};
-
-PortalState currentState = ROTATING;
 unsigned long lastUpdate = 0;
-int rotatingPosition = 0;
+uint64_t lastSharedStep = 0; // Animation step last rendered from the shared clock
 
-// Animation speed (ms between updates)
+// Animation speed (ms between updates, default, see /config)
 #define ANIMATION_SPEED 75
+#define LED_BRIGHTNESS 50 // 0-255 (default, see /config)
+#define LED_GAMMA 2.2     // Output gamma, 1.0 = linear (default, see /config)
 
 // Rotating effect configuration
 CRGB rotatingSpotColor = CRGB(0, 255, 0); // Spot color (default: bright green)
 
-// Color transition configuration for base color (Blue -> Purple -> Pink)
-CRGB colorBlue = CRGB(0, 0, 255);     // Blue
-CRGB colorPurple = CRGB(128, 0, 255); // Purple
-CRGB colorPink = CRGB(255, 0, 128);   // Pink
-float colorPhase = 0.0;               // Current position in transition (0.0 to 2.0)
-float colorDirection = 1.0;           // 1.0 = forward, -1.0 = backward
-#define COLOR_TRANSITION_SPEED 0.025  // How fast color transitions
-
-// Blink configuration
-struct BlinkConfig {
-  CRGB color;
-  int numBlinks;
-  int blinkDuration;  // ms per blink (on or off)
-  bool solidAfterBlink; // true = solid color after blink, false = return to ROTATING
-};
+RotatingAnimation rotating = {0, 0.0, 1.0}; // Light point position and color phase
+#define COLOR_TRANSITION_SPEED 0.025  // How fast color transitions (default, see /config)
 
-// State-specific configurations
-BlinkConfig redBlinkConfig = {CRGB::Red, 5, 200, true};
-BlinkConfig greenBlinkConfig = {CRGB::Green, 0, 0, true};  // Solid green, stays until manually cleared
+// Portal state, blink animation and event queue (see portal_fsm.h)
+PortalMachine portal;
 
-// Variables for blink animation
-unsigned long blinkStartTime = 0;
-bool blinkingDone = false;
-BlinkConfig activeBlinkConfig;
+TriggerLatency triggerLatency = {0, 0, 0, 0, 0};
 
-// Variables for auto-trigger and timeout
-unsigned long stateEndTime = ULONG_MAX; // Initialize to max value to prevent false timeout at startup
-bool autoTriggered = false;
-#define RED_STATE_DURATION 10000 // ms - how long red mode should be active (10 seconds)
+// Network pixel input (DDP on UDP port 4048, see pixel_stream.h)
+PixelStream pixelStream;
+CRGB streamSlots[STREAM_SLOTS * NUM_LEDS]; // Jitter buffer frames
+#define STREAM_TIMEOUT 2000 // ms without frames before falling back to ROTATING
+#define STREAM_JITTER_DEPTH 2 // Frames buffered before playback (0 = show on arrival), GET /stream?depth=N
 
-// Calculate opposite position (across the circle)
-int getOppositePosition(int pos) {
-  return (pos + NUM_LEDS / 2) % NUM_LEDS;
-}
+// Shared animation clock with other portals (UDP port 4050, see time_sync.h)
+TimeSync timeSync;
+
+// Authenticated binary commands from the controller (UDP port 4210, see udp_control.h)
+UdpControl control;
+
+// Position and polar coordinates of every LED, built at boot
+PortalGeometry geometry;
+
+// Pre-rendered clips in the "clips" flash partition (see clip_player.h),
+// GET /play?clip=NAME plays one in the PLAYING state
+ClipPlayer clips;
+uint16_t clipLoops = 1; // Plays of the next clip started (0 = until reset)
+bool clipUploadOk = false;
+
+// Timeline of a choreographed scenario (POST /sequence, MQTT portal/sequence,
+// see sequencer.h). Its red and green steps blink with sequenceBlink.
+Sequencer sequencer;
+SequenceTimeline parsedTimeline; // Parse buffer, kept off the loop task stack
+BlinkConfig sequenceBlink;
 
 // Variables for ultrasonic sensor
 float lastDistance = DETECTION_RANGE;  // Initialize to "no one there"
-unsigned long lastSensorRead = 0;
 unsigned long sensorStartTime = 0; // Track when sensor started
 bool sensorWarmedUp = false; // Flag to indicate sensor warmup complete
 #define SENSOR_READ_INTERVAL 50 // ms between readings
-#define SENSOR_WARMUP_TIME 3000 // ms - ignore detections for first 3 seconds
+#define SENSOR_WARMUP_TIME 1000 // ms - ignore detections for the first second after power-on
 
 // Variables for passage detection
 bool inPassage = false; // True when someone is passing through
 unsigned long passageStartTime = 0; // When passage started
 unsigned long lastPassageEndTime = 0; // When last passage ended
-#define MIN_PASSAGE_DURATION 1500 // ms - minimum time to stay green during passage
-#define PASSAGE_COOLDOWN 1000 // ms - cooldown after passage before next trigger
+#define MIN_PASSAGE_DURATION 1500 // ms - minimum time to stay green during passage (default, see /config)
+#define PASSAGE_COOLDOWN 1000 // ms - cooldown after passage before next trigger (default, see /config)
 
-// Variables for WiFi reconnection
-unsigned long lastWiFiReconnectAttempt = 0;
-#define WIFI_RECONNECT_INTERVAL 5000 // ms - try reconnecting every 5 seconds
+// Passage sparks (see particles.h): a burst from the LED nearest the sensor
+// when a passage starts a blink, then one spark per sensor sample while the
+// visitor is in the portal, over the dimmed blink color
+#define SPARKS_PER_PASSAGE 24 // Burst size, 0 = flat blink (default, see /config)
+#define SPARK_LED 0           // LED nearest the ultrasonic sensor(s)
+#define SPARK_MIN_SPEED 40    // LEDs per second
+#define SPARK_MAX_SPEED 120   // LEDs per second
+#define SPARK_LIFE 900        // ms
+#define SPARK_BASE_SCALE 64   // Blink color under the sparks (0-255)
+ParticlePool sparks;
+unsigned long sparksUpdatedAt = 0;
+
+// Crossfades between states (see transition.h): the frame on the strip is
+// frozen at a state change and the new state's frames are blended over it.
+// Between animation steps the fade is refreshed every FADE_FRAME_MS.
+#define FADE_MS 250           // Fade length, 0 = hard cuts (default, see /config)
+#define FADE_BLINKS false     // Blinks start with their pre-rendered first frame (default, see /config)
+#define FADE_FRAME_MS 20      // ms between fade frames without a new effect frame
+static_assert(NUM_LEDS <= TRANSITION_MAX_LEDS, "raise TRANSITION_MAX_LEDS to NUM_LEDS");
+Transition transition;
+unsigned long lastShowMs = 0;
+// Runtime configuration (GET/PUT /config, MQTT portal/config, see
+// portal_config.h): the defaults above, overlaid with the values in NVS
+PortalConfig config = {
+  LED_BRIGHTNESS,
+  LED_GAMMA,
+  CRGB(255, 255, 255),  // White balance: uncorrected
+  ANIMATION_SPEED,
+  COLOR_TRANSITION_SPEED,
+  CRGB(0, 0, 255),    // Base color sequence: blue
+  CRGB(128, 0, 255),  // -> purple
+  CRGB(255, 0, 128),  // -> pink
+  DETECTION_RANGE,
+  MIN_PASSAGE_DURATION,
+  PASSAGE_COOLDOWN,
+  SPARKS_PER_PASSAGE,
+  {CRGB::Red, 5, 200, true},   // Red: 5 blinks, then solid until reset
+  {CRGB::Green, 0, 0, true},   // Green: solid, until the passage ends
+  FADE_MS,
+  FADE_BLINKS,
+};
+PortalConfig pendingConfig; // Accepted change, swapped in before the next frame
+int pendingConfigDirty = 0; // CONFIG_DIRTY_* bits of pendingConfig (0 = nothing pending)
+// An NVS write blocks the loop for milliseconds and wears the flash: a burst
+// of changes (a slider in Home Assistant) is saved once it has settled
+#define CONFIG_SAVE_DELAY 3000 // ms without a further change before saving
+bool configUnsaved = false;    // Applied change not in NVS yet
+unsigned long configChangedAt = 0;
+
+// First frame of every trigger target, rendered at boot. A trigger points the
+// strip at it and starts output right away (see showFirstFrame()).
+struct FirstFrame {
+  PortalState state;
+  const BlinkConfig* config;
+  int dirty;  // CONFIG_DIRTY_* bits that invalidate it
+  CRGB leds[NUM_LEDS];
+};
+FirstFrame firstFrames[] = {
+  {BLINK_RED, &config.red, CONFIG_DIRTY_RED | CONFIG_DIRTY_OUTPUT, {}},
+  {BLINK_GREEN, &config.green, CONFIG_DIRTY_GREEN | CONFIG_DIRTY_OUTPUT, {}},
+};
+#define NUM_FIRST_FRAMES (sizeof(firstFrames) / sizeof(firstFrames[0]))
+
+DirectionEstimator passageDirection; // Direction/velocity of the current passage (dual sensor)
+PassageTracer passageTrace; // Reaction time per stage of recent passages (GET /latency)
+
+// WiFi association with a direct fast path to the last access point (see wifi_link.h)
+WifiLink wifiLink;
+
+// Variables for MQTT reconnection
+unsigned long lastMqttReconnectAttempt = 0;
+#define MQTT_RECONNECT_INTERVAL 5000 // ms
+// PubSubClient drops an incoming message larger than its buffer (256 bytes
+// by default) without a callback; a timeline on portal/sequence easily is
+#define MQTT_BUFFER_SIZE 4096
+
+BootTimes bootTimes = {0, 0, 0, 0, 0, 0}; // Boot phase timings (GET /metrics)
+bool networkUp = false; // startNetwork() done
+bool warmRestart = false; // State restored from the RTC snapshot at boot
 
 // Forward declarations
-void triggerRedBlink();
-void triggerGreenBlink();
 void triggerRandomBlink();
 void updateLEDs();
 void publishStateToMQTT();
+void publishPassageToMQTT(bool started, unsigned long duration);
 void reconnectMQTT();
+void saveSnapshot();
+void publishSequenceEvent(const char* event, const String& fields);
 
-// Function to draw rotating effect
-void drawRotatingEffect() {
-  // 4 punkter jämnt fördelade på 140 LEDs: 0, 35, 70, 105
-  int secondPos = (rotatingPosition + 35) % NUM_LEDS;  // 90 degrees (140/4 = 35)
-  int thirdPos = (rotatingPosition + 70) % NUM_LEDS;   // 180 degrees
-  int fourthPos = (rotatingPosition + 105) % NUM_LEDS; // 270 degrees
-  
-  // Calculate current base color by blending between blue -> purple -> pink
-  CRGB rotatingBaseColor;
-  if (colorPhase < 1.0) {
-    // Blend from blue to purple (phase 0.0 to 1.0)
-    rotatingBaseColor = blend(colorBlue, colorPurple, (uint8_t)(colorPhase * 255));
-  } else {
-    // Blend from purple to pink (phase 1.0 to 2.0)
-    rotatingBaseColor = blend(colorPurple, colorPink, (uint8_t)((colorPhase - 1.0) * 255));
+// Show leds[] through the output LUT, the level of a running timeline and
+// a running crossfade, pointing the strip back at outputLeds[] after a
+// pre-rendered frame
+void showLeds() {
+  TRACE_SCOPE("show");
+  unsigned long now = millis();
+  outputLutApply(outputLut, leds, outputLeds, NUM_LEDS);
+  if (sequencer.levelActive && sequencer.level < 255) {
+    nscale8(outputLeds, NUM_LEDS, sequencer.level);
   }
-  
-  for(int i = 0; i < NUM_LEDS; i++) {
-    // Set base color (dim version of the blended color)
-    leds[i] = rotatingBaseColor;
-    leds[i].nscale8(50); // Dim to 20% brightness for base
-    
-    // First rotating light point (21 LEDs wide with fade: center + 10 on each side)
-    int dist1 = abs(i - rotatingPosition);
-    if (dist1 > NUM_LEDS / 2) dist1 = NUM_LEDS - dist1; // Wrapping
-    
-    if (dist1 == 0) {
-      leds[i] = rotatingBaseColor; // Center - max brightness
-    } else if (dist1 <= 2) {
-      leds[i] = rotatingBaseColor;
-      leds[i].nscale8(240); // 94% brightness
-    } else if (dist1 <= 4) {
-      leds[i] = rotatingBaseColor;
-      leds[i].nscale8(210); // 82% brightness
-    } else if (dist1 <= 6) {
-      leds[i] = rotatingBaseColor;
-      leds[i].nscale8(180); // 71% brightness
-    } else if (dist1 <= 8) {
-      leds[i] = rotatingBaseColor;
-      leds[i].nscale8(140); // 55% brightness
-    } else if (dist1 <= 10) {
-      leds[i] = rotatingBaseColor;
-      leds[i].nscale8(90); // 35% brightness
-    }
-    
-    // Second rotating light point (90 degrees, 21 LEDs wide with fade)
-    int dist2 = abs(i - secondPos);
-    if (dist2 > NUM_LEDS / 2) dist2 = NUM_LEDS - dist2; // Wrapping
-    
-    if (dist2 == 0) {
-      leds[i] = rotatingBaseColor; // Center - max brightness
-    } else if (dist2 <= 2) {
-      leds[i] = rotatingBaseColor;
-      leds[i].nscale8(240); // 94% brightness
-    } else if (dist2 <= 4) {
-      leds[i] = rotatingBaseColor;
-      leds[i].nscale8(210); // 82% brightness
-    } else if (dist2 <= 6) {
-      leds[i] = rotatingBaseColor;
-      leds[i].nscale8(180); // 71% brightness
-    } else if (dist2 <= 8) {
-      leds[i] = rotatingBaseColor;
-      leds[i].nscale8(140); // 55% brightness
-    } else if (dist2 <= 10) {
-      leds[i] = rotatingBaseColor;
-      leds[i].nscale8(90); // 35% brightness
-    }
-    
-    // Third rotating light point (180 degrees, 21 LEDs wide with fade)
-    int dist3 = abs(i - thirdPos);
-    if (dist3 > NUM_LEDS / 2) dist3 = NUM_LEDS - dist3; // Wrapping
-    
-    if (dist3 == 0) {
-      leds[i] = rotatingBaseColor; // Center - max brightness
-    } else if (dist3 <= 2) {
-      leds[i] = rotatingBaseColor;
-      leds[i].nscale8(240); // 94% brightness
-    } else if (dist3 <= 4) {
-      leds[i] = rotatingBaseColor;
-      leds[i].nscale8(210); // 82% brightness
-    } else if (dist3 <= 6) {
-      leds[i] = rotatingBaseColor;
-      leds[i].nscale8(180); // 71% brightness
-    } else if (dist3 <= 8) {
-      leds[i] = rotatingBaseColor;
-      leds[i].nscale8(140); // 55% brightness
-    } else if (dist3 <= 10) {
-      leds[i] = rotatingBaseColor;
-      leds[i].nscale8(90); // 35% brightness
-    }
-    
-    // Fourth rotating light point (270 degrees, 21 LEDs wide with fade)
-    int dist4 = abs(i - fourthPos);
-    if (dist4 > NUM_LEDS / 2) dist4 = NUM_LEDS - dist4; // Wrapping
-    
-    if (dist4 == 0) {
-      leds[i] = rotatingBaseColor; // Center - max brightness
-    } else if (dist4 <= 2) {
-      leds[i] = rotatingBaseColor;
-      leds[i].nscale8(240); // 94% brightness
-    } else if (dist4 <= 4) {
-      leds[i] = rotatingBaseColor;
-      leds[i].nscale8(210); // 82% brightness
-    } else if (dist4 <= 6) {
-      leds[i] = rotatingBaseColor;
-      leds[i].nscale8(180); // 71% brightness
-    } else if (dist4 <= 8) {
-      leds[i] = rotatingBaseColor;
-      leds[i].nscale8(140); // 55% brightness
-    } else if (dist4 <= 10) {
-      leds[i] = rotatingBaseColor;
-      leds[i].nscale8(90); // 35% brightness
-    }
+  transitionApply(transition, outputLeds, NUM_LEDS, now);
+  lastShowMs = now;
+  if (FastLED[0].leds() != outputLeds) {
+    FastLED[0].setLeds(outputLeds, NUM_LEDS);
   }
   FastLED.show();
 }
 
+// Function to draw rotating effect
+void drawRotatingEffect() {
+  TRACE_SCOPE("drawRotating");
+  CRGB baseColor = sequencer.colorActive
+      ? sequencer.color
+      : rotatingBaseColor(rotating.colorPhase, config.colorBlue, config.colorPurple, config.colorPink);
+  renderRotating(leds, geometry, rotating.position, baseColor);
+  showLeds();
+}
+
 // Function to draw blink effect
+// (the end of the blink sequence is handled by the state machine via EV_BLINK_DONE)
 void drawBlinkEffect() {
-  unsigned long elapsed = millis() - blinkStartTime;
-  
-  // Calculate total duration based on numBlinks
-  unsigned long totalBlinkDuration;
-  if (activeBlinkConfig.numBlinks == 0) {
-    // Special case: solid color indefinitely (blinkDuration = 0) or for specific time
-    if (activeBlinkConfig.blinkDuration == 0) {
-      // Duration 0 means stay solid forever (until manually changed)
-      totalBlinkDuration = ULONG_MAX;
-    } else {
-      totalBlinkDuration = activeBlinkConfig.blinkDuration;
+  TRACE_SCOPE("drawBlink");
+  unsigned long now = millis();
+  BlinkConfig blink = portal.activeBlinkConfig;
+  if (sequencer.colorActive) {
+    blink.color = sequencer.color;
+  }
+  renderBlink(leds, NUM_LEDS, blink, now - portal.blinkStartTime, portal.blinkingDone);
+  particlesUpdate(sparks, NUM_LEDS, now - sparksUpdatedAt);
+  sparksUpdatedAt = now;
+  renderSparks(leds, NUM_LEDS, sparks, SPARK_BASE_SCALE);
+  showLeds();
+}
+
+// Render the first frames invalidated by `dirty` (CONFIG_DIRTY_* bits),
+// stored as output values (after the LUT)
+void prerenderFirstFrames(int dirty) {
+  for (unsigned int i = 0; i < NUM_FIRST_FRAMES; i++) {
+    if (!(firstFrames[i].dirty & dirty)) {
+      continue;
     }
-  } else {
-    // Normal blinking: numBlinks * (on + off time)
-    totalBlinkDuration = activeBlinkConfig.numBlinks * activeBlinkConfig.blinkDuration * 2;
+    renderBlink(firstFrames[i].leds, NUM_LEDS, *firstFrames[i].config, 0, false);
+    outputLutApply(outputLut, firstFrames[i].leds, firstFrames[i].leds, NUM_LEDS);
   }
-  
-  if (!blinkingDone) {
-    if (elapsed > totalBlinkDuration) {
-      // Blinking is complete
-      blinkingDone = true;
-      
-      if (activeBlinkConfig.solidAfterBlink) {
-        // Solid color with blink color
-        for(int i = 0; i < NUM_LEDS; i++) {
-          leds[i] = activeBlinkConfig.color;
-        }
-      } else {
-        // Return to ROTATING
-        currentState = ROTATING;
-        autoTriggered = false;
-        publishStateToMQTT();
-        drawRotatingEffect();
-        return;
-      }
-    } else {
-      // Special case: if numBlinks is 0, just show solid color
-      if (activeBlinkConfig.numBlinks == 0) {
-        for(int i = 0; i < NUM_LEDS; i++) {
-          leds[i] = activeBlinkConfig.color;
-        }
-      } else {
-        // Blink phase: toggle between color and black
-        int cycle = elapsed / activeBlinkConfig.blinkDuration;
-        bool shouldLight = (cycle % 2 == 0);
-        
-        for(int i = 0; i < NUM_LEDS; i++) {
-          leds[i] = shouldLight ? activeBlinkConfig.color : CRGB::Black;
-        }
-      }
+}
+
+// Output the pre-rendered first frame of the state just entered: no
+// rendering on the trigger path, the strip is pointed at the frame and
+// shown. The next regular update switches back to leds[]. A blink with
+// timeline parameters or color doesn't match the frame, and a blink that
+// fades in starts from the old frame: both are rendered.
+bool showFirstFrame(unsigned long triggerUs) {
+  TRACE_SCOPE("showFirstFrame");
+  if (sequencer.colorActive || sequencer.levelActive || transition.active) {
+    return false;
+  }
+  const BlinkConfig& active = portal.activeBlinkConfig;
+  for (unsigned int i = 0; i < NUM_FIRST_FRAMES; i++) {
+    const BlinkConfig& c = *firstFrames[i].config;
+    if (firstFrames[i].state != portal.state || c.color != active.color || c.numBlinks != active.numBlinks ||
+        c.blinkDuration != active.blinkDuration) {
+      continue;
     }
-  } else {
-    // After blinking - solid color
-    if (activeBlinkConfig.solidAfterBlink) {
-      for(int i = 0; i < NUM_LEDS; i++) {
-        leds[i] = activeBlinkConfig.color;
-      }
+    unsigned long showStart = micros();
+    FastLED[0].setLeds(firstFrames[i].leds, NUM_LEDS);
+    FastLED.show();
+    unsigned long now = micros();
+    
+    triggerLatency.count++;
+    triggerLatency.lastUs = now - triggerUs;
+    triggerLatency.lastShowUs = now - showStart;
+    triggerLatency.totalUs += triggerLatency.lastUs;
+    if (triggerLatency.lastUs > triggerLatency.maxUs) {
+      triggerLatency.maxUs = triggerLatency.lastUs;
     }
+    return true;
   }
-  FastLED.show();
+  return false;
 }
 
 // Function to set LED colors based on state
 void updateLEDs() {
-  switch (currentState) {
+  switch (portal.state) {
     case ROTATING:
       drawRotatingEffect();
       break;
@@ -306,97 +349,531 @@ void updateLEDs() {
     case BLINK_GREEN:
       drawBlinkEffect();
       break;
+    case STREAMING:
+      // Frames are shown by checkPixelStream() as they become due
+      break;
+    case PLAYING:
+      // Frames are shown by checkClipPlayback() as they become due
+      break;
   }
 }
 
 // Update animations
 void updateAnimations() {
+  TRACE_SCOPE("updateAnimations");
   unsigned long now = millis();
-  if (now - lastUpdate > ANIMATION_SPEED) {
-    rotatingPosition = (rotatingPosition + 1) % NUM_LEDS;
-    
-    // Update color transition for ROTATING state (Blue -> Purple -> Pink -> Purple -> Blue)
-    if (currentState == ROTATING) {
-      colorPhase += colorDirection * COLOR_TRANSITION_SPEED;
-      
-      // Reverse direction at endpoints (0.0 = blue, 1.0 = purple, 2.0 = pink)
-      if (colorPhase >= 2.0) {
-        colorPhase = 2.0;
-        colorDirection = -1.0;
-      } else if (colorPhase <= 0.0) {
-        colorPhase = 0.0;
-        colorDirection = 1.0;
+
+  // With other portals around, the animation step follows the shared clock
+  // so that all of them show the same frame
+  if (timeSyncShared(timeSync)) {
+    uint64_t step = (uint64_t)timeSyncNow(timeSync, esp_timer_get_time()) / 1000 / config.animationSpeed;
+    if (step != lastSharedStep) {
+      rotatingAt(rotating, NUM_LEDS, config.colorSpeed, step);
+      if (portal.state != STREAMING) {
+        updateLEDs();
       }
+      lastSharedStep = step;
+      lastUpdate = now;
+      saveSnapshot();
     }
+    return;
+  }
+
+  if (now - lastUpdate > (unsigned long)config.animationSpeed) {
+    // Color only transitions in ROTATING state
+    rotatingStep(rotating, NUM_LEDS, config.colorSpeed, portal.state == ROTATING);
     
-    updateLEDs();
+    // Streamed frames are shown as they arrive
+    if (portal.state != STREAMING) {
+      updateLEDs();
+    }
     lastUpdate = now;
+    saveSnapshot();
   }
 }
 
-void handleToggle() {
-  autoTriggered = false; // Manual toggle, not automatic
-  
-  // Toggle between ROTATING and BLINK_RED
-  if (currentState == ROTATING) {
-    currentState = BLINK_RED;
-    activeBlinkConfig = redBlinkConfig;
-    blinkStartTime = millis();
-    blinkingDone = false;
-    stateEndTime = millis() + RED_STATE_DURATION;
-  } else {
-    currentState = ROTATING;
+// Receive network frames while the portal is idle and show them at an even
+// pace through the jitter buffer
+void checkPixelStream() {
+  TRACE_SCOPE("checkPixelStream");
+  unsigned long now = millis();
+  // A blink or a clip owns the strip: a clip's delta frames build on
+  // leds[], which a stream frame (direct mode) would overwrite
+  bool frameDone = streamPoll(pixelStream, now, portal.state == ROTATING || portal.state == STREAMING);
+  
+  if (portal.state == STREAMING) {
+    const CRGB* frame = streamNextFrame(pixelStream, micros());
+    if (frame) {
+      if (frame != leds) {
+        memcpy(leds, frame, sizeof(leds));
+      }
+      showLeds();
+    } else if (now - pixelStream.lastFrameTime > STREAM_TIMEOUT) {
+      portalPost(portal, EV_STREAM_TIMEOUT, now);
+    }
+  } else if (frameDone && portal.state == ROTATING) {
+    portalPost(portal, EV_STREAM_FRAME, now);
+  }
+}
+
+// Show the frames of the playing clip as they become due; back to ROTATING
+// when it ends
+void checkClipPlayback() {
+  if (portal.state != PLAYING) {
+    return;
+  }
+  TRACE_SCOPE("checkClipPlayback");
+  switch (clipPoll(clips, leds, NUM_LEDS, micros())) {
+    case CLIP_FRAME:
+      showLeds();
+      break;
+    case CLIP_WAIT:
+      break;
+    case CLIP_ERROR:
+      LOG_WARN("Clip playback stopped: corrupt frame");
+      portalPost(portal, EV_CLIP_DONE, millis());
+      break;
+    default:
+      portalPost(portal, EV_CLIP_DONE, millis());
+      break;
+  }
+}
+
+// Log every transition taken by the state machine, start or stop the clip
+// player with the PLAYING state and start the crossfade of a state change.
+// A blink cuts to its pre-rendered first frame unless fadeBlinks is set.
+void logTransition(const PortalEvent& ev, PortalState from, PortalState to) {
+  if (ev.type == EV_SENSOR_ENTER) {
+    traceMark(passageTrace, STAGE_TRANSITION, micros());
+  }
+  LOG_INFO("State: %s -> %s (%s)", portalStateName(from), portalStateName(to), portalEventName(ev.type));
+  bool blinkStart = from != to && (to == BLINK_RED || to == BLINK_GREEN);
+  if (from != to && config.fadeMs > 0 && (!blinkStart || config.fadeBlinks)) {
+    transitionStart(transition, FastLED[0].leds(), NUM_LEDS, config.fadeMs, millis());
+  } else if (blinkStart) {
+    transitionCancel(transition);
+  }
+  if (ev.type == EV_CLIP_START || ev.type == EV_SEQ_CLIP) {
+    // A clip that can't start ends on the next checkClipPlayback()
+    clipStart(clips, ev.arg, clipLoops, NUM_LEDS, micros());
+  } else if (from == PLAYING && to != PLAYING) {
+    clipStop(clips);
+  }
+  if (ev.type == EV_SEQ_RED || ev.type == EV_SEQ_GREEN) {
+    portal.activeBlinkConfig = sequenceBlink;
+  }
+}
+
+// A timeline step fired: post its state change and report it
+void onSequenceStep(const SequenceStep& step, uint8_t index, unsigned long lateUs) {
+  unsigned long now = millis();
+  if (step.state == SEQ_RED || step.state == SEQ_GREEN) {
+    sequenceBlink = step.state == SEQ_RED ? config.red : config.green;
+    if (step.blinks >= 0) sequenceBlink.numBlinks = step.blinks;
+    if (step.blinkMs >= 0) sequenceBlink.blinkDuration = step.blinkMs;
+    if (step.solid >= 0) sequenceBlink.solidAfterBlink = step.solid;
+    portalPost(portal, step.state == SEQ_RED ? EV_SEQ_RED : EV_SEQ_GREEN, now);
+  } else if (step.state == SEQ_ROTATING) {
+    portalPost(portal, EV_SEQ_RESET, now);
+  } else if (step.state == SEQ_CLIP) {
+    clipLoops = step.loops;
+    portalPost(portal, EV_SEQ_CLIP, now, (uint8_t)clipFind(clips, step.clip));
+  }
+
+  String fields = ",\"step\":";
+  fields += index;
+  fields += ",\"at\":";
+  fields += (unsigned long)step.at;
+  fields += ",\"state\":\"";
+  fields += sequenceStateName(step.state);
+  fields += "\",\"lateUs\":";
+  fields += lateUs;
+  fields += ",\"cycle\":";
+  fields += sequencer.cycle;
+  publishSequenceEvent("step", fields);
+}
+
+// A fade in progress gets a frame every FADE_FRAME_MS, also between the
+// frames of the state it fades to: the last frame again, blended further
+void checkTransition() {
+  if (!transition.active || millis() - lastShowMs < FADE_FRAME_MS) {
+    return;
+  }
+  TRACE_SCOPE("checkTransition");
+  showLeds();
+}
+
+// Fire the timeline steps that are due, before the events they post are
+// processed on the same loop pass. Color and level changes between steps
+// are picked up by the next frame.
+void checkSequence() {
+  if (!sequencer.running) {
+    return;
+  }
+  TRACE_SCOPE("checkSequence");
+  if (sequencePoll(sequencer, micros(), onSequenceStep) == SEQUENCE_DONE) {
+    LOG_INFO("Timeline %s done", String(sequencer.timeline.id));
+    publishSequenceEvent("done", "");
+  }
+}
+
+// Parse and start a timeline, replacing a running one. Returns false with
+// `error` set if it is invalid or names a clip that can't play.
+bool startSequence(const char* json, String& error) {
+  if (sequenceParse(parsedTimeline, json, error) < 0) {
+    return false;
+  }
+  for (int i = 0; i < parsedTimeline.count; i++) {
+    const SequenceStep& step = parsedTimeline.steps[i];
+    int index = step.state == SEQ_CLIP ? clipFind(clips, step.clip) : 0;
+    if (index < 0 || (step.state == SEQ_CLIP && clips.entries[index].leds != NUM_LEDS)) {
+      error = String("cannot play clip ") + step.clip;
+      return false;
+    }
+  }
+  if (sequencer.running) {
+    sequenceAbort(sequencer);
+    publishSequenceEvent("aborted", "");
+  }
+  sequenceStart(sequencer, parsedTimeline, micros());
+  LOG_INFO("Timeline %s started: %d steps, %lu ms", String(sequencer.timeline.id), sequencer.timeline.count,
+           (unsigned long)sequencer.timeline.durationMs);
+  String fields = ",\"steps\":";
+  fields += sequencer.timeline.count;
+  fields += ",\"durationMs\":";
+  fields += (unsigned long)sequencer.timeline.durationMs;
+  fields += ",\"loop\":";
+  fields += sequencer.timeline.loop ? "true" : "false";
+  publishSequenceEvent("start", fields);
+  return true;
+}
+
+// One command stops everything: the running timeline (if any) ends and
+// the portal goes back to ROTATING. Returns false if the event queue is full.
+bool abortSequence() {
+  if (sequenceAbort(sequencer)) {
+    LOG_INFO("Timeline %s aborted", String(sequencer.timeline.id));
+    publishSequenceEvent("aborted", "");
+  }
+  return portalPost(portal, EV_SEQ_RESET, millis());
+}
+
+// A new blink drops the old sparks; started by a passage it gets a burst in
+// its color (drawn from the next animation step, after the first frame)
+void startSparks() {
+  particlesClear(sparks);
+  sparksUpdatedAt = millis();
+  if (inPassage && config.sparks > 0) {
+    particlesBurst(sparks, SPARK_LED, config.sparks, portal.activeBlinkConfig.color,
+                   SPARK_MIN_SPEED, SPARK_MAX_SPEED, SPARK_LIFE);
+  }
+}
+
+// Keep the live state in RTC memory for a warm restart (see rtc_snapshot.h)
+void saveSnapshot() {
+  unsigned long now = millis();
+  PortalSnapshot s = PortalSnapshot();
+  s.state = portal.state;
+  s.autoTriggered = portal.autoTriggered;
+  s.blinkingDone = portal.blinkingDone;
+  s.inPassage = inPassage;
+  s.activeBlinkConfig = portal.activeBlinkConfig;
+  s.blinkElapsed = now - portal.blinkStartTime;
+  s.passageElapsed = now - passageStartTime;
+  s.sincePassageEnd = now - lastPassageEndTime;
+  s.rotating = rotating;
+  s.lastDistance = lastDistance;
+  for (int i = 0; i < numSensors; i++) {
+    s.filtered[i] = sensors[i].filtered;
+  }
+  snapshotSave(s);
+}
+
+// Come back in the state from before a warm reset: same portal state, blink
+// and passage timing, animation phase and sensor baseline, no warmup
+bool restoreSnapshot() {
+  PortalSnapshot s;
+  if (!snapshotRestore(s)) {
+    return false;
+  }
+  unsigned long now = millis();
+  portalRestore(portal, (PortalState)s.state, s.activeBlinkConfig, now - s.blinkElapsed,
+                s.blinkingDone, s.autoTriggered);
+  inPassage = s.inPassage;
+  passageStartTime = now - s.passageElapsed;
+  lastPassageEndTime = now - s.sincePassageEnd;
+  rotating = s.rotating;
+  lastDistance = s.lastDistance;
+  for (int i = 0; i < numSensors; i++) {
+    sensors[i].filtered = s.filtered[i];
+  }
+  sensorWarmedUp = true;
+  return true;
+}
+
+// Drain the event queue: one render and one MQTT publish for all events
+// that arrived since the last loop pass
+void processPortalEvents() {
+  TRACE_SCOPE("processPortalEvents");
+  portalCheckBlink(portal, millis());
+  if (portal.queueCount == 0) {
+    return;
   }
   
-  updateLEDs();
-  publishStateToMQTT();
+  PortalBatch batch = portalProcess(portal, logTransition);
+  if (batch.blinkStarted) {
+    startSparks();
+  }
+  if (batch.changed) {
+    traceMark(passageTrace, STAGE_RENDER, micros());
+  }
+  if (batch.blinkStarted && showFirstFrame(batch.triggerUs)) {
+    // First frame is out, updateAnimations() takes over from here
+  } else if (batch.changed) {
+    updateLEDs();
+  }
+  if (batch.changed) {
+    traceMark(passageTrace, STAGE_SHOW, micros());
+  }
+  if (batch.stateChanged) {
+    publishStateToMQTT();
+  }
+  if (batch.changed) {
+    saveSnapshot();
+  }
+}
+
+// Reply to a state-changing request right away with the state it leads to
+// and the event's sequence number. Rendering and the MQTT publish follow in
+// processPortalEvents() on this loop pass, after the reply has gone out.
+void sendStateResponse(bool queued) {
+  TRACE_SCOPE("sendStateResponse");
+  if (!queued) {
+    String response = "{\"status\":\"busy\",\"state\":";
+    response += portalStateNumber(portal.state);
+    response += "}\n";
+    server.send(503, "application/json", response);
+    return;
+  }
   
   String response = "{\"status\":\"ok\",\"state\":";
-  response += (currentState == ROTATING) ? "1" : "2";
+  response += portalStateNumber(portalPendingState(portal));
+  response += ",\"seq\":";
+  response += portal.postedSeq;
   response += "}\n";
-
-  Serial.println("Toggle state (manual)");
   
   server.send(200, "application/json", response);
 }
 
+// Toggle between ROTATING and BLINK_RED. The handlers don't log: the
+// transition is logged when it is applied, off the request path.
+void handleToggle() {
+  sendStateResponse(portalPost(portal, EV_HTTP_TOGGLE, millis()));
+}
+
+// Execute a UDP control command. Like the HTTP handlers it only queues the
+// event; the reply carries the state it leads to.
+ControlStatus onControlCommand(uint8_t command, uint8_t& state) {
+  TRACE_SCOPE("controlCommand");
+  unsigned long now = millis();
+  bool queued = true;
+  switch (command) {
+    case CMD_STATE:  break;
+    case CMD_RED:    queued = portalPost(portal, EV_UDP_RED, now); break;
+    case CMD_GREEN:  queued = portalPost(portal, EV_UDP_GREEN, now); break;
+    case CMD_RESET:  queued = portalPost(portal, EV_UDP_RESET, now); break;
+    case CMD_TOGGLE: queued = portalPost(portal, EV_UDP_TOGGLE, now); break;
+    case CMD_ABORT:  queued = abortSequence(); break;
+    default:         return CTRL_UNKNOWN;
+  }
+  state = portalStateNumber(portalPendingState(portal));
+  return queued ? CTRL_OK : CTRL_BUSY;
+}
+
+// `seq` is the last applied event: a command has taken effect once it
+// reaches the seq of the command's reply
 void handleState() {
+  TRACE_SCOPE("handleState");
   String response = "{\"state\":";
-  response += (currentState == ROTATING) ? "1" : ((currentState == BLINK_RED) ? "2" : "3");
+  response += portalStateNumber(portal.state);
+  response += ",\"seq\":";
+  response += portal.processedSeq;
   response += "}\n";
   
   server.send(200, "application/json", response);
 }
 
 void handleGreenBlink() {
-  triggerGreenBlink();
-  
-  String response = "{\"status\":\"ok\",\"state\":3}\n";
-  Serial.println("Green blink triggered (manual)");
-  
-  server.send(200, "application/json", response);
+  sendStateResponse(portalPost(portal, EV_HTTP_GREEN, millis()));
 }
 
 void handleRedBlink() {
-  triggerRedBlink();
-  
-  String response = "{\"status\":\"ok\",\"state\":2}\n";
-  Serial.println("Red blink triggered (manual)");
-  
-  server.send(200, "application/json", response);
+  sendStateResponse(portalPost(portal, EV_HTTP_RED, millis()));
 }
 
 void handleReset() {
-  currentState = ROTATING;
-  publishStateToMQTT();
+  sendStateResponse(portalPost(portal, EV_HTTP_RESET, millis()));
+}
+
+// Append the timeline counters as JSON fields
+void appendSequenceJson(String& response) {
+  response += "\"started\":";
+  response += sequencer.started;
+  response += ",\"completed\":";
+  response += sequencer.completed;
+  response += ",\"aborted\":";
+  response += sequencer.aborted;
+  response += ",\"stepsFired\":";
+  response += sequencer.stepsFired;
+  response += ",\"lastLateUs\":";
+  response += sequencer.lastLateUs;
+  response += ",\"maxLateUs\":";
+  response += sequencer.maxLateUs;
+}
+
+// Append the clip partition and playback counters as JSON fields
+void appendClipsJson(String& response) {
+  response += "\"partition\":";
+  response += clips.partition ? (unsigned long)clips.partition->size : 0UL;
+  response += ",\"image\":";
+  response += clips.header ? (unsigned long)clips.header->size : 0UL;
+  response += ",\"playing\":\"";
+  response += clips.playing >= 0 ? clips.entries[clips.playing].name : "";
+  response += "\",\"frames\":";
+  response += clips.framesShown;
+  response += ",\"late\":";
+  response += clips.lateFrames;
+  response += ",\"errors\":";
+  response += clips.errors;
+  response += ",\"decodeUsMean\":";
+  response += (unsigned long)(clips.framesShown ? clips.decodeUsTotal / clips.framesShown : 0);
+  response += ",\"decodeUsMax\":";
+  response += clips.decodeUsMax;
+  response += ",\"uploads\":";
+  response += clips.uploads;
+}
+
+// GET /clips - clips in flash and playback counters. POST /clips uploads a
+// new image built by host/clip_pack (multipart file upload).
+void handleClips() {
+  TRACE_SCOPE("handleClips");
+  String response = "{";
+  appendClipsJson(response);
+  response += ",\"clips\":[";
+  int count = clips.header ? clips.header->count : 0;
+  for (int i = 0; i < count; i++) {
+    const ClipEntry& e = clips.entries[i];
+    if (i > 0) response += ",";
+    response += "{\"name\":\"";
+    response += e.name;
+    response += "\",\"frames\":";
+    response += e.frames;
+    response += ",\"frameMs\":";
+    response += e.frameMs;
+    response += ",\"durationMs\":";
+    response += (unsigned long)e.frames * e.frameMs;
+    response += ",\"bytes\":";
+    response += (unsigned long)e.size;
+    response += ",\"leds\":";
+    response += e.leds;
+    response += "}";
+  }
+  response += "]}\n";
   
-  String response = "{\"status\":\"ok\",\"state\":1}\n";
-  Serial.println("Reset to ROTATING state (manual)");
+  server.send(200, "application/json", response);
+}
+
+// Upload chunks go straight to flash; a clip playing stops first
+void handleClipUpload() {
+  HTTPUpload& upload = server.upload();
+  if (upload.status == UPLOAD_FILE_START) {
+    clipUploadOk = clipUploadBegin(clips);
+  } else if (upload.status == UPLOAD_FILE_WRITE) {
+    clipUploadOk = clipUploadOk && clipUploadWrite(clips, upload.buf, upload.currentSize);
+  } else if (clips.uploading) {
+    // End or aborted: an incomplete image is erased
+    bool valid = clipUploadEnd(clips);
+    clipUploadOk = clipUploadOk && valid && upload.status == UPLOAD_FILE_END;
+  }
+}
+
+void handleClipUploadDone() {
+  TRACE_SCOPE("handleClipUploadDone");
+  if (!clipUploadOk) {
+    LOG_WARN("Clip upload failed");
+    server.send(400, "application/json", "{\"status\":\"error\",\"message\":\"invalid or too large clip image\"}\n");
+    return;
+  }
+  LOG_INFO("Clip image uploaded: %d clips, %lu bytes", clips.header->count, (unsigned long)clips.header->size);
+  handleClips();
+}
+
+// GET /play?clip=NAME[&loops=N] - play a clip from flash N times (default
+// 1, 0 = until reset), then return to ROTATING
+void handlePlay() {
+  TRACE_SCOPE("handlePlay");
+  int index = clipFind(clips, server.arg("clip").c_str());
+  if (index < 0) {
+    server.send(404, "application/json", "{\"status\":\"error\",\"message\":\"unknown clip\"}\n");
+    return;
+  }
+  if (clips.entries[index].leds != NUM_LEDS) {
+    server.send(400, "application/json", "{\"status\":\"error\",\"message\":\"clip is for another number of LEDs\"}\n");
+    return;
+  }
+  long loops = server.hasArg("loops") ? server.arg("loops").toInt() : 1;
+  if (loops < 0 || loops > 1000) {
+    server.send(400, "application/json", "{\"status\":\"error\",\"message\":\"loops must be 0-1000\"}\n");
+    return;
+  }
+  clipLoops = (uint16_t)loops;
+  sendStateResponse(portalPost(portal, EV_CLIP_START, millis(), (uint8_t)index));
+}
+
+// GET /sequence - the running timeline and counters. POST/PUT with a
+// timeline as JSON body starts it (see sequencer.h), DELETE aborts it and
+// resets the portal.
+void handleSequence() {
+  TRACE_SCOPE("handleSequence");
+  if (server.method() == HTTP_POST || server.method() == HTTP_PUT) {
+    String error;
+    if (!startSequence(server.arg("plain").c_str(), error)) {
+      String response = "{\"status\":\"error\",\"message\":\"";
+      response += error;
+      response += "\"}\n";
+      server.send(400, "application/json", response);
+      return;
+    }
+  } else if (server.method() == HTTP_DELETE) {
+    sendStateResponse(abortSequence());
+    return;
+  }
   
+  const SequenceTimeline& t = sequencer.timeline;
+  String response = "{\"running\":";
+  response += sequencer.running ? "true" : "false";
+  response += ",\"id\":\"";
+  response += t.id;
+  response += "\",\"steps\":";
+  response += t.count;
+  response += ",\"next\":";
+  response += sequencer.next;
+  response += ",\"elapsedMs\":";
+  response += sequenceElapsedMs(sequencer, micros());
+  response += ",\"durationMs\":";
+  response += (unsigned long)t.durationMs;
+  response += ",\"loop\":";
+  response += t.loop ? "true" : "false";
+  response += ",\"cycle\":";
+  response += sequencer.cycle;
+  response += ",";
+  appendSequenceJson(response);
+  response += "}\n";
   server.send(200, "application/json", response);
 }
 
 void handleRoot() {
+  TRACE_SCOPE("handleRoot");
   String html = "<html><body>";
   html += "<h1>ESP32 LED Controller</h1>";
   html += "<p>Available endpoints:</p>";
@@ -405,9 +882,16 @@ void handleRoot() {
   html += "<li>GET /red - Trigger red blink (persists until reset)</li>";
   html += "<li>GET /green - Trigger green blink (returns to ROTATING)</li>";
   html += "<li>GET /reset - Reset to ROTATING state</li>";
-  html += "<li>GET /state - Get current state (1=ROTATING, 2=BLINK_RED, 3=BLINK_GREEN)</li>";
+  html += "<li>GET /state - Get current state (1=ROTATING, 2=BLINK_RED, 3=BLINK_GREEN, 4=STREAMING, 5=PLAYING)</li>";
   html += "<li>GET /distance - Get current ultrasonic sensor distance</li>";
   html += "<li>GET /signal - Get WiFi signal strength</li>";
+  html += "<li>GET /stream - Network pixel input (DDP) statistics, ?depth=N sets the jitter buffer</li>";
+  html += "<li>GET /metrics - Runtime counters</li>";
+  html += "<li>GET /latency - Reaction time per stage of recent passages</li>";
+  html += "<li>GET /config - Runtime configuration (PUT /config?brightness=80 changes it)</li>";
+  html += "<li>GET /clips - Pre-rendered clips in flash (POST /clips uploads an image)</li>";
+  html += "<li>GET /play?clip=NAME&amp;loops=N - Play a clip (loops=0 until reset)</li>";
+  html += "<li>GET /sequence - Running timeline (POST a JSON timeline to start one, DELETE aborts)</li>";
   html += "</ul>";
   html += "<button onclick=\"fetch('/toggle')\">Toggle Red</button> ";
   html += "<button onclick=\"fetch('/red')\">Red Blink</button> ";
@@ -420,40 +904,83 @@ void handleRoot() {
   server.send(200, "text/html", html);
 }
 
-// Function to measure distance with HC-SR04
-float measureDistance() {
-  // Send out a pulse
-  digitalWrite(TRIG_PIN, LOW);
-  delayMicroseconds(2);
-  digitalWrite(TRIG_PIN, HIGH);
-  delayMicroseconds(10);
-  digitalWrite(TRIG_PIN, LOW);
-  
-  // Read the echo (timeout after 30ms = approx 5m)
-  long duration = pulseIn(ECHO_PIN, HIGH, 30000);
+// Append the cached reading of one sensor as JSON fields (no sensor time spent)
+void appendSensorJson(String& response, const SensorChannel& ch, unsigned long now) {
+  SensorStats stats = sensorHistoryStats(ch);
   
-  // Calculate distance in cm (speed of sound: 343 m/s)
-  // Distance = (time * speed) / 2 (because sound travels there and back)
-  float distance = duration * 0.034 / 2;
-  
-  return distance;
+  response += "\"distance\":";
+  response += String(ch.distance, 2); // 2 decimaler
+  response += ",\"unit\":\"cm\",\"inRange\":";
+  response += ch.valid ? "true" : "false";
+  response += ",\"personDetected\":";
+  response += (ch.valid && ch.filtered < config.detectionRange) ? "true" : "false";
+  response += ",\"filtered\":";
+  response += String(ch.filtered, 2);
+  response += ",\"age\":";
+  response += ch.sampleCount > 0 ? now - ch.sampleTime : 0;
+  response += ",\"samples\":";
+  response += ch.sampleCount;
+  response += ",\"history\":{\"n\":";
+  response += stats.count;
+  response += ",\"min\":";
+  response += String(stats.min, 2);
+  response += ",\"max\":";
+  response += String(stats.max, 2);
+  response += ",\"mean\":";
+  response += String(stats.mean, 2);
+  response += "}";
 }
 
+// Served from the sampler's latest reading - never pings the sensor itself
 void handleDistance() {
-  float distance = measureDistance();
+  TRACE_SCOPE("handleDistance");
+  unsigned long now = millis();
   
-  String response = "{\"distance\":";
-  response += String(distance, 2); // 2 decimaler
-  response += ",\"unit\":\"cm\",\"inRange\":";
-  response += (distance >= MIN_DETECTION_DISTANCE && distance <= MAX_DETECTION_DISTANCE) ? "true" : "false";
-  response += ",\"personDetected\":";
-  response += (distance < DETECTION_RANGE && distance >= MIN_DETECTION_DISTANCE) ? "true" : "false";
+  String response = "{";
+  appendSensorJson(response, sensors[0], now);
+  if (numSensors > 1) {
+    response += ",\"sensors\":[";
+    for (int s = 0; s < numSensors; s++) {
+      if (s > 0) response += ",";
+      response += "{";
+      appendSensorJson(response, sensors[s], now);
+      response += "}";
+    }
+    response += "]";
+  }
   response += "}\n";
   
   server.send(200, "application/json", response);
 }
 
+// WiFi link fields shared by /signal and /metrics
+void appendWifiJson(String& response) {
+  response += "\"phase\":\"";
+  response += wifiLinkPhaseName(wifiLink.phase);
+  response += "\",\"channel\":";
+  response += wifiLink.cache.channel;
+  response += ",\"connects\":";
+  response += wifiLink.connects;
+  response += ",\"direct\":";
+  response += wifiLink.directConnects;
+  response += ",\"scans\":";
+  response += wifiLink.scanConnects;
+  response += ",\"directFailures\":";
+  response += wifiLink.directFailures;
+  response += ",\"drops\":";
+  response += wifiLink.drops;
+  response += ",\"leaseRenewals\":";
+  response += wifiLink.leaseRenewals;
+  response += ",\"lastMs\":";
+  response += wifiLink.lastConnectMs;
+  response += ",\"meanMs\":";
+  response += (unsigned long)(wifiLink.connects ? wifiLink.totalConnectMs / wifiLink.connects : 0);
+  response += ",\"maxMs\":";
+  response += wifiLink.maxConnectMs;
+}
+
 void handleWiFiSignal() {
+  TRACE_SCOPE("handleWiFiSignal");
   int rssi = WiFi.RSSI(); // Get signal strength in dBm
   int quality = 0;
   
@@ -471,95 +998,461 @@ void handleWiFiSignal() {
   response += rssi;
   response += ",\"quality\":";
   response += quality;
-  response += ",\"unit\":\"dBm\"}\n";
+  response += ",\"unit\":\"dBm\",\"link\":{";
+  appendWifiJson(response);
+  response += "}}\n";
   
-  Serial.print("WiFi Signal: ");
-  Serial.print(rssi);
-  Serial.print(" dBm (");
-  Serial.print(quality);
-  Serial.println("%)");
+  LOG_INFO("WiFi Signal: %d dBm (%d%%)", rssi, quality);
   
   server.send(200, "application/json", response);
 }
 
-// Function to trigger red blink (state 2)
-void triggerRedBlink() {
-  if (currentState == ROTATING) { // Only trigger if we're in ROTATING mode
-    currentState = BLINK_RED;
-    autoTriggered = true;
-    activeBlinkConfig = redBlinkConfig;
-    blinkStartTime = millis();
-    blinkingDone = false;
-    // No timeout - stays red until manual reset
-    updateLEDs();
-    publishStateToMQTT();
-    Serial.println("Red state triggered! Will stay red until manual reset via API...");
+// Append the DDP input and jitter buffer counters as JSON fields
+void appendStreamJson(String& response, unsigned long now) {
+  response += "\"active\":";
+  response += portal.state == STREAMING ? "true" : "false";
+  response += ",\"port\":";
+  response += DDP_PORT;
+  response += ",\"frames\":";
+  response += pixelStream.frames;
+  response += ",\"packets\":";
+  response += pixelStream.packets;
+  response += ",\"badPackets\":";
+  response += pixelStream.badPackets;
+  response += ",\"discarded\":";
+  response += pixelStream.discarded;
+  response += ",\"compressedFrames\":";
+  response += pixelStream.compressedFrames;
+  response += ",\"compressedBytesPerFrame\":";
+  response += String(pixelStream.compressedFrames > 0 ? (float)pixelStream.compressedBytes / pixelStream.compressedFrames : 0, 1);
+  response += ",\"deltaSkipped\":";
+  response += pixelStream.deltaSkipped;
+  response += ",\"age\":";
+  response += pixelStream.frames > 0 ? now - pixelStream.lastFrameTime : 0;
+  response += ",\"depth\":";
+  response += pixelStream.depth;
+  response += ",\"buffered\":";
+  response += streamBuffered(pixelStream);
+  response += ",\"presented\":";
+  response += pixelStream.presented;
+  response += ",\"late\":";
+  response += pixelStream.late;
+  response += ",\"dropped\":";
+  response += pixelStream.dropped;
+  response += ",\"underruns\":";
+  response += pixelStream.underruns;
+  response += ",\"intervalMs\":";
+  response += String(pixelStream.intervalUs / 1000.0, 2);
+  response += ",\"bufferDelayMs\":";
+  response += String(pixelStream.bufferDelayUs / 1000.0, 2);
+}
+
+// GET /stream[?depth=N] - stream statistics, optionally set the jitter buffer depth
+void handleStream() {
+  TRACE_SCOPE("handleStream");
+  if (server.hasArg("depth")) {
+    int depth = server.arg("depth").toInt();
+    if (depth < 0 || depth > STREAM_MAX_DEPTH) {
+      String error = "{\"status\":\"error\",\"message\":\"depth must be 0-";
+      error += STREAM_MAX_DEPTH;
+      error += "\"}\n";
+      server.send(400, "application/json", error);
+      return;
+    }
+    streamSetDepth(pixelStream, depth);
+    LOG_INFO("Stream jitter buffer depth set to %d", depth);
+  }
+  
+  String response = "{";
+  appendStreamJson(response, millis());
+  response += "}\n";
+  
+  server.send(200, "application/json", response);
+}
+
+// Validate a config change against the current (or already pending) config
+// and stage it for the next frame boundary. Returns the CONFIG_DIRTY_* bits,
+// -1 if it was rejected (`error` says why, nothing changes).
+int queueConfigJson(const char* json, String& error) {
+  PortalConfig next = pendingConfigDirty ? pendingConfig : config;
+  int dirty = configApplyJson(next, json, error);
+  if (dirty > 0) {
+    pendingConfig = next;
+    pendingConfigDirty |= dirty;
   }
+  return dirty;
 }
 
-// Function to trigger green blink (state 3)
-void triggerGreenBlink() {
-  if (currentState == ROTATING || currentState == BLINK_RED) { // Trigger from ROTATING or RED mode
-    currentState = BLINK_GREEN;
-    autoTriggered = true;
-    activeBlinkConfig = greenBlinkConfig;
-    blinkStartTime = millis();
-    blinkingDone = false;
-    updateLEDs();
-    publishStateToMQTT();
-    Serial.println("Green blink triggered! Will stay green while person in portal...");
+// GET /config - runtime configuration. PUT/POST changes it, with a JSON body
+// ({"brightness":80}) or query arguments (?brightness=80).
+void handleConfig() {
+  TRACE_SCOPE("handleConfig");
+  if (server.method() == HTTP_PUT || server.method() == HTTP_POST) {
+    String json;
+    if (server.hasArg("plain")) {
+      json = server.arg("plain");
+    } else {
+      // Query arguments as a flat JSON object (strings, the parser takes
+      // numbers and booleans quoted too)
+      json = "{";
+      for (int i = 0; i < server.args(); i++) {
+        if (i > 0) json += ",";
+        json += "\"" + server.argName(i) + "\":\"" + server.arg(i) + "\"";
+      }
+      json += "}";
+    }
+    String error;
+    int dirty = queueConfigJson(json.c_str(), error);
+    if (dirty < 0) {
+      String response = "{\"status\":\"error\",\"message\":\"";
+      response += error;
+      response += "\"}\n";
+      server.send(400, "application/json", response);
+      return;
+    }
+    String response = "{\"status\":\"ok\",\"changed\":";
+    response += dirty;
+    response += ",\"config\":";
+    configToJson(pendingConfigDirty ? pendingConfig : config, response);
+    response += "}\n";
+    server.send(200, "application/json", response);
+    return;
+  }
+  
+  String response;
+  configToJson(config, response);
+  response += "\n";
+  server.send(200, "application/json", response);
+}
+
+// Swap in a staged config change between two frames and rebuild only what
+// depends on the fields that changed
+void applyPendingConfig() {
+  if (!pendingConfigDirty) {
+    return;
+  }
+  TRACE_SCOPE("applyConfig");
+  int dirty = pendingConfigDirty;
+  config = pendingConfig;
+  pendingConfigDirty = 0;
+  
+  if (dirty & CONFIG_DIRTY_BRIGHTNESS) {
+    FastLED.setBrightness(config.brightness);
+  }
+  if (dirty & CONFIG_DIRTY_OUTPUT) {
+    outputLutBuild(outputLut, config.gamma, config.whiteBalance);
+  }
+  if (dirty & (CONFIG_DIRTY_RED | CONFIG_DIRTY_GREEN | CONFIG_DIRTY_OUTPUT)) {
+    prerenderFirstFrames(dirty);
+  }
+  // Blink configs are copied when a blink starts: a running blink finishes
+  // with the old one. Everything else is read per frame or per sample.
+  
+  configUnsaved = true;
+  configChangedAt = millis();
+  LOG_INFO("Config changed (0x%02X)", dirty);
+}
+
+// Store the config once no change has come in for CONFIG_SAVE_DELAY (or
+// right away with `now`, before an update restarts the board)
+void saveConfig(bool now) {
+  if (!configUnsaved || (!now && millis() - configChangedAt < CONFIG_SAVE_DELAY)) {
+    return;
+  }
+  TRACE_SCOPE("saveConfig");
+  configUnsaved = false;
+  if (configSave(config)) {
+    LOG_INFO("Config saved");
+  } else {
+    LOG_WARN("Saving the config to NVS failed");
+  }
+}
+
+// Append the time sync state as JSON fields
+void appendSyncJson(String& response) {
+  response += "\"role\":\"";
+  response += timeSyncRoleName(timeSync.role);
+  response += "\",\"nodeId\":";
+  response += timeSync.nodeId;
+  response += ",\"masterId\":";
+  response += timeSync.role == SYNC_FOLLOWER ? timeSync.masterId : timeSync.nodeId;
+  response += ",\"locked\":";
+  response += timeSync.locked ? "true" : "false";
+  response += ",\"offsetUs\":";
+  response += (long)timeSync.lastOffsetUs;
+  response += ",\"delayUs\":";
+  response += (long)timeSync.lastDelayUs;
+  response += ",\"freqPpm\":";
+  response += String(timeSync.freqPpb / 1000.0, 3);
+  response += ",\"beacons\":";
+  response += timeSync.beacons;
+  response += ",\"exchanges\":";
+  response += timeSync.exchanges;
+  response += ",\"steps\":";
+  response += timeSync.steps;
+  response += ",\"lost\":";
+  response += timeSync.lost;
+}
+
+void appendHistogramJson(String& response, const unsigned long* hist) {
+  response += "[";
+  for (int i = 0; i < TRACE_HIST_BUCKETS; i++) {
+    if (i > 0) response += ",";
+    response += hist[i];
   }
+  response += "]";
+}
+
+// Passage count and reaction time histograms (bucket upper bounds in ms,
+// the last bucket is everything above)
+void appendLatencyJson(String& response) {
+  response += "\"passages\":";
+  response += passageTrace.passages;
+  response += ",\"bucketsMs\":[";
+  for (int i = 0; i < TRACE_HIST_BUCKETS - 1; i++) {
+    if (i > 0) response += ",";
+    response += TRACE_HIST_LIMITS_MS[i];
+  }
+  response += "],\"photon\":";
+  appendHistogramJson(response, passageTrace.photonHist);
+  response += ",\"mqtt\":";
+  appendHistogramJson(response, passageTrace.mqttHist);
+  response += ",\"mqttSkipped\":";
+  response += passageTrace.mqttSkipped;
+}
+
+// GET /latency - recent passages, newest first. Stage times are us after the
+// echo; stages the passage didn't reach are left out.
+void handleLatency() {
+  TRACE_SCOPE("handleLatency");
+  String response = "{";
+  appendLatencyJson(response);
+  response += ",\"traces\":[";
+  for (uint8_t age = 0; age < passageTrace.count; age++) {
+    const PassageTrace* tr = traceGet(passageTrace, age);
+    if (age > 0) response += ",";
+    response += "{\"id\":";
+    response += tr->id;
+    response += ",\"time\":";
+    response += tr->time;
+    response += ",\"target\":";
+    response += tr->target;
+    response += ",\"us\":{";
+    bool first = true;
+    for (uint8_t stage = 0; stage < STAGE_COUNT; stage++) {
+      if (!(tr->marked & (1 << stage))) continue;
+      if (!first) response += ",";
+      first = false;
+      response += "\"";
+      response += traceStageName(stage);
+      response += "\":";
+      response += tr->stageUs[stage] - tr->stageUs[STAGE_ECHO];
+    }
+    response += "}}";
+  }
+  response += "]}\n";
+  
+  server.send(200, "application/json", response);
+}
+
+#if PORTAL_TRACE
+void sendTraceChunk(const char* data, size_t len) {
+  server.sendContent(data, len);
+}
+
+// GET /trace.json - execution timeline in Chrome trace-event format
+void handleTrace() {
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "application/json", "");
+  timelineExport(sendTraceChunk);
+  server.sendContent("");  // End of chunked response
+}
+#endif
+
+// GET /metrics - runtime counters
+void handleMetrics() {
+  TRACE_SCOPE("handleMetrics");
+  unsigned long now = millis();
+  
+  String response = "{\"uptime\":";
+  response += now;
+  response += ",\"state\":";
+  response += portalStateNumber(portal.state);
+  response += ",\"transitions\":";
+  response += portal.transitionCount;
+  response += ",\"droppedEvents\":";
+  response += portal.droppedEvents;
+  response += ",\"boot\":{\"firstFrame\":";
+  response += bootTimes.firstFrame;
+  response += ",\"setup\":";
+  response += bootTimes.setupDone;
+  response += ",\"detection\":";
+  response += bootTimes.detection;
+  response += ",\"wifi\":";
+  response += bootTimes.wifi;
+  response += ",\"network\":";
+  response += bootTimes.network;
+  response += ",\"mqtt\":";
+  response += bootTimes.mqtt;
+  response += ",\"reset\":\"";
+  response += snapshotResetReason();
+  response += "\",\"restored\":";
+  response += warmRestart ? "true" : "false";
+  response += "},\"wifi\":{";
+  appendWifiJson(response);
+  response += "},\"stream\":{";
+  appendStreamJson(response, now);
+  response += "},\"sync\":{";
+  appendSyncJson(response);
+  response += "},\"trigger\":{\"count\":";
+  response += triggerLatency.count;
+  response += ",\"lastUs\":";
+  response += triggerLatency.lastUs;
+  response += ",\"meanUs\":";
+  response += (unsigned long)(triggerLatency.count ? triggerLatency.totalUs / triggerLatency.count : 0);
+  response += ",\"maxUs\":";
+  response += triggerLatency.maxUs;
+  response += ",\"showUs\":";
+  response += triggerLatency.lastShowUs;
+  response += "},\"latency\":{";
+  appendLatencyJson(response);
+  response += "},\"sparks\":{\"active\":";
+  response += sparks.active;
+  response += ",\"spawned\":";
+  response += sparks.spawned;
+  response += ",\"dropped\":";
+  response += sparks.dropped;
+  response += "},\"fade\":{\"started\":";
+  response += transition.started;
+  response += ",\"frames\":";
+  response += transition.frames;
+  response += ",\"blendUsMean\":";
+  response += (unsigned long)(transition.frames ? transition.blendUsTotal / transition.frames : 0);
+  response += ",\"blendUsMax\":";
+  response += transition.blendUsMax;
+  response += "},\"clips\":{";
+  appendClipsJson(response);
+  response += "},\"sequence\":{";
+  appendSequenceJson(response);
+  response += "},\"log\":{\"written\":";
+  LogStats log = logStats();
+  response += log.written;
+  response += ",\"dropped\":";
+  response += log.dropped;
+  response += "},\"control\":{\"enabled\":";
+  response += control.enabled ? "true" : "false";
+  response += ",\"commands\":";
+  response += control.commands;
+  response += ",\"retries\":";
+  response += control.retries;
+  response += ",\"stale\":";
+  response += control.stale;
+  response += ",\"challenges\":";
+  response += control.challenges;
+  response += ",\"badTags\":";
+  response += control.badTags;
+  response += ",\"badPackets\":";
+  response += control.badPackets;
+  response += "}}\n";
+  
+  server.send(200, "application/json", response);
 }
 
 // Function to trigger random blink (60% green, 40% red)
 void triggerRandomBlink() {
-  if (currentState == ROTATING) {
+  if (portalIdle(portal.state)) {
     // Generate random number between 0-99
     int randomValue = random(100);
+    PortalState target;
     
     if (randomValue < 60) {
       // 60% chance for green blink
-      Serial.println("Random trigger: GREEN (60% chance)");
-      triggerGreenBlink();
+      LOG_INFO("Random trigger: GREEN (60%% chance)");
+      target = BLINK_GREEN;
     } else {
       // 40% chance for red blink
-      Serial.println("Random trigger: RED (40% chance)");
-      triggerRedBlink();
+      LOG_INFO("Random trigger: RED (40%% chance)");
+      target = BLINK_RED;
     }
+    traceTarget(passageTrace, portalStateNumber(target));
+    portalPost(portal, EV_SENSOR_ENTER, millis(), target);
+  } else {
+    // Nothing to show: the trace ends at the decision
+    traceEnd(passageTrace);
   }
 }
 
 // Publish current state to MQTT
 void publishStateToMQTT() {
+  TRACE_SCOPE("publishState");
   if (!mqttClient.connected()) {
-    return; // Don't try to publish if not connected
+    // Don't try to publish if not connected; a passage waiting for this
+    // publish ends here instead of at the next one
+    traceSkip(passageTrace, STAGE_MQTT_QUEUED);
+    return;
   }
   
-  String stateStr;
-  switch (currentState) {
-    case ROTATING:
-      stateStr = "1";
-      break;
-    case BLINK_RED:
-      stateStr = "2";
-      break;
-    case BLINK_GREEN:
-      stateStr = "3";
-      break;
-  }
+  String stateStr = String(portalStateNumber(portal.state));
   
+  traceMark(passageTrace, STAGE_MQTT_QUEUED, micros());
   mqttClient.publish(mqtt_topic_state, stateStr.c_str());
-  Serial.print("MQTT: Published state ");
-  Serial.print(stateStr);
-  Serial.print(" to ");
-  Serial.println(mqtt_topic_state);
+  traceMark(passageTrace, STAGE_MQTT_SENT, micros());
+  LOG_INFO("MQTT: Published state %s to %s", stateStr, mqtt_topic_state);
+}
+
+// Publish passage start/end with the estimated walking direction to MQTT
+void publishPassageToMQTT(bool started, unsigned long duration) {
+  TRACE_SCOPE("publishPassage");
+  if (!mqttClient.connected()) {
+    return;
+  }
+  
+  String payload = "{\"event\":";
+  if (started) {
+    payload += "\"start\",\"direction\":\"";
+    payload += directionName(numSensors > 1 ? directionProvisional(passageDirection) : DIR_UNKNOWN);
+    payload += "\"";
+  } else {
+    PassageEstimate estimate = directionEstimate(passageDirection, SENSOR_SPACING_CM);
+    payload += "\"end\",\"direction\":\"";
+    payload += directionName(estimate.direction);
+    payload += "\",\"velocity\":";
+    payload += String(estimate.velocity, 1);
+    payload += ",\"lag\":";
+    payload += String(estimate.lagMs, 1);
+    payload += ",\"duration\":";
+    payload += duration;
+  }
+  payload += ",\"sensors\":";
+  payload += numSensors;
+  payload += "}";
+  
+  mqttClient.publish(mqtt_topic_passage, payload.c_str());
+  LOG_INFO("MQTT: Published passage %s", payload);
+}
+
+// Publish timeline progress: {"event":"step","id":"scare",...}. `fields`
+// are appended after the id, starting with a comma.
+void publishSequenceEvent(const char* event, const String& fields) {
+  if (!mqttClient.connected()) {
+    return;
+  }
+  String payload = "{\"event\":\"";
+  payload += event;
+  payload += "\",\"id\":\"";
+  payload += sequencer.timeline.id;
+  payload += "\"";
+  payload += fields;
+  payload += "}";
+  mqttClient.publish(mqtt_topic_sequence_event, payload.c_str());
 }
 
 // Reconnect to MQTT broker
 void reconnectMQTT() {
+  TRACE_SCOPE("reconnectMQTT");
   // Don't block if MQTT is down
   if (!mqttClient.connected()) {
-    Serial.print("Attempting MQTT connection...");
+    LOG_INFO("Attempting MQTT connection...");
     
     // Create a random client ID
     String clientId = "ESP32Portal-";
@@ -567,191 +1460,290 @@ void reconnectMQTT() {
     
     // Attempt to connect
     if (mqttClient.connect(clientId.c_str(), mqtt_user, mqtt_password)) {
-      Serial.println("connected");
+      LOG_INFO("MQTT connected");
+      if (!bootTimes.mqtt) {
+        bootTimes.mqtt = millis();
+      }
+      mqttClient.subscribe(mqtt_topic_command);
+      mqttClient.subscribe(mqtt_topic_config);
+      mqttClient.subscribe(mqtt_topic_sequence);
       publishStateToMQTT(); // Publish initial state
     } else {
-      Serial.print("failed, rc=");
-      Serial.print(mqttClient.state());
-      Serial.println(" (will retry later)");
+      LOG_WARN("MQTT connection failed, rc=%d (will retry later)", mqttClient.state());
     }
   }
 }
 
-// Function to check if red blink should end (removed - now manual reset only)
-// State 2 (red) now stays until manually reset via API
+// Handle commands on portal/command (red, green, reset, abort), config
+// changes on portal/config (JSON, like PUT /config) and timelines on
+// portal/sequence (JSON, like POST /sequence)
+void onMqttMessage(char* topic, uint8_t* payload, unsigned int length) {
+  TRACE_SCOPE("mqttMessage");
+  String command;
+  for (unsigned int i = 0; i < length; i++) {
+    command += (char)payload[i];
+  }
+  command.trim();
+  
+  if (strcmp(topic, mqtt_topic_config) == 0) {
+    String error;
+    if (queueConfigJson(command.c_str(), error) < 0) {
+      LOG_WARN("MQTT: Config change rejected: %s", error);
+    }
+    return;
+  }
+  if (strcmp(topic, mqtt_topic_sequence) == 0) {
+    String error;
+    if (!startSequence(command.c_str(), error)) {
+      LOG_WARN("MQTT: Timeline rejected: %s", error);
+    }
+    return;
+  }
+  
+  unsigned long now = millis();
+  if (command == "red") {
+    portalPost(portal, EV_MQTT_RED, now);
+  } else if (command == "green") {
+    portalPost(portal, EV_MQTT_GREEN, now);
+  } else if (command == "reset") {
+    portalPost(portal, EV_MQTT_RESET, now);
+  } else if (command == "abort") {
+    abortSequence();
+  } else {
+    LOG_WARN("MQTT: Unknown command on %s: %s", String(topic), command);
+  }
+}
+
+// Passage over: the state machine returns green to ROTATING, red stays
+// until a manual reset
+void endPassage(unsigned long now, unsigned long passageDuration) {
+  inPassage = false;
+  lastPassageEndTime = now;
+  publishPassageToMQTT(false, passageDuration);
+  portalPost(portal, EV_SENSOR_EXIT, now);
+  
+  if (portal.state == BLINK_RED) {
+    LOG_INFO("Staying in RED state (requires manual reset)");
+  }
+}
 
 // Function to check if someone is moving through the portal
 void checkMotionDetection() {
+  TRACE_SCOPE("checkMotionDetection");
   unsigned long now = millis();
   
   // Check if sensor warmup period has passed
   if (!sensorWarmedUp) {
     if (now - sensorStartTime > SENSOR_WARMUP_TIME) {
       sensorWarmedUp = true;
-      Serial.println("Motion sensor warmup complete, detection active");
-      Serial.print("Initial distance: ");
-      Serial.print(lastDistance);
-      Serial.println(" cm");
+      bootTimes.detection = now;
+      LOG_INFO("Motion sensor warmup complete, detection active");
+      LOG_INFO("Initial distance: %.2f cm", lastDistance);
     } else {
       // During warmup, just read without triggering
-      if (now - lastSensorRead > SENSOR_READ_INTERVAL) {
-        float distance = measureDistance();
-        if (distance >= MIN_DETECTION_DISTANCE && distance <= MAX_DETECTION_DISTANCE) {
-          lastDistance = distance;
-        }
-        lastSensorRead = now;
+      int sampled = sensorSampleNext(now);
+      if (sampled >= 0 && sensors[sampled].valid) {
+        lastDistance = sensors[sampled].distance;
       }
       return;
     }
   }
   
-  if (now - lastSensorRead > SENSOR_READ_INTERVAL) {
-    float distance = measureDistance();
-    
-    // Check if reading is valid
-    bool validReading = (distance >= MIN_DETECTION_DISTANCE && distance <= MAX_DETECTION_DISTANCE);
+  // Only one sensor is pinged per call (interleaved time slots)
+  int sampled = sensorSampleNext(now);
+  if (sampled < 0) {
+    return;
+  }
+  
+  // Combine the latest reading of all sensors: the closest valid reading wins
+  bool validReading = false;
+  float distance = sensors[sampled].distance;
+  int closest = sampled;
+  for (int s = 0; s < numSensors; s++) {
+    if (sensors[s].valid && (!validReading || sensors[s].distance < distance)) {
+      validReading = true;
+      distance = sensors[s].distance;
+      closest = s;
+    }
+  }
+  
+  if (inPassage) {
+    directionAddSample(passageDirection, sampled, now, sensors[sampled].distance,
+                       sensors[sampled].valid, config.detectionRange);
+  }
+  
+  if (validReading) {
+    bool someoneInPortal = (distance < config.detectionRange);
+    bool inCooldown = (now - lastPassageEndTime) < (unsigned long)config.passageCooldown;
     
-    if (validReading) {
-      bool someoneInPortal = (distance < DETECTION_RANGE);
-      bool inCooldown = (now - lastPassageEndTime) < PASSAGE_COOLDOWN;
+    if (!inPassage && !inCooldown && someoneInPortal) {
+      // Someone just entered the portal - start passage
+      traceBegin(passageTrace, sensors[closest].echoUs, micros(), now);
+      LOG_INFO("PASSAGE STARTED! Distance: %.2f cm (someone in portal)", distance);
       
-      if (!inPassage && !inCooldown && someoneInPortal) {
-        // Someone just entered the portal - start passage
-        Serial.print("PASSAGE STARTED! Distance: ");
-        Serial.print(distance);
-        Serial.println(" cm (someone in portal)");
-        
-        inPassage = true;
-        passageStartTime = now;
-        triggerRandomBlink(); // Use random selection (60% green, 40% red)
-        
-      } else if (inPassage) {
-        unsigned long passageDuration = now - passageStartTime;
-        
-        if (!someoneInPortal) {
-          // No one in portal anymore - check if we can end passage
-          if (passageDuration >= MIN_PASSAGE_DURATION) {
-            Serial.print("PASSAGE ENDED after ");
-            Serial.print(passageDuration);
-            Serial.print(" ms. Distance: ");
-            Serial.print(distance);
-            Serial.println(" cm (portal clear)");
-            
-            inPassage = false;
-            lastPassageEndTime = now;
-            
-            // Return to ROTATING state - but ONLY if we're in GREEN state
-            // RED state (2) must stay until manual API reset
-            if (currentState == BLINK_GREEN) {
-              currentState = ROTATING;
-              autoTriggered = false;
-              publishStateToMQTT();
-              Serial.println("Returning to ROTATING state");
-            } else if (currentState == BLINK_RED) {
-              Serial.println("Staying in RED state (requires manual reset)");
-            }
-          } else {
-            // Minimum duration not reached yet
-            Serial.print("Maintaining state (min duration not reached: ");
-            Serial.print(passageDuration);
-            Serial.print("/");
-            Serial.print(MIN_PASSAGE_DURATION);
-            Serial.print(" ms, distance: ");
-            Serial.print(distance);
-            Serial.println(" cm)");
-          }
-        } else {
-          // Someone still in portal - keep state active
-          if ((passageDuration % 500) == 0) {  // Log every 500ms to avoid spam
-            Serial.print("Person in portal (distance: ");
-            Serial.print(distance);
-            Serial.print(" cm, duration: ");
-            Serial.print(passageDuration);
-            Serial.println(" ms)");
-          }
-        }
+      inPassage = true;
+      passageStartTime = now;
+      
+      // Seed the direction estimator with the latest reading of every sensor
+      directionReset(passageDirection, now);
+      for (int s = 0; s < numSensors; s++) {
+        directionAddSample(passageDirection, s, sensors[s].sampleTime, sensors[s].distance,
+                           sensors[s].valid, config.detectionRange);
       }
       
-      lastDistance = distance;
+      // Publish the passage before the state so the controller knows the direction
+      publishPassageToMQTT(true, 0);
+      triggerRandomBlink(); // Use random selection (60% green, 40% red)
       
-    } else {
-      // Invalid reading (out of range)
-      if (inPassage) {
-        unsigned long passageDuration = now - passageStartTime;
-        
-        if (passageDuration >= MIN_PASSAGE_DURATION) {
-          Serial.print("PASSAGE ENDED (out of range) after ");
-          Serial.print(passageDuration);
-          Serial.print(" ms. Distance: ");
-          Serial.print(distance);
-          Serial.println(" cm");
-          
-          inPassage = false;
-          lastPassageEndTime = now;
+    } else if (inPassage) {
+      unsigned long passageDuration = now - passageStartTime;
+      
+      if (!someoneInPortal) {
+        // No one in portal anymore - check if we can end passage
+        if (passageDuration >= (unsigned long)config.minPassageDuration) {
+          LOG_INFO("PASSAGE ENDED after %lu ms. Distance: %.2f cm (portal clear)", passageDuration, distance);
           
-          // Return to ROTATING state - but ONLY if we're in GREEN state
-          if (currentState == BLINK_GREEN) {
-            currentState = ROTATING;
-            autoTriggered = false;
-            publishStateToMQTT();
-            Serial.println("Returning to ROTATING state");
-          } else if (currentState == BLINK_RED) {
-            Serial.println("Staying in RED state (requires manual reset)");
-          }
+          endPassage(now, passageDuration);
+        } else {
+          // Minimum duration not reached yet (every sample, debug builds only)
+          LOG_DEBUG("Maintaining state (min duration not reached: %lu/%d ms, distance: %.2f cm)",
+                    passageDuration, config.minPassageDuration, distance);
+        }
+      } else {
+        // Someone still in portal - keep state active, keep the sparks coming
+        if (config.sparks > 0 && !portalIdle(portal.state)) {
+          particlesBurst(sparks, SPARK_LED, 1, portal.activeBlinkConfig.color,
+                         SPARK_MIN_SPEED, SPARK_MAX_SPEED, SPARK_LIFE);
+        }
+        if ((passageDuration % 500) == 0) {  // Log every 500ms to avoid spam
+          LOG_INFO("Person in portal (distance: %.2f cm, duration: %lu ms)", distance, passageDuration);
         }
       }
     }
     
-    lastSensorRead = now;
+    lastDistance = distance;
+    
+  } else {
+    // Invalid reading (out of range)
+    if (inPassage) {
+      unsigned long passageDuration = now - passageStartTime;
+      
+      if (passageDuration >= (unsigned long)config.minPassageDuration) {
+        LOG_INFO("PASSAGE ENDED (out of range) after %lu ms. Distance: %.2f cm", passageDuration, distance);
+        
+        endPassage(now, passageDuration);
+      }
+    }
   }
 }
 
-void setup() {
-  Serial.begin(115200);
-  delay(500); // Give serial port time to initialize
+// Network services, started from loop() the first time WiFi connects.
+// Until then the portal animates and detects passages offline.
+void startNetwork() {
+  unsigned long now = millis();
+  bootTimes.wifi = now;
+  LOG_INFO("IP address: %s", WiFi.localIP().toString());
   
-  Serial.println("\n\n=== RGB Portal Starting ===");
+  // Initialize random seed for random blink selection
+  randomSeed(micros());
+  
+  ArduinoOTA.begin();
+  LOG_INFO("OTA ready");
   
-  // Initialize ultrasonic sensor pins
-  pinMode(TRIG_PIN, OUTPUT);
-  pinMode(ECHO_PIN, INPUT);
-  Serial.println("Ultrasonic sensor initialized");
+  // Network pixel input
+  streamBegin(pixelStream, leds, NUM_LEDS, streamSlots, DDP_PORT);
+  streamSetDepth(pixelStream, STREAM_JITTER_DEPTH);
+  LOG_INFO("DDP input on UDP port %u", DDP_PORT);
+  
+  // Animation clock shared with other portals; the lowest node ID is master
+  timeSyncBegin(timeSync, (uint32_t)(ESP.getEfuseMac() >> 16), TIME_SYNC_PORT, esp_timer_get_time());
+  LOG_INFO("Time sync on UDP port %u, node ID %X", TIME_SYNC_PORT, timeSync.nodeId);
+  
+  // Controller commands over UDP (needs CONTROL_KEY in secrets.h)
+  if (controlBegin(control, CONTROL_KEY, CONTROL_PORT)) {
+    LOG_INFO("UDP control on port %u", CONTROL_PORT);
+  } else {
+    LOG_WARN("UDP control disabled (no valid CONTROL_KEY)");
+  }
   
-  // Initialize FastLED
-  FastLED.addLeds<LED_TYPE, LED_PIN, COLOR_ORDER>(leds, NUM_LEDS);
-  FastLED.setBrightness(50); // Set brightness (0-255)
-  Serial.println("FastLED initialized");
+  server.begin();
+  LOG_INFO("HTTP server started");
   
-  // Set initial state to ROTATING before any updates
-  currentState = ROTATING;
-  autoTriggered = false;
-  blinkingDone = false;
-  Serial.println("Initial state set to ROTATING");
+  networkUp = true;
+  bootTimes.network = millis();
   
-  // Draw initial rotating effect
-  drawRotatingEffect();
-  Serial.println("Initial portal effect displayed");
+  lastMqttReconnectAttempt = bootTimes.network;
+  reconnectMQTT();
   
-  // Initialize motion sensor warmup
+  LOG_INFO("=== SYSTEM READY === first frame %lu ms, detection %lu ms, WiFi %lu ms, network %lu ms",
+           bootTimes.firstFrame, bootTimes.detection, bootTimes.wifi, bootTimes.network);
+}
+
+void setup() {
+  // First frame before anything else: the strip shows the portal within
+  // milliseconds of power-on (or of a warm reset, in the state it was in)
+  bool configStored = configLoad(config);
+  FastLED.addLeds<LED_TYPE, LED_PIN, COLOR_ORDER>(outputLeds, NUM_LEDS);
+  geometryBuildArch(geometry, NUM_LEDS, PORTAL_WIDTH_MM, PORTAL_LEG_MM);
+  FastLED.setBrightness(config.brightness); // Dithered, the output LUT is full range
+  outputLutBuild(outputLut, config.gamma, config.whiteBalance);
+  portalInit(portal, &config.red, &config.green);
+  
+  // Initialize ultrasonic sensor pins (outer sensor first)
+  sensorAdd(TRIG_PIN, ECHO_PIN);
+#if NUM_SENSORS > 1
+  sensorAdd(TRIG2_PIN, ECHO2_PIN);
+#endif
+  sensorConfigure(MIN_DETECTION_DISTANCE, MAX_DETECTION_DISTANCE, SENSOR_READ_INTERVAL);
   sensorStartTime = millis();
-  sensorWarmedUp = false;
-  Serial.println("Motion sensor warmup started (3 seconds)...");
+  warmRestart = restoreSnapshot();
+  
+  updateLEDs();
+  bootTimes.firstFrame = millis();
+  
+  Serial.begin(115200);
+  
+  // Log output from loop() goes through the drain task (setup prints directly)
+  logBegin(LOG_SYSLOG_HOST);
   
-  // Connect to WiFi
-  Serial.println("Connecting to WiFi...");
-  WiFi.begin(ssid, password);
+  Serial.println("\n\n=== RGB Portal Starting ===");
+  Serial.print("Reset: ");
+  Serial.println(snapshotResetReason());
+  Serial.print("Initial portal effect displayed after ");
+  Serial.print(bootTimes.firstFrame);
+  Serial.println(" ms");
+  Serial.println(configStored ? "Config loaded from NVS" : "Config: defaults");
+  Serial.print("Ultrasonic sensor initialized (");
+  Serial.print(numSensors);
+  Serial.println(numSensors > 1 ? " sensors, interleaved)" : " sensor)");
   
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(500);
-    Serial.print(".");
+  if (warmRestart) {
+    Serial.print("Warm restart: state ");
+    Serial.print(portalStateName(portal.state));
+    Serial.println(" restored, detection active");
+  } else {
+    Serial.print("Motion sensor warmup started (");
+    Serial.print(SENSOR_WARMUP_TIME);
+    Serial.println(" ms)...");
   }
   
-  Serial.println("\nWiFi connected!");
-  Serial.print("IP address: ");
-  Serial.println(WiFi.localIP());
+  prerenderFirstFrames(CONFIG_DIRTY_RED | CONFIG_DIRTY_GREEN);
+  if (clipsBegin(clips)) {
+    Serial.print("Clips in flash: ");
+    Serial.println(clips.header ? clips.header->count : 0);
+  } else {
+    Serial.println("No clips partition");
+  }
+  traceInit(passageTrace);
+  particlesInit(sparks, (uint32_t)esp_random());
   
-  // Initialize random seed for random blink selection
-  randomSeed(micros());
+  // Connect to WiFi in the background; loop() starts the network services
+  // once it is up (see startNetwork)
+  wifiLinkBegin(wifiLink, ssid, password, WIFI_STATIC_IP, WIFI_GATEWAY, WIFI_SUBNET, WIFI_DNS,
+                WIFI_REUSE_LEASE, millis());
+  Serial.print("Connecting to WiFi (");
+  Serial.print(wifiLinkPhaseName(wifiLink.phase));
+  Serial.println(")...");
   
   // Setup OTA updates
   ArduinoOTA.setHostname("rgb_portal");
@@ -764,6 +1756,7 @@ void setup() {
       type = "filesystem";
     }
     Serial.println("Start updating " + type);
+    saveConfig(true);
   });
   
   ArduinoOTA.onEnd([]() {
@@ -789,16 +1782,16 @@ void setup() {
     }
   });
   
-  ArduinoOTA.begin();
-  Serial.println("OTA ready");
-  
   // Setup MQTT
   mqttClient.setServer(mqtt_server, mqtt_port);
+  mqttClient.setCallback(onMqttMessage);
+  if (!mqttClient.setBufferSize(MQTT_BUFFER_SIZE)) {
+    LOG_WARN("MQTT buffer of %d bytes not allocated", MQTT_BUFFER_SIZE);
+  }
   Serial.print("MQTT server set to: ");
   Serial.print(mqtt_server);
   Serial.print(":");
   Serial.println(mqtt_port);
-  reconnectMQTT();
   
   // REST API endpoints
   
@@ -823,49 +1816,111 @@ void setup() {
   // GET /signal - Get WiFi signal strength
   server.on("/signal", handleWiFiSignal);
   
+  // GET /stream - Network pixel input statistics (?depth=N sets the jitter buffer depth)
+  server.on("/stream", handleStream);
+  
+  // GET /metrics - Runtime counters
+  server.on("/metrics", handleMetrics);
+  
+  // GET /config - Runtime configuration, PUT/POST /config changes it
+  server.on("/config", handleConfig);
+  
+  // GET /clips - Pre-rendered clips in flash, POST /clips uploads an image
+  server.on("/clips", HTTP_GET, handleClips);
+  server.on("/clips", HTTP_POST, handleClipUploadDone, handleClipUpload);
+  
+  // GET /play?clip=NAME - Play a clip
+  server.on("/play", handlePlay);
+  
+  // GET /sequence - Running timeline, POST starts one, DELETE aborts it
+  server.on("/sequence", handleSequence);
+  
+  // GET /latency - Passage traces (echo to LEDs and MQTT)
+  server.on("/latency", handleLatency);
+  
+#if PORTAL_TRACE
+  // GET /trace.json - Execution timeline (open in ui.perfetto.dev)
+  server.on("/trace.json", handleTrace);
+#endif
+  
   // GET / - Welcome page
   server.on("/", handleRoot);
   
-  // Start server
-  server.begin();
-  Serial.println("HTTP server started!");
-  
-  // Extra status message (in case serial monitor started late)
-  delay(1000);
-  Serial.println("\n=== SYSTEM READY ===");
-  Serial.print("Portal state: ROTATING (green)\n");
-  Serial.print("IP: ");
-  Serial.println(WiFi.localIP());
-  Serial.println("====================\n");
+  bootTimes.setupDone = millis();
+  if (warmRestart) {
+    bootTimes.detection = bootTimes.setupDone; // No warmup: detection runs from the first loop pass
+  }
+  Serial.print("Setup done after ");
+  Serial.print(bootTimes.setupDone);
+  Serial.println(" ms, portal running");
 }
 
 void loop() {
-  // Handle OTA updates
-  ArduinoOTA.handle();
+  TRACE_SCOPE("loop");
   
-  // Maintain WiFi connection
-  if (WiFi.status() != WL_CONNECTED) {
-    unsigned long now = millis();
-    if (now - lastWiFiReconnectAttempt > WIFI_RECONNECT_INTERVAL) {
-      lastWiFiReconnectAttempt = now;
-      Serial.println("WiFi disconnected! Attempting to reconnect...");
-      WiFi.reconnect();
+  // Network services come up once WiFi is connected; the portal runs
+  // offline until then
+  if (!networkUp) {
+    if (WiFi.status() == WL_CONNECTED) {
+      startNetwork();
+    }
+  } else {
+    // Controller commands first: they are the latency-critical input
+    {
+      TRACE_SCOPE("controlPoll");
+      controlPoll(control, millis(), onControlCommand);
+    }
+    
+    // Handle OTA updates
+    {
+      TRACE_SCOPE("ota");
+      ArduinoOTA.handle();
     }
   }
   
+  // Maintain WiFi connection
+  switch (wifiLinkPoll(wifiLink, millis())) {
+    case LINK_LOST:
+      LOG_WARN("WiFi disconnected! Reconnecting (%s)...", wifiLinkPhaseName(wifiLink.phase));
+      break;
+    case LINK_FALLBACK:
+      LOG_WARN("WiFi direct association failed, scanning");
+      break;
+    case LINK_CONNECTED:
+      LOG_INFO("WiFi up after %lu ms (%s)", wifiLink.lastConnectMs, wifiLink.lastDirect ? "direct" : "scan");
+      break;
+    default:
+      break;
+  }
   // Maintain MQTT connection (non-blocking)
-  if (!mqttClient.connected()) {
-    static unsigned long lastReconnectAttempt = 0;
-    unsigned long now = millis();
-    if (now - lastReconnectAttempt > 5000) { // Try reconnecting every 5 seconds
-      lastReconnectAttempt = now;
-      reconnectMQTT();
+  if (WiFi.status() == WL_CONNECTED) {
+    if (!mqttClient.connected()) {
+      unsigned long now = millis();
+      if (now - lastMqttReconnectAttempt > MQTT_RECONNECT_INTERVAL) {
+        lastMqttReconnectAttempt = now;
+        reconnectMQTT();
+      }
+    } else {
+      TRACE_SCOPE("mqttLoop");
+      mqttClient.loop();
     }
-  } else {
-    mqttClient.loop();
   }
   
-  server.handleClient();
-  updateAnimations();
+  if (networkUp) {
+    TRACE_SCOPE("handleClient");
+    server.handleClient();
+  }
   checkMotionDetection();
-}
\ No newline at end of file
+  if (networkUp) {
+    checkPixelStream();
+    TRACE_SCOPE("timeSyncPoll");
+    timeSyncPoll(timeSync, esp_timer_get_time());
+  }
+  checkSequence();
+  processPortalEvents();
+  checkClipPlayback();
+  applyPendingConfig();
+  saveConfig(false);
+  updateAnimations();
+  checkTransition();
+}
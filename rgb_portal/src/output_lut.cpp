@@ -0,0 +1,37 @@
+#include "output_lut.h"
+#include <math.h>
+
+void outputLutBuild(OutputLut& lut, float gamma, const CRGB& balance) {
+  lut.gamma = gamma;
+  lut.balance = balance;
+
+  // Gamma curve in 16.16 fixed point, shared by all three channels
+  uint32_t curve[256];
+  for (int i = 0; i < 256; i++) {
+    curve[i] = (uint32_t)(powf(i / 255.0f, gamma) * 255.0f * 65536.0f + 0.5f);
+  }
+
+  for (int c = 0; c < 3; c++) {
+    uint32_t scale = balance[c];
+    lut.table[c][0] = 0;
+    for (int i = 1; i < 256; i++) {
+      uint32_t v = (uint32_t)(((uint64_t)curve[i] * scale + 255ull * 32768) / (255ull * 65536));
+      if (v == 0 && scale > 0) {
+        v = 1;
+      }
+      lut.table[c][i] = (uint8_t)v;
+    }
+  }
+}
+
+void outputLutApply(const OutputLut& lut, const CRGB* in, CRGB* out, int count) {
+  const uint8_t* r = lut.table[0];
+  const uint8_t* g = lut.table[1];
+  const uint8_t* b = lut.table[2];
+  for (int i = 0; i < count; i++) {
+    CRGB c = in[i];
+    out[i].r = r[c.r];
+    out[i].g = g[c.g];
+    out[i].b = b[c.b];
+  }
+}
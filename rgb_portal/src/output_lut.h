@@ -0,0 +1,33 @@
+#ifndef OUTPUT_LUT_H
+#define OUTPUT_LUT_H
+
+#include <FastLED.h>
+
+// Output stage: gamma and white balance in one table.
+//
+// Renderers work in linear 0-255 values. Before a frame goes to the strip
+// every byte is looked up in a per-channel table that holds
+//
+//   out = 255 * (in / 255)^gamma * balance / 255
+//
+// so all color correction is one lookup per byte. The table spans the full
+// 0-255 range: global brightness stays with FastLED.setBrightness(), whose
+// temporal dithering keeps the low end smooth. Folded into 8-bit entries a
+// brightness of 50 would leave about 50 output levels and every input up to
+// about 50 at 1. A lit input stays lit (at least 1) as long as its channel
+// isn't scaled to 0, so dim colors don't drop out under gamma. The table is
+// only rebuilt when gamma or white balance change.
+
+struct OutputLut {
+  uint8_t table[3][256];   // r, g, b
+  float gamma;
+  CRGB balance;
+};
+
+// Rebuild the table (768 entries, 256 powf calls)
+void outputLutBuild(OutputLut& lut, float gamma, const CRGB& balance);
+
+// Convert a rendered frame into output values (`in` and `out` may be the same)
+void outputLutApply(const OutputLut& lut, const CRGB* in, CRGB* out, int count);
+
+#endif
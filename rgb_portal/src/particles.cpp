@@ -0,0 +1,111 @@
+#include "particles.h"
+
+void particlesInit(ParticlePool& p, uint32_t seed) {
+  p.active = 0;
+  p.seed = seed ? seed : 1;
+  p.spawned = 0;
+  p.dropped = 0;
+}
+
+void particlesClear(ParticlePool& p) {
+  p.active = 0;
+}
+
+static uint32_t nextRandom(ParticlePool& p) {
+  uint32_t x = p.seed;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  p.seed = x;
+  return x;
+}
+
+bool particleSpawn(ParticlePool& p, int led, int speed, const CRGB& color, uint16_t lifeMs) {
+  if (p.active >= PARTICLE_CAPACITY) {
+    p.dropped++;
+    return false;
+  }
+  if (lifeMs == 0) {
+    lifeMs = 1;
+  }
+  uint16_t i = p.active++;
+  p.position[i] = (int32_t)led << 16;
+  p.velocity[i] = (int32_t)(((int64_t)speed << 16) / 1000);
+  p.red[i] = color.r;
+  p.green[i] = color.g;
+  p.blue[i] = color.b;
+  p.life[i] = lifeMs;
+  p.fade[i] = (255UL << 16) / lifeMs;
+  p.spawned++;
+  return true;
+}
+
+int particlesBurst(ParticlePool& p, int led, int n, const CRGB& color, int minSpeed, int maxSpeed,
+                   uint16_t lifeMs) {
+  int spawned = 0;
+  uint32_t speedRange = maxSpeed > minSpeed ? maxSpeed - minSpeed + 1 : 1;
+  uint32_t backwards = nextRandom(p) & 1;  // Alternating, from a random side
+  for (int k = 0; k < n; k++) {
+    int speed = minSpeed + (int)(nextRandom(p) % speedRange);
+    uint16_t life = lifeMs * 3 / 4 + nextRandom(p) % (lifeMs / 2 + 1);
+    if (!particleSpawn(p, led, ((k + backwards) & 1) ? -speed : speed, color, life)) {
+      break;
+    }
+    spawned++;
+  }
+  return spawned;
+}
+
+void particlesUpdate(ParticlePool& p, int count, unsigned long dtMs) {
+  const int32_t ring = (int32_t)count << 16;
+  // A long gap only ends lives; nothing moves more than a second at once
+  const int32_t step = dtMs > 1000 ? 1000 : (int32_t)dtMs;
+  uint16_t i = 0;
+  while (i < p.active) {
+    if (p.life[i] <= dtMs) {
+      // Dead: the last live particle takes its slot
+      uint16_t last = --p.active;
+      p.position[i] = p.position[last];
+      p.velocity[i] = p.velocity[last];
+      p.red[i] = p.red[last];
+      p.green[i] = p.green[last];
+      p.blue[i] = p.blue[last];
+      p.life[i] = p.life[last];
+      p.fade[i] = p.fade[last];
+      continue;
+    }
+    p.life[i] -= dtMs;
+    int32_t pos = (p.position[i] + p.velocity[i] * step) % ring;
+    p.position[i] = pos < 0 ? pos + ring : pos;
+    i++;
+  }
+}
+
+void particlesRender(const ParticlePool& p, CRGB* leds, int count) {
+  for (uint16_t i = 0; i < p.active; i++) {
+    uint8_t brightness = (uint8_t)(((uint32_t)p.life[i] * p.fade[i]) >> 16);
+    int led = p.position[i] >> 16;
+    uint8_t frac = (p.position[i] >> 8) & 0xFF;
+    uint8_t near = scale8(brightness, 255 - frac);
+    uint8_t far = scale8(brightness, frac);
+
+    CRGB& a = leds[led];
+    a.r = qadd8(a.r, scale8(p.red[i], near));
+    a.g = qadd8(a.g, scale8(p.green[i], near));
+    a.b = qadd8(a.b, scale8(p.blue[i], near));
+    CRGB& b = leds[led + 1 < count ? led + 1 : 0];
+    b.r = qadd8(b.r, scale8(p.red[i], far));
+    b.g = qadd8(b.g, scale8(p.green[i], far));
+    b.b = qadd8(b.b, scale8(p.blue[i], far));
+  }
+}
+
+void renderSparks(CRGB* leds, int count, const ParticlePool& p, uint8_t baseScale) {
+  if (p.active == 0) {
+    return;
+  }
+  for (int i = 0; i < count; i++) {
+    leds[i].nscale8(baseScale);
+  }
+  particlesRender(p, leds, count);
+}
@@ -0,0 +1,60 @@
+#ifndef PARTICLES_H
+#define PARTICLES_H
+
+#include <FastLED.h>
+
+// Sparks running around the LED ring.
+//
+// A fixed-capacity pool in structure-of-arrays form: one array per
+// attribute, all fixed point, the live particles packed at the front
+// (index < active). A dead particle is replaced by the last live one, so
+// update and render only touch live particles, and nothing is allocated
+// after boot. Positions are LEDs in 16.16, velocities LEDs per ms in 16.16;
+// a particle fades out linearly over its life.
+
+#ifndef PARTICLE_CAPACITY
+#define PARTICLE_CAPACITY 64
+#endif
+
+struct ParticlePool {
+  int32_t position[PARTICLE_CAPACITY];  // LED, 16.16, 0 to count
+  int32_t velocity[PARTICLE_CAPACITY];  // LEDs per ms, 16.16 (negative = backwards)
+  uint8_t red[PARTICLE_CAPACITY];
+  uint8_t green[PARTICLE_CAPACITY];
+  uint8_t blue[PARTICLE_CAPACITY];
+  uint16_t life[PARTICLE_CAPACITY];     // ms left
+  uint32_t fade[PARTICLE_CAPACITY];     // Brightness per ms of life, 8.16
+
+  uint16_t active;
+  uint32_t seed;                        // xorshift32 for bursts
+  unsigned long spawned;
+  unsigned long dropped;                // Pool full
+};
+
+void particlesInit(ParticlePool& p, uint32_t seed);
+
+// Remove all particles
+void particlesClear(ParticlePool& p);
+
+// Add one particle at LED `led`, `speed` LEDs per second. Returns false if
+// the pool is full.
+bool particleSpawn(ParticlePool& p, int led, int speed, const CRGB& color, uint16_t lifeMs);
+
+// `n` particles from `led` in both directions, with speeds between
+// `minSpeed` and `maxSpeed` LEDs per second and lives of 75-125% of
+// `lifeMs`. Returns the number spawned.
+int particlesBurst(ParticlePool& p, int led, int n, const CRGB& color, int minSpeed, int maxSpeed,
+                   uint16_t lifeMs);
+
+// Move the particles `dtMs` along a ring of `count` LEDs and age them
+void particlesUpdate(ParticlePool& p, int count, unsigned long dtMs);
+
+// Add the particles to the frame, each spread over the two LEDs it is
+// between
+void particlesRender(const ParticlePool& p, CRGB* leds, int count);
+
+// Passage reaction: the frame (a solid blink color) dimmed to `baseScale`
+// with the particles on top. Leaves the frame alone without particles.
+void renderSparks(CRGB* leds, int count, const ParticlePool& p, uint8_t baseScale);
+
+#endif
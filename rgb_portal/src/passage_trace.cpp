@@ -0,0 +1,91 @@
+#include "passage_trace.h"
+
+const unsigned int TRACE_HIST_LIMITS_MS[TRACE_HIST_BUCKETS - 1] = {1, 2, 5, 10, 20, 50, 100, 200, 500};
+
+static const char* const stageNames[STAGE_COUNT] = {
+  "echo", "decision", "transition", "render", "show", "mqttQueued", "mqttSent"
+};
+
+void traceInit(PassageTracer& t) {
+  memset(&t, 0, sizeof(t));
+}
+
+static void addToHistogram(unsigned long* hist, unsigned long us) {
+  int bucket = 0;
+  while (bucket < TRACE_HIST_BUCKETS - 1 && us >= TRACE_HIST_LIMITS_MS[bucket] * 1000UL) {
+    bucket++;
+  }
+  hist[bucket]++;
+}
+
+void traceEnd(PassageTracer& t) {
+  t.open = false;
+}
+
+void traceBegin(PassageTracer& t, unsigned long echoUs, unsigned long decisionUs, unsigned long now) {
+  traceEnd(t);
+
+  if (t.count > 0) {
+    t.head = (t.head + 1) % PASSAGE_TRACE_SIZE;
+  }
+  if (t.count < PASSAGE_TRACE_SIZE) {
+    t.count++;
+  }
+  PassageTrace& tr = t.ring[t.head];
+  memset(&tr, 0, sizeof(tr));
+  tr.id = ++t.passages;
+  tr.time = now;
+  tr.stageUs[STAGE_ECHO] = echoUs;
+  tr.stageUs[STAGE_DECISION] = decisionUs;
+  tr.marked = (1 << STAGE_ECHO) | (1 << STAGE_DECISION);
+  t.open = true;
+}
+
+void traceMark(PassageTracer& t, TraceStage stage, unsigned long us) {
+  if (!t.open) {
+    return;
+  }
+  PassageTrace& tr = t.ring[t.head];
+  if ((tr.marked & (1 << stage)) || !(tr.marked & (1 << (stage - 1)))) {
+    return;
+  }
+  tr.stageUs[stage] = us;
+  tr.marked |= (1 << stage);
+  if (stage == STAGE_SHOW) {
+    addToHistogram(t.photonHist, us - tr.stageUs[STAGE_ECHO]);
+  } else if (stage == STAGE_MQTT_SENT) {
+    addToHistogram(t.mqttHist, us - tr.stageUs[STAGE_ECHO]);
+    traceEnd(t);
+  }
+}
+
+void traceSkip(PassageTracer& t, TraceStage stage) {
+  if (!t.open) {
+    return;
+  }
+  const PassageTrace& tr = t.ring[t.head];
+  if ((tr.marked & (1 << stage)) || !(tr.marked & (1 << (stage - 1)))) {
+    return;
+  }
+  if (stage == STAGE_MQTT_QUEUED) {
+    t.mqttSkipped++;
+  }
+  traceEnd(t);
+}
+
+void traceTarget(PassageTracer& t, uint8_t target) {
+  if (t.open) {
+    t.ring[t.head].target = target;
+  }
+}
+
+const PassageTrace* traceGet(const PassageTracer& t, uint8_t age) {
+  if (age >= t.count) {
+    return nullptr;
+  }
+  return &t.ring[(t.head + PASSAGE_TRACE_SIZE - age) % PASSAGE_TRACE_SIZE];
+}
+
+const char* traceStageName(uint8_t stage) {
+  return stage < STAGE_COUNT ? stageNames[stage] : "?";
+}
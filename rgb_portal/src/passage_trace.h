@@ -0,0 +1,74 @@
+#ifndef PASSAGE_TRACE_H
+#define PASSAGE_TRACE_H
+
+#include <Arduino.h>
+
+// Reaction time of the portal to a passage, stage by stage.
+//
+// Every passage start opens a trace with the micros() time of the echo that
+// triggered it; the firmware marks the following stages as it gets to them.
+// The last PASSAGE_TRACE_SIZE traces are kept for GET /latency, and two
+// histograms count echo to photon and echo to MQTT sent of every passage.
+
+enum TraceStage {
+  STAGE_ECHO,         // Echo captured (end of pulseIn)
+  STAGE_DECISION,     // Passage start decided
+  STAGE_TRANSITION,   // State machine took the SensorEnter transition
+  STAGE_RENDER,       // Frame output started (render or pre-rendered frame)
+  STAGE_SHOW,         // FastLED.show() returned
+  STAGE_MQTT_QUEUED,  // portal/state publish started
+  STAGE_MQTT_SENT,    // publish() returned
+  STAGE_COUNT
+};
+
+#define PASSAGE_TRACE_SIZE 8
+#define TRACE_HIST_BUCKETS 10  // Upper bounds in TRACE_HIST_LIMITS_MS, last one open
+
+struct PassageTrace {
+  unsigned long id;         // Passage number since boot
+  unsigned long time;       // millis() of the decision
+  uint8_t target;           // State number the passage triggered (0 = none)
+  uint8_t marked;           // Bit per stage reached
+  unsigned long stageUs[STAGE_COUNT];  // micros() per stage
+};
+
+struct PassageTracer {
+  PassageTrace ring[PASSAGE_TRACE_SIZE];
+  uint8_t head;             // Slot of the newest trace
+  uint8_t count;
+  bool open;                // Newest trace still collecting stages
+  unsigned long passages;
+  unsigned long photonHist[TRACE_HIST_BUCKETS];  // Echo to show complete
+  unsigned long mqttHist[TRACE_HIST_BUCKETS];    // Echo to MQTT sent
+  unsigned long mqttSkipped;  // Passages whose state publish was skipped (MQTT not connected)
+};
+
+extern const unsigned int TRACE_HIST_LIMITS_MS[TRACE_HIST_BUCKETS - 1];
+
+void traceInit(PassageTracer& t);
+
+// Open a trace for a new passage (closes the previous one as it is)
+void traceBegin(PassageTracer& t, unsigned long echoUs, unsigned long decisionUs, unsigned long now);
+
+// Record a stage of the open trace. Only the first mark of a stage counts,
+// and only once the stage before it was reached, so renders and publishes
+// unrelated to the passage are ignored. STAGE_MQTT_SENT completes the trace.
+void traceMark(PassageTracer& t, TraceStage stage, unsigned long us);
+
+// State number the open trace leads to
+void traceTarget(PassageTracer& t, uint8_t target);
+
+// Close the open trace without waiting for further stages
+void traceEnd(PassageTracer& t);
+
+// `stage` won't happen (no MQTT connection for STAGE_MQTT_QUEUED): if the
+// open trace was waiting for it, close it, so a later unrelated publish
+// doesn't complete it
+void traceSkip(PassageTracer& t, TraceStage stage);
+
+// Trace `age` steps back from the newest (0 = newest), nullptr if not kept
+const PassageTrace* traceGet(const PassageTracer& t, uint8_t age);
+
+const char* traceStageName(uint8_t stage);
+
+#endif
@@ -0,0 +1,268 @@
+#include "pixel_stream.h"
+#include "frame_codec.h"
+
+#define INTERVAL_WINDOW 16      // Frames per interval measurement (spans several bursts)
+#define INTERVAL_FIRST_WINDOW 4
+#define INTERVAL_EWMA_SHIFT 1   // Interval estimate follows 1/2 of each new measurement
+#define DELAY_EWMA_SHIFT 4
+#define MAX_FRAME_GAP_US 500000 // Longer gaps are pauses, not frame intervals
+#define REBUFFER_INTERVALS 4    // Empty this long (in frame intervals): prebuffer again
+#define REFERENCE_MAX_AGE 500   // ms - older frames may have been drawn over, no delta on top
+
+void streamBegin(PixelStream& s, CRGB* leds, int count, CRGB* slots, uint16_t port) {
+  s.leds = leds;
+  s.count = count;
+  s.lastFrameTime = 0;
+  s.packets = 0;
+  s.frames = 0;
+  s.badPackets = 0;
+  s.discarded = 0;
+  s.lastSequence = 0;
+
+  s.slots = slots;
+  s.depth = 0;
+  s.lastArrivalUs = 0;
+  s.windowStartUs = 0;
+  s.windowFrames = 0;
+  s.intervalUs = 0;
+  s.bufferDelayUs = 0;
+  s.presented = 0;
+  s.late = 0;
+  s.dropped = 0;
+  s.underruns = 0;
+  s.compressedFrames = 0;
+  s.compressedBytes = 0;
+  s.deltaSkipped = 0;
+  streamSetDepth(s, 0);
+
+  s.udp.begin(port);
+}
+
+void streamSetDepth(PixelStream& s, uint8_t depth) {
+  s.depth = depth > STREAM_MAX_DEPTH ? STREAM_MAX_DEPTH : depth;
+  s.head = 0;
+  s.queued = 0;
+  s.playing = false;
+  s.starved = false;
+  s.directFrame = false;
+  s.reference = nullptr;
+}
+
+// Frame buffer that packets are currently written to
+static uint8_t* assemblyBuffer(PixelStream& s) {
+  if (s.depth == 0) {
+    return (uint8_t*)s.leds;
+  }
+  return (uint8_t*)(s.slots + ((s.head + s.queued) % STREAM_SLOTS) * s.count);
+}
+
+// A frame is complete: update the interval estimate and queue it
+static void frameComplete(PixelStream& s, unsigned long nowUs) {
+  // Frames arrive in bursts, so single gaps say little. The interval is
+  // measured over a window of frames instead.
+  if (s.windowFrames > 0 && nowUs - s.lastArrivalUs > MAX_FRAME_GAP_US) {
+    s.windowFrames = 0;  // Sender paused, start over
+  }
+  // The first estimate comes from a short window so playback can start soon
+  uint8_t window = s.intervalUs == 0 ? INTERVAL_FIRST_WINDOW : INTERVAL_WINDOW;
+  if (s.windowFrames == 0) {
+    s.windowStartUs = nowUs;
+  } else if (s.windowFrames >= window) {
+    unsigned long measured = (nowUs - s.windowStartUs) / s.windowFrames;
+    if (s.intervalUs == 0 || measured > 2 * s.intervalUs || 2 * measured < s.intervalUs) {
+      // First estimate, new frame rate, or a backlog flushed at once
+      s.intervalUs = measured;
+    } else {
+      s.intervalUs = s.intervalUs - (s.intervalUs >> INTERVAL_EWMA_SHIFT) + (measured >> INTERVAL_EWMA_SHIFT);
+    }
+    s.windowStartUs = nowUs;
+    s.windowFrames = 0;
+  }
+  s.windowFrames++;
+  s.lastArrivalUs = nowUs;
+  s.reference = (const CRGB*)assemblyBuffer(s);
+
+  if (s.depth == 0) {
+    s.directFrame = true;
+    return;
+  }
+
+  s.arrivalUs[(s.head + s.queued) % STREAM_SLOTS] = nowUs;
+  if (s.queued < STREAM_CAPACITY) {
+    s.queued++;
+  } else {
+    // Full: the oldest frame is lost, the new one takes its place in line
+    s.head = (s.head + 1) % STREAM_SLOTS;
+    s.dropped++;
+  }
+}
+
+// Decode a compressed frame from the socket into the frame buffer. Delta
+// frames need the previous frame: after a lost packet, a pause or a buffer
+// reset they are skipped until the next keyframe.
+static bool decodeFrame(PixelStream& s, unsigned long now, uint8_t sequence, uint16_t length) {
+  CRGB* target = (CRGB*)assemblyBuffer(s);
+
+  if (s.udp.peek() == FRAME_DELTA) {
+    bool inOrder = sequence == 0 || sequence == (s.lastSequence % 15) + 1;
+    if (!s.reference || !inOrder || now - s.lastFrameTime > REFERENCE_MAX_AGE) {
+      s.reference = nullptr;
+      s.deltaSkipped++;
+      return false;
+    }
+    if (s.reference != target) {
+      memcpy(target, s.reference, s.count * sizeof(CRGB));
+    }
+  }
+
+  if (frameDecode(s.udp, target, s.count) < 0) {
+    s.reference = nullptr;
+    s.badPackets++;
+    return false;
+  }
+  s.compressedFrames++;
+  s.compressedBytes += length;
+  return true;
+}
+
+bool streamPoll(PixelStream& s, unsigned long now, bool accept) {
+  bool frameDone = false;
+
+  for (int n = 0; n < STREAM_MAX_PACKETS_PER_POLL; n++) {
+    int size = s.udp.parsePacket();
+    if (size <= 0) {
+      break;
+    }
+
+    uint8_t header[DDP_HEADER_LEN];
+    if (size < DDP_HEADER_LEN || s.udp.read(header, DDP_HEADER_LEN) != DDP_HEADER_LEN) {
+      s.badPackets++;
+      continue;
+    }
+
+    uint8_t flags = header[0];
+    uint8_t id = header[3];
+    uint32_t offset = ((uint32_t)header[4] << 24) | ((uint32_t)header[5] << 16) |
+                      ((uint32_t)header[6] << 8) | header[7];
+    uint16_t length = ((uint16_t)header[8] << 8) | header[9];
+    int payloadSize = size - DDP_HEADER_LEN;
+
+    if (flags & DDP_FLAG_TIMECODE) {
+      uint8_t timecode[DDP_TIMECODE_LEN];
+      if (s.udp.read(timecode, DDP_TIMECODE_LEN) != DDP_TIMECODE_LEN) {
+        s.badPackets++;
+        continue;
+      }
+      payloadSize -= DDP_TIMECODE_LEN;
+    }
+
+    // Only pixel data for our display; queries, replies and storage are ignored
+    if ((flags & DDP_VERSION_MASK) != DDP_FLAG_VER1 ||
+        (flags & (DDP_FLAG_QUERY | DDP_FLAG_REPLY | DDP_FLAG_STORAGE)) ||
+        (id != DDP_ID_DISPLAY && id != DDP_ID_ALL) || length > payloadSize) {
+      s.badPackets++;
+      continue;
+    }
+
+    if (!accept) {
+      s.discarded++;
+      if (s.queued > 0 || s.playing) {
+        streamSetDepth(s, s.depth);
+      }
+      continue;
+    }
+
+    uint8_t sequence = header[1] & 0x0F;
+    if (header[2] == DDP_TYPE_FRAME_CODEC) {
+      // A whole compressed frame per packet (see frame_codec.h)
+      if (offset != 0 || !(flags & DDP_FLAG_PUSH)) {
+        s.badPackets++;
+        continue;
+      }
+      bool decoded = decodeFrame(s, now, sequence, length);
+      s.lastSequence = sequence;
+      if (!decoded) {
+        continue;
+      }
+    } else {
+      // Copy straight from the socket into the frame buffer, clipped to the strip
+      uint32_t bufferSize = (uint32_t)s.count * sizeof(CRGB);
+      if (offset < bufferSize) {
+        uint32_t copy = length < bufferSize - offset ? length : bufferSize - offset;
+        s.udp.read(assemblyBuffer(s) + offset, copy);
+      }
+      s.lastSequence = sequence;
+    }
+    s.packets++;
+
+    if (flags & DDP_FLAG_PUSH) {
+      s.frames++;
+      s.lastFrameTime = now;
+      frameComplete(s, micros());
+      frameDone = true;
+    }
+  }
+
+  return frameDone;
+}
+
+const CRGB* streamNextFrame(PixelStream& s, unsigned long nowUs) {
+  if (s.depth == 0) {
+    if (!s.directFrame) {
+      return nullptr;
+    }
+    s.directFrame = false;
+    s.presented++;
+    return s.leds;
+  }
+
+  if (!s.playing) {
+    // Prebuffer: wait until the buffer holds `depth` frames and the frame
+    // interval is known
+    if (s.queued < s.depth || s.intervalUs == 0) {
+      return nullptr;
+    }
+    s.playing = true;
+    s.nextPresentUs = nowUs;
+  }
+
+  if ((long)(nowUs - s.nextPresentUs) < 0) {
+    return nullptr;
+  }
+  if (s.queued == 0) {
+    // Frame not here in time: wait for it (it will count as late), and
+    // rebuffer if the sender has paused
+    if (!s.starved) {
+      s.starved = true;
+      s.underruns++;
+    }
+    if (nowUs - s.nextPresentUs > REBUFFER_INTERVALS * s.intervalUs) {
+      s.playing = false;
+    }
+    return nullptr;
+  }
+  s.starved = false;
+
+  unsigned long interval = s.intervalUs;
+  if ((long)(nowUs - s.nextPresentUs) > (long)(interval / 2)) {
+    s.late++;
+    s.nextPresentUs = nowUs;  // Don't try to catch up with a burst
+  }
+  // Stay close to the sender's rate: run slightly fast while the buffer is
+  // above its target fill and slightly slow below it
+  if (s.queued > s.depth) {
+    interval -= interval >> 5;
+  } else if (s.queued < s.depth) {
+    interval += interval >> 5;
+  }
+  s.nextPresentUs += interval;
+
+  unsigned long delayUs = nowUs - s.arrivalUs[s.head];
+  s.bufferDelayUs = s.bufferDelayUs - (s.bufferDelayUs >> DELAY_EWMA_SHIFT) + (delayUs >> DELAY_EWMA_SHIFT);
+
+  const CRGB* frame = s.slots + s.head * s.count;
+  s.head = (s.head + 1) % STREAM_SLOTS;
+  s.queued--;
+  s.presented++;
+  return frame;
+}
@@ -0,0 +1,103 @@
+#ifndef PIXEL_STREAM_H
+#define PIXEL_STREAM_H
+
+#include <Arduino.h>
+#include <FastLED.h>
+#include <WiFiUdp.h>
+
+// Network pixel input (DDP, Distributed Display Protocol).
+//
+// A host streams frames as UDP packets: a 10-byte header (flags, sequence,
+// data type, destination, byte offset, length), an optional 4-byte timecode,
+// then raw RGB bytes. The payload is read from the UDP socket straight into
+// a frame buffer at the given offset - there is no intermediate packet
+// buffer. The PUSH flag marks the last packet of a frame. Packets with data
+// type DDP_TYPE_FRAME_CODEC carry one compressed frame instead (keyframe or
+// delta against the previous frame, see frame_codec.h), decoded in place.
+//
+// With a jitter buffer depth of 0 frames are assembled in leds[] and shown
+// as they complete. With depth N they are assembled in a ring of frame slots
+// and presented at an even cadence: playback starts once N frames are
+// queued, then one frame is released per estimated frame interval, so WiFi
+// bursts turn into evenly spaced frames at the cost of N intervals latency.
+// The release rate is nudged so that the buffer hovers around N frames; the
+// headroom above N absorbs bursts before frames have to be dropped.
+
+#define DDP_PORT 4048
+#define DDP_HEADER_LEN 10
+#define DDP_TIMECODE_LEN 4
+
+#define DDP_FLAG_VER1     0x40
+#define DDP_FLAG_TIMECODE 0x10
+#define DDP_FLAG_STORAGE  0x08
+#define DDP_FLAG_REPLY    0x04
+#define DDP_FLAG_QUERY    0x02
+#define DDP_FLAG_PUSH     0x01
+#define DDP_VERSION_MASK  0xC0
+
+#define DDP_TYPE_CUSTOM       0x80
+#define DDP_TYPE_FRAME_CODEC  (DDP_TYPE_CUSTOM | 0x01)  // frame_codec.h payload
+
+#define DDP_ID_DISPLAY    1    // Default output device
+#define DDP_ID_ALL        255
+
+#define STREAM_MAX_PACKETS_PER_POLL 8  // Bounds the time spent per loop pass
+#define STREAM_MAX_DEPTH 4             // Jitter buffer depth limit (frames)
+#define STREAM_CAPACITY (2 * STREAM_MAX_DEPTH)  // Queued frames before the oldest is dropped
+#define STREAM_SLOTS (STREAM_CAPACITY + 1)      // Queued frames + the one being assembled
+
+struct PixelStream {
+  WiFiUDP udp;
+  CRGB* leds;
+  int count;
+  unsigned long lastFrameTime;   // millis() of the last complete frame
+  unsigned long packets;         // Accepted packets
+  unsigned long frames;          // Complete frames (PUSH received)
+  unsigned long badPackets;      // Wrong version/destination or truncated
+  unsigned long discarded;       // Packets dropped while streaming was not allowed
+  uint8_t lastSequence;
+  const CRGB* reference;         // Last complete frame (delta base), nullptr = none
+  unsigned long compressedFrames;
+  unsigned long compressedBytes; // Payload bytes of the compressed frames
+  unsigned long deltaSkipped;    // Delta frames without a valid previous frame
+
+  // Jitter buffer
+  CRGB* slots;                   // STREAM_SLOTS frames of `count` LEDs
+  unsigned long arrivalUs[STREAM_SLOTS];
+  uint8_t depth;                 // 0 = show frames as they complete
+  uint8_t head;                  // Oldest queued frame
+  uint8_t queued;                // Complete frames waiting for presentation
+  bool playing;                  // Prebuffer filled, frames are being released
+  bool starved;                  // A frame was due but the buffer was empty
+  bool directFrame;              // Depth 0: a frame completed in leds[]
+  unsigned long lastArrivalUs;   // micros() of the previous complete frame
+  unsigned long windowStartUs;   // Start of the current interval measurement
+  uint8_t windowFrames;          // Frames in the current measurement
+  unsigned long intervalUs;      // Estimated frame interval (0 = unknown)
+  unsigned long nextPresentUs;   // When the next frame is due
+  unsigned long bufferDelayUs;   // Arrival to presentation (EWMA)
+  unsigned long presented;       // Frames handed out for display
+  unsigned long late;            // Presented more than half an interval after their slot
+  unsigned long dropped;         // Overwritten because the buffer was full
+  unsigned long underruns;       // Buffer was empty when a frame was due
+};
+
+// `slots` must hold STREAM_SLOTS * count LEDs
+void streamBegin(PixelStream& s, CRGB* leds, int count, CRGB* slots, uint16_t port = DDP_PORT);
+
+// Read pending packets. With `accept` false (a blink or a clip owns the strip)
+// packets are counted and dropped and the jitter buffer is emptied. Returns
+// true if a frame was completed.
+bool streamPoll(PixelStream& s, unsigned long now, bool accept);
+
+// Frame due for display at `nowUs`, or nullptr. Returns `leds` itself in
+// direct mode (depth 0), a jitter buffer slot otherwise.
+const CRGB* streamNextFrame(PixelStream& s, unsigned long nowUs);
+
+// Change the jitter buffer depth (clamped to STREAM_MAX_DEPTH); restarts buffering
+void streamSetDepth(PixelStream& s, uint8_t depth);
+
+// Frames currently waiting in the jitter buffer
+inline uint8_t streamBuffered(const PixelStream& s) { return s.queued; }
+
+#endif
@@ -0,0 +1,254 @@
+#include "portal_config.h"
+#include "json_scan.h"
+#include <Preferences.h>
+#include <stddef.h>
+
+#define FIELD(name, type, member, min, max, dirty) \
+  {name, type, (uint16_t)offsetof(PortalConfig, member), min, max, dirty}
+
+const ConfigField CONFIG_FIELDS[] = {
+  FIELD("brightness", CONFIG_U8, brightness, 0, 255, CONFIG_DIRTY_BRIGHTNESS),
+  FIELD("gamma", CONFIG_FLOAT, gamma, 1, 3, CONFIG_DIRTY_OUTPUT),
+  FIELD("whiteBalance", CONFIG_COLOR, whiteBalance, 0, 0, CONFIG_DIRTY_OUTPUT),
+  FIELD("animationSpeed", CONFIG_INT, animationSpeed, 10, 1000, CONFIG_DIRTY_ANIMATION),
+  FIELD("colorSpeed", CONFIG_FLOAT, colorSpeed, 0, 1, CONFIG_DIRTY_ANIMATION),
+  FIELD("colorBlue", CONFIG_COLOR, colorBlue, 0, 0, CONFIG_DIRTY_ANIMATION),
+  FIELD("colorPurple", CONFIG_COLOR, colorPurple, 0, 0, CONFIG_DIRTY_ANIMATION),
+  FIELD("colorPink", CONFIG_COLOR, colorPink, 0, 0, CONFIG_DIRTY_ANIMATION),
+  FIELD("detectionRange", CONFIG_FLOAT, detectionRange, 2, 400, CONFIG_DIRTY_DETECTION),
+  FIELD("minPassageDuration", CONFIG_INT, minPassageDuration, 0, 60000, CONFIG_DIRTY_DETECTION),
+  FIELD("passageCooldown", CONFIG_INT, passageCooldown, 0, 60000, CONFIG_DIRTY_DETECTION),
+  FIELD("sparks", CONFIG_INT, sparks, 0, PARTICLE_CAPACITY, CONFIG_DIRTY_ANIMATION),
+  FIELD("red.color", CONFIG_COLOR, red.color, 0, 0, CONFIG_DIRTY_RED),
+  FIELD("red.blinks", CONFIG_INT, red.numBlinks, 0, 100, CONFIG_DIRTY_RED),
+  FIELD("red.blinkMs", CONFIG_INT, red.blinkDuration, 0, 10000, CONFIG_DIRTY_RED),
+  FIELD("red.solid", CONFIG_BOOL, red.solidAfterBlink, 0, 1, CONFIG_DIRTY_RED),
+  FIELD("green.color", CONFIG_COLOR, green.color, 0, 0, CONFIG_DIRTY_GREEN),
+  FIELD("green.blinks", CONFIG_INT, green.numBlinks, 0, 100, CONFIG_DIRTY_GREEN),
+  FIELD("green.blinkMs", CONFIG_INT, green.blinkDuration, 0, 10000, CONFIG_DIRTY_GREEN),
+  FIELD("green.solid", CONFIG_BOOL, green.solidAfterBlink, 0, 1, CONFIG_DIRTY_GREEN),
+  FIELD("fadeMs", CONFIG_INT, fadeMs, 0, 5000, CONFIG_DIRTY_ANIMATION),
+  FIELD("fadeBlinks", CONFIG_BOOL, fadeBlinks, 0, 1, CONFIG_DIRTY_ANIMATION),
+};
+const uint8_t CONFIG_FIELD_COUNT = sizeof(CONFIG_FIELDS) / sizeof(CONFIG_FIELDS[0]);
+
+#undef FIELD
+
+static const ConfigField* findField(const char* name) {
+  for (uint8_t i = 0; i < CONFIG_FIELD_COUNT; i++) {
+    if (strcmp(CONFIG_FIELDS[i].name, name) == 0) {
+      return &CONFIG_FIELDS[i];
+    }
+  }
+  return nullptr;
+}
+
+static size_t fieldSize(ConfigType type) {
+  switch (type) {
+    case CONFIG_U8: return sizeof(uint8_t);
+    case CONFIG_INT: return sizeof(int);
+    case CONFIG_FLOAT: return sizeof(float);
+    case CONFIG_BOOL: return sizeof(bool);
+    default: return sizeof(CRGB);
+  }
+}
+
+// Parse `value` into `out` (fieldSize bytes), false if invalid or out of range
+static bool parseValue(const ConfigField& f, const char* value, uint8_t* out) {
+  switch (f.type) {
+    case CONFIG_U8:
+    case CONFIG_INT: {
+      long v;
+      if (!jsonParseLong(value, (long)f.min, (long)f.max, v)) return false;
+      if (f.type == CONFIG_U8) {
+        *out = (uint8_t)v;
+      } else {
+        int i = (int)v;
+        memcpy(out, &i, sizeof(i));
+      }
+      return true;
+    }
+    case CONFIG_FLOAT: {
+      char* end = nullptr;
+      float v = strtof(value, &end);
+      if (end == value || *end || !(v >= f.min && v <= f.max)) return false;
+      memcpy(out, &v, sizeof(v));
+      return true;
+    }
+    case CONFIG_BOOL: {
+      bool v;
+      if (!jsonParseBool(value, v)) return false;
+      memcpy(out, &v, sizeof(v));
+      return true;
+    }
+    case CONFIG_COLOR: {
+      CRGB c;
+      if (!jsonParseColor(value, c)) return false;
+      memcpy(out, &c, sizeof(c));
+      return true;
+    }
+  }
+  return false;
+}
+
+int configSet(PortalConfig& c, const char* name, const char* value) {
+  const ConfigField* f = findField(name);
+  uint8_t parsed[sizeof(CRGB) > sizeof(float) ? sizeof(CRGB) : sizeof(float)];
+  if (!f || !parseValue(*f, value, parsed)) {
+    return -1;
+  }
+  uint8_t* field = (uint8_t*)&c + f->offset;
+  size_t size = fieldSize(f->type);
+  if (memcmp(field, parsed, size) == 0) {
+    return 0;
+  }
+  memcpy(field, parsed, size);
+  return f->dirty;
+}
+
+// Blinks need a length: blinks with blinkMs 0 would have no blink phase.
+// A stored config keeps the blink config from before instead.
+static bool checkBlink(BlinkConfig& b, const BlinkConfig& before, const char* name, String& error, bool strict) {
+  if (b.numBlinks == 0 || b.blinkDuration > 0) {
+    return true;
+  }
+  if (!strict) {
+    b = before;
+    return true;
+  }
+  error = String(name) + ".blinkMs must be above 0 with " + name + ".blinks";
+  return false;
+}
+
+// `strict` rejects unknown fields and bad values; a stored config skips
+// them (fields or ranges of another firmware version)
+static int applyJson(PortalConfig& c, const char* json, String& error, bool strict) {
+  int dirty = 0;
+  const BlinkConfig red = c.red;
+  const BlinkConfig green = c.green;
+  const char* p = jsonSkipSpace(json);
+  if (*p++ != '{') {
+    error = "expected a JSON object";
+    return -1;
+  }
+  p = jsonSkipSpace(p);
+  if (*p == '}') {
+    return 0;
+  }
+  for (;;) {
+    char name[32];
+    char value[32];
+    p = jsonSkipSpace(p);
+    if (*p != '"' || !(p = jsonToken(p, name, sizeof(name)))) {
+      error = "expected a field name";
+      return -1;
+    }
+    p = jsonSkipSpace(p);
+    if (*p++ != ':') {
+      error = "expected ':'";
+      return -1;
+    }
+    p = jsonSkipSpace(p);
+    if (!(p = jsonToken(p, value, sizeof(value)))) {
+      error = String("bad value for ") + name;
+      return -1;
+    }
+    int bits = configSet(c, name, value);
+    if (bits < 0 && strict) {
+      error = String(findField(name) ? "bad value for " : "unknown field ") + name;
+      return -1;
+    }
+    if (bits > 0) {
+      dirty |= bits;
+    }
+    p = jsonSkipSpace(p);
+    if (*p == '}') {
+      if (!checkBlink(c.red, red, "red", error, strict) || !checkBlink(c.green, green, "green", error, strict)) {
+        return -1;
+      }
+      return dirty;
+    }
+    if (*p++ != ',') {
+      error = "expected ',' or '}'";
+      return -1;
+    }
+  }
+}
+
+int configApplyJson(PortalConfig& c, const char* json, String& error) {
+  return applyJson(c, json, error, true);
+}
+
+void configToJson(const PortalConfig& c, String& out) {
+  out += "{";
+  for (uint8_t i = 0; i < CONFIG_FIELD_COUNT; i++) {
+    const ConfigField& f = CONFIG_FIELDS[i];
+    const uint8_t* field = (const uint8_t*)&c + f.offset;
+    char value[16];
+    switch (f.type) {
+      case CONFIG_U8:
+        snprintf(value, sizeof(value), "%u", *field);
+        break;
+      case CONFIG_INT: {
+        int v;
+        memcpy(&v, field, sizeof(v));
+        snprintf(value, sizeof(value), "%d", v);
+        break;
+      }
+      case CONFIG_FLOAT: {
+        float v;
+        memcpy(&v, field, sizeof(v));
+        snprintf(value, sizeof(value), "%g", v);
+        break;
+      }
+      case CONFIG_BOOL:
+        snprintf(value, sizeof(value), "%s", *(const bool*)field ? "true" : "false");
+        break;
+      case CONFIG_COLOR:
+        snprintf(value, sizeof(value), "\"%02x%02x%02x\"", field[0], field[1], field[2]);
+        break;
+    }
+    if (i > 0) out += ",";
+    out += "\"";
+    out += f.name;
+    out += "\":";
+    out += value;
+  }
+  out += "}";
+}
+
+// Stored as the JSON text, so a firmware with other fields still reads the
+// ones it knows. Firmware before the "version" key stored version 1.
+bool configLoad(PortalConfig& c) {
+  Preferences prefs;
+  bool ok = false;
+  if (prefs.begin(CONFIG_NVS_NAMESPACE, true) && prefs.getUChar("version", 1) == CONFIG_VERSION) {
+    size_t len = prefs.getBytesLength("config");
+    if (len > 0 && len < 1024) {
+      char* json = (char*)malloc(len + 1);
+      if (json && prefs.getBytes("config", json, len) == len) {
+        json[len] = '\0';
+        PortalConfig loaded = c;
+        String error;
+        if (applyJson(loaded, json, error, false) >= 0) {
+          c = loaded;
+          ok = true;
+        }
+      }
+      free(json);
+    }
+  }
+  prefs.end();
+  return ok;
+}
+
+bool configSave(const PortalConfig& c) {
+  String json;
+  configToJson(c, json);
+  Preferences prefs;
+  bool ok = prefs.begin(CONFIG_NVS_NAMESPACE, false) &&
+            prefs.putBytes("config", json.c_str(), json.length()) == json.length() &&
+            (prefs.getUChar("version", 0) == CONFIG_VERSION || prefs.putUChar("version", CONFIG_VERSION) == 1);
+  prefs.end();
+  return ok;
+}
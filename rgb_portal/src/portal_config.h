@@ -0,0 +1,92 @@
+#ifndef PORTAL_CONFIG_H
+#define PORTAL_CONFIG_H
+
+#include <Arduino.h>
+#include "portal_fsm.h"
+#include "particles.h"
+
+// Runtime configuration.
+//
+// The tunables of the portal live in one struct with a table of typed,
+// range-checked fields, so they can be read and changed by name over HTTP
+// (GET/PUT /config) and MQTT (portal/config) and kept in NVS. A change is
+// parsed and validated into a copy as a whole (one bad field rejects the
+// request); the firmware swaps the copy in between two frames and rebuilds
+// only what depends on the fields that changed (CONFIG_DIRTY_* bits).
+//
+// Compile-time sizes (NUM_LEDS, sensor pins) are not part of it.
+
+// Stored next to the config. Fields are stored by name, so adding or
+// removing one needs no new version; bump it when a field keeps its name but
+// changes meaning or unit, and a stored config of another version is ignored.
+#define CONFIG_VERSION 1
+#define CONFIG_NVS_NAMESPACE "portal"
+
+// What a field change invalidates
+#define CONFIG_DIRTY_ANIMATION  0x01  // Animation speed and colors (read every frame)
+#define CONFIG_DIRTY_OUTPUT     0x02  // Output LUT: gamma, white balance
+#define CONFIG_DIRTY_RED        0x04  // Red blink config and its pre-rendered first frame
+#define CONFIG_DIRTY_GREEN      0x08  // Green blink config and its pre-rendered first frame
+#define CONFIG_DIRTY_DETECTION  0x10  // Detection range and passage timing
+#define CONFIG_DIRTY_BRIGHTNESS 0x20  // Output brightness (FastLED, dithered)
+
+struct PortalConfig {
+  uint8_t brightness;
+  float gamma;              // Output gamma (1.0 = linear)
+  CRGB whiteBalance;        // Per-channel output scale of the strip
+  int animationSpeed;       // ms per animation step
+  float colorSpeed;         // Base color transition per step
+  CRGB colorBlue;           // Base color sequence
+  CRGB colorPurple;
+  CRGB colorPink;
+  float detectionRange;     // cm, someone is in the portal below this
+  int minPassageDuration;   // ms
+  int passageCooldown;      // ms
+  int sparks;               // Sparks per passage burst, 0 = flat blink
+  BlinkConfig red;
+  BlinkConfig green;
+  int fadeMs;               // Crossfade between states, 0 = hard cut
+  bool fadeBlinks;          // Fade into blinks too (no pre-rendered first frame)
+};
+
+enum ConfigType : uint8_t {
+  CONFIG_U8,
+  CONFIG_INT,
+  CONFIG_FLOAT,
+  CONFIG_BOOL,
+  CONFIG_COLOR    // "rrggbb" (or "#rrggbb")
+};
+
+struct ConfigField {
+  const char* name;
+  ConfigType type;
+  uint16_t offset;          // In PortalConfig
+  float min;
+  float max;
+  uint8_t dirty;            // CONFIG_DIRTY_* bits
+};
+
+extern const ConfigField CONFIG_FIELDS[];
+extern const uint8_t CONFIG_FIELD_COUNT;
+
+// Overlay the fields stored in NVS on `c` (which holds the defaults).
+// Returns false if nothing valid is stored or it has another CONFIG_VERSION.
+bool configLoad(PortalConfig& c);
+
+// Store `c` in NVS
+bool configSave(const PortalConfig& c);
+
+// Set one field from text. Returns its CONFIG_DIRTY_* bits if the value
+// differs (0 if it is unchanged), -1 for an unknown name or a bad value.
+int configSet(PortalConfig& c, const char* name, const char* value);
+
+// Apply a flat JSON object ({"brightness":80,"red.color":"ff0000"}) to `c`.
+// Returns the CONFIG_DIRTY_* bits of the changed fields, -1 on a parse
+// error or a bad field (`error` says which); `c` is then partly updated,
+// so parse into a copy.
+int configApplyJson(PortalConfig& c, const char* json, String& error);
+
+// All fields as a flat JSON object
+void configToJson(const PortalConfig& c, String& out);
+
+#endif
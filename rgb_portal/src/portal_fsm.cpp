@@ -0,0 +1,253 @@
+#include "portal_fsm.h"
+
+#define ANY_STATE  0xFF  // Row matches in every state
+#define SAME_STATE 0xFE  // Row keeps the current state
+#define IDLE_STATE 0xFD  // Row matches in ROTATING, STREAMING and PLAYING
+
+// Transition actions
+#define ACT_START_BLINK 0x01  // Load the blink config of the target state and restart the sequence
+#define ACT_SET_AUTO    0x02
+#define ACT_CLEAR_AUTO  0x04
+#define ACT_BLINK_DONE  0x08  // Blink sequence finished, hold the solid color
+
+struct PortalTransition {
+  uint8_t from;
+  uint8_t event;
+  bool (*guard)(const PortalMachine& m, const PortalEvent& ev);
+  uint8_t to;
+  uint8_t actions;
+};
+
+static bool enterGreen(const PortalMachine& m, const PortalEvent& ev) {
+  (void)m;
+  return ev.arg == BLINK_GREEN;
+}
+
+static bool enterRed(const PortalMachine& m, const PortalEvent& ev) {
+  (void)m;
+  return ev.arg == BLINK_RED;
+}
+
+static bool holdSolid(const PortalMachine& m, const PortalEvent& ev) {
+  (void)ev;
+  return m.activeBlinkConfig.solidAfterBlink;
+}
+
+// First matching row wins
+static const PortalTransition transitions[] = {
+  // Motion detection: random green/red from an idle portal only
+  {IDLE_STATE,  EV_SENSOR_ENTER, enterGreen, BLINK_GREEN, ACT_START_BLINK | ACT_SET_AUTO},
+  {IDLE_STATE,  EV_SENSOR_ENTER, enterRed,   BLINK_RED,   ACT_START_BLINK | ACT_SET_AUTO},
+  // Passage end releases green; red stays until a manual reset
+  {BLINK_GREEN, EV_SENSOR_EXIT,  nullptr,    ROTATING,    ACT_CLEAR_AUTO},
+
+  // Manual toggle between ROTATING and BLINK_RED
+  {IDLE_STATE,  EV_HTTP_TOGGLE,  nullptr,    BLINK_RED,   ACT_START_BLINK | ACT_CLEAR_AUTO},
+  {ANY_STATE,   EV_HTTP_TOGGLE,  nullptr,    ROTATING,    ACT_CLEAR_AUTO},
+  {IDLE_STATE,  EV_UDP_TOGGLE,   nullptr,    BLINK_RED,   ACT_START_BLINK | ACT_CLEAR_AUTO},
+  {ANY_STATE,   EV_UDP_TOGGLE,   nullptr,    ROTATING,    ACT_CLEAR_AUTO},
+
+  // Red only from an idle portal, green from idle or red
+  {IDLE_STATE,  EV_HTTP_RED,     nullptr,    BLINK_RED,   ACT_START_BLINK | ACT_SET_AUTO},
+  {IDLE_STATE,  EV_MQTT_RED,     nullptr,    BLINK_RED,   ACT_START_BLINK | ACT_SET_AUTO},
+  {IDLE_STATE,  EV_UDP_RED,      nullptr,    BLINK_RED,   ACT_START_BLINK | ACT_SET_AUTO},
+  {IDLE_STATE,  EV_HTTP_GREEN,   nullptr,    BLINK_GREEN, ACT_START_BLINK | ACT_SET_AUTO},
+  {BLINK_RED,   EV_HTTP_GREEN,   nullptr,    BLINK_GREEN, ACT_START_BLINK | ACT_SET_AUTO},
+  {IDLE_STATE,  EV_MQTT_GREEN,   nullptr,    BLINK_GREEN, ACT_START_BLINK | ACT_SET_AUTO},
+  {BLINK_RED,   EV_MQTT_GREEN,   nullptr,    BLINK_GREEN, ACT_START_BLINK | ACT_SET_AUTO},
+  {IDLE_STATE,  EV_UDP_GREEN,    nullptr,    BLINK_GREEN, ACT_START_BLINK | ACT_SET_AUTO},
+  {BLINK_RED,   EV_UDP_GREEN,    nullptr,    BLINK_GREEN, ACT_START_BLINK | ACT_SET_AUTO},
+
+  {ANY_STATE,   EV_HTTP_RESET,   nullptr,    ROTATING,    ACT_CLEAR_AUTO},
+  {ANY_STATE,   EV_MQTT_RESET,   nullptr,    ROTATING,    ACT_CLEAR_AUTO},
+  {ANY_STATE,   EV_UDP_RESET,    nullptr,    ROTATING,    ACT_CLEAR_AUTO},
+
+  // End of the blink sequence: hold the color or go back to ROTATING
+  {BLINK_RED,   EV_BLINK_DONE,   holdSolid,  SAME_STATE,  ACT_BLINK_DONE},
+  {BLINK_GREEN, EV_BLINK_DONE,   holdSolid,  SAME_STATE,  ACT_BLINK_DONE},
+  {BLINK_RED,   EV_BLINK_DONE,   nullptr,    ROTATING,    ACT_BLINK_DONE | ACT_CLEAR_AUTO},
+  {BLINK_GREEN, EV_BLINK_DONE,   nullptr,    ROTATING,    ACT_BLINK_DONE | ACT_CLEAR_AUTO},
+
+  // Network frames take over the idle effect; ROTATING again when they stop
+  {ROTATING,    EV_STREAM_FRAME,   nullptr,  STREAMING,   0},
+  {STREAMING,   EV_STREAM_TIMEOUT, nullptr,  ROTATING,    0},
+
+  // A clip replaces the idle effect (or the clip playing) until it ends;
+  // passages and commands interrupt it like they do ROTATING
+  {IDLE_STATE,  EV_CLIP_START,   nullptr,    PLAYING,     0},
+  {PLAYING,     EV_CLIP_DONE,    nullptr,    ROTATING,    0},
+
+  // A timeline owns the choreography: its steps apply in every state
+  {ANY_STATE,   EV_SEQ_RED,      nullptr,    BLINK_RED,   ACT_START_BLINK | ACT_CLEAR_AUTO},
+  {ANY_STATE,   EV_SEQ_GREEN,    nullptr,    BLINK_GREEN, ACT_START_BLINK | ACT_CLEAR_AUTO},
+  {ANY_STATE,   EV_SEQ_RESET,    nullptr,    ROTATING,    ACT_CLEAR_AUTO},
+  {ANY_STATE,   EV_SEQ_CLIP,     nullptr,    PLAYING,     ACT_CLEAR_AUTO},
+};
+
+#define NUM_TRANSITIONS (sizeof(transitions) / sizeof(transitions[0]))
+
+void portalInit(PortalMachine& m, const BlinkConfig* redConfig, const BlinkConfig* greenConfig) {
+  m.state = ROTATING;
+  m.autoTriggered = false;
+  m.blinkStartTime = 0;
+  m.blinkingDone = false;
+  m.activeBlinkConfig = *redConfig;
+  m.redConfig = redConfig;
+  m.greenConfig = greenConfig;
+  m.queueHead = 0;
+  m.queueCount = 0;
+  m.transitionCount = 0;
+  m.droppedEvents = 0;
+  m.blinkStarts = 0;
+  m.postedSeq = 0;
+  m.processedSeq = 0;
+}
+
+void portalRestore(PortalMachine& m, PortalState state, const BlinkConfig& activeConfig,
+                   unsigned long blinkStartTime, bool blinkingDone, bool autoTriggered) {
+  // A stream or clip doesn't survive a reset: its frames stopped with it
+  m.state = (state == STREAMING || state == PLAYING) ? ROTATING : state;
+  m.activeBlinkConfig = activeConfig;
+  m.blinkStartTime = blinkStartTime;
+  m.blinkingDone = blinkingDone;
+  m.autoTriggered = autoTriggered;
+}
+
+bool portalPost(PortalMachine& m, PortalEventType type, unsigned long time, uint8_t arg) {
+  if (m.queueCount >= PORTAL_EVENT_QUEUE_SIZE) {
+    m.droppedEvents++;
+    return false;
+  }
+  PortalEvent& ev = m.queue[(m.queueHead + m.queueCount) % PORTAL_EVENT_QUEUE_SIZE];
+  ev.type = type;
+  ev.arg = arg;
+  ev.time = time;
+  ev.postedUs = micros();
+  m.queueCount++;
+  m.postedSeq++;
+  return true;
+}
+
+bool portalApply(PortalMachine& m, const PortalEvent& ev) {
+  for (unsigned int i = 0; i < NUM_TRANSITIONS; i++) {
+    const PortalTransition& t = transitions[i];
+    if (t.event != ev.type) {
+      continue;
+    }
+    if (t.from != ANY_STATE && t.from != m.state && !(t.from == IDLE_STATE && portalIdle(m.state))) {
+      continue;
+    }
+    if (t.guard && !t.guard(m, ev)) {
+      continue;
+    }
+
+    if (t.to != SAME_STATE) {
+      m.state = (PortalState)t.to;
+    }
+    if (t.actions & ACT_START_BLINK) {
+      m.activeBlinkConfig = (m.state == BLINK_RED) ? *m.redConfig : *m.greenConfig;
+      m.blinkStartTime = ev.time;
+      m.blinkingDone = false;
+      m.blinkStarts++;
+    }
+    if (t.actions & ACT_BLINK_DONE) {
+      m.blinkingDone = true;
+    }
+    if (t.actions & ACT_SET_AUTO) {
+      m.autoTriggered = true;
+    }
+    if (t.actions & ACT_CLEAR_AUTO) {
+      m.autoTriggered = false;
+    }
+    m.transitionCount++;
+    return true;
+  }
+  return false;
+}
+
+PortalBatch portalProcess(PortalMachine& m, PortalTransitionCallback onTransition) {
+  PortalBatch batch = {0, false, false, false, 0};
+  PortalState before = m.state;
+
+  while (m.queueCount > 0) {
+    PortalEvent ev = m.queue[m.queueHead];
+    m.queueHead = (m.queueHead + 1) % PORTAL_EVENT_QUEUE_SIZE;
+    m.queueCount--;
+    m.processedSeq++;
+    batch.processed++;
+
+    PortalState from = m.state;
+    unsigned long blinkStarts = m.blinkStarts;
+    if (portalApply(m, ev)) {
+      batch.changed = true;
+      if (m.blinkStarts != blinkStarts) {
+        batch.blinkStarted = true;
+        batch.triggerUs = ev.postedUs;
+      }
+      if (onTransition) {
+        onTransition(ev, from, m.state);
+      }
+    }
+  }
+
+  batch.stateChanged = (m.state != before);
+  return batch;
+}
+
+PortalState portalPendingState(const PortalMachine& m) {
+  PortalMachine copy = m;
+  portalProcess(copy);
+  return copy.state;
+}
+
+unsigned long portalBlinkDuration(const BlinkConfig& config) {
+  if (config.numBlinks == 0) {
+    // Special case: solid color indefinitely (blinkDuration = 0) or for specific time
+    return config.blinkDuration == 0 ? ULONG_MAX : (unsigned long)config.blinkDuration;
+  }
+  // Normal blinking: numBlinks * (on + off time)
+  return (unsigned long)config.numBlinks * config.blinkDuration * 2;
+}
+
+void portalCheckBlink(PortalMachine& m, unsigned long now) {
+  if (portalIdle(m.state) || m.blinkingDone) {
+    return;
+  }
+  if (now - m.blinkStartTime > portalBlinkDuration(m.activeBlinkConfig)) {
+    portalPost(m, EV_BLINK_DONE, now);
+  }
+}
+
+int portalStateNumber(PortalState state) {
+  switch (state) {
+    case BLINK_RED:   return 2;
+    case BLINK_GREEN: return 3;
+    case STREAMING:   return 4;
+    case PLAYING:     return 5;
+    default:          return 1;
+  }
+}
+
+const char* portalStateName(PortalState state) {
+  switch (state) {
+    case BLINK_RED:   return "BLINK_RED";
+    case BLINK_GREEN: return "BLINK_GREEN";
+    case STREAMING:   return "STREAMING";
+    case PLAYING:     return "PLAYING";
+    default:          return "ROTATING";
+  }
+}
+
+bool portalIdle(PortalState state) {
+  return state == ROTATING || state == STREAMING || state == PLAYING;
+}
+
+const char* portalEventName(uint8_t type) {
+  static const char* const names[EV_COUNT] = {
+    "SensorEnter", "SensorExit", "HttpToggle", "HttpRed", "HttpGreen", "HttpReset",
+    "MqttRed", "MqttGreen", "MqttReset", "BlinkDone", "StreamFrame", "StreamTimeout",
+    "UdpToggle", "UdpRed", "UdpGreen", "UdpReset", "ClipStart", "ClipDone",
+    "SeqRed", "SeqGreen", "SeqReset", "SeqClip"
+  };
+  return type < EV_COUNT ? names[type] : "?";
+}
@@ -0,0 +1,158 @@
+#ifndef PORTAL_FSM_H
+#define PORTAL_FSM_H
+
+#include <FastLED.h>
+
+// Portal state machine.
+//
+// Every state change goes through one transition table, driven by a small
+// event queue. Producers (HTTP handlers, MQTT callback, motion detection,
+// blink timer) only post events; loop() drains the queue once per pass so
+// that all events of a pass cost one render and one MQTT publish. The module
+// has no hardware dependencies and can be exercised on the host.
+
+// Portal states
+enum PortalState {
+  ROTATING,      // Rotating light points
+  BLINK_RED,     // Blink red, then solid red
+  BLINK_GREEN,   // Blink green once, then return to ROTATING
+  STREAMING,     // Frames from the network (DDP) replace the ROTATING effect
+  PLAYING        // A pre-rendered clip from flash (clip_player.h) replaces the ROTATING effect
+};
+
+// Blink configuration
+struct BlinkConfig {
+  CRGB color;
+  int numBlinks;
+  int blinkDuration;  // ms per blink (on or off)
+  bool solidAfterBlink; // true = solid color after blink, false = return to ROTATING
+};
+
+enum PortalEventType {
+  EV_SENSOR_ENTER,  // Passage started, arg = target state picked at random
+  EV_SENSOR_EXIT,   // Passage ended
+  EV_HTTP_TOGGLE,
+  EV_HTTP_RED,
+  EV_HTTP_GREEN,
+  EV_HTTP_RESET,
+  EV_MQTT_RED,
+  EV_MQTT_GREEN,
+  EV_MQTT_RESET,
+  EV_BLINK_DONE,    // Blink sequence of the active config has finished
+  EV_STREAM_FRAME,  // Network frame received
+  EV_STREAM_TIMEOUT,// No network frame for STREAM_TIMEOUT ms
+  EV_UDP_TOGGLE,    // UDP control channel (udp_control.h), same as HTTP
+  EV_UDP_RED,
+  EV_UDP_GREEN,
+  EV_UDP_RESET,
+  EV_CLIP_START,    // Play a clip, arg = clip index
+  EV_CLIP_DONE,     // Clip has played to the end (or failed)
+  EV_SEQ_RED,       // Timeline step (sequencer.h): from any state
+  EV_SEQ_GREEN,
+  EV_SEQ_RESET,
+  EV_SEQ_CLIP,      // arg = clip index
+  EV_COUNT
+};
+
+struct PortalEvent {
+  uint8_t type;         // PortalEventType
+  uint8_t arg;
+  unsigned long time;   // millis() when the event was posted
+  unsigned long postedUs;  // micros() when the event was posted (latency measurement)
+};
+
+#define PORTAL_EVENT_QUEUE_SIZE 16
+
+struct PortalMachine {
+  PortalState state;
+  bool autoTriggered;           // State was entered by a trigger, not a toggle/reset
+  unsigned long blinkStartTime;
+  bool blinkingDone;
+  BlinkConfig activeBlinkConfig;
+  const BlinkConfig* redConfig;
+  const BlinkConfig* greenConfig;
+
+  PortalEvent queue[PORTAL_EVENT_QUEUE_SIZE];
+  uint8_t queueHead;
+  uint8_t queueCount;
+
+  unsigned long transitionCount;  // Events that matched a table row
+  unsigned long droppedEvents;    // Events lost to a full queue
+  unsigned long blinkStarts;      // Blink sequences started or restarted
+  unsigned long postedSeq;        // Sequence number of the last queued event (1, 2, ...)
+  unsigned long processedSeq;     // Sequence number of the last processed event
+};
+
+// Result of draining the queue
+struct PortalBatch {
+  uint8_t processed;      // Events taken from the queue
+  bool changed;           // Some transition fired - the frame must be redrawn
+  bool stateChanged;      // State differs from before the batch - publish it
+  bool blinkStarted;      // A blink sequence was (re)started - its first frame is due
+  unsigned long triggerUs;  // postedUs of the event that started it
+};
+
+// Trigger-to-photon latency, kept by the firmware: from posting the event
+// that started a blink (PortalBatch::triggerUs) to the end of the
+// FastLED.show() of its first frame
+struct TriggerLatency {
+  unsigned long count;
+  unsigned long lastUs;
+  unsigned long maxUs;
+  uint64_t totalUs;
+  unsigned long lastShowUs;  // Output part of lastUs
+};
+
+// Boot phases, kept by the firmware in ms since power-on (0 = not reached
+// yet). LEDs and sensors start in setup(); the network services wait for
+// WiFi in the background.
+struct BootTimes {
+  unsigned long firstFrame;  // Rotating effect on the strip
+  unsigned long setupDone;   // loop() running
+  unsigned long detection;   // Sensor warmup over, passages trigger
+  unsigned long wifi;        // WiFi connected the first time
+  unsigned long network;     // OTA, UDP inputs and HTTP started
+  unsigned long mqtt;        // First MQTT connection
+};
+
+typedef void (*PortalTransitionCallback)(const PortalEvent& ev, PortalState from, PortalState to);
+
+void portalInit(PortalMachine& m, const BlinkConfig* redConfig, const BlinkConfig* greenConfig);
+
+// Put the machine back into a state saved before a warm reset (see
+// rtc_snapshot.h). No transition runs; STREAMING and PLAYING come back as
+// ROTATING.
+void portalRestore(PortalMachine& m, PortalState state, const BlinkConfig& activeConfig,
+                   unsigned long blinkStartTime, bool blinkingDone, bool autoTriggered);
+
+// Queue an event. Returns false (and counts a drop) if the queue is full.
+// Queued events are numbered in order: the event has taken effect once
+// processedSeq has reached the postedSeq it got.
+bool portalPost(PortalMachine& m, PortalEventType type, unsigned long time, uint8_t arg = 0);
+
+// Run one event through the transition table. Returns true if a row matched.
+bool portalApply(PortalMachine& m, const PortalEvent& ev);
+
+// Drain the queue. `onTransition` (optional) is called for every matched event.
+PortalBatch portalProcess(PortalMachine& m, PortalTransitionCallback onTransition = nullptr);
+
+// State the machine will be in once the queue has been drained
+PortalState portalPendingState(const PortalMachine& m);
+
+// Post EV_BLINK_DONE if the active blink sequence has run out
+void portalCheckBlink(PortalMachine& m, unsigned long now);
+
+// Total length of a blink sequence in ms (ULONG_MAX = solid forever)
+unsigned long portalBlinkDuration(const BlinkConfig& config);
+
+// State number used on MQTT and the HTTP API (1=ROTATING, 2=BLINK_RED, 3=BLINK_GREEN, 4=STREAMING,
+// 5=PLAYING)
+int portalStateNumber(PortalState state);
+
+const char* portalStateName(PortalState state);
+
+// ROTATING, STREAMING or PLAYING: nothing is being signalled to a visitor
+bool portalIdle(PortalState state);
+const char* portalEventName(uint8_t type);
+
+#endif
@@ -0,0 +1,35 @@
+#include "portal_geometry.h"
+#include <math.h>
+
+void geometryBuildArch(PortalGeometry& g, int count, int widthMm, int legMm) {
+  if (count > GEOMETRY_MAX_LEDS) {
+    count = GEOMETRY_MAX_LEDS;
+  }
+  g.count = count;
+  const float r = widthMm / 2.0f;
+  const float arc = (float)M_PI * r;
+  const float pitch = (2.0f * legMm + arc) / count;
+  const float top = legMm + r;
+  g.centerY = (int16_t)(top / 2.0f + 0.5f);
+
+  for (int i = 0; i < count; i++) {
+    // Distance along the strip to the middle of the LED
+    float s = (i + 0.5f) * pitch;
+    float x, y;
+    if (s < legMm) {
+      x = -r;
+      y = s;
+    } else if (s < legMm + arc) {
+      float theta = (s - legMm) / r;  // 0 at the left end of the arch, pi at the right
+      x = -r * cosf(theta);
+      y = legMm + r * sinf(theta);
+    } else {
+      x = r;
+      y = legMm - (s - legMm - arc);
+    }
+    float dy = y - g.centerY;
+    g.x[i] = (int16_t)lroundf(x);
+    g.y[i] = (int16_t)lroundf(y);
+    g.angle[i] = (uint16_t)((int32_t)lroundf(atan2f(x, dy) / (2.0f * (float)M_PI) * GEOMETRY_TURN) & 0xFFFF);
+  }
+}
@@ -0,0 +1,37 @@
+#ifndef PORTAL_GEOMETRY_H
+#define PORTAL_GEOMETRY_H
+
+#include <Arduino.h>
+
+// Where every LED of the strip sits on the portal.
+//
+// The portal is a door-shaped arch: two vertical legs joined by a
+// semicircle. The strip starts at the bottom of the left leg, runs up, over
+// the arch and down the right leg, with an even LED pitch. At boot the
+// position of every LED is computed once, together with its fixed-point
+// angle around the middle of the opening, so effects render angular
+// patterns with table lookups and no trig per frame.
+//
+// Angles are 0-65535 for a full turn, 0 pointing up and increasing
+// clockwise (the direction of the strip).
+
+#ifndef GEOMETRY_MAX_LEDS
+#define GEOMETRY_MAX_LEDS 140
+#endif
+
+#define GEOMETRY_TURN 65536UL  // Angle units per full turn
+
+struct PortalGeometry {
+  int count;
+  int16_t x[GEOMETRY_MAX_LEDS];         // mm from the middle, right positive
+  int16_t y[GEOMETRY_MAX_LEDS];         // mm above the floor
+  uint16_t angle[GEOMETRY_MAX_LEDS];    // Around the center
+  int16_t centerY;                      // mm, the center is at x = 0
+};
+
+// Lay `count` LEDs (at most GEOMETRY_MAX_LEDS) on an arch with an opening
+// `widthMm` wide and legs `legMm` high; the arch adds `widthMm / 2` on top.
+// The center is half way up the opening.
+void geometryBuildArch(PortalGeometry& g, int count, int widthMm, int legMm);
+
+#endif
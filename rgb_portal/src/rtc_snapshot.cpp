@@ -0,0 +1,56 @@
+#include "rtc_snapshot.h"
+#include <esp_system.h>
+
+RTC_NOINIT_ATTR PortalSnapshot rtcSnapshot;
+
+static uint32_t crc32(const uint8_t* data, size_t len) {
+  uint32_t crc = 0xFFFFFFFF;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (int b = 0; b < 8; b++) {
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+static uint32_t snapshotCrc(const PortalSnapshot& s) {
+  return crc32((const uint8_t*)&s, offsetof(PortalSnapshot, crc));
+}
+
+void snapshotSave(PortalSnapshot& s) {
+  s.magic = SNAPSHOT_MAGIC;
+  s.version = SNAPSHOT_VERSION;
+  s.size = sizeof(PortalSnapshot);
+  s.crc = snapshotCrc(s);
+  memcpy(&rtcSnapshot, &s, sizeof(s));  // Byte copy: the CRC covers the padding too
+}
+
+bool snapshotRestore(PortalSnapshot& s) {
+  // RTC memory holds garbage after power-on; after deep sleep there is no
+  // live state to come back to
+  esp_reset_reason_t reason = esp_reset_reason();
+  if (reason == ESP_RST_POWERON || reason == ESP_RST_DEEPSLEEP || reason == ESP_RST_UNKNOWN) {
+    return false;
+  }
+  if (rtcSnapshot.magic != SNAPSHOT_MAGIC || rtcSnapshot.version != SNAPSHOT_VERSION ||
+      rtcSnapshot.size != sizeof(PortalSnapshot) || rtcSnapshot.crc != snapshotCrc(rtcSnapshot)) {
+    return false;
+  }
+  memcpy(&s, &rtcSnapshot, sizeof(s));
+  return true;
+}
+
+const char* snapshotResetReason() {
+  switch (esp_reset_reason()) {
+    case ESP_RST_POWERON: return "power-on";
+    case ESP_RST_SW: return "software";
+    case ESP_RST_PANIC: return "panic";
+    case ESP_RST_INT_WDT:
+    case ESP_RST_TASK_WDT:
+    case ESP_RST_WDT: return "watchdog";
+    case ESP_RST_BROWNOUT: return "brownout";
+    case ESP_RST_DEEPSLEEP: return "deep sleep";
+    default: return "other";
+  }
+}
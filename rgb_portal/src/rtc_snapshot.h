@@ -0,0 +1,55 @@
+#ifndef RTC_SNAPSHOT_H
+#define RTC_SNAPSHOT_H
+
+#include <Arduino.h>
+#include "portal_fsm.h"
+#include "effects.h"
+#include "sensor_sampler.h"
+
+// Live portal state kept in RTC slow memory across warm resets.
+//
+// RTC memory survives software resets (OTA), panics, watchdog and brownout
+// resets, but not a power cycle. The firmware saves a snapshot after every
+// transition and animation step; on boot after a warm reset a snapshot with
+// a matching version, size and CRC is restored, so the portal comes back in
+// the state it was in (a red state set by the controller included) without
+// a sensor warmup. Times are stored as ms elapsed at the moment of saving.
+
+#define SNAPSHOT_MAGIC 0x50525453  // "STRP"
+#define SNAPSHOT_VERSION 1
+
+struct PortalSnapshot {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t size;
+
+  uint8_t state;                // PortalState
+  uint8_t autoTriggered;
+  uint8_t blinkingDone;
+  uint8_t inPassage;
+  BlinkConfig activeBlinkConfig;
+  uint32_t blinkElapsed;        // ms since the blink started
+  uint32_t passageElapsed;      // ms since the passage started
+  uint32_t sincePassageEnd;     // ms since the last passage ended (cooldown)
+  RotatingAnimation rotating;
+  float lastDistance;           // Sensor baseline
+  float filtered[MAX_SENSORS];
+
+  uint32_t crc;                 // Over everything before it
+};
+
+// The copy in RTC memory (not initialised at boot). Exposed so that host
+// tools can carry it across simulated resets.
+extern PortalSnapshot rtcSnapshot;
+
+// Stamp `s` and copy it to RTC memory
+void snapshotSave(PortalSnapshot& s);
+
+// Copy the RTC snapshot into `s` if the last reset kept RTC memory and the
+// snapshot is intact
+bool snapshotRestore(PortalSnapshot& s);
+
+// Reset cause as text, for the boot log
+const char* snapshotResetReason();
+
+#endif
@@ -0,0 +1,126 @@
+#include "sensor_sampler.h"
+#include "timeline.h"
+
+SensorChannel sensors[MAX_SENSORS];
+uint8_t numSensors = 0;
+
+static float minValidDistance = 0;
+static float maxValidDistance = 0;
+static unsigned long slotInterval = 50;  // ms between two pings (any sensor)
+static unsigned long lastSlotTime = 0;
+static uint8_t nextSensor = 0;
+
+// Median of the valid readings in the ring; the latest until it's full
+static float medianOfRecent(const SensorChannel& ch) {
+  if (ch.recentCount < SENSOR_MEDIAN_SIZE) {
+    return ch.distance;
+  }
+  float sorted[SENSOR_MEDIAN_SIZE];
+  for (int i = 0; i < SENSOR_MEDIAN_SIZE; i++) {
+    float v = ch.recentValid[i];
+    int j = i;
+    for (; j > 0 && sorted[j - 1] > v; j--) {
+      sorted[j] = sorted[j - 1];
+    }
+    sorted[j] = v;
+  }
+  return sorted[SENSOR_MEDIAN_SIZE / 2];
+}
+
+void sensorAdd(uint8_t trigPin, uint8_t echoPin) {
+  if (numSensors >= MAX_SENSORS) {
+    return;
+  }
+
+  pinMode(trigPin, OUTPUT);
+  pinMode(echoPin, INPUT);
+
+  SensorChannel& ch = sensors[numSensors++];
+  ch.trigPin = trigPin;
+  ch.echoPin = echoPin;
+  ch.distance = 0;
+  ch.valid = false;
+  ch.sampleTime = 0;
+  ch.echoUs = 0;
+  ch.filtered = 0;
+  ch.recentCount = 0;
+  ch.recentHead = 0;
+  ch.sampleCount = 0;
+  ch.historyHead = 0;
+}
+
+void sensorConfigure(float minDistance, float maxDistance, unsigned long readInterval) {
+  minValidDistance = minDistance;
+  maxValidDistance = maxDistance;
+  // Each sensor gets its own slot within the read interval
+  slotInterval = readInterval / (numSensors > 0 ? numSensors : 1);
+}
+
+int sensorSampleNext(unsigned long now) {
+  if (numSensors == 0 || now - lastSlotTime <= slotInterval) {
+    return -1;
+  }
+
+  uint8_t index = nextSensor;
+  SensorChannel& ch = sensors[index];
+
+  ch.distance = measureDistance(ch.trigPin, ch.echoPin);
+  ch.echoUs = micros();
+  ch.valid = (ch.distance >= minValidDistance && ch.distance <= maxValidDistance);
+  ch.sampleTime = now;
+  if (ch.valid) {
+    ch.recentValid[ch.recentHead] = ch.distance;
+    ch.recentHead = (ch.recentHead + 1) % SENSOR_MEDIAN_SIZE;
+    if (ch.recentCount < SENSOR_MEDIAN_SIZE) ch.recentCount++;
+    ch.filtered = medianOfRecent(ch);
+  }
+  ch.history[ch.historyHead] = ch.distance;
+  ch.historyHead = (ch.historyHead + 1) % SENSOR_HISTORY_SIZE;
+  ch.sampleCount++;
+
+  nextSensor = (nextSensor + 1) % numSensors;
+  lastSlotTime = now;
+  return index;
+}
+
+SensorStats sensorHistoryStats(const SensorChannel& ch) {
+  SensorStats stats = {0, 0, 0, 0};
+  unsigned long stored = ch.sampleCount < SENSOR_HISTORY_SIZE ? ch.sampleCount : SENSOR_HISTORY_SIZE;
+  float sum = 0;
+
+  for (unsigned long i = 0; i < stored; i++) {
+    float d = ch.history[i];
+    if (d < minValidDistance || d > maxValidDistance) {
+      continue;
+    }
+    if (stats.count == 0 || d < stats.min) stats.min = d;
+    if (stats.count == 0 || d > stats.max) stats.max = d;
+    sum += d;
+    stats.count++;
+  }
+
+  if (stats.count > 0) {
+    stats.mean = sum / stats.count;
+  }
+  return stats;
+}
+
+// Function to measure distance with HC-SR04
+float measureDistance(uint8_t trigPin, uint8_t echoPin) {
+  TRACE_SCOPE("pulseIn");
+  // Send out a pulse
+  digitalWrite(trigPin, LOW);
+  delayMicroseconds(2);
+  digitalWrite(trigPin, HIGH);
+  delayMicroseconds(10);
+  digitalWrite(trigPin, LOW);
+
+  // Read the echo (timeout after 30ms = approx 5m)
+  long duration = pulseIn(echoPin, HIGH, 30000);
+
+  // Calculate distance in cm (speed of sound: 343 m/s)
+  // Distance = (time * speed) / 2 (because sound travels there and back)
+  float distance = duration * 0.034 / 2;
+
+  return distance;
+}
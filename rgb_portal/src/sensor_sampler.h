@@ -0,0 +1,59 @@
+#ifndef SENSOR_SAMPLER_H
+#define SENSOR_SAMPLER_H
+
+#include <Arduino.h>
+
+// HC-SR04 sampling for one or two sensors.
+//
+// With two sensors the pings are interleaved: the read interval is split into
+// one time slot per sensor and only one sensor is triggered per slot, so an
+// echo from one sensor can never be picked up by the other.
+
+#define MAX_SENSORS 2
+#define SENSOR_HISTORY_SIZE 16  // Recent readings kept per sensor for statistics
+#define SENSOR_MEDIAN_SIZE 3    // Valid readings the filtered distance is the median of
+
+struct SensorChannel {
+  uint8_t trigPin;
+  uint8_t echoPin;
+  float distance;             // Latest reading in cm (0 = no echo)
+  bool valid;                 // Latest reading within the valid range
+  unsigned long sampleTime;   // millis() of the latest reading
+  unsigned long echoUs;       // micros() when the latest echo was captured
+  float filtered;             // Median of the last valid readings in cm (drops single spikes)
+  float recentValid[SENSOR_MEDIAN_SIZE]; // Ring buffer of the last valid readings
+  uint8_t recentCount;        // Valid readings in recentValid (up to SENSOR_MEDIAN_SIZE)
+  uint8_t recentHead;         // Next slot to write
+  unsigned long sampleCount;  // Readings taken since boot
+  float history[SENSOR_HISTORY_SIZE]; // Ring buffer of recent readings
+  uint8_t historyHead;        // Next slot to write
+};
+
+// Statistics over the valid readings in a sensor's history
+struct SensorStats {
+  uint8_t count;  // Number of valid readings (0 = min/max/mean undefined)
+  float min;
+  float max;
+  float mean;
+};
+
+extern SensorChannel sensors[MAX_SENSORS];
+extern uint8_t numSensors;
+
+// Register a sensor and configure its pins
+void sensorAdd(uint8_t trigPin, uint8_t echoPin);
+
+// Set the valid reading range (cm) and the interval between two readings of
+// the same sensor (ms)
+void sensorConfigure(float minDistance, float maxDistance, unsigned long readInterval);
+
+// Ping one sensor if its time slot has come. Returns the index of the sensor
+// that was sampled, or -1 if it's not time yet.
+int sensorSampleNext(unsigned long now);
+
+SensorStats sensorHistoryStats(const SensorChannel& ch);
+
+// Single blocking measurement in cm
+float measureDistance(uint8_t trigPin, uint8_t echoPin);
+
+#endif
@@ -0,0 +1,354 @@
+#include "sequencer.h"
+#include "json_scan.h"
+
+static const char* const STATE_NAMES[] = {"", "rotating", "red", "green", "clip"};
+static const char* const EASE_NAMES[] = {"step", "linear", "smooth"};
+
+static int findName(const char* const* names, int count, const char* value) {
+  for (int i = 0; i < count; i++) {
+    if (strcmp(names[i], value) == 0) return i;
+  }
+  return -1;
+}
+
+// One field of a step
+static bool setStepField(SequenceStep& step, const char* name, const char* value) {
+  long v;
+  bool b;
+  if (strcmp(name, "at") == 0) {
+    if (!jsonParseLong(value, 0, SEQUENCE_MAX_MS, v)) return false;
+    step.at = (uint32_t)v;
+  } else if (strcmp(name, "state") == 0) {
+    int state = findName(STATE_NAMES + 1, 4, value);
+    if (state < 0) return false;
+    step.state = (uint8_t)(state + 1);
+  } else if (strcmp(name, "ease") == 0) {
+    int ease = findName(EASE_NAMES, 3, value);
+    if (ease < 0) return false;
+    step.ease = (uint8_t)ease;
+  } else if (strcmp(name, "color") == 0) {
+    if (!jsonParseColor(value, step.color)) return false;
+    step.tracks |= SEQ_HAS_COLOR;
+  } else if (strcmp(name, "level") == 0) {
+    if (!jsonParseLong(value, 0, 255, v)) return false;
+    step.level = (uint8_t)v;
+    step.tracks |= SEQ_HAS_LEVEL;
+  } else if (strcmp(name, "blinks") == 0) {
+    if (!jsonParseLong(value, 0, 100, v)) return false;
+    step.blinks = (int16_t)v;
+  } else if (strcmp(name, "blinkMs") == 0) {
+    if (!jsonParseLong(value, 0, 10000, v)) return false;
+    step.blinkMs = (int32_t)v;
+  } else if (strcmp(name, "solid") == 0) {
+    if (!jsonParseBool(value, b)) return false;
+    step.solid = b ? 1 : 0;
+  } else if (strcmp(name, "loops") == 0) {
+    if (!jsonParseLong(value, 0, 1000, v)) return false;
+    step.loops = (uint16_t)v;
+  } else if (strcmp(name, "clip") == 0) {
+    if (!*value || strlen(value) >= SEQUENCE_ID_LEN) return false;
+    strcpy(step.clip, value);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// id, loop or durationMs
+static bool setTimelineField(SequenceTimeline& t, const char* name, const char* value) {
+  long v;
+  if (strcmp(name, "id") == 0) {
+    if (strlen(value) >= SEQUENCE_ID_LEN) return false;
+    strcpy(t.id, value);
+  } else if (strcmp(name, "loop") == 0) {
+    if (!jsonParseBool(value, t.loop)) return false;
+  } else if (strcmp(name, "durationMs") == 0) {
+    if (!jsonParseLong(value, 0, SEQUENCE_MAX_MS, v)) return false;
+    t.durationMs = (uint32_t)v;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// A flat object of step fields
+static const char* parseStep(const char* p, SequenceStep& step, String& error) {
+  step = SequenceStep();
+  step.at = UINT32_MAX;
+  step.ease = SEQ_EASE_LINEAR;
+  step.solid = -1;
+  step.blinks = -1;
+  step.blinkMs = -1;
+  step.loops = 1;
+  if (*p++ != '{') {
+    error = "expected a step object";
+    return nullptr;
+  }
+  p = jsonSkipSpace(p);
+  while (*p != '}') {
+    char name[16];
+    char value[32];
+    if (*p != '"' || !(p = jsonToken(p, name, sizeof(name)))) {
+      error = "expected a step field name";
+      return nullptr;
+    }
+    p = jsonSkipSpace(p);
+    if (*p++ != ':') {
+      error = "expected ':'";
+      return nullptr;
+    }
+    p = jsonSkipSpace(p);
+    if (!(p = jsonToken(p, value, sizeof(value))) || !setStepField(step, name, value)) {
+      error = String("bad step field ") + name;
+      return nullptr;
+    }
+    p = jsonSkipSpace(p);
+    if (*p == ',') {
+      p = jsonSkipSpace(p + 1);
+      if (*p == '}') {
+        error = "expected a step field name";
+        return nullptr;
+      }
+    } else if (*p != '}') {
+      error = "expected ',' or '}'";
+      return nullptr;
+    }
+  }
+  if (step.at == UINT32_MAX) {
+    error = "step without \"at\"";
+    return nullptr;
+  }
+  if ((step.blinks >= 0 || step.blinkMs >= 0 || step.solid >= 0) && step.state != SEQ_RED &&
+      step.state != SEQ_GREEN) {
+    error = "blink fields need state red or green";
+    return nullptr;
+  }
+  // blinks not given come from the config, which may have some
+  if (step.blinkMs == 0 && step.blinks != 0) {
+    error = "blinkMs 0 needs blinks 0";
+    return nullptr;
+  }
+  if ((step.state == SEQ_CLIP) != (step.clip[0] != '\0')) {
+    error = "state clip needs a clip name (and only it)";
+    return nullptr;
+  }
+  return p + 1;
+}
+
+int sequenceParse(SequenceTimeline& t, const char* json, String& error) {
+  t = SequenceTimeline();
+  t.durationMs = UINT32_MAX;  // Not given
+  const char* p = jsonSkipSpace(json);
+  if (*p++ != '{') {
+    error = "expected a JSON object";
+    return -1;
+  }
+  p = jsonSkipSpace(p);
+  while (*p != '}') {
+    char name[16];
+    if (*p != '"' || !(p = jsonToken(p, name, sizeof(name)))) {
+      error = "expected a field name";
+      return -1;
+    }
+    p = jsonSkipSpace(p);
+    if (*p++ != ':') {
+      error = "expected ':'";
+      return -1;
+    }
+    p = jsonSkipSpace(p);
+
+    if (strcmp(name, "steps") == 0) {
+      if (*p++ != '[') {
+        error = "steps must be an array";
+        return -1;
+      }
+      p = jsonSkipSpace(p);
+      while (*p != ']') {
+        if (t.count >= SEQUENCE_MAX_STEPS) {
+          error = String("more than ") + SEQUENCE_MAX_STEPS + " steps";
+          return -1;
+        }
+        SequenceStep& step = t.steps[t.count];
+        if (!(p = parseStep(p, step, error))) {
+          return -1;
+        }
+        if (t.count > 0 && step.at < t.steps[t.count - 1].at) {
+          error = "steps out of order";
+          return -1;
+        }
+        t.count++;
+        p = jsonSkipSpace(p);
+        if (*p == ',') {
+          p = jsonSkipSpace(p + 1);
+          if (*p == ']') {
+            error = "expected a step object";
+            return -1;
+          }
+        } else if (*p != ']') {
+          error = "expected ',' or ']'";
+          return -1;
+        }
+      }
+      p++;
+    } else {
+      char value[32];
+      if (!(p = jsonToken(p, value, sizeof(value))) || !setTimelineField(t, name, value)) {
+        error = String("bad field ") + name;
+        return -1;
+      }
+    }
+    p = jsonSkipSpace(p);
+    if (*p == ',') {
+      p = jsonSkipSpace(p + 1);
+      if (*p == '}') {
+        error = "expected a field name";
+        return -1;
+      }
+    } else if (*p != '}') {
+      error = "expected ',' or '}'";
+      return -1;
+    }
+  }
+
+  if (t.count == 0) {
+    error = "no steps";
+    return -1;
+  }
+  uint32_t last = t.steps[t.count - 1].at;
+  if (t.durationMs == UINT32_MAX) {
+    t.durationMs = last;
+  } else if (t.durationMs < last) {
+    error = "durationMs before the last step";
+    return -1;
+  }
+  if (t.loop && t.durationMs < SEQUENCE_MIN_LOOP_MS) {
+    error = String("a looping timeline needs durationMs of at least ") + SEQUENCE_MIN_LOOP_MS;
+    return -1;
+  }
+  return t.count;
+}
+
+void sequenceStart(Sequencer& s, const SequenceTimeline& t, unsigned long nowUs) {
+  s.timeline = t;
+  s.running = true;
+  s.startUs = nowUs;
+  s.next = 0;
+  s.cycle = 0;
+  s.colorActive = false;
+  s.levelActive = false;
+  s.started++;
+}
+
+static void stop(Sequencer& s) {
+  s.running = false;
+  s.colorActive = false;
+  s.levelActive = false;
+}
+
+bool sequenceAbort(Sequencer& s) {
+  if (!s.running) {
+    return false;
+  }
+  stop(s);
+  s.aborted++;
+  return true;
+}
+
+unsigned long sequenceElapsedMs(const Sequencer& s, unsigned long nowUs) {
+  return s.running ? (nowUs - s.startUs) / 1000 : 0;
+}
+
+// Eased fraction 0-255 of `num` / `den`
+static uint8_t easeFraction(uint8_t ease, uint32_t num, uint32_t den) {
+  uint32_t f = num * 255 / den;
+  if (ease == SEQ_EASE_SMOOTH) {
+    f = f * f * (765 - 2 * f) / 65025;
+  }
+  return (uint8_t)f;
+}
+
+// Keyframes of a track around `t`: the last at or before it (-1 = none
+// yet) and the first after it (-1 = none)
+static void trackKeys(const SequenceTimeline& tl, uint8_t track, uint32_t t, int& prev, int& next) {
+  prev = -1;
+  next = -1;
+  for (int i = 0; i < tl.count; i++) {
+    if (!(tl.steps[i].tracks & track)) {
+      continue;
+    }
+    if (tl.steps[i].at <= t) {
+      prev = i;
+    } else {
+      next = i;
+      break;
+    }
+  }
+}
+
+static void updateTracks(Sequencer& s, uint32_t t) {
+  const SequenceTimeline& tl = s.timeline;
+  int prev, next;
+
+  trackKeys(tl, SEQ_HAS_COLOR, t, prev, next);
+  s.colorActive = prev >= 0;
+  if (s.colorActive) {
+    s.color = tl.steps[prev].color;
+    if (next >= 0 && tl.steps[next].ease != SEQ_EASE_STEP) {
+      uint8_t f = easeFraction(tl.steps[next].ease, t - tl.steps[prev].at, tl.steps[next].at - tl.steps[prev].at);
+      s.color = blend(tl.steps[prev].color, tl.steps[next].color, f);
+    }
+  }
+
+  trackKeys(tl, SEQ_HAS_LEVEL, t, prev, next);
+  s.levelActive = prev >= 0;
+  if (s.levelActive) {
+    s.level = tl.steps[prev].level;
+    if (next >= 0 && tl.steps[next].ease != SEQ_EASE_STEP) {
+      uint8_t f = easeFraction(tl.steps[next].ease, t - tl.steps[prev].at, tl.steps[next].at - tl.steps[prev].at);
+      s.level = blend8(tl.steps[prev].level, tl.steps[next].level, f);
+    }
+  }
+}
+
+SequenceResult sequencePoll(Sequencer& s, unsigned long nowUs, SequenceStepCallback onStep) {
+  if (!s.running) {
+    return SEQUENCE_IDLE;
+  }
+  const SequenceTimeline& tl = s.timeline;
+  for (;;) {
+    unsigned long elapsedUs = nowUs - s.startUs;
+    while (s.next < tl.count && elapsedUs >= tl.steps[s.next].at * 1000UL) {
+      unsigned long lateUs = elapsedUs - tl.steps[s.next].at * 1000UL;
+      s.lastLateUs = lateUs;
+      if (lateUs > s.maxLateUs) {
+        s.maxLateUs = lateUs;
+      }
+      s.stepsFired++;
+      uint8_t index = s.next++;
+      if (onStep) {
+        onStep(tl.steps[index], index, lateUs);
+      }
+    }
+    if (s.next < tl.count || elapsedUs < tl.durationMs * 1000UL) {
+      updateTracks(s, elapsedUs / 1000);
+      return SEQUENCE_RUNNING;
+    }
+    if (!tl.loop) {
+      stop(s);
+      s.completed++;
+      return SEQUENCE_DONE;
+    }
+    // Next cycle on the same time base, so loops don't drift. After a stall
+    // the cycles that passed entirely are skipped instead of replayed step
+    // by step; the steps of the current one fire late.
+    unsigned long durationUs = tl.durationMs * 1000UL;
+    unsigned long cycles = (elapsedUs - durationUs) / durationUs + 1;
+    s.startUs += cycles * durationUs;
+    s.next = 0;
+    s.cycle += (uint16_t)cycles;
+  }
+}
+
+const char* sequenceStateName(uint8_t state) {
+  return state < sizeof(STATE_NAMES) / sizeof(STATE_NAMES[0]) ? STATE_NAMES[state] : "?";
+}
@@ -0,0 +1,125 @@
+#ifndef SEQUENCER_H
+#define SEQUENCER_H
+
+#include <Arduino.h>
+#include <FastLED.h>
+
+// Timeline sequencer for choreographed scenarios.
+//
+// A controller sends a whole scenario in one request instead of timing
+// separate commands over the network: a list of keyframes at millisecond
+// offsets from the start, each of which can change the portal state (with
+// its own blink parameters), start a clip, and set a color or brightness
+// level. The timeline runs on the device clock: a step fires on the first
+// loop pass at or after its time, and how late that was is reported.
+//
+// Color and level are tracks: between two keyframes of a track the value is
+// interpolated (eased by the later keyframe), after the last one it holds.
+// The color replaces the base color of the running effect, the level scales
+// the output. Both end with the timeline.
+//
+// JSON, as sent to POST /sequence or MQTT portal/sequence:
+//   {"id":"scare","loop":false,"durationMs":32000,"steps":[
+//     {"at":0,"state":"red","blinks":8,"blinkMs":80},
+//     {"at":1500,"color":"ff0000","level":255},
+//     {"at":6000,"color":"300000","level":60,"ease":"smooth"},
+//     {"at":30000,"state":"rotating"}]}
+// Step fields: at (ms, not decreasing), state (rotating, red, green, clip),
+// blinks, blinkMs, solid (with red or green, defaults from the config;
+// blinkMs 0 only with blinks 0), clip and loops (with clip), color
+// ("rrggbb"), level (0-255), ease (step, linear, smooth). A looping timeline starts over after durationMs
+// (default: the time of the last step, at least SEQUENCE_MIN_LOOP_MS).
+
+#define SEQUENCE_MAX_STEPS 32
+#define SEQUENCE_ID_LEN 16
+#define SEQUENCE_MAX_MS 3600000UL  // One hour, well inside the micros() wrap
+#define SEQUENCE_MIN_LOOP_MS 100   // Shortest cycle of a looping timeline
+
+enum SequenceStepState : uint8_t {
+  SEQ_KEEP,        // No state change
+  SEQ_ROTATING,
+  SEQ_RED,
+  SEQ_GREEN,
+  SEQ_CLIP
+};
+
+enum SequenceEase : uint8_t {
+  SEQ_EASE_STEP,   // Jump at the keyframe
+  SEQ_EASE_LINEAR,
+  SEQ_EASE_SMOOTH  // Smoothstep: slow start and end
+};
+
+#define SEQ_HAS_COLOR 0x01
+#define SEQ_HAS_LEVEL 0x02
+
+struct SequenceStep {
+  uint32_t at;           // ms from the start
+  uint8_t state;         // SequenceStepState
+  uint8_t ease;          // SequenceEase, for the tracks this step is a keyframe of
+  uint8_t tracks;        // SEQ_HAS_* bits
+  uint8_t level;
+  CRGB color;
+  int8_t solid;          // -1 = from the config
+  int16_t blinks;        // -1 = from the config
+  int32_t blinkMs;       // -1 = from the config
+  uint16_t loops;        // Clip plays, 0 = until the next state change
+  char clip[SEQUENCE_ID_LEN];
+};
+
+struct SequenceTimeline {
+  char id[SEQUENCE_ID_LEN];
+  bool loop;
+  uint32_t durationMs;
+  uint8_t count;
+  SequenceStep steps[SEQUENCE_MAX_STEPS];
+};
+
+enum SequenceResult {
+  SEQUENCE_IDLE,
+  SEQUENCE_RUNNING,
+  SEQUENCE_DONE     // The last step has fired and durationMs is over
+};
+
+struct Sequencer {
+  SequenceTimeline timeline;
+  bool running;
+  unsigned long startUs;   // Start of the current cycle
+  uint8_t next;            // Next step to fire
+  uint16_t cycle;          // Loops completed
+
+  // Track values for the current time
+  bool colorActive;
+  CRGB color;
+  bool levelActive;
+  uint8_t level;
+
+  unsigned long started;
+  unsigned long completed;
+  unsigned long aborted;
+  unsigned long stepsFired;
+  unsigned long lastLateUs;  // Step time to firing
+  unsigned long maxLateUs;
+};
+
+// Called for every step as it fires, `lateUs` after its time
+typedef void (*SequenceStepCallback)(const SequenceStep& step, uint8_t index, unsigned long lateUs);
+
+// Parse a timeline. Returns the number of steps, -1 if it is invalid
+// (`error` says why).
+int sequenceParse(SequenceTimeline& t, const char* json, String& error);
+
+// Run `t` from `nowUs`, replacing a running timeline
+void sequenceStart(Sequencer& s, const SequenceTimeline& t, unsigned long nowUs);
+
+// Stop the running timeline. Returns false if none was running.
+bool sequenceAbort(Sequencer& s);
+
+// Fire the steps that are due and update the track values
+SequenceResult sequencePoll(Sequencer& s, unsigned long nowUs, SequenceStepCallback onStep);
+
+// Time since the start of the current cycle in ms
+unsigned long sequenceElapsedMs(const Sequencer& s, unsigned long nowUs);
+
+const char* sequenceStateName(uint8_t state);
+
+#endif
@@ -0,0 +1,261 @@
+#include "time_sync.h"
+
+#define SYNC_MAGIC_0 'P'
+#define SYNC_MAGIC_1 'S'
+#define SYNC_VERSION 1
+
+#define SYNC_BEACON   1   // Master -> broadcast: node ID, shared clock
+#define SYNC_REQUEST  2   // Follower -> master: t1
+#define SYNC_RESPONSE 3   // Master -> follower: t1 (echo), t2 (received), t3 (sent)
+
+#define SYNC_HEADER_LEN 8  // Magic, version, type, node ID
+#define SYNC_MAX_LEN (SYNC_HEADER_LEN + 3 * 8)
+#define SYNC_MAX_PACKETS_PER_POLL 4
+
+#define SYNC_LISTEN_US         2500000  // After boot: wait this long for a beacon
+#define SYNC_BEACON_INTERVAL_US 1000000
+#define SYNC_REQUEST_INTERVAL_US 1000000
+#define SYNC_ACQUIRE_INTERVAL_US 250000 // Until the sample filter is full
+#define SYNC_REQUEST_TIMEOUT_US 500000
+#define SYNC_PEER_TIMEOUT_US   5000000  // No beacons/requests this long: peer gone
+#define SYNC_STEP_US           50000    // Larger errors are stepped, not slewed
+#define SYNC_MAX_FREQ_PPB      500000   // +-500 ppm
+
+// Loop gains: phase 1/16, frequency 1/1024 per interval (critically damped,
+// time constant ~30 intervals: averages out WiFi delay noise)
+#define SYNC_PHASE_SHIFT 4
+#define SYNC_FREQ_SHIFT  10
+
+static void put64(uint8_t* p, int64_t v) {
+  for (int i = 0; i < 8; i++) p[i] = (uint8_t)((uint64_t)v >> (8 * i));
+}
+
+static int64_t get64(const uint8_t* p) {
+  uint64_t v = 0;
+  for (int i = 7; i >= 0; i--) v = (v << 8) | p[i];
+  return (int64_t)v;
+}
+
+static void putHeader(uint8_t* p, uint8_t type, uint32_t nodeId) {
+  p[0] = SYNC_MAGIC_0;
+  p[1] = SYNC_MAGIC_1;
+  p[2] = SYNC_VERSION;
+  p[3] = type;
+  for (int i = 0; i < 4; i++) p[4 + i] = (uint8_t)(nodeId >> (8 * i));
+}
+
+static void sendPacket(TimeSync& ts, IPAddress ip, uint16_t port, const uint8_t* data, size_t len) {
+  ts.udp.beginPacket(ip, port);
+  ts.udp.write(data, len);
+  ts.udp.endPacket();
+}
+
+void timeSyncBegin(TimeSync& ts, uint32_t nodeId, uint16_t port, uint64_t nowUs) {
+  ts.nodeId = nodeId;
+  ts.port = port;
+  ts.role = SYNC_ALONE;
+  ts.baseLocalUs = nowUs;
+  ts.baseSharedUs = (int64_t)nowUs;
+  ts.freqPpb = 0;
+  ts.listenUntilUs = nowUs + SYNC_LISTEN_US;
+  ts.masterId = 0;
+  ts.masterIP = IPAddress();
+  ts.masterPort = 0;
+  ts.lastBeaconUs = 0;
+  ts.lastFollowerUs = 0;
+  ts.nextSendUs = ts.listenUntilUs;
+  ts.requestPending = false;
+  ts.locked = false;
+  ts.sampleCount = 0;
+  ts.sampleNext = 0;
+  ts.lastAppliedUs = 0;
+  ts.beacons = 0;
+  ts.exchanges = 0;
+  ts.steps = 0;
+  ts.lost = 0;
+  ts.badPackets = 0;
+  ts.lastOffsetUs = 0;
+  ts.lastDelayUs = 0;
+
+  ts.udp.begin(port);
+}
+
+int64_t timeSyncNow(const TimeSync& ts, uint64_t localUs) {
+  int64_t elapsed = (int64_t)(localUs - ts.baseLocalUs);
+  return ts.baseSharedUs + elapsed + elapsed * ts.freqPpb / 1000000000LL;
+}
+
+const char* timeSyncRoleName(SyncRole role) {
+  switch (role) {
+    case SYNC_MASTER: return "master";
+    case SYNC_FOLLOWER: return "follower";
+    default: return "alone";
+  }
+}
+
+// Start the model over from `nowUs`, shifted by `phaseUs`. Stored samples
+// were measured against the old model and are shifted along.
+static void adjustClock(TimeSync& ts, uint64_t nowUs, int64_t phaseUs) {
+  ts.baseSharedUs = timeSyncNow(ts, nowUs) + phaseUs;
+  ts.baseLocalUs = nowUs;
+  for (int i = 0; i < ts.sampleCount; i++) {
+    ts.samples[i].offsetUs -= phaseUs;
+  }
+}
+
+static void followMaster(TimeSync& ts, uint32_t masterId, uint64_t nowUs) {
+  ts.role = SYNC_FOLLOWER;
+  ts.masterId = masterId;
+  ts.locked = false;
+  ts.sampleCount = 0;
+  ts.sampleNext = 0;
+  ts.requestPending = false;
+  ts.nextSendUs = nowUs;
+}
+
+// Clock filter + discipline: use the sample with the shortest round trip
+// of the last SYNC_FILTER_SIZE, each sample at most once
+static void addSample(TimeSync& ts, int64_t offsetUs, int64_t delayUs, uint64_t nowUs) {
+  ts.samples[ts.sampleNext] = {offsetUs, delayUs, nowUs};
+  ts.sampleNext = (ts.sampleNext + 1) % SYNC_FILTER_SIZE;
+  if (ts.sampleCount < SYNC_FILTER_SIZE) ts.sampleCount++;
+
+  const SyncSample* best = &ts.samples[0];
+  for (int i = 1; i < ts.sampleCount; i++) {
+    if (ts.samples[i].delayUs < best->delayUs) best = &ts.samples[i];
+  }
+  if (ts.locked && best->localUs <= ts.lastAppliedUs) {
+    return;
+  }
+
+  int64_t error = best->offsetUs;
+  ts.lastOffsetUs = error;
+  ts.lastDelayUs = best->delayUs;
+  if (!ts.locked || error > SYNC_STEP_US || error < -SYNC_STEP_US) {
+    adjustClock(ts, nowUs, error);
+    ts.steps++;
+    ts.locked = true;
+  } else {
+    int64_t interval = (int64_t)(nowUs - ts.lastAppliedUs);
+    if (interval < SYNC_ACQUIRE_INTERVAL_US) interval = SYNC_ACQUIRE_INTERVAL_US;
+    int64_t freq = ts.freqPpb + ((error * 1000000000LL / interval) >> SYNC_FREQ_SHIFT);
+    ts.freqPpb = (int32_t)constrain(freq, (int64_t)-SYNC_MAX_FREQ_PPB, (int64_t)SYNC_MAX_FREQ_PPB);
+    adjustClock(ts, nowUs, error >> SYNC_PHASE_SHIFT);
+  }
+  ts.lastAppliedUs = best->localUs;
+}
+
+static void handlePacket(TimeSync& ts, const uint8_t* p, int len, uint64_t nowUs) {
+  if (len < SYNC_HEADER_LEN || p[0] != SYNC_MAGIC_0 || p[1] != SYNC_MAGIC_1 || p[2] != SYNC_VERSION) {
+    ts.badPackets++;
+    return;
+  }
+  uint32_t nodeId = (uint32_t)p[4] | ((uint32_t)p[5] << 8) | ((uint32_t)p[6] << 16) | ((uint32_t)p[7] << 24);
+  if (nodeId == ts.nodeId) {
+    return;  // Our own broadcast
+  }
+
+  switch (p[3]) {
+    case SYNC_BEACON: {
+      if (len < SYNC_HEADER_LEN + 8) break;
+      // A portal that just booted joins the running group clock
+      if (nowUs < ts.listenUntilUs) {
+        adjustClock(ts, nowUs, get64(p + SYNC_HEADER_LEN) - timeSyncNow(ts, nowUs));
+        ts.listenUntilUs = 0;
+      }
+      if (nodeId > ts.nodeId) {
+        return;  // They will follow us
+      }
+      bool masterGone = nowUs - ts.lastBeaconUs > SYNC_PEER_TIMEOUT_US;
+      if (ts.role != SYNC_FOLLOWER || nodeId < ts.masterId || masterGone) {
+        if (ts.role != SYNC_FOLLOWER || nodeId != ts.masterId) {
+          followMaster(ts, nodeId, nowUs);
+        }
+      }
+      if (nodeId == ts.masterId) {
+        ts.masterIP = ts.udp.remoteIP();
+        ts.masterPort = ts.udp.remotePort();
+        ts.lastBeaconUs = nowUs;
+        ts.beacons++;
+      }
+      return;
+    }
+
+    case SYNC_REQUEST: {
+      if (len < SYNC_HEADER_LEN + 8 || ts.role == SYNC_FOLLOWER) break;
+      ts.role = SYNC_MASTER;
+      ts.lastFollowerUs = nowUs;
+      // Answered in the same loop pass: receive and send time are equal
+      int64_t t2 = timeSyncNow(ts, nowUs);
+      uint8_t reply[SYNC_HEADER_LEN + 24];
+      putHeader(reply, SYNC_RESPONSE, ts.nodeId);
+      memcpy(reply + SYNC_HEADER_LEN, p + SYNC_HEADER_LEN, 8);
+      put64(reply + SYNC_HEADER_LEN + 8, t2);
+      put64(reply + SYNC_HEADER_LEN + 16, t2);
+      sendPacket(ts, ts.udp.remoteIP(), ts.udp.remotePort(), reply, sizeof(reply));
+      return;
+    }
+
+    case SYNC_RESPONSE: {
+      if (len < SYNC_HEADER_LEN + 24 || ts.role != SYNC_FOLLOWER || nodeId != ts.masterId) break;
+      int64_t t1 = get64(p + SYNC_HEADER_LEN);
+      if (!ts.requestPending || t1 != ts.requestSharedUs) {
+        return;  // Late answer to a request we gave up on
+      }
+      ts.requestPending = false;
+      int64_t t2 = get64(p + SYNC_HEADER_LEN + 8);
+      int64_t t3 = get64(p + SYNC_HEADER_LEN + 16);
+      int64_t t4 = timeSyncNow(ts, nowUs);
+      ts.exchanges++;
+      addSample(ts, ((t2 - t1) + (t3 - t4)) / 2, (t4 - t1) - (t3 - t2), nowUs);
+      return;
+    }
+  }
+}
+
+void timeSyncPoll(TimeSync& ts, uint64_t nowUs) {
+  uint8_t packet[SYNC_MAX_LEN];
+  for (int i = 0; i < SYNC_MAX_PACKETS_PER_POLL; i++) {
+    int size = ts.udp.parsePacket();
+    if (size <= 0) break;
+    int len = ts.udp.read(packet, sizeof(packet));
+    handlePacket(ts, packet, len, nowUs);
+  }
+
+  // Peers that went quiet
+  if (ts.role == SYNC_FOLLOWER && nowUs - ts.lastBeaconUs > SYNC_PEER_TIMEOUT_US) {
+    ts.role = SYNC_ALONE;  // Keep the disciplined clock, take over if we are next
+    ts.locked = false;
+    ts.nextSendUs = nowUs;
+  } else if (ts.role == SYNC_MASTER && nowUs - ts.lastFollowerUs > SYNC_PEER_TIMEOUT_US) {
+    ts.role = SYNC_ALONE;
+  }
+  if (ts.requestPending && nowUs - ts.requestLocalUs > SYNC_REQUEST_TIMEOUT_US) {
+    ts.requestPending = false;
+    ts.lost++;
+  }
+
+  if (nowUs < ts.nextSendUs || nowUs < ts.listenUntilUs) {
+    return;
+  }
+  uint8_t out[SYNC_HEADER_LEN + 8];
+  if (ts.role == SYNC_FOLLOWER) {
+    if (ts.requestPending) {
+      return;
+    }
+    ts.requestPending = true;
+    ts.requestLocalUs = nowUs;
+    ts.requestSharedUs = timeSyncNow(ts, nowUs);
+    putHeader(out, SYNC_REQUEST, ts.nodeId);
+    put64(out + SYNC_HEADER_LEN, ts.requestSharedUs);
+    sendPacket(ts, ts.masterIP, ts.masterPort, out, sizeof(out));
+    bool acquiring = !ts.locked || ts.sampleCount < SYNC_FILTER_SIZE;
+    ts.nextSendUs = nowUs + (acquiring ? SYNC_ACQUIRE_INTERVAL_US : SYNC_REQUEST_INTERVAL_US);
+  } else {
+    putHeader(out, SYNC_BEACON, ts.nodeId);
+    put64(out + SYNC_HEADER_LEN, timeSyncNow(ts, nowUs));
+    sendPacket(ts, WiFi.broadcastIP(), ts.port, out, sizeof(out));
+    if (ts.role == SYNC_MASTER) ts.beacons++;
+    ts.nextSendUs = nowUs + SYNC_BEACON_INTERVAL_US;
+  }
+}
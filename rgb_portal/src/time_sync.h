@@ -0,0 +1,95 @@
+#ifndef TIME_SYNC_H
+#define TIME_SYNC_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <WiFiUdp.h>
+
+// Shared animation clock for several portals on one network.
+//
+// The portal with the lowest node ID is the master: it broadcasts a beacon
+// with its clock every second on UDP port 4050, and the others follow the
+// lowest ID they hear. A follower measures its offset to the master with
+// NTP-style exchanges (four timestamps, so the network delay cancels out as
+// long as it is symmetric). It keeps the exchange with the shortest round
+// trip of the last eight, because WiFi delays are mostly one-sided queueing,
+// and disciplines its clock with a phase + frequency loop. The crystal
+// difference between two boards (tens of ppm, i.e. a LED step every few
+// minutes) becomes a frequency correction instead of a growing offset.
+//
+// The shared clock is each portal's own clock run through the disciplined
+// model (offset + frequency). A master keeps the model it had as a
+// follower, so when it takes over the group clock continues without a jump.
+// A newly booted portal listens for a beacon first and adopts that time
+// before it can win the election.
+
+#define TIME_SYNC_PORT 4050
+#define SYNC_FILTER_SIZE 8
+
+enum SyncRole {
+  SYNC_ALONE,     // No peers: shared clock = own clock, not in use
+  SYNC_MASTER,    // Followers are asking for our time
+  SYNC_FOLLOWER   // Disciplined to a master
+};
+
+struct SyncSample {
+  int64_t offsetUs;   // Master clock - shared clock
+  int64_t delayUs;    // Round trip minus the master's turnaround
+  uint64_t localUs;   // When it was measured
+};
+
+struct TimeSync {
+  WiFiUDP udp;
+  uint16_t port;
+  uint32_t nodeId;
+  SyncRole role;
+
+  // Clock model: shared = baseShared + elapsed + elapsed * freqPpb / 1e9
+  uint64_t baseLocalUs;
+  int64_t baseSharedUs;
+  int32_t freqPpb;
+
+  uint64_t listenUntilUs;     // After boot: adopt a beacon before beaconing ourselves
+  uint32_t masterId;
+  IPAddress masterIP;
+  uint16_t masterPort;
+  uint64_t lastBeaconUs;      // Last beacon from our master (follower)
+  uint64_t lastFollowerUs;    // Last request from a follower (master)
+  uint64_t nextSendUs;        // Next beacon (master) or request (follower)
+
+  bool requestPending;
+  uint64_t requestLocalUs;    // Our clock when the pending request was sent
+  int64_t requestSharedUs;    // Shared clock at the same moment
+  bool locked;                // A measurement has been applied since following
+
+  SyncSample samples[SYNC_FILTER_SIZE];
+  uint8_t sampleCount;
+  uint8_t sampleNext;
+  uint64_t lastAppliedUs;     // localUs of the last sample used
+
+  // Statistics
+  unsigned long beacons;      // Sent (master) or received from our master
+  unsigned long exchanges;    // Completed request/response pairs
+  unsigned long steps;        // Corrections too large to slew
+  unsigned long lost;         // Requests without response
+  unsigned long badPackets;
+  int64_t lastOffsetUs;       // Offset of the last applied sample
+  int64_t lastDelayUs;
+};
+
+void timeSyncBegin(TimeSync& ts, uint32_t nodeId, uint16_t port, uint64_t nowUs);
+
+// Answer requests, follow beacons and send our own; call every loop pass
+void timeSyncPoll(TimeSync& ts, uint64_t nowUs);
+
+// Shared clock at local time `localUs`
+int64_t timeSyncNow(const TimeSync& ts, uint64_t localUs);
+
+// True if other portals share our clock (animations should follow it)
+inline bool timeSyncShared(const TimeSync& ts) {
+  return ts.role == SYNC_MASTER || (ts.role == SYNC_FOLLOWER && ts.locked);
+}
+
+const char* timeSyncRoleName(SyncRole role);
+
+#endif
@@ -0,0 +1,71 @@
+#include "timeline.h"
+
+#if PORTAL_TRACE
+
+static TimelineEvent events[TIMELINE_EVENTS];
+static volatile uint32_t recorded = 0;  // Next slot is recorded % TIMELINE_EVENTS
+static bool paused = false;
+static uint32_t lastCycles = 0;
+static uint32_t wraps = 0;
+
+uint64_t timelineCycles() {
+  uint32_t cycles = ESP.getCycleCount();
+  if (cycles < lastCycles) {
+    wraps++;
+  }
+  lastCycles = cycles;
+  return ((uint64_t)wraps << 32) | cycles;
+}
+
+void timelineRecord(const char* name, uint64_t start, uint64_t end) {
+  if (paused || end - start < (uint64_t)TIMELINE_MIN_US * ESP.getCpuFreqMHz()) {
+    return;
+  }
+  TimelineEvent& ev = events[recorded % TIMELINE_EVENTS];
+  ev.name = name;
+  ev.start = start;
+  ev.duration = (uint32_t)(end - start);
+  recorded = recorded + 1;  // Publish the slot after it is complete
+}
+
+uint32_t timelineCount() {
+  return recorded;
+}
+
+void timelineExport(void (*write)(const char* data, size_t len)) {
+  paused = true;
+
+  uint32_t count = recorded;
+  uint32_t first = count > TIMELINE_EVENTS ? count - TIMELINE_EVENTS : 0;
+  double cyclesPerUs = ESP.getCpuFreqMHz();
+
+  char buf[512];
+  size_t used = snprintf(buf, sizeof(buf),
+                         "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"recorded\":%lu,\"overwritten\":%lu},"
+                         "\"traceEvents\":[{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,"
+                         "\"args\":{\"name\":\"loop\"}}",
+                         (unsigned long)count, (unsigned long)first);
+  for (uint32_t i = first; i < count; i++) {
+    const TimelineEvent& ev = events[i % TIMELINE_EVENTS];
+    char line[128];
+    int n = snprintf(line, sizeof(line), ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}",
+                     ev.name, ev.start / cyclesPerUs, ev.duration / cyclesPerUs);
+    if (n <= 0 || n >= (int)sizeof(line)) continue;
+    if (used + n >= sizeof(buf)) {
+      write(buf, used);
+      used = 0;
+    }
+    memcpy(buf + used, line, n);
+    used += n;
+  }
+  if (used + 4 > sizeof(buf)) {
+    write(buf, used);
+    used = 0;
+  }
+  used += snprintf(buf + used, sizeof(buf) - used, "]}\n");
+  write(buf, used);
+
+  paused = false;
+}
+
+#endif
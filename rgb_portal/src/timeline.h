@@ -0,0 +1,68 @@
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <Arduino.h>
+
+// Execution timeline for Perfetto / chrome://tracing.
+//
+// TRACE_SCOPE("name") records one complete event (start and duration in CPU
+// cycles) when the enclosing scope ends, if it took TIMELINE_MIN_US or more.
+// Events go into a ring of TIMELINE_EVENTS entries that is overwritten from
+// the oldest; GET /trace.json exports it in Chrome trace-event format. Everything runs in the loop task,
+// so the ring has one writer and needs no lock; recording pauses while the
+// ring is exported.
+//
+// Off by default: build with -DPORTAL_TRACE=1. Without it TRACE_SCOPE
+// expands to nothing and no timeline code is compiled.
+
+#ifndef PORTAL_TRACE
+#define PORTAL_TRACE 0
+#endif
+
+#if PORTAL_TRACE
+
+#define TIMELINE_EVENTS 1024  // 16 bytes each
+#ifndef TIMELINE_MIN_US
+#define TIMELINE_MIN_US 10    // Shorter scopes are skipped so idle loop passes don't flush the ring
+#endif
+
+struct TimelineEvent {
+  const char* name;     // String literal
+  uint64_t start;       // CPU cycles since boot
+  uint32_t duration;    // CPU cycles
+};
+
+// CPU cycle counter extended to 64 bits (the 32-bit counter wraps every
+// 18 s at 240 MHz; the loop records far more often than that)
+uint64_t timelineCycles();
+
+void timelineRecord(const char* name, uint64_t start, uint64_t end);
+
+// Events recorded since boot (older than TIMELINE_EVENTS are overwritten)
+uint32_t timelineCount();
+
+// Write the ring as Chrome trace-event JSON, oldest event first, through
+// `write` in chunks of a few hundred bytes
+void timelineExport(void (*write)(const char* data, size_t len));
+
+class TimelineScope {
+public:
+  explicit TimelineScope(const char* name) : name_(name), start_(timelineCycles()) {}
+  ~TimelineScope() { timelineRecord(name_, start_, timelineCycles()); }
+
+private:
+  const char* name_;
+  uint64_t start_;
+};
+
+#define TIMELINE_CONCAT_(a, b) a##b
+#define TIMELINE_CONCAT(a, b) TIMELINE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TimelineScope TIMELINE_CONCAT(timelineScope_, __LINE__)(name)
+
+#else
+
+#define TRACE_SCOPE(name) do {} while (0)
+
+#endif
+
+#endif
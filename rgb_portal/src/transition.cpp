@@ -0,0 +1,50 @@
+#include "transition.h"
+
+void transitionStart(Transition& t, const CRGB* shown, int count, uint16_t durationMs, unsigned long nowMs) {
+  if (count > TRANSITION_MAX_LEDS || durationMs == 0) {
+    t.active = false;
+    return;
+  }
+  memmove(t.from, shown, count * sizeof(CRGB));
+  t.active = true;
+  t.startMs = nowMs;
+  t.durationMs = durationMs;
+  t.started++;
+}
+
+void transitionCancel(Transition& t) {
+  t.active = false;
+}
+
+uint8_t transitionAmount(unsigned long elapsedMs, uint16_t durationMs) {
+  return elapsedMs >= durationMs ? 255 : (uint8_t)(elapsedMs * 255 / durationMs);
+}
+
+void transitionBlend(const CRGB* from, CRGB* out, int count, uint8_t amount) {
+  const uint8_t* a = from[0].raw;
+  uint8_t* b = out[0].raw;
+  for (int i = 0; i < count * 3; i++) {
+    b[i] = blend8(a[i], b[i], amount);
+  }
+}
+
+bool transitionApply(Transition& t, CRGB* out, int count, unsigned long nowMs) {
+  if (!t.active) {
+    return false;
+  }
+  unsigned long elapsed = nowMs - t.startMs;
+  if (elapsed >= t.durationMs) {
+    // The incoming frame as it is
+    t.active = false;
+    return true;
+  }
+  unsigned long start = micros();
+  transitionBlend(t.from, out, count, transitionAmount(elapsed, t.durationMs));
+  unsigned long took = micros() - start;
+  t.blendUsTotal += took;
+  if (took > t.blendUsMax) {
+    t.blendUsMax = took;
+  }
+  t.frames++;
+  return true;
+}
@@ -0,0 +1,50 @@
+#ifndef TRANSITION_H
+#define TRANSITION_H
+
+#include <FastLED.h>
+
+// Crossfades between portal states.
+//
+// Rendering the outgoing and the incoming effect on every frame of a fade
+// would double the render cost. Instead the outgoing side is frozen: the
+// frame on the strip when the state changes is copied once, and each frame
+// of the fade blends the incoming frame into it in a single pass. The blend
+// works on output values (after the LUT), right before show(), so rendered
+// effects, clips and streamed frames fade the same way and leds[] - the
+// base of clip and stream delta frames - is never touched. A state change
+// during a fade freezes the blended frame, so it goes on from what is shown.
+
+#ifndef TRANSITION_MAX_LEDS
+#define TRANSITION_MAX_LEDS 140
+#endif
+
+struct Transition {
+  CRGB from[TRANSITION_MAX_LEDS];  // Frozen outgoing frame (output values)
+  bool active;
+  unsigned long startMs;
+  uint16_t durationMs;
+
+  unsigned long started;
+  unsigned long frames;           // Blended frames
+  uint64_t blendUsTotal;
+  unsigned long blendUsMax;
+};
+
+// Freeze `shown` (the frame on the strip) and fade from it over `durationMs`.
+// More than TRANSITION_MAX_LEDS (main.cpp asserts NUM_LEDS fits) cuts.
+void transitionStart(Transition& t, const CRGB* shown, int count, uint16_t durationMs, unsigned long nowMs);
+
+// Drop a running fade: the next frame is a hard cut
+void transitionCancel(Transition& t);
+
+// Blend the incoming frame `out` with the frozen one for `nowMs`. The fade
+// ends once its duration is over. Returns false if no fade is running.
+bool transitionApply(Transition& t, CRGB* out, int count, unsigned long nowMs);
+
+// Blend amount of the incoming frame (0-255) `elapsedMs` into a fade
+uint8_t transitionAmount(unsigned long elapsedMs, uint16_t durationMs);
+
+// The single blend pass: blend8() of every byte, `amount` of `out`
+void transitionBlend(const CRGB* from, CRGB* out, int count, uint8_t amount);
+
+#endif
@@ -0,0 +1,222 @@
+#include "udp_control.h"
+
+static uint32_t get32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t get64(const uint8_t* p) {
+  return (uint64_t)get32(p) | ((uint64_t)get32(p + 4) << 32);
+}
+
+static inline uint64_t rotl(uint64_t x, int b) {
+  return (x << b) | (x >> (64 - b));
+}
+
+#define SIPROUND                                                       \
+  do {                                                                 \
+    v0 += v1; v1 = rotl(v1, 13); v1 ^= v0; v0 = rotl(v0, 32);          \
+    v2 += v3; v3 = rotl(v3, 16); v3 ^= v2;                             \
+    v0 += v3; v3 = rotl(v3, 21); v3 ^= v0;                             \
+    v2 += v1; v1 = rotl(v1, 17); v1 ^= v2; v2 = rotl(v2, 32);          \
+  } while (0)
+
+uint64_t sipHash24(const uint8_t key[16], const uint8_t* data, size_t len) {
+  uint64_t k0 = get64(key);
+  uint64_t k1 = get64(key + 8);
+  uint64_t v0 = 0x736f6d6570736575ULL ^ k0;
+  uint64_t v1 = 0x646f72616e646f6dULL ^ k1;
+  uint64_t v2 = 0x6c7967656e657261ULL ^ k0;
+  uint64_t v3 = 0x7465646279746573ULL ^ k1;
+
+  size_t blocks = len / 8;
+  for (size_t i = 0; i < blocks; i++) {
+    uint64_t m = get64(data + 8 * i);
+    v3 ^= m;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= m;
+  }
+
+  // Last block: remaining bytes and the length in the top byte
+  uint64_t b = (uint64_t)len << 56;
+  for (size_t i = 0; i < len % 8; i++) {
+    b |= (uint64_t)data[8 * blocks + i] << (8 * i);
+  }
+  v3 ^= b;
+  SIPROUND;
+  SIPROUND;
+  v0 ^= b;
+
+  v2 ^= 0xff;
+  SIPROUND;
+  SIPROUND;
+  SIPROUND;
+  SIPROUND;
+  return v0 ^ v1 ^ v2 ^ v3;
+}
+
+static void put32(uint8_t* p, uint32_t v) {
+  for (int i = 0; i < 4; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static void putTag(const UdpControl& c, uint8_t* packet, size_t len) {
+  uint64_t tag = sipHash24(c.key, packet, len);
+  for (int i = 0; i < CONTROL_TAG_LEN; i++) packet[len + i] = (uint8_t)(tag >> (8 * i));
+}
+
+// Request tag over the header and the session nonce. Compared without an
+// early exit, so timing doesn't tell how much matched.
+static bool tagValid(const UdpControl& c, const uint8_t* packet, uint32_t nonce) {
+  const size_t len = CONTROL_REQUEST_LEN - CONTROL_TAG_LEN;
+  uint8_t data[len + 4];
+  memcpy(data, packet, len);
+  put32(data + len, nonce);
+  uint64_t tag = sipHash24(c.key, data, sizeof(data));
+  uint8_t diff = 0;
+  for (int i = 0; i < CONTROL_TAG_LEN; i++) diff |= packet[len + i] ^ (uint8_t)(tag >> (8 * i));
+  return diff == 0;
+}
+
+static int hexDigit(char ch) {
+  if (ch >= '0' && ch <= '9') return ch - '0';
+  if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+  if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+  return -1;
+}
+
+bool controlBegin(UdpControl& c, const char* hexKey, uint16_t port) {
+  c.enabled = false;
+  c.commands = 0;
+  c.retries = 0;
+  c.stale = 0;
+  c.challenges = 0;
+  c.badTags = 0;
+  c.badPackets = 0;
+  for (int i = 0; i < CONTROL_SESSIONS; i++) c.sessions[i].used = false;
+
+  if (!hexKey || strlen(hexKey) != 2 * CONTROL_KEY_LEN) {
+    return false;
+  }
+  for (int i = 0; i < CONTROL_KEY_LEN; i++) {
+    int hi = hexDigit(hexKey[2 * i]);
+    int lo = hexDigit(hexKey[2 * i + 1]);
+    if (hi < 0 || lo < 0) {
+      return false;
+    }
+    c.key[i] = (uint8_t)(hi << 4 | lo);
+  }
+
+  c.enabled = c.udp.begin(port);
+  return c.enabled;
+}
+
+static ControlSession* findSession(UdpControl& c, uint32_t id) {
+  for (int i = 0; i < CONTROL_SESSIONS; i++) {
+    if (c.sessions[i].used && c.sessions[i].id == id) {
+      return &c.sessions[i];
+    }
+  }
+  return nullptr;
+}
+
+// Take a free or the least recently used slot for `id`, with a new nonce
+static ControlSession& openSession(UdpControl& c, uint32_t id, unsigned long now) {
+  ControlSession* oldest = &c.sessions[0];
+  for (int i = 0; i < CONTROL_SESSIONS; i++) {
+    ControlSession& s = c.sessions[i];
+    if (!s.used || (oldest->used && s.lastUsed < oldest->lastUsed)) {
+      oldest = &s;
+    }
+  }
+  oldest->used = true;
+  oldest->answered = false;
+  oldest->id = id;
+  oldest->nonce = esp_random();
+  oldest->lastUsed = now;
+  return *oldest;
+}
+
+static void sendReply(UdpControl& c, const uint8_t* reply) {
+  c.udp.beginPacket(c.udp.remoteIP(), c.udp.remotePort());
+  c.udp.write(reply, CONTROL_REPLY_LEN);
+  c.udp.endPacket();
+}
+
+int controlPoll(UdpControl& c, unsigned long now, ControlHandler handler) {
+  if (!c.enabled) {
+    return 0;
+  }
+
+  int executed = 0;
+  uint8_t packet[CONTROL_REQUEST_LEN];
+  for (int i = 0; i < CONTROL_MAX_PACKETS_PER_POLL; i++) {
+    int size = c.udp.parsePacket();
+    if (size <= 0) break;
+    if (size != CONTROL_REQUEST_LEN || c.udp.read(packet, sizeof(packet)) != CONTROL_REQUEST_LEN ||
+        packet[0] != CONTROL_VERSION) {
+      c.badPackets++;
+      continue;
+    }
+    uint8_t command = packet[1];
+    uint32_t seq = get32(packet + 2);
+    uint32_t sessionId = get32(packet + 6);
+    uint8_t reply[CONTROL_REPLY_LEN];
+    memcpy(reply, packet, 10);
+    reply[1] = CONTROL_REPLY_FLAG | command;
+
+    ControlSession* session = findSession(c, sessionId);
+    bool valid = session && tagValid(c, packet, session->nonce);
+    if (!valid && (!session || !session->answered)) {
+      // Unknown session, or its challenge got lost: nothing runs before the
+      // client has shown it holds the session's nonce
+      if (!session) {
+        session = &openSession(c, sessionId, now);
+        c.challenges++;
+      }
+      reply[10] = CTRL_CHALLENGE;
+      reply[11] = 0;
+      put32(reply + 12, session->nonce);
+      putTag(c, reply, CONTROL_REPLY_LEN - CONTROL_TAG_LEN);
+      sendReply(c, reply);
+      continue;
+    }
+    if (!valid) {
+      c.badTags++;
+      continue;
+    }
+    session->lastUsed = now;
+
+    if (session->answered && seq == session->lastSeq) {
+      c.retries++;
+      sendReply(c, session->reply);
+      continue;
+    }
+
+    uint8_t state = 0;
+    ControlStatus status;
+    if (session->answered && (int32_t)(seq - session->lastSeq) < 0) {
+      c.stale++;
+      status = CTRL_STALE;
+    } else {
+      status = handler(command, state);
+    }
+    reply[10] = status;
+    reply[11] = state;
+    put32(reply + 12, session->nonce);
+    putTag(c, reply, CONTROL_REPLY_LEN - CONTROL_TAG_LEN);
+    sendReply(c, reply);
+
+    // Answers are remembered so that a retry doesn't run the command twice.
+    // A busy portal hasn't run it: the retry should.
+    if (status == CTRL_OK || status == CTRL_UNKNOWN) {
+      session->answered = true;
+      session->lastSeq = seq;
+      memcpy(session->reply, reply, CONTROL_REPLY_LEN);
+    }
+    if (status == CTRL_OK) {
+      c.commands++;
+      executed++;
+    }
+  }
+  return executed;
+}
@@ -0,0 +1,91 @@
+#ifndef UDP_CONTROL_H
+#define UDP_CONTROL_H
+
+#include <Arduino.h>
+#include <WiFiUdp.h>
+
+// Binary control channel for the controller (UDP port 4210).
+//
+// One datagram per command and one per reply, both authenticated with a
+// SipHash-2-4 tag under a shared 128-bit key (CONTROL_KEY in secrets.h):
+//
+//   request  [version][command][seq LE32][session LE32][tag 8]                         18 bytes
+//   reply    [version][0x80|command][seq][session][status][state][nonce LE32][tag 8]  24 bytes
+//
+// The request tag covers the packet and the session's nonce, the reply tag
+// the packet. A client picks a random session ID; the portal answers the
+// first command of a session it doesn't know (new, evicted from the cache,
+// or from before a reboot) with CTRL_CHALLENGE and a fresh random nonce
+// instead of running it, and the client sends it again with that nonce. A
+// recorded packet therefore can't run again once its session is gone.
+//
+// Within a session the client numbers its commands. A retry re-sends the
+// same sequence number: the portal answers it from the reply cached for
+// that session without executing the command again, so retries are
+// idempotent. Older sequence numbers are answered with CTRL_STALE and
+// ignored. Commands are posted to the portal event queue and the reply
+// carries the state they lead to - no rendering or MQTT on this path.
+
+#define CONTROL_PORT 4210
+#define CONTROL_VERSION 2
+#define CONTROL_KEY_LEN 16
+#define CONTROL_TAG_LEN 8
+#define CONTROL_REQUEST_LEN (10 + CONTROL_TAG_LEN)
+#define CONTROL_REPLY_LEN (16 + CONTROL_TAG_LEN)
+#define CONTROL_REPLY_FLAG 0x80
+#define CONTROL_SESSIONS 4             // Clients remembered for retries
+#define CONTROL_MAX_PACKETS_PER_POLL 4
+
+enum ControlCommand {
+  CMD_STATE = 1,
+  CMD_RED = 2,
+  CMD_GREEN = 3,
+  CMD_RESET = 4,
+  CMD_TOGGLE = 5,
+  CMD_ABORT = 6      // Stop the running timeline (if any) and reset
+};
+
+enum ControlStatus {
+  CTRL_OK = 0,
+  CTRL_STALE = 1,     // Sequence number older than the last one of the session
+  CTRL_UNKNOWN = 2,   // Unknown command
+  CTRL_BUSY = 3,      // Event queue full, retry
+  CTRL_CHALLENGE = 4  // Unknown session, not run: send it again with the nonce of this reply
+};
+
+struct ControlSession {
+  uint32_t id;
+  uint32_t nonce;             // Issued with the challenge, part of every request tag
+  uint32_t lastSeq;
+  unsigned long lastUsed;     // millis(), least recently used slot is reused
+  bool used;
+  bool answered;              // lastSeq and reply are set
+  uint8_t reply[CONTROL_REPLY_LEN];  // Answer to lastSeq
+};
+
+struct UdpControl {
+  WiFiUDP udp;
+  bool enabled;
+  uint8_t key[CONTROL_KEY_LEN];
+  ControlSession sessions[CONTROL_SESSIONS];
+
+  unsigned long commands;     // Executed
+  unsigned long retries;      // Answered from the session cache
+  unsigned long stale;
+  unsigned long challenges;   // Sessions opened (new clients, evicted or from before a reboot)
+  unsigned long badTags;      // Wrong key or tampered
+  unsigned long badPackets;   // Wrong size or version
+};
+
+// Executes one command and fills in the state number for the reply
+typedef ControlStatus (*ControlHandler)(uint8_t command, uint8_t& state);
+
+// `hexKey` is 32 hex digits. Anything else leaves the channel disabled.
+bool controlBegin(UdpControl& c, const char* hexKey, uint16_t port);
+
+// Answer pending commands; returns the number of commands executed
+int controlPoll(UdpControl& c, unsigned long now, ControlHandler handler);
+
+uint64_t sipHash24(const uint8_t key[16], const uint8_t* data, size_t len);
+
+#endif
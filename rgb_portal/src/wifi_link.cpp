@@ -0,0 +1,189 @@
+#include "wifi_link.h"
+#include <Preferences.h>
+
+static bool loadCache(WifiLinkCache& c) {
+  Preferences prefs;
+  bool ok = prefs.begin(WIFI_NVS_NAMESPACE, true) && prefs.getBytes("ap", &c, sizeof(c)) == sizeof(c);
+  prefs.end();
+  return ok && c.channel >= 1 && c.channel <= 14;
+}
+
+static void storeCache(WifiLink& l) {
+  Preferences prefs;
+  if (prefs.begin(WIFI_NVS_NAMESPACE, false)) {
+    prefs.putBytes("ap", &l.cache, sizeof(l.cache));
+    l.cacheWrites++;
+  }
+  prefs.end();
+}
+
+// Static IP, the cached lease or DHCP for the next association
+static void applyAddress(WifiLink& l, bool useLease) {
+  if ((uint32_t)l.staticIp != 0) {
+    WiFi.config(l.staticIp, l.staticGateway, l.staticSubnet, l.staticDns);
+  } else if (useLease) {
+    WiFi.config(IPAddress(l.cache.ip), IPAddress(l.cache.gateway), IPAddress(l.cache.subnet),
+                IPAddress(l.cache.dns));
+  } else {
+    WiFi.config(IPAddress(), IPAddress(), IPAddress());
+  }
+}
+
+static void startDirect(WifiLink& l, unsigned long now) {
+  l.phase = LINK_DIRECT;
+  l.attemptStart = now;
+  l.directLease = (uint32_t)l.staticIp == 0 && l.leaseValid && now - l.leaseHeldAt < WIFI_LEASE_REUSE_MS;
+  WiFi.disconnect();
+  applyAddress(l, l.directLease);
+  WiFi.begin(l.ssid, l.password, l.cache.channel, l.cache.bssid);
+}
+
+static void startScan(WifiLink& l, unsigned long now) {
+  l.phase = LINK_SCAN;
+  l.attemptStart = now;
+  l.directLease = false;
+  WiFi.disconnect();
+  applyAddress(l, false);
+  WiFi.begin(l.ssid, l.password);
+}
+
+static void startAttempt(WifiLink& l, unsigned long now) {
+  if (l.cache.channel) {
+    startDirect(l, now);
+  } else {
+    startScan(l, now);
+  }
+}
+
+static void updateCache(WifiLink& l, const WifiLinkCache& c) {
+  if (memcmp(&c, &l.cache, sizeof(c)) != 0) {
+    l.cache = c;
+    storeCache(l);  // Only on change: NVS is flash
+  }
+}
+
+static void rememberLease(WifiLink& l, WifiLinkCache& c, unsigned long now) {
+  c.ip = WiFi.localIP();
+  c.gateway = WiFi.gatewayIP();
+  c.subnet = WiFi.subnetMask();
+  c.dns = WiFi.dnsIP();
+  l.leaseValid = c.ip != 0;
+  l.leaseHeldAt = now;
+}
+
+static void linkUp(WifiLink& l, unsigned long now) {
+  unsigned long ms = now - l.downSince;
+  l.connects++;
+  l.lastDirect = l.phase == LINK_DIRECT;
+  if (l.lastDirect) {
+    l.directConnects++;
+  } else {
+    l.scanConnects++;
+  }
+  l.lastConnectMs = ms;
+  l.totalConnectMs += ms;
+  if (ms > l.maxConnectMs) {
+    l.maxConnectMs = ms;
+  }
+  l.phase = LINK_UP;
+
+  // Remember the access point, and the lease if DHCP just handed one out
+  WifiLinkCache c = l.cache;
+  memcpy(c.bssid, WiFi.BSSID(), sizeof(c.bssid));
+  c.channel = (uint8_t)WiFi.channel();
+  l.onCachedLease = l.directLease;
+  if ((uint32_t)l.staticIp == 0 && !l.directLease) {
+    rememberLease(l, c, now);
+  }
+  updateCache(l, c);
+}
+
+void wifiLinkBegin(WifiLink& l, const char* ssid, const char* password, const char* staticIp,
+                   const char* gateway, const char* subnet, const char* dns, bool reuseStoredLease,
+                   unsigned long now) {
+  l = WifiLink();
+  l.ssid = ssid;
+  l.password = password;
+  if (staticIp[0] && l.staticIp.fromString(staticIp)) {
+    l.staticGateway.fromString(gateway);
+    l.staticSubnet.fromString(subnet[0] ? subnet : "255.255.255.0");
+    l.staticDns.fromString(dns[0] ? dns : gateway);
+  }
+
+  // The link does its own reconnects, and the WiFi library shouldn't write
+  // its config to flash on every begin()
+  WiFi.persistent(false);
+  WiFi.setAutoReconnect(false);
+  WiFi.mode(WIFI_STA);
+
+  if (!loadCache(l.cache)) {
+    memset(&l.cache, 0, sizeof(l.cache));
+  }
+  l.leaseValid = reuseStoredLease && l.cache.ip != 0;
+  l.leaseHeldAt = now;
+  l.downSince = now;
+  startAttempt(l, now);
+}
+
+WifiLinkEvent wifiLinkPoll(WifiLink& l, unsigned long now) {
+  bool up = WiFi.status() == WL_CONNECTED;
+  switch (l.phase) {
+    case LINK_UP:
+      if (!up) {
+        if (!l.onCachedLease && !l.renewing) {
+          l.leaseHeldAt = now;  // DHCP kept renewing it until now
+        }
+        l.onCachedLease = false;
+        l.renewing = false;
+        l.drops++;
+        l.downSince = now;
+        startAttempt(l, now);
+        return LINK_LOST;
+      }
+      if (l.onCachedLease && now - l.leaseHeldAt >= WIFI_LEASE_REUSE_MS) {
+        // The lease may run out soon and nobody renews it
+        l.onCachedLease = false;
+        l.renewing = true;
+        applyAddress(l, false);
+      } else if (l.renewing && (uint32_t)WiFi.localIP() != 0) {
+        WifiLinkCache c = l.cache;
+        rememberLease(l, c, now);
+        updateCache(l, c);
+        l.renewing = false;
+        l.leaseRenewals++;
+      }
+      break;
+    case LINK_DIRECT:
+      if (up) {
+        linkUp(l, now);
+        return LINK_CONNECTED;
+      }
+      if (now - l.attemptStart > WIFI_DIRECT_TIMEOUT) {
+        l.directFailures++;
+        startScan(l, now);
+        return LINK_FALLBACK;
+      }
+      break;
+    case LINK_SCAN:
+      if (up) {
+        linkUp(l, now);
+        return LINK_CONNECTED;
+      }
+      if (now - l.attemptStart > WIFI_SCAN_RETRY) {
+        startScan(l, now);
+      }
+      break;
+    case LINK_DOWN:
+      break;
+  }
+  return LINK_NONE;
+}
+
+const char* wifiLinkPhaseName(WifiLinkPhase phase) {
+  switch (phase) {
+    case LINK_DIRECT: return "direct";
+    case LINK_SCAN: return "scan";
+    case LINK_UP: return "up";
+    default: return "down";
+  }
+}
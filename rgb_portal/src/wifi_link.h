@@ -0,0 +1,100 @@
+#ifndef WIFI_LINK_H
+#define WIFI_LINK_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+
+// WiFi association with a fast path for reconnects.
+//
+// A full connect scans every channel for the SSID and then runs DHCP, which
+// takes seconds. The link remembers the BSSID and channel of the last good
+// association (in NVS, so they survive power cycles) and the DHCP lease of
+// the current boot. After a drop or a reboot it first associates directly
+// with that access point on that channel, with the remembered lease or the
+// static IP as address, and falls back to a scan with DHCP if that doesn't
+// come up within WIFI_DIRECT_TIMEOUT.
+//
+// A DHCP client renews its lease at half time, so when the link drops at
+// least half of it is left. The lease is reused for WIFI_LEASE_REUSE_MS after
+// that (half of a one-hour lease), later reconnects run DHCP. A link that
+// came up on the cached lease has no DHCP client renewing it: once the reuse
+// window is over the address goes back to DHCP, which gets it renewed. The
+// address is gone during that exchange, so connections on it start over.
+//
+// A lease stored in NVS is only reused after a reboot with reuseStoredLease:
+// the router may have given the address away while the portal was off. A
+// static IP (or a DHCP reservation plus reuseStoredLease) makes that safe.
+
+#define WIFI_DIRECT_TIMEOUT 1500   // ms for a direct association before scanning
+#define WIFI_SCAN_RETRY 10000      // ms before a scan that didn't connect is restarted
+#define WIFI_LEASE_REUSE_MS 1800000UL  // ms after the drop the cached lease is reused
+#define WIFI_NVS_NAMESPACE "wifi"
+
+enum WifiLinkPhase {
+  LINK_DOWN,     // Not started
+  LINK_DIRECT,   // Associating with the cached BSSID and channel
+  LINK_SCAN,     // Full scan and DHCP
+  LINK_UP
+};
+
+enum WifiLinkEvent {
+  LINK_NONE,
+  LINK_CONNECTED,
+  LINK_LOST,
+  LINK_FALLBACK   // Direct association timed out, scanning
+};
+
+// Stored in NVS as one blob
+struct WifiLinkCache {
+  uint8_t bssid[6];
+  uint8_t channel;          // 0 = no cached access point
+  uint8_t reserved;
+  uint32_t ip;              // DHCP lease (0 = none)
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+};
+
+struct WifiLink {
+  const char* ssid;
+  const char* password;
+  IPAddress staticIp;       // 0 = DHCP
+  IPAddress staticGateway;
+  IPAddress staticSubnet;
+  IPAddress staticDns;
+  WifiLinkCache cache;
+  bool leaseValid;          // cache lease usable for a direct association
+  unsigned long leaseHeldAt;  // ms, last time DHCP was known to hold the cached lease
+  WifiLinkPhase phase;
+  bool directLease;         // Current attempt uses the cached lease
+  bool onCachedLease;       // Up on the cached lease, no DHCP client running
+  bool renewing;            // Address handed back to DHCP, waiting for the lease
+  unsigned long downSince;  // ms, start of the outage (or of the boot)
+  unsigned long attemptStart;
+
+  // Statistics
+  unsigned long connects;
+  unsigned long directConnects;
+  unsigned long scanConnects;
+  unsigned long directFailures;  // Direct attempts that fell back to a scan
+  unsigned long leaseRenewals;   // Cached leases handed back to DHCP and renewed
+  unsigned long drops;
+  unsigned long lastConnectMs;   // Outage (or boot) to connected
+  unsigned long maxConnectMs;
+  uint64_t totalConnectMs;
+  bool lastDirect;
+  unsigned long cacheWrites;
+};
+
+// Load the cache and start the first association. `staticIp` etc. are
+// dotted quads, empty for DHCP.
+void wifiLinkBegin(WifiLink& l, const char* ssid, const char* password, const char* staticIp,
+                   const char* gateway, const char* subnet, const char* dns, bool reuseStoredLease,
+                   unsigned long now);
+
+// Drive reconnects and fallbacks; call on every loop pass
+WifiLinkEvent wifiLinkPoll(WifiLink& l, unsigned long now);
+
+const char* wifiLinkPhaseName(WifiLinkPhase phase);
+
+#endif
@@ -0,0 +1,172 @@
+#!/usr/bin/env python3
+"""Round-trip benchmark for the portal's UDP control channel (port 4210).
+
+Sends commands one at a time, retrying lost ones with the same sequence
+number like the controller does, and reports the round-trip time
+distribution. Works against the real portal or the host simulator in
+real-time mode (the simulator's secrets.h has key 000102...0f):
+
+    cd host && build/simulator --hours 0.02 --realtime --udp-port-offset 10000 &
+    python3 tools/control_bench.py --port 14210 --key 000102030405060708090a0b0c0d0e0f
+
+--compare-http also times GET /state on the real portal.
+"""
+
+import argparse
+import os
+import socket
+import struct
+import time
+import urllib.request
+
+CONTROL_VERSION = 2
+COMMANDS = {"state": 1, "red": 2, "green": 3, "reset": 4, "toggle": 5, "abort": 6}
+STATUS = {0: "ok", 1: "stale", 2: "unknown", 3: "busy", 4: "challenge"}
+STATUS_CHALLENGE = 4
+RETRY_TIMEOUTS = (0.02, 0.04, 0.08, 0.16)
+
+MASK = 0xFFFFFFFFFFFFFFFF
+
+
+def _rotl(x, b):
+    return ((x << b) | (x >> (64 - b))) & MASK
+
+
+def siphash24(key, data):
+    """SipHash-2-4, same as sipHash24() in src/udp_control.cpp."""
+    k0, k1 = struct.unpack("<QQ", key)
+    v = [0x736f6d6570736575 ^ k0, 0x646f72616e646f6d ^ k1, 0x6c7967656e657261 ^ k0, 0x7465646279746573 ^ k1]
+
+    def rounds(n):
+        for _ in range(n):
+            v[0] = (v[0] + v[1]) & MASK; v[1] = _rotl(v[1], 13) ^ v[0]; v[0] = _rotl(v[0], 32)
+            v[2] = (v[2] + v[3]) & MASK; v[3] = _rotl(v[3], 16) ^ v[2]
+            v[0] = (v[0] + v[3]) & MASK; v[3] = _rotl(v[3], 21) ^ v[0]
+            v[2] = (v[2] + v[1]) & MASK; v[1] = _rotl(v[1], 17) ^ v[2]; v[2] = _rotl(v[2], 32)
+
+    tail = len(data) % 8
+    for (m,) in struct.iter_unpack("<Q", data[:len(data) - tail]):
+        v[3] ^= m
+        rounds(2)
+        v[0] ^= m
+    b = (len(data) & 0xFF) << 56 | int.from_bytes(data[len(data) - tail:], "little")
+    v[3] ^= b
+    rounds(2)
+    v[0] ^= b
+    v[2] ^= 0xFF
+    rounds(4)
+    return v[0] ^ v[1] ^ v[2] ^ v[3]
+
+
+class ControlClient:
+    def __init__(self, host, port, key):
+        self.addr = (host, port)
+        self.key = key
+        self.session = struct.unpack("<I", os.urandom(4))[0]
+        self.seq = 0
+        self.nonce = 0  # Learnt from the portal's challenge
+        self.challenges = 0
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+
+    def command(self, command):
+        """Returns (status, state, attempts); raises TimeoutError."""
+        self.seq = (self.seq + 1) & 0xFFFFFFFF
+        attempts = 1  # Sends of the same packet, not counting challenges
+        # A new session, or a portal that rebooted, answers with a challenge
+        # first: the command is sent again with its nonce
+        for _ in range(2):
+            status, state, nonce, tries = self._send(command)
+            attempts += tries - 1
+            if status != STATUS_CHALLENGE:
+                return status, state, attempts
+            self.nonce = nonce
+            self.challenges += 1
+        raise TimeoutError(f"command {command} seq {self.seq} challenged twice")
+
+    def _send(self, command):
+        body = struct.pack("<BBII", CONTROL_VERSION, command, self.seq, self.session)
+        packet = body + struct.pack("<Q", siphash24(self.key, body + struct.pack("<I", self.nonce)))
+        for attempt, timeout in enumerate(RETRY_TIMEOUTS, 1):
+            self.sock.sendto(packet, self.addr)
+            deadline = time.monotonic() + timeout
+            while True:
+                remaining = deadline - time.monotonic()
+                if remaining <= 0:
+                    break
+                self.sock.settimeout(remaining)
+                try:
+                    reply = self.sock.recv(64)
+                except socket.timeout:
+                    break
+                if len(reply) != 24 or struct.unpack("<Q", reply[16:])[0] != siphash24(self.key, reply[:16]):
+                    continue
+                _, kind, seq, session, status, state, nonce = struct.unpack("<BBIIBBI", reply[:16])
+                if kind == 0x80 | command and seq == self.seq and session == self.session:
+                    return status, state, nonce, attempt
+        raise TimeoutError(f"no reply to command {command} seq {self.seq}")
+
+
+def percentile(values, p):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(p * len(values)))]
+
+
+def report(name, rtts):
+    ms = [r * 1000 for r in rtts]
+    print(f"{name:<6} {len(ms):6d} {percentile(ms, 0.5):8.2f} {percentile(ms, 0.9):8.2f} "
+          f"{percentile(ms, 0.99):8.2f} {max(ms):8.2f}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--host", default="127.0.0.1", help="Portal IP address")
+    parser.add_argument("--port", type=int, default=4210)
+    parser.add_argument("--key", required=True, help="CONTROL_KEY from secrets.h (32 hex digits)")
+    parser.add_argument("--count", type=int, default=500)
+    parser.add_argument("--interval-ms", type=float, default=10.0, help="Pause between commands")
+    parser.add_argument("--command", choices=sorted(COMMANDS) + ["cycle"], default="state",
+                        help="cycle = red, reset, green, reset, ...")
+    parser.add_argument("--compare-http", action="store_true", help="Also time GET /state (real portal)")
+    args = parser.parse_args()
+
+    try:
+        key = bytes.fromhex(args.key)
+    except ValueError:
+        key = b""
+    if len(key) != 16:
+        parser.error("--key must be 32 hex digits")
+    client = ControlClient(args.host, args.port, key)
+    cycle = ["red", "reset", "green", "reset"]
+    rtts, retried, failed, statuses = [], 0, 0, {}
+    for i in range(args.count):
+        name = cycle[i % len(cycle)] if args.command == "cycle" else args.command
+        start = time.perf_counter()
+        try:
+            status, state, attempts = client.command(COMMANDS[name])
+        except TimeoutError:
+            failed += 1
+            continue
+        rtts.append(time.perf_counter() - start)
+        retried += attempts > 1
+        statuses[STATUS.get(status, status)] = statuses.get(STATUS.get(status, status), 0) + 1
+        time.sleep(args.interval_ms / 1000.0)
+
+    http = []
+    if args.compare_http:
+        for _ in range(min(args.count, 100)):
+            start = time.perf_counter()
+            with urllib.request.urlopen(f"http://{args.host}/state", timeout=5) as response:
+                response.read()
+            http.append(time.perf_counter() - start)
+
+    print(f"{'':<6} {'n':>6} {'p50 ms':>8} {'p90 ms':>8} {'p99 ms':>8} {'max ms':>8}")
+    if rtts:
+        report("udp", rtts)
+    if http:
+        report("http", http)
+    print(f"\n{args.count} commands ({args.command}): {retried} needed a retry, {failed} failed, "
+          f"{client.challenges} challenges, status {statuses}")
+
+
+if __name__ == "__main__":
+    main()
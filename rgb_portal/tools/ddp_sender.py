@@ -0,0 +1,153 @@
+#!/usr/bin/env python3
+"""Stream test animations to the portal over DDP (UDP port 4048).
+
+Works against the real portal or the host simulator in real-time mode:
+
+    cd host && build/simulator --hours 0.02 --realtime --udp-port-offset 10000 &
+    python3 tools/ddp_sender.py --host 127.0.0.1 --port 14048 --seconds 30
+
+--compress sends every frame as one packet in the portal's frame codec
+(src/frame_codec.h): a keyframe every --key-interval frames, otherwise an
+XOR delta against the previous frame when that is smaller.
+"""
+
+import argparse
+import colorsys
+import math
+import socket
+import struct
+import time
+
+DDP_FLAG_VER1 = 0x40
+DDP_FLAG_PUSH = 0x01
+DDP_TYPE_RGB8 = 0x0B
+DDP_TYPE_FRAME_CODEC = 0x81
+DDP_ID_DISPLAY = 1
+DDP_MAX_DATA = 1440  # Keeps every packet within one Ethernet/WiFi frame
+
+
+def rainbow(frame, num_leds):
+    pixels = bytearray()
+    for i in range(num_leds):
+        r, g, b = colorsys.hsv_to_rgb(((i / num_leds) + frame * 0.01) % 1.0, 1.0, 1.0)
+        pixels += bytes((int(r * 255), int(g * 255), int(b * 255)))
+    return pixels
+
+
+def comet(frame, num_leds):
+    pixels = bytearray(num_leds * 3)
+    head = frame % num_leds
+    for tail in range(20):
+        i = (head - tail) % num_leds
+        level = int(255 * math.exp(-tail / 5.0))
+        pixels[i * 3:i * 3 + 3] = bytes((level, level // 3, 0))
+    return pixels
+
+
+PATTERNS = {"rainbow": rainbow, "comet": comet}
+
+FRAME_KEY = 0x01
+FRAME_DELTA = 0x02
+FRAME_RUN_REPEAT = 0x80
+FRAME_RUN_MAX = 128
+
+
+def frame_encode(pixels, reference=None):
+    """Same greedy run coding as frameEncode() in src/frame_codec.cpp."""
+    if reference is not None:
+        pixels = bytes(a ^ b for a, b in zip(pixels, reference))
+    px = [bytes(pixels[i:i + 3]) for i in range(0, len(pixels), 3)]
+    out = bytearray([FRAME_DELTA if reference is not None else FRAME_KEY])
+    i = 0
+    while i < len(px):
+        run = 1
+        while i + run < len(px) and run < FRAME_RUN_MAX and px[i + run] == px[i]:
+            run += 1
+        if run >= 2:
+            out.append(FRAME_RUN_REPEAT | (run - 1))
+            out += px[i]
+            i += run
+            continue
+        literal = 1
+        while i + literal < len(px) and literal < FRAME_RUN_MAX:
+            if i + literal + 1 < len(px) and px[i + literal] == px[i + literal + 1]:
+                break
+            literal += 1
+        out.append(literal - 1)
+        for k in range(literal):
+            out += px[i + k]
+        i += literal
+    return bytes(out)
+
+
+def codec_packet(pixels, previous, frame, key_interval):
+    """One compressed frame in a single DDP packet."""
+    data = frame_encode(pixels)
+    if previous is not None and frame % key_interval != 0:
+        delta = frame_encode(pixels, previous)
+        if len(delta) < len(data):
+            data = delta
+    # Sequence 1..15: the portal only applies a delta on top of the frame
+    # right before it
+    header = struct.pack(">BBBBIH", DDP_FLAG_VER1 | DDP_FLAG_PUSH, frame % 15 + 1, DDP_TYPE_FRAME_CODEC,
+                         DDP_ID_DISPLAY, 0, len(data))
+    return header + data
+
+
+def ddp_packets(pixels, sequence):
+    """Split one frame into DDP packets, PUSH set on the last one."""
+    packets = []
+    for offset in range(0, len(pixels), DDP_MAX_DATA):
+        chunk = pixels[offset:offset + DDP_MAX_DATA]
+        flags = DDP_FLAG_VER1
+        if offset + len(chunk) >= len(pixels):
+            flags |= DDP_FLAG_PUSH
+        header = struct.pack(">BBBBIH", flags, sequence & 0x0F, DDP_TYPE_RGB8, DDP_ID_DISPLAY,
+                             offset, len(chunk))
+        packets.append(header + chunk)
+    return packets
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--host", default="127.0.0.1", help="Portal IP address")
+    parser.add_argument("--port", type=int, default=4048)
+    parser.add_argument("--leds", type=int, default=140)
+    parser.add_argument("--fps", type=float, default=40.0)
+    parser.add_argument("--seconds", type=float, default=10.0)
+    parser.add_argument("--pattern", choices=sorted(PATTERNS), default="rainbow")
+    parser.add_argument("--compress", action="store_true", help="Send frames in the portal's frame codec")
+    parser.add_argument("--key-interval", type=int, default=40, help="Frames between keyframes with --compress")
+    args = parser.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    render = PATTERNS[args.pattern]
+    interval = 1.0 / args.fps
+    start = time.monotonic()
+    frame = 0
+    sent_bytes = 0
+    previous = None
+
+    while time.monotonic() - start < args.seconds:
+        pixels = render(frame, args.leds)
+        if args.compress:
+            packets = [codec_packet(pixels, previous, frame, max(1, args.key_interval))]
+        else:
+            packets = ddp_packets(pixels, frame)
+        for packet in packets:
+            sock.sendto(packet, (args.host, args.port))
+            sent_bytes += len(packet)
+        previous = pixels
+        frame += 1
+        # Pace against the start time so rounding errors don't accumulate
+        delay = start + frame * interval - time.monotonic()
+        if delay > 0:
+            time.sleep(delay)
+
+    elapsed = time.monotonic() - start
+    print(f"Sent {frame} frames in {elapsed:.1f} s ({frame / elapsed:.1f} fps, "
+          f"{sent_bytes / elapsed / 1024:.1f} KiB/s) to {args.host}:{args.port}")
+
+
+if __name__ == "__main__":
+    main()
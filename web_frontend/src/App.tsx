@@ -365,6 +365,10 @@ function App() {
         return 'BLINK RED (Alarm)'
       case 3:
         return 'BLINK GREEN (Success)'
+      case 4:
+        return 'STREAMING (DDP)'
+      case 5:
+        return 'PLAYING (Clip)'
       default:
         return 'UNKNOWN'
     }
@@ -378,6 +382,10 @@ function App() {
         return '#ff0000' // Red
       case 3:
         return '#00ff00' // Green
+      case 4:
+        return '#1e90ff' // Blue
+      case 5:
+        return '#ff8c00' // Orange
       default:
         return '#666666' // Gray
     }